@@ -44,6 +44,97 @@ struct snapshot
 	int                       module_pos;    /* current position in module snapshot */
 };
 
+/* store as many of the next processes as fit in the reply, returns the number stored */
+static int snapshot_next_processes(struct snapshot *snapshot)
+{
+	struct process_snapshot *ptr;
+	struct process_dll *exe_module;
+	struct snapshot_process *entry;
+	data_size_t size = get_reply_max_size(), used = 0, entry_size, namelen;
+	char *data;
+	int count = 0;
+
+	if (snapshot->process_pos >= snapshot->process_count) {
+		set_error(STATUS_NO_MORE_FILES);
+		return 0;
+	}
+	if (!(data = malloc(size))) {
+		set_error(STATUS_NO_MEMORY);
+		return 0;
+	}
+
+	while (snapshot->process_pos < snapshot->process_count) {
+		ptr = &snapshot->processes[snapshot->process_pos];
+		exe_module = get_process_exe_module(ptr->process);
+		namelen = (exe_module && exe_module->filename) ? exe_module->namelen : 0;
+		entry_size = (offsetof(struct snapshot_process, name) + namelen + 3) & ~3;
+		if (used + entry_size > size)
+			break;
+
+		entry = (struct snapshot_process *)(data + used);
+		entry->count    = ptr->count;
+		entry->pid      = get_process_id(ptr->process);
+		entry->ppid     = ptr->process->parent ? get_process_id(ptr->process->parent) : 0;
+		entry->threads  = ptr->threads;
+		entry->priority = ptr->priority;
+		entry->handles  = ptr->handles;
+		entry->namelen  = namelen;
+		if (namelen)
+			memcpy(entry->name, exe_module->filename, namelen);
+		used += entry_size;
+		snapshot->process_pos++;
+		count++;
+	}
+
+	if (!count)
+		set_error(STATUS_BUFFER_TOO_SMALL);
+	else
+		set_reply_data(data, used);
+	free(data);
+	return count;
+}
+
+/* store as many of the next threads as fit in the reply, returns the number stored */
+static int snapshot_next_threads(struct snapshot *snapshot, process_id_t pid)
+{
+	struct thread_snapshot *ptr;
+	struct snapshot_thread *data, *entry;
+	int max = get_reply_max_size() / sizeof(*entry), count = 0;
+
+	while (snapshot->thread_pos < snapshot->thread_count &&
+			pid && get_process_id(snapshot->threads[snapshot->thread_pos].thread->process) != pid)
+		snapshot->thread_pos++;
+	if (snapshot->thread_pos >= snapshot->thread_count) {
+		set_error(STATUS_NO_MORE_FILES);
+		return 0;
+	}
+	if (!max) {
+		set_error(STATUS_BUFFER_TOO_SMALL);
+		return 0;
+	}
+	if (!(data = malloc(max * sizeof(*entry)))) {
+		set_error(STATUS_NO_MEMORY);
+		return 0;
+	}
+
+	entry = data;
+	for (; snapshot->thread_pos < snapshot->thread_count && count < max; snapshot->thread_pos++) {
+		ptr = &snapshot->threads[snapshot->thread_pos];
+		if (pid && get_process_id(ptr->thread->process) != pid)
+			continue;
+		entry->count     = ptr->count;
+		entry->pid       = get_process_id(ptr->thread->process);
+		entry->tid       = get_thread_id(ptr->thread);
+		entry->base_pri  = ptr->priority;
+		entry->delta_pri = 0;  /* FIXME */
+		entry++;
+		count++;
+	}
+	set_reply_data(data, count * sizeof(*entry));
+	free(data);
+	return count;
+}
+
 static void snapshot_dump(struct object *obj, int verbose);
 static void snapshot_destroy(struct object *obj);
 
@@ -314,4 +405,36 @@ DECL_HANDLER(next_module)
 		release_object(snapshot);
 	}
 }
+
+/* get as many of the next processes of a snapshot as fit in the reply */
+DECL_HANDLER(next_processes)
+{
+	struct snapshot *snapshot;
+
+	ktrace("\n");
+	reply->count = 0;
+	if ((snapshot = (struct snapshot *)get_wine_handle_obj(get_current_w32process(), req->handle,
+					0, &snapshot_ops))) {
+		if (req->reset)
+			snapshot->process_pos = 0;
+		reply->count = snapshot_next_processes(snapshot);
+		release_object(snapshot);
+	}
+}
+
+/* get as many of the next threads of a snapshot as fit in the reply */
+DECL_HANDLER(next_threads)
+{
+	struct snapshot *snapshot;
+
+	ktrace("\n");
+	reply->count = 0;
+	if ((snapshot = (struct snapshot *)get_wine_handle_obj(get_current_w32process(), req->handle,
+					0, &snapshot_ops))) {
+		if (req->reset)
+			snapshot->thread_pos = 0;
+		reply->count = snapshot_next_threads(snapshot, req->pid);
+		release_object(snapshot);
+	}
+}
 #endif /* CONFIG_UNIFIED_KERNEL */
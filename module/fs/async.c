@@ -25,6 +25,7 @@
  * Refered to Wine code
  */
 #include "unistr.h"
+#include "apc.h"
 #include "wineserver/lib.h"
 
 #ifdef CONFIG_UNIFIED_KERNEL
@@ -46,6 +47,8 @@ struct async
 	struct uk_completion *completion;
 	unsigned long        comp_key;
 	async_data_t         data;            /* data for async I/O call */
+	void                *kernel_io;       /* transfer done by the kernel, NULL for client callbacks */
+	struct task_struct  *task;            /* task whose buffers the kernel transfer uses */
 };
 
 static void async_dump(struct object *obj, int verbose);
@@ -71,11 +74,18 @@ static const struct object_ops async_ops =
 };
 
 
+/*
+ * The lock of a queue protects its list and the status of the asyncs in it,
+ * since kernel transfers claim and complete asyncs from a work queue while
+ * the request handlers wake them up.  It is never held across callbacks,
+ * APCs or object releases.
+ */
 struct async_queue
 {
 	struct object        obj;             /* object header */
 	struct fd           *fd;              /* file descriptor owning this queue */
 	struct list_head     queue;           /* queue of async objects */
+	spinlock_t           lock;            /* protects queue and the async states */
 };
 
 static void async_queue_dump(struct object *obj, int verbose);
@@ -172,7 +182,9 @@ static void async_destroy(struct object *obj)
 {
 	struct async *async = (struct async *)obj;
 
+	spin_lock(&async->queue->lock);
 	list_del(&async->queue_entry);
+	spin_unlock(&async->queue->lock);
 	async_reselect(async);
 
 	if (async->timeout)
@@ -181,6 +193,10 @@ static void async_destroy(struct object *obj)
 		release_object(async->event);
 	if (async->completion)
 		release_object(async->completion);
+	if (async->kernel_io)
+		free(async->kernel_io);
+	if (async->task)
+		put_task_struct(async->task);
 	release_object(async->queue);
 	release_object(async->thread);
 }
@@ -194,12 +210,26 @@ void async_terminate(struct async *async, unsigned int status)
 {
 	apc_call_t data;
 
+	spin_lock(&async->queue->lock);
 	if (async->status != STATUS_PENDING) {
 		/* already terminated, just update status */
 		async->status = status;
+		spin_unlock(&async->queue->lock);
 		return;
 	}
 
+	if (async->kernel_io) {
+		/* there is no client callback, the kernel does the transfer itself */
+		if (status != STATUS_ALERTED)
+			async->status = status;  /* keeps the transfer from claiming it */
+		spin_unlock(&async->queue->lock);
+		if (status != STATUS_ALERTED)
+			async_complete(async, status, 0);
+		return;
+	}
+	async->status = status;
+	spin_unlock(&async->queue->lock);
+
 	memset(&data, 0, sizeof(data));
 	data.type            = APC_ASYNC_IO;
 	data.async_io.func   = async->data.callback;
@@ -207,7 +237,6 @@ void async_terminate(struct async *async, unsigned int status)
 	data.async_io.sb     = async->data.iosb;
 	data.async_io.status = status;
 	thread_queue_apc(async->thread, &async->obj, &data);
-	async->status = status;
 	async_reselect(async);
 	release_object(async);  /* so that it gets destroyed when the async is done */
 }
@@ -244,6 +273,7 @@ struct async_queue *create_async_queue(struct fd *fd)
 
 		queue->fd = fd;
 		INIT_LIST_HEAD(&queue->queue);
+		spin_lock_init(&queue->lock);
 		INIT_DISP_HEADER(&queue->obj.header, ASYNC_QUEUE, sizeof(struct async_queue), 0);
 	}
 	return queue;
@@ -293,11 +323,15 @@ struct async *create_async(struct w32thread *thread, struct async_queue *queue,
 		async->timeout = NULL;
 		async->queue   = (struct async_queue *)grab_object(queue);
 		async->completion = NULL;
+		async->kernel_io = NULL;
+		async->task = NULL;
 		if (queue->fd)
 			fd_assign_completion(queue->fd, &async->completion, &async->comp_key);
 
-		list_add_before(&queue->queue, &async->queue_entry);
 		grab_object(async);
+		spin_lock(&queue->lock);
+		list_add_before(&queue->queue, &async->queue_entry);
+		spin_unlock(&queue->lock);
 
 		if (queue->fd)
 			set_fd_signaled(queue->fd, 0);
@@ -331,9 +365,11 @@ void async_set_result(struct object *obj, unsigned int status, unsigned long tot
 		return;  /* in case the client messed up the APC results */
 
 	if (status == STATUS_PENDING) { /* restart it */
+		grab_object(async);
+		spin_lock(&async->queue->lock);
 		status = async->status;
 		async->status = STATUS_PENDING;
-		grab_object(async);
+		spin_unlock(&async->queue->lock);
 
 		if (status != STATUS_ALERTED)  /* it was terminated in the meantime */
 			async_terminate(async, status);
@@ -344,7 +380,9 @@ void async_set_result(struct object *obj, unsigned int status, unsigned long tot
 		if (async->timeout)
 			remove_timeout_user(async->timeout);
 		async->timeout = NULL;
+		spin_lock(&async->queue->lock);
 		async->status = status;
+		spin_unlock(&async->queue->lock);
 		if (async->completion && async->data.cvalue)
 			add_completion(async->completion, async->comp_key, async->data.cvalue, status, total);
 		if (async->data.apc) {
@@ -364,31 +402,154 @@ void async_set_result(struct object *obj, unsigned int status, unsigned long tot
 	}
 }
 
+/* queue the user APC of an async straight to the owning thread */
+static void async_queue_user_apc(struct async *async)
+{
+	struct ethread *thread = async->thread->ethread;
+	struct kapc *apc;
+
+	if (!(apc = kmalloc(sizeof(struct kapc), GFP_KERNEL)))
+		return;
+
+	apc_init(apc,
+			&thread->tcb,
+			OriginalApcEnvironment,
+			free_apc_routine,
+			NULL,
+			(PKNORMAL_ROUTINE)async->data.apc,
+			UserMode,
+			async->data.arg);
+	if (!insert_queue_apc(apc, async->data.iosb, NULL, IO_NO_INCREMENT))
+		kfree(apc);
+	else
+		set_tsk_thread_flag(thread->et_task, TIF_APC);
+}
+
+/* let the kernel do the transfer of an async, io is freed along with it,
+ * this is called by the owning thread so its task can be pinned */
+void async_set_kernel_io(struct async *async, void *io)
+{
+	get_task_struct(current);
+	spin_lock(&async->queue->lock);
+	async->task = current;
+	async->kernel_io = io;
+	spin_unlock(&async->queue->lock);
+}
+
+/* take the first async of a queue over for a transfer done in the kernel,
+ * the async stays alive until it is unclaimed or completed */
+struct async *async_claim(struct async_queue *queue, void **io, struct task_struct **tsk)
+{
+	struct async *async = NULL;
+
+	if (!queue)
+		return NULL;
+
+	spin_lock(&queue->lock);
+	if (!list_empty(&queue->queue)) {
+		async = list_entry(queue->queue.next, struct async, queue_entry);
+		if (async->status == STATUS_PENDING && async->kernel_io) {
+			/* like an alerted client callback, a termination meanwhile only updates the status */
+			async->status = STATUS_ALERTED;
+			*io = async->kernel_io;
+			*tsk = async->task;
+		}
+		else
+			async = NULL;
+	}
+	spin_unlock(&queue->lock);
+	return async;
+}
+
+/* give a claimed async back to its queue, the transfer would block */
+void async_unclaim(struct async *async)
+{
+	unsigned int status;
+
+	spin_lock(&async->queue->lock);
+	status = async->status;
+	async->status = STATUS_PENDING;
+	spin_unlock(&async->queue->lock);
+	if (status != STATUS_ALERTED)  /* it was terminated in the meantime */
+		async_terminate(async, status);
+}
+
+/* store the result of a transfer done by the kernel and notify the client,
+ * this takes the place of both the client-side callback and async_set_result */
+void async_complete(struct async *async, unsigned int status, unsigned long total)
+{
+	IO_STATUS_BLOCK iosb;
+
+	if (async->timeout)
+		remove_timeout_user(async->timeout);
+	async->timeout = NULL;
+	spin_lock(&async->queue->lock);
+	async->status = status;
+	spin_unlock(&async->queue->lock);
+
+	if (async->thread->state != TERMINATED) {
+		iosb.Status = status;
+		iosb.Information = total;
+		if (access_process_vm(async->task, (unsigned long)async->data.iosb,
+					&iosb, sizeof(iosb), 1) != sizeof(iosb))
+			ktrace("can't write the iosb %p of async %p\n", async->data.iosb, async);
+	}
+
+	if (async->completion && async->data.cvalue)
+		add_completion(async->completion, async->comp_key, async->data.cvalue, status, total);
+	if (async->data.apc && async->thread->state != TERMINATED)
+		async_queue_user_apc(async);
+	if (async->event)
+		set_event(async->event, EVENT_INCREMENT, FALSE);
+	else if (async->queue->fd)
+		set_fd_signaled(async->queue->fd, 1);
+	release_object(async);  /* the async is done */
+}
+
 /* check if an async operation is waiting to be alerted */
 int async_waiting(struct async_queue *queue)
 {
-	struct list_head *ptr;
 	struct async *async;
+	int ret = 0;
 
 	if (!queue)
 		return 0;
-	if (!(ptr = (((&queue->queue)->next == &queue->queue) ? NULL: (&queue->queue)->next)))
-		return 0;
-	async = list_entry(ptr, struct async, queue_entry);
-	return async->status == STATUS_PENDING;
+	spin_lock(&queue->lock);
+	if (!list_empty(&queue->queue)) {
+		async = list_entry(queue->queue.next, struct async, queue_entry);
+		ret = (async->status == STATUS_PENDING);
+	}
+	spin_unlock(&queue->lock);
+	return ret;
 }
 
 /* wake up async operations on the queue */
 void async_wake_up(struct async_queue *queue, unsigned int status)
 {
-	struct list_head *ptr, *next;
+	struct async *async, *iter;
 
 	if (!queue)
 		return;
 
-	list_for_each_safe(ptr, next, &queue->queue) {
-		struct async *async = list_entry(ptr, struct async, queue_entry);
+	/* terminating may release asyncs, so the lock is dropped for each one */
+	for (;;) {
+		async = NULL;
+		spin_lock(&queue->lock);
+		list_for_each_entry(iter, &queue->queue, queue_entry) {
+			if (iter->status == STATUS_PENDING) {
+				async = (struct async *)grab_object(iter);
+				break;
+			}
+			iter->status = status;  /* already terminated, just update status */
+			if (status == STATUS_ALERTED)
+				break;  /* only wake up the first one */
+		}
+		spin_unlock(&queue->lock);
+
+		if (!async)
+			break;
 		async_terminate(async, status);
+		release_object(async);
 		if (status == STATUS_ALERTED)
 			break;  /* only wake up the first one */
 	}
@@ -27,6 +27,7 @@
 #include <linux/security.h>
 #include <linux/major.h>
 #include <linux/poll.h>
+#include <linux/namei.h>
 
 #include "handle.h"
 #include "file.h"
@@ -1570,6 +1571,117 @@ DECL_HANDLER(set_completion_info)
 	}
 }
 
+/* state of a read_directory request while the file system fills it */
+struct read_dir_ctx
+{
+	char                  *data;      /* entries buffer */
+	data_size_t            size;      /* size of the buffer */
+	data_size_t            used;      /* size used so far */
+	struct dir_entry_info *last;      /* last entry stored */
+};
+
+static int read_dir_filldir(void *ptr, const char *name, int len, loff_t offset, u64 ino, unsigned int d_type)
+{
+	struct read_dir_ctx *ctx = ptr;
+	struct dir_entry_info *entry;
+	data_size_t entry_size = (offsetof(struct dir_entry_info, name[len + 1]) + 7) & ~7;
+
+	if (ctx->used + entry_size > ctx->size)
+		return -EINVAL;  /* full, the position stays on this entry */
+
+	/* the offset passed along with an entry is the position of the entry itself */
+	if (ctx->last)
+		ctx->last->next_pos = offset;
+	entry = (struct dir_entry_info *)(ctx->data + ctx->used);
+	memset(entry, 0, entry_size);
+	entry->len = len;
+	memcpy(entry->name, name, len);
+	ctx->last = entry;
+	ctx->used += entry_size;
+	return 0;
+}
+
+/* retrieve the attributes of a directory entry, following symlinks like stat() does */
+static void get_dir_entry_attr(struct file *dir, struct dir_entry_info *entry)
+{
+	struct nameidata nd;
+	struct kstat st;
+
+	if (vfs_path_lookup(dir->f_path.dentry, dir->f_path.mnt, entry->name, 0, &nd))
+		return;
+	if (vfs_getattr(nd.path.mnt, nd.path.dentry, &st))
+		goto out;
+	if (S_ISLNK(st.mode)) {
+		path_put(&nd.path);
+		entry->flags |= DIR_ENTRY_SYMLINK;
+		if (vfs_path_lookup(dir->f_path.dentry, dir->f_path.mnt, entry->name, LOOKUP_FOLLOW, &nd))
+			return;  /* dangling link, no attributes */
+		if (vfs_getattr(nd.path.mnt, nd.path.dentry, &st))
+			goto out;
+	}
+	entry->mode   = st.mode;
+	entry->size   = st.size;
+	entry->blocks = st.blocks;
+	entry->atime  = st.atime.tv_sec;
+	entry->mtime  = st.mtime.tv_sec;
+	entry->ctime  = st.ctime.tv_sec;
+out:
+	path_put(&nd.path);
+}
+
+/* read entries from a directory, along with their attributes */
+DECL_HANDLER(read_directory)
+{
+	struct read_dir_ctx ctx;
+	struct dir_entry_info *entry;
+	struct file *file;
+	struct fd *fd;
+	data_size_t pos;
+	int ret;
+
+	ktrace("\n");
+	fd = get_handle_fd_obj(get_current_w32process(), req->handle, FILE_LIST_DIRECTORY);
+	if (!fd)
+		return;
+
+	if (!(file = get_unix_file(fd))) {
+		set_error(STATUS_OBJECT_TYPE_MISMATCH);
+		goto out;
+	}
+
+	ctx.size = get_reply_max_size();
+	ctx.used = 0;
+	ctx.last = NULL;
+	if (!(ctx.data = malloc(ctx.size))) {
+		set_error(STATUS_NO_MEMORY);
+		goto out;
+	}
+
+	ret = vfs_readdir(file, read_dir_filldir, &ctx);
+	if (ctx.last)
+		ctx.last->next_pos = file->f_pos;
+	else if (ret < 0 && ret != -EINVAL) {
+		set_error(errno2ntstatus(-ret));
+		goto done;
+	}
+
+	if (!(req->flags & READ_DIRECTORY_NAMES_ONLY)) {
+		/* the directory lock is not held anymore, lookups are safe now */
+		pos = 0;
+		while (pos < ctx.used) {
+			entry = (struct dir_entry_info *)(ctx.data + pos);
+			get_dir_entry_attr(file, entry);
+			pos += (offsetof(struct dir_entry_info, name[entry->len + 1]) + 7) & ~7;
+		}
+	}
+	set_reply_data(ctx.data, ctx.used);
+
+done:
+	free(ctx.data);
+out:
+	release_object(fd);
+}
+
 /* push new completion msg into a completion queue attached to the fd */
 DECL_HANDLER(add_fd_completion)
 {
@@ -0,0 +1,66 @@
+/*
+ * keyedevent.h
+ *
+ * Copyright (C) 2006  Insigme Co., Ltd
+ *
+ * This software has been developed while working on the Linux Unified Kernel
+ * project (http://www.longene.org) in the Insigma Research Institute,
+ * which is a subdivision of Insigma Co., Ltd (http://www.insigma.com.cn).
+ *
+ * The project is sponsored by Insigma Co., Ltd.
+ *
+ * The authors can be reached at linux@insigma.com.cn.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of  the GNU General  Public License as published by the
+ * Free Software Foundation; either version 2 of the  License, or (at your
+ * option) any later version.
+ *
+ * Revision History:
+ *   Oct 2026 - Created.
+ */
+
+/*
+ * keyedevent.h: win32 keyed event definition
+ */
+
+#ifndef _KEYEDEVENT_H
+#define _KEYEDEVENT_H
+
+#include "win32.h"
+#include "ke.h"
+
+#ifdef CONFIG_UNIFIED_KERNEL
+
+#define KEYEDEVENT_WAIT		(0x0001)
+#define KEYEDEVENT_WAKE		(0x0002)
+#define KEYEDEVENT_ALL_ACCESS	(STANDARD_RIGHTS_REQUIRED | 0x3)
+
+VOID
+init_keyed_event_implement(VOID);
+
+NTSTATUS SERVICECALL
+NtCreateKeyedEvent(OUT PHANDLE			KeyedEventHandle,
+		IN  ACCESS_MASK			DesiredAccess,
+		IN  POBJECT_ATTRIBUTES		ObjectAttributes  OPTIONAL,
+		IN  ULONG			Flags);
+
+NTSTATUS SERVICECALL
+NtOpenKeyedEvent(OUT PHANDLE			KeyedEventHandle,
+		IN  ACCESS_MASK			DesiredAccess,
+		IN  POBJECT_ATTRIBUTES		ObjectAttributes);
+
+NTSTATUS SERVICECALL
+NtReleaseKeyedEvent(IN HANDLE			KeyedEventHandle  OPTIONAL,
+		IN  PVOID			Key,
+		IN  BOOLEAN			Alertable,
+		IN  PLARGE_INTEGER		Timeout  OPTIONAL);
+
+NTSTATUS SERVICECALL
+NtWaitForKeyedEvent(IN HANDLE			KeyedEventHandle  OPTIONAL,
+		IN  PVOID			Key,
+		IN  BOOLEAN			Alertable,
+		IN  PLARGE_INTEGER		Timeout  OPTIONAL);
+
+#endif /* CONFIG_UNIFIED_KERNEL */
+#endif /* _KEYEDEVENT_H */
@@ -297,8 +297,8 @@ struct eprocess
 
 	struct nls_table*		ep_nls;	/* unicode-ascii translation */
 	rwlock_t			ep_lock;
-	struct list_head		ep_reserved_head;
-	struct list_head		ep_mapped_head;
+	struct rb_root			ep_reserved_areas;
+	struct rb_root			ep_mapped_areas;
     void                    *ep_handle_info_table;
 
 	/*for NtNotifyDirectoryChange */
@@ -463,6 +463,9 @@ struct w32process
 	obj_handle_t         desktop;         /* handle to desktop to use for new threads */
 	struct token        *token;           /* security token associated with this process */
 	struct list_head     dlls;            /* list of loaded dlls */
+	void                *user_shared;     /* address of the shared user handle table view */
+	void                *windows_view;    /* address of the shared window state view */
+	struct file         *windows_file;    /* desktop file of that view, kept by the mapping */
 	unsigned int         trace_data;      /* opaque data used by the process tracing mechanism */
 	int                 dummyfd;
 };
@@ -1424,6 +1424,12 @@ typedef union _FILE_SEGMENT_ELEMENT {
 	ULONGLONG Alignment;
 }FILE_SEGMENT_ELEMENT, *PFILE_SEGMENT_ELEMENT;
 
+typedef struct _VIRTUAL_MEMORY_VECTOR {
+	PVOID RemoteAddress;	/* address in the target process */
+	PVOID Buffer;		/* buffer in the calling process */
+	ULONG Length;
+} VIRTUAL_MEMORY_VECTOR, *PVIRTUAL_MEMORY_VECTOR;
+
 typedef struct _LDT_ENTRY
 {
 	USHORT LimitLow;
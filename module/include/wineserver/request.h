@@ -248,6 +248,14 @@ DECL_HANDLER(set_completion_info);
 DECL_HANDLER(add_fd_completion);
 DECL_HANDLER(load_init_registry);
 DECL_HANDLER(save_branch);
+DECL_HANDLER(map_user_shared);
+DECL_HANDLER(read_directory);
+DECL_HANDLER(register_sock_io);
+DECL_HANDLER(map_screen_buffer);
+DECL_HANDLER(notify_screen_buffer);
+DECL_HANDLER(next_processes);
+DECL_HANDLER(next_threads);
+DECL_HANDLER(map_user_shared_data);
 
 typedef void (*req_handler)(const void *req, void *reply);
 static const req_handler req_handlers[REQ_NB_REQUESTS] =
@@ -487,6 +495,14 @@ static const req_handler req_handlers[REQ_NB_REQUESTS] =
 	(req_handler)req_add_fd_completion,
 	(req_handler)req_load_init_registry,
 	(req_handler)req_save_branch,
+	(req_handler)req_map_user_shared,
+	(req_handler)req_read_directory,
+	(req_handler)req_register_sock_io,
+	(req_handler)req_map_screen_buffer,
+	(req_handler)req_notify_screen_buffer,
+	(req_handler)req_next_processes,
+	(req_handler)req_next_threads,
+	(req_handler)req_map_user_shared_data,
 };
 
 #endif  /* CONFIG_UNIFIED_KERNEL */
@@ -66,6 +66,8 @@ struct desktop
 	struct hook_table   *global_hooks;   /* table of global hooks on this desktop */
 	struct timeout_user *close_timeout;  /* timeout before closing the desktop */
 	unsigned int         users;          /* processes and threads using this desktop */
+	struct window_shared *shared_windows; /* window state shown to the clients, NULL until mapped */
+	struct file         *shared_file;    /* file the shared window state is mapped from */
 };
 
 /* user handles functions */
@@ -76,6 +78,9 @@ extern void *get_user_object_handle(user_handle_t *handle, enum user_object type
 extern user_handle_t get_user_full_handle(user_handle_t handle);
 extern void *free_user_handle(user_handle_t handle);
 extern void *next_user_handle(user_handle_t *handle, enum user_object type);
+extern struct window_shared *begin_window_shared(struct desktop *desktop, user_handle_t handle);
+extern void end_window_shared(struct desktop *desktop, struct window_shared *shared);
+extern void free_desktop_shared(struct desktop *desktop);
 
 /* clipboard functions */
 
@@ -143,6 +148,7 @@ extern struct w32thread *get_window_thread(user_handle_t handle);
 extern user_handle_t window_from_point(struct desktop *desktop, int x, int y);
 extern user_handle_t find_window_to_repaint(user_handle_t parent, struct w32thread *thread);
 extern struct window_class *get_window_class(user_handle_t window);
+extern void publish_desktop_windows(struct desktop *desktop);
 
 /* window class functions */
 
@@ -205,6 +205,58 @@ struct kapc {
 
 #define USER_SHARED_DATA (0x7FFE0000)
 
+/* times in the user shared data are written High2Time, LowPart, High1Time */
+/* and read in the opposite order, so no lock is needed */
+typedef struct _KSYSTEM_TIME {
+	ULONG LowPart;
+	LONG High1Time;
+	LONG High2Time;
+} KSYSTEM_TIME, *PKSYSTEM_TIME;
+
+#define PROCESSOR_FEATURE_MAX 64
+
+/* same layout as the KSHARED_USER_DATA of Wine's ddk/wdm.h */
+typedef struct _KUSER_SHARED_DATA {
+	ULONG TickCountLowDeprecated;
+	ULONG TickCountMultiplier;
+	volatile KSYSTEM_TIME InterruptTime;
+	volatile KSYSTEM_TIME SystemTime;
+	volatile KSYSTEM_TIME TimeZoneBias;
+	USHORT ImageNumberLow;
+	USHORT ImageNumberHigh;
+	WCHAR NtSystemRoot[260];
+	ULONG MaxStckTraceDepth;
+	ULONG CryptoExponent;
+	ULONG TimeZoneId;
+	ULONG LargePageMinimum;
+	ULONG Reserverd2[7];
+	ULONG NtProductType;
+	BOOLEAN ProductTypeIsValid;
+	ULONG MajorNtVersion;
+	ULONG MinorNtVersion;
+	BOOLEAN ProcessorFeatures[PROCESSOR_FEATURE_MAX];
+	ULONG Reserved1;
+	ULONG Reserved3;
+	volatile ULONG TimeSlip;
+	ULONG AlternativeArchitecture;
+	LARGE_INTEGER SystemExpirationDate;
+	ULONG SuiteMask;
+	BOOLEAN KdDebuggerEnabled;
+	volatile ULONG ActiveConsoleId;
+	volatile ULONG DismountCount;
+	ULONG ComPlusPackage;
+	ULONG LastSystemRITEventTickCount;
+	ULONG NumberOfPhysicalPages;
+	BOOLEAN SafeBootMode;
+	ULONG TraceLogging;
+	ULONGLONG Fill0;
+	ULONGLONG SystemCall[4];
+	union {
+		volatile KSYSTEM_TIME TickCount;
+		volatile ULONG64 TickCountQuad;
+	} u;
+} KUSER_SHARED_DATA, *PKUSER_SHARED_DATA;
+
 /* Global Flags */
 #define FLG_STOP_ON_EXCEPTION          0x00000001
 #define FLG_SHOW_LDR_SNAPS             0x00000002
@@ -0,0 +1,368 @@
+/*
+ * keyedevent.c
+ *
+ * Copyright (C) 2006  Insigme Co., Ltd
+ *
+ * This software has been developed while working on the Linux Unified Kernel
+ * project (http://www.longene.org) in the Insigma Research Institute,
+ * which is a subdivision of Insigma Co., Ltd (http://www.insigma.com.cn).
+ *
+ * The project is sponsored by Insigma Co., Ltd.
+ *
+ * The authors can be reached at linux@insigma.com.cn.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of  the GNU General  Public License as published by the
+ * Free Software Foundation; either version 2 of the  License, or (at your
+ * option) any later version.
+ *
+ * Revision History:
+ *   Oct 2026 - Created.
+ */
+
+/*
+ * keyedevent.c: keyed event syscall functions
+ */
+#include <linux/sched.h>
+#include <linux/math64.h>
+#include "keyedevent.h"
+#include "unistr.h"
+#include "handle.h"
+
+#ifdef CONFIG_UNIFIED_KERNEL
+/*
+ * A keyed event has no state of its own: a thread waiting on a key sleeps
+ * until another thread of the same process releases that key, and a thread
+ * releasing a key sleeps until one waits on it.  Any number of keys share
+ * one object, so ntdll needs a single one for all its critical sections;
+ * a NULL handle stands for that process-wide event.
+ */
+
+#define KEYED_EVENT_BUCKETS	64
+
+struct keyed_event
+{
+	spinlock_t		lock;
+	struct list_head	waits[KEYED_EVENT_BUCKETS];	/* sleeping threads, by key */
+};
+
+struct keyed_wait
+{
+	struct list_head	entry;
+	struct task_struct	*task;
+	pid_t			tgid;		/* keys are private to a process */
+	void			*key;
+	int			release;	/* a releaser waiting for a waiter */
+	int			done;		/* matched, set under the event lock */
+};
+
+POBJECT_TYPE keyed_event_object_type = NULL;
+EXPORT_SYMBOL(keyed_event_object_type);
+
+static GENERIC_MAPPING keyed_event_mapping = {
+	STANDARD_RIGHTS_READ    | KEYEDEVENT_WAIT,
+	STANDARD_RIGHTS_WRITE   | KEYEDEVENT_WAKE,
+	STANDARD_RIGHTS_EXECUTE,
+	KEYEDEVENT_ALL_ACCESS};
+
+static WCHAR keyed_event_type_name[] = {'K', 'e', 'y', 'e', 'd', 'E', 'v', 'e', 'n', 't', 0};
+
+static struct keyed_event default_keyed_event;
+
+extern HANDLE base_dir_handle;
+
+static void keyed_event_init(struct keyed_event *event)
+{
+	int i;
+
+	spin_lock_init(&event->lock);
+	for (i = 0; i < KEYED_EVENT_BUCKETS; i++)
+		INIT_LIST_HEAD(&event->waits[i]);
+}
+
+VOID
+init_keyed_event_implement(VOID)
+{
+	OBJECT_TYPE_INITIALIZER ObjectTypeInitializer;
+	UNICODE_STRING Name;
+
+	memset(&ObjectTypeInitializer, 0, sizeof(ObjectTypeInitializer));
+	init_unistr(&Name, (PWSTR)keyed_event_type_name);
+	ObjectTypeInitializer.Length = sizeof(ObjectTypeInitializer);
+	ObjectTypeInitializer.DefaultNonPagedPoolCharge = sizeof(struct keyed_event);
+	ObjectTypeInitializer.GenericMapping = keyed_event_mapping;
+	ObjectTypeInitializer.PoolType = NonPagedPool;
+	ObjectTypeInitializer.ValidAccessMask = KEYEDEVENT_ALL_ACCESS;
+	create_type_object(&ObjectTypeInitializer, &Name, &keyed_event_object_type);
+
+	keyed_event_init(&default_keyed_event);
+}
+
+/* turn an NT timeout into jiffies, MAX_SCHEDULE_TIMEOUT for none */
+static long keyed_event_timeout(PLARGE_INTEGER Timeout)
+{
+	struct timespec ts;
+	LONGLONG when;
+	s32 rem;
+
+	if (!Timeout)
+		return MAX_SCHEDULE_TIMEOUT;
+
+	when = Timeout->QuadPart;
+	if (when > 0) {
+		/* absolute system time */
+		getnstimeofday(&ts);
+		when = (LONGLONG)ts.tv_sec * TICKS_PER_SEC + ts.tv_nsec / 100 + TICKS_1601_TO_1970 - when;
+		if (when >= 0)
+			return 0;
+	}
+	ts.tv_sec = div_s64_rem(-when * 100, 1000000000, &rem);
+	ts.tv_nsec = rem;
+	return timespec_to_jiffies(&ts) + (ts.tv_sec || ts.tv_nsec);
+}
+
+/* pair the current thread with one doing the opposite operation on the same key */
+static NTSTATUS keyed_event_rendezvous(struct keyed_event *event, void *key, int release, long timeout)
+{
+	struct list_head *bucket = &event->waits[((unsigned long)key >> 2) % KEYED_EVENT_BUCKETS];
+	struct keyed_wait *wait, self;
+
+	spin_lock(&event->lock);
+	list_for_each_entry(wait, bucket, entry) {
+		if (wait->key == key && wait->tgid == current->tgid && wait->release != release) {
+			list_del_init(&wait->entry);
+			wait->done = 1;
+			wake_up_process(wait->task);
+			spin_unlock(&event->lock);
+			return STATUS_SUCCESS;
+		}
+	}
+	if (!timeout) {
+		spin_unlock(&event->lock);
+		return STATUS_TIMEOUT;
+	}
+	self.task = current;
+	self.tgid = current->tgid;
+	self.key = key;
+	self.release = release;
+	self.done = 0;
+	list_add_tail(&self.entry, bucket);
+	spin_unlock(&event->lock);
+
+	for (;;) {
+		set_current_state(TASK_INTERRUPTIBLE);
+		if (self.done || !timeout || signal_pending(current))
+			break;
+		timeout = schedule_timeout(timeout);
+	}
+	__set_current_state(TASK_RUNNING);
+
+	spin_lock(&event->lock);
+	if (!self.done)
+		list_del(&self.entry);
+	spin_unlock(&event->lock);
+
+	if (self.done)
+		return STATUS_SUCCESS;
+	/* interrupted by a signal, the client delivers it and calls again */
+	return timeout ? STATUS_ALERTED : STATUS_TIMEOUT;
+}
+
+static NTSTATUS keyed_event_call(HANDLE KeyedEventHandle, PVOID Key, PLARGE_INTEGER Timeout,
+		ACCESS_MASK access, int release)
+{
+	struct keyed_event *event = &default_keyed_event;
+	LARGE_INTEGER _timeout;
+	NTSTATUS status;
+
+	ktrace("handle %p, key %p, release %d\n", KeyedEventHandle, Key, release);
+	if ((ULONG)Key & 1)
+		return STATUS_INVALID_PARAMETER_1;
+
+	if (Timeout) {
+		if ((ULONG)Timeout < TASK_SIZE) {
+			if (copy_from_user(&_timeout, Timeout, sizeof(_timeout)))
+				return STATUS_NO_MEMORY;
+		}
+		else
+			_timeout = *Timeout;
+	}
+
+	if (KeyedEventHandle) {
+		status = ref_object_by_handle(KeyedEventHandle,
+				access,
+				keyed_event_object_type,
+				KernelMode,
+				(PVOID *)&event,
+				NULL);
+		if (!NT_SUCCESS(status))
+			return status;
+	}
+
+	status = keyed_event_rendezvous(event, Key, release,
+			keyed_event_timeout(Timeout ? &_timeout : NULL));
+
+	if (KeyedEventHandle)
+		deref_object(event);
+	return status;
+}
+
+/*
+ * create a keyed event object
+ */
+NTSTATUS
+SERVICECALL
+NtCreateKeyedEvent(OUT PHANDLE KeyedEventHandle,
+		IN ACCESS_MASK DesiredAccess,
+		IN POBJECT_ATTRIBUTES ObjectAttributes OPTIONAL,
+		IN ULONG Flags)
+{
+	HANDLE hKeyedEvent;
+	struct keyed_event *event;
+	POBJECT_ATTRIBUTES obj_attr = NULL;
+	NTSTATUS status = STATUS_SUCCESS;
+
+	ktrace("\n");
+	if (ObjectAttributes) {
+		if ((ULONG)ObjectAttributes < TASK_SIZE) {
+			if (copy_object_attr_from_user(ObjectAttributes, &obj_attr))
+				return STATUS_NO_MEMORY;
+		}
+		else {
+			obj_attr = ObjectAttributes;
+		}
+	}
+
+	if (obj_attr) {
+		if (obj_attr->RootDirectory)
+			obj_attr->RootDirectory = base_dir_handle;
+	}
+
+	status = create_object(KernelMode,
+			keyed_event_object_type,
+			obj_attr,
+			KernelMode,
+			NULL,
+			sizeof(struct keyed_event),
+			0,
+			0,
+			(PVOID *)&event);
+
+	if (ObjectAttributes && (ULONG)ObjectAttributes < TASK_SIZE)
+		kfree(obj_attr);
+
+	if (!NT_SUCCESS(status))
+		return status;
+
+	keyed_event_init(event);
+
+	status = insert_object((PVOID)event,
+			NULL,
+			DesiredAccess,
+			0,
+			NULL,
+			&hKeyedEvent);
+
+	if (status != STATUS_OBJECT_NAME_EXISTS && !NT_SUCCESS(status))
+		return status;
+
+	deref_object(event);
+
+	if (KeyedEventHandle) {
+		if ((ULONG)KeyedEventHandle < TASK_SIZE) {
+			if (copy_to_user(KeyedEventHandle, &hKeyedEvent, sizeof(HANDLE)))
+				return STATUS_NO_MEMORY;
+		}
+		else
+			*KeyedEventHandle = hKeyedEvent;
+	}
+
+	return status;
+}
+EXPORT_SYMBOL(NtCreateKeyedEvent);
+
+/*
+ * open a keyed event object, failing if non-existent
+ */
+NTSTATUS
+SERVICECALL
+NtOpenKeyedEvent(OUT PHANDLE KeyedEventHandle,
+		IN ACCESS_MASK DesiredAccess,
+		IN POBJECT_ATTRIBUTES ObjectAttributes)
+{
+	HANDLE hKeyedEvent;
+	POBJECT_ATTRIBUTES obj_attr = NULL;
+	NTSTATUS status = STATUS_SUCCESS;
+
+	ktrace("\n");
+	if (ObjectAttributes) {
+		if ((ULONG)ObjectAttributes < TASK_SIZE) {
+			if (copy_object_attr_from_user(ObjectAttributes, &obj_attr))
+				return STATUS_NO_MEMORY;
+		}
+		else {
+			obj_attr = ObjectAttributes;
+		}
+	}
+
+	if (obj_attr) {
+		if (obj_attr->RootDirectory)
+			obj_attr->RootDirectory = base_dir_handle;
+	}
+
+	status = open_object_by_name(obj_attr,
+			keyed_event_object_type,
+			NULL,
+			KernelMode,
+			DesiredAccess,
+			NULL,
+			&hKeyedEvent);
+
+	if (ObjectAttributes && (ULONG)ObjectAttributes < TASK_SIZE)
+		kfree(obj_attr);
+
+	if (!NT_SUCCESS(status))
+		return status;
+
+	if (KeyedEventHandle) {
+		if ((ULONG)KeyedEventHandle < TASK_SIZE) {
+			if (copy_to_user(KeyedEventHandle, &hKeyedEvent, sizeof(HANDLE)))
+				return STATUS_NO_MEMORY;
+		}
+		else
+			*KeyedEventHandle = hKeyedEvent;
+	}
+
+	return status;
+}
+EXPORT_SYMBOL(NtOpenKeyedEvent);
+
+/*
+ * release a key, waiting for a thread to wait on it
+ */
+NTSTATUS
+SERVICECALL
+NtReleaseKeyedEvent(IN HANDLE KeyedEventHandle OPTIONAL,
+		IN PVOID Key,
+		IN BOOLEAN Alertable,
+		IN PLARGE_INTEGER Timeout OPTIONAL)
+{
+	/* FIXME: alertable waits don't run APCs */
+	return keyed_event_call(KeyedEventHandle, Key, Timeout, KEYEDEVENT_WAKE, 1);
+}
+EXPORT_SYMBOL(NtReleaseKeyedEvent);
+
+/*
+ * wait on a key until a thread releases it
+ */
+NTSTATUS
+SERVICECALL
+NtWaitForKeyedEvent(IN HANDLE KeyedEventHandle OPTIONAL,
+		IN PVOID Key,
+		IN BOOLEAN Alertable,
+		IN PLARGE_INTEGER Timeout OPTIONAL)
+{
+	return keyed_event_call(KeyedEventHandle, Key, Timeout, KEYEDEVENT_WAIT, 0);
+}
+EXPORT_SYMBOL(NtWaitForKeyedEvent);
+#endif /* CONFIG_UNIFIED_KERNEL */
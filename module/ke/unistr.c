@@ -28,9 +28,6 @@
 #include "wineserver/lib.h"
 
 #ifdef CONFIG_UNIFIED_KERNEL
-/* FIXME */
-#define	UpcaseUnicodeChar(wc)	wc
-
 static char debug_buf[1024];
 
 extern size_t wcslen(PWSTR ws);
@@ -157,34 +154,13 @@ equal_unistr(
 		IN const UNICODE_STRING *String2,
 		IN BOOLEAN  CaseInsensitive)
 {
-	ULONG i;
-	WCHAR wc1, wc2;
-	PWCHAR pw1, pw2;
-
 	if (String1->Length != String2->Length)
 		return FALSE;
 
-	pw1 = String1->Buffer;
-	pw2 = String2->Buffer;
-
-	for (i = 0; i < String1->Length / sizeof(WCHAR); i++) {
-		if (CaseInsensitive == TRUE) {
-			wc1 = UpcaseUnicodeChar (*pw1);
-			wc2 = UpcaseUnicodeChar (*pw2);
-		}
-		else {
-			wc1 = tolowerW(*pw1);
-			wc2 = tolowerW(*pw2);
-		}
-
-		if (wc1 != wc2)
-			return FALSE;
-
-		pw1++;
-		pw2++;
-	}
+	if (CaseInsensitive)
+		return !memicmpW(String1->Buffer, String2->Buffer, String1->Length / sizeof(WCHAR));
 
-	return TRUE;
+	return !memcmp(String1->Buffer, String2->Buffer, String1->Length);
 }
 EXPORT_SYMBOL(equal_unistr);
 
@@ -29,6 +29,7 @@
 
 #include "w32syscall.h"
 #include "file.h"
+#include "keyedevent.h"
 #include "mutex.h"
 #include "section.h"
 #include "semaphore.h"
@@ -2748,6 +2749,12 @@ SSDT MainSSDT[] = {
 	(SSDT)NtW32Call,			/* 230 */
 	(SSDT)NtYieldExecution,
 	(SSDT)NtWineService,
+	(SSDT)NtReadVirtualMemoryVector,
+	(SSDT)NtWriteVirtualMemoryVector,	/* 234 */
+	(SSDT)NtCreateKeyedEvent,		/* 235 */
+	(SSDT)NtOpenKeyedEvent,
+	(SSDT)NtReleaseKeyedEvent,
+	(SSDT)NtWaitForKeyedEvent,		/* 238 */
 };
 EXPORT_SYMBOL(MainSSDT);
 
@@ -2800,14 +2807,15 @@ SSPT MainSSPT[] = {
 	3,  1,  1,  5,  4,
 	2,  2,  5,  3,  1, /* 220 */
 	1,  9,  9,  6,  5,
-	5,  0,  1   	   /* 230 */
+	5,  0,  1,  4,  4, /* 230 */
+	4,  3,  4,  4
 };
 EXPORT_SYMBOL(MainSSPT);
 
 
 #define MIN_SYSCALL_NUMBER    0
-#define MAX_SYSCALL_NUMBER    232
-#define NUMBER_OF_SYSCALLS    233
+#define MAX_SYSCALL_NUMBER    238
+#define NUMBER_OF_SYSCALLS    239
 
 /* From ReactOS, don't touch. */
 
@@ -3068,7 +3076,13 @@ char* syscall[] = {
 	"NtWriteVirtualMemory",
 	"NtW32Call",			/* 230 */
 	"NtYieldExecution",
-	"NtWineService"
+	"NtWineService",
+	"NtReadVirtualMemoryVector",
+	"NtWriteVirtualMemoryVector",
+	"NtCreateKeyedEvent",		/* 235 */
+	"NtOpenKeyedEvent",
+	"NtReleaseKeyedEvent",
+	"NtWaitForKeyedEvent"
 };
 
 const char* wine_service[REQ_NB_REQUESTS] =
@@ -3307,7 +3321,15 @@ const char* wine_service[REQ_NB_REQUESTS] =
     "req_set_completion_info",
     "req_add_fd_completion",
     "req_load_init_registry",
-    "req_save_branch"
+    "req_save_branch",
+    "req_map_user_shared",
+    "req_read_directory",
+    "req_register_sock_io",
+    "req_map_screen_buffer",
+    "req_notify_screen_buffer",
+    "req_next_processes",
+    "req_next_threads",
+    "req_map_user_shared_data"
 };
 
 void log_call_id(int call_id)
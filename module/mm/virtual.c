@@ -404,104 +404,212 @@ out:
 } /* end NtAllocateVirtualMemory */
 EXPORT_SYMBOL(NtAllocateVirtualMemory);
 
+/* number of target pages pinned at a time by copy_process_vm */
+#define COPY_CHUNK_PAGES	16
+
 /*
- * NtWriteVirtualMemory
- * Write to  memory
+ * ref_process_mm
+ * reference a process and its address space for a cross-process copy
  */
-NTSTATUS SERVICECALL
-NtWriteVirtualMemory(IN HANDLE ProcessHandle,
-		IN PVOID BaseAddress,
-		IN PVOID Buffer,
-		IN ULONG NumberOfBytesToWrite,
-		OUT PULONG NumberOfBytesWritten OPTIONAL)
+static NTSTATUS ref_process_mm(HANDLE ProcessHandle, ACCESS_MASK access,
+		struct eprocess **process, struct task_struct **tsk, struct mm_struct **mm)
+{
+	NTSTATUS	status;
+
+	status = ref_object_by_handle(ProcessHandle,
+			access,
+			NULL,
+			UserMode,
+			(PVOID *)process,
+			NULL);
+	if (!NT_SUCCESS(status))
+		return status;
+
+	*tsk = get_first_thread(*process)->et_task;
+	if (!(*mm = get_task_mm(*tsk))) {
+		deref_object(*process);
+		return STATUS_PROCESS_IS_TERMINATING;
+	}
+	return STATUS_SUCCESS;
+} /* end ref_process_mm */
+
+/*
+ * vm_fault_status
+ * status for a target range that could not be pinned
+ */
+static NTSTATUS vm_fault_status(struct mm_struct *mm, unsigned long addr)
 {
-	struct ethread 	*first_thread;
-	struct eprocess	*process;
-	struct mm_struct	*mm = NULL;
-	struct mm_struct	*cur_mm = NULL;
 	struct vm_area_struct	*vma;
-	PVOID		kbuf;
-	MODE		previous_mode;
-	NTSTATUS 	status;
+	NTSTATUS	status = STATUS_INVALID_ADDRESS;
 
-	ktrace("ProcessHandle %p, BaseAddress %p, Buffer %p, NumberOfBytesToWrite %d\n",
-			ProcessHandle, BaseAddress, Buffer, NumberOfBytesToWrite);
+	down_read(&mm->mmap_sem);
+	vma = find_vma(mm, addr);
+	if (vma && vma->vm_start <= addr)
+		status = STATUS_ACCESS_VIOLATION;	/* mapped, but not with the needed access */
+	up_read(&mm->mmap_sem);
+	return status;
+} /* end vm_fault_status */
+
+/*
+ * copy_process_vm
+ * copy between a buffer of the current process and the address space mm,
+ * pinning the target pages with get_user_pages and copying through kmap
+ * a chunk at a time, so that there is neither a bounce buffer nor a switch
+ * of the address space, and the range may span several vmas
+ */
+static NTSTATUS copy_process_vm(struct task_struct *tsk, struct mm_struct *mm,
+		unsigned long addr, char __user *buf, unsigned long len,
+		int write, unsigned long *copied)
+{
+	struct page	*pages[COPY_CHUNK_PAGES];
+	unsigned long	offset, bytes, left;
+	int	nr_pages, pinned, i;
+	char	*maddr;
+	NTSTATUS	status = STATUS_SUCCESS;
+
+	while (len && NT_SUCCESS(status)) {
+		offset = addr & ~PAGE_MASK;
+		nr_pages = min((offset + len + PAGE_SIZE - 1) >> PAGE_SHIFT, (unsigned long)COPY_CHUNK_PAGES);
+
+		/* don't hold mmap_sem while touching buf, it may belong to mm itself */
+		down_read(&mm->mmap_sem);
+		pinned = get_user_pages(tsk, mm, addr & PAGE_MASK, nr_pages, write, 0, pages, NULL);
+		up_read(&mm->mmap_sem);
+		if (pinned <= 0) {
+			status = vm_fault_status(mm, addr);
+			break;
+		}
 
-	previous_mode = (unsigned long)Buffer > TASK_SIZE ? KernelMode : UserMode;
+		for (i = 0; i < pinned && len; i++) {
+			bytes = min(PAGE_SIZE - offset, len);
+			maddr = kmap(pages[i]);
+			if (write)
+				left = copy_from_user(maddr + offset, buf, bytes);
+			else
+				left = copy_to_user(buf, maddr + offset, bytes);
+			kunmap(pages[i]);
+
+			bytes -= left;
+			addr += bytes;
+			buf += bytes;
+			len -= bytes;
+			*copied += bytes;
+			if (left) {
+				status = STATUS_INVALID_ADDRESS;
+				break;
+			}
+			offset = 0;
+		}
 
-	if (previous_mode == KernelMode) {
-		/* TODO */
+		for (i = 0; i < pinned; i++) {
+			if (write)
+				set_page_dirty_lock(pages[i]);
+			page_cache_release(pages[i]);
+		}
 	}
 
-	if (NumberOfBytesToWrite > WIN32_TASK_SIZE)
+	if (!NT_SUCCESS(status) && *copied)
+		status = STATUS_PARTIAL_COPY;
+	return status;
+} /* end copy_process_vm */
+
+/*
+ * rw_virtual_memory
+ * common part of NtReadVirtualMemory and NtWriteVirtualMemory
+ */
+static NTSTATUS rw_virtual_memory(HANDLE ProcessHandle, PVOID BaseAddress, PVOID Buffer,
+		ULONG Length, PULONG Transferred, int write)
+{
+	struct eprocess	*process;
+	struct task_struct	*tsk;
+	struct mm_struct	*mm;
+	unsigned long	copied = 0;
+	NTSTATUS	status;
+
+	if (Length > WIN32_TASK_SIZE)
 		return STATUS_INVALID_PARAMETER;
 	if ((ULONG)BaseAddress > WIN32_TASK_SIZE || (ULONG)Buffer > WIN32_TASK_SIZE)
 		return STATUS_INVALID_ADDRESS;
 
-	status = ref_object_by_handle(ProcessHandle,
-			PROCESS_VM_WRITE,
-			NULL,
-			UserMode,
-			(PVOID *)(&process),
-			NULL);
+	status = ref_process_mm(ProcessHandle, write ? PROCESS_VM_WRITE : PROCESS_VM_READ,
+			&process, &tsk, &mm);
 	if (!NT_SUCCESS(status))
 		return status;
 
-	first_thread = get_first_thread(process);
-	mm = first_thread->et_task->mm;
+	status = copy_process_vm(tsk, mm, (unsigned long)BaseAddress, Buffer, Length, write, &copied);
+
+	mmput(mm);
+	deref_object(process);
 
-	vma = find_vma(mm, (ULONG)BaseAddress);
-	if (!vma || vma->vm_start > (ULONG)BaseAddress
-			|| vma->vm_end < (ULONG)BaseAddress + NumberOfBytesToWrite) {
+	if (Transferred && copy_to_user(Transferred, &copied, sizeof(ULONG)) && NT_SUCCESS(status))
 		status = STATUS_INVALID_ADDRESS;
-		goto out;
-	}
+	return status;
+} /* end rw_virtual_memory */
 
-	if (!(vma->vm_flags & VM_WRITE)) {
-		status = STATUS_ACCESS_VIOLATION;
-		goto out;
-	}
+/*
+ * rw_virtual_memory_vector
+ * common part of NtReadVirtualMemoryVector and NtWriteVirtualMemoryVector
+ */
+static NTSTATUS rw_virtual_memory_vector(HANDLE ProcessHandle, PVIRTUAL_MEMORY_VECTOR Vector,
+		ULONG Count, PULONG Transferred, int write)
+{
+	VIRTUAL_MEMORY_VECTOR	entry;
+	struct eprocess	*process;
+	struct task_struct	*tsk;
+	struct mm_struct	*mm;
+	unsigned long	copied = 0;
+	NTSTATUS	status;
+	ULONG	i;
 
-	kbuf = kmalloc(NumberOfBytesToWrite, GFP_KERNEL);
-	if (!kbuf) {
-		status = STATUS_NO_MEMORY;
-		goto out;
-	}
+	if ((ULONG)Vector > WIN32_TASK_SIZE)
+		return STATUS_INVALID_ADDRESS;
 
-	status = STATUS_INVALID_ADDRESS;
-	if (copy_from_user(kbuf, Buffer, NumberOfBytesToWrite))
-		goto out_free_kbuf;
+	status = ref_process_mm(ProcessHandle, write ? PROCESS_VM_WRITE : PROCESS_VM_READ,
+			&process, &tsk, &mm);
+	if (!NT_SUCCESS(status))
+		return status;
 
-	/* Write memory */
-	if (process == get_current_eprocess()) {
-		if (copy_to_user(BaseAddress, kbuf, NumberOfBytesToWrite))
-			goto out_free_kbuf;
-	}
-	else {
-		cur_mm = attach_process(&process->pcb);
-		if (copy_to_user(BaseAddress, kbuf, NumberOfBytesToWrite)) {
-			detach_process(cur_mm);
-			goto out_free_kbuf;
+	/* stop at the first range that can't be copied completely */
+	for (i = 0; i < Count && NT_SUCCESS(status); i++) {
+		if (copy_from_user(&entry, &Vector[i], sizeof(entry))) {
+			status = STATUS_INVALID_ADDRESS;
+			break;
 		}
-		detach_process(cur_mm);
-	}
-
-	if (previous_mode == UserMode && NumberOfBytesWritten) {
-		if (copy_to_user(NumberOfBytesWritten, &NumberOfBytesToWrite, sizeof(ULONG)))
-			goto out_free_kbuf;
+		if ((ULONG)entry.RemoteAddress > WIN32_TASK_SIZE || (ULONG)entry.Buffer > WIN32_TASK_SIZE
+				|| entry.Length > WIN32_TASK_SIZE) {
+			status = STATUS_INVALID_PARAMETER;
+			break;
+		}
+		status = copy_process_vm(tsk, mm, (unsigned long)entry.RemoteAddress, entry.Buffer,
+				entry.Length, write, &copied);
 	}
-	/* TODO
-	   else *NumberOfBytesWritten = NumberOfBytesToWrite;
-	   */
-	status = STATUS_SUCCESS;
-
-out_free_kbuf:
-	kfree(kbuf);
+	if (!NT_SUCCESS(status) && copied)
+		status = STATUS_PARTIAL_COPY;
 
-out:
+	mmput(mm);
 	deref_object(process);
+
+	if (Transferred && copy_to_user(Transferred, &copied, sizeof(ULONG)) && NT_SUCCESS(status))
+		status = STATUS_INVALID_ADDRESS;
 	return status;
+} /* end rw_virtual_memory_vector */
+
+/*
+ * NtWriteVirtualMemory
+ * Write to  memory
+ */
+NTSTATUS SERVICECALL
+NtWriteVirtualMemory(IN HANDLE ProcessHandle,
+		IN PVOID BaseAddress,
+		IN PVOID Buffer,
+		IN ULONG NumberOfBytesToWrite,
+		OUT PULONG NumberOfBytesWritten OPTIONAL)
+{
+	ktrace("ProcessHandle %p, BaseAddress %p, Buffer %p, NumberOfBytesToWrite %d\n",
+			ProcessHandle, BaseAddress, Buffer, NumberOfBytesToWrite);
 
+	return rw_virtual_memory(ProcessHandle, BaseAddress, Buffer,
+			NumberOfBytesToWrite, NumberOfBytesWritten, 1);
 } /* end NtWriteVirtualMemory */
 EXPORT_SYMBOL(NtWriteVirtualMemory);
 
@@ -516,95 +624,45 @@ NtReadVirtualMemory(IN HANDLE ProcessHandle,
 		IN ULONG NumberOfBytesToRead,
 		OUT PULONG NumberOfBytesRead OPTIONAL)
 {
-	struct eprocess	*process;
-	struct ethread	*first_thread;
-	PVOID	kbuf;
-	struct mm_struct	*mm, *cur_mm;
-	struct vm_area_struct	*vma;
-	MODE	previous_mode;
-	NTSTATUS status = STATUS_SUCCESS;
-
 	ktrace("ProcessHandle %p, BaseAddress %p, Buffer %p, NumberOfBytesToRead %d\n",
 			ProcessHandle, BaseAddress, Buffer, NumberOfBytesToRead);
 
-	previous_mode = (unsigned long)Buffer > TASK_SIZE ? KernelMode : UserMode;
-
-	if (previous_mode == KernelMode) {
-		/* TODO */
-	}
-
-	if (NumberOfBytesToRead > WIN32_TASK_SIZE)
-		return STATUS_INVALID_PARAMETER;
-	if ((ULONG)BaseAddress > WIN32_TASK_SIZE || (ULONG)Buffer > WIN32_TASK_SIZE)
-		return STATUS_INVALID_ADDRESS;
-
-	status = ref_object_by_handle(ProcessHandle,
-			PROCESS_VM_READ,
-			NULL,
-			UserMode,
-			(PVOID *)(&process),
-			NULL);
-	if (!NT_SUCCESS(status))
-		return status;
-
-	first_thread = get_first_thread(process);
-	mm = first_thread->et_task->mm;
-
-	vma = find_vma(mm, (ULONG)BaseAddress);
-	if (!vma || vma->vm_start > (ULONG)BaseAddress
-			|| vma->vm_end < (ULONG)BaseAddress + NumberOfBytesToRead) {
-		status = STATUS_INVALID_ADDRESS;
-		goto out;
-	}
-
-	if (!(vma->vm_flags & VM_READ)) {
-		status = STATUS_ACCESS_VIOLATION;
-		goto out;
-	}
-
-	kbuf = kmalloc(NumberOfBytesToRead, GFP_KERNEL);
-	if (!kbuf) {
-		status = STATUS_NO_MEMORY;
-		goto out;
-	}
-
-	status = STATUS_INVALID_ADDRESS;
-
-	/* Read memory */
-	if (process == get_current_eprocess()) {
-		if (copy_from_user(kbuf, BaseAddress, NumberOfBytesToRead))
-			goto out_free_kbuf;
-	}
-	else {
-		cur_mm = attach_process(&process->pcb);
-		if(copy_from_user(kbuf, BaseAddress, NumberOfBytesToRead)) {
-			detach_process(cur_mm);
-			goto out_free_kbuf;
-		}
-		detach_process(cur_mm);
-	}
+	return rw_virtual_memory(ProcessHandle, BaseAddress, Buffer,
+			NumberOfBytesToRead, NumberOfBytesRead, 0);
+} /* end NtReadVirtualMemory */
+EXPORT_SYMBOL(NtReadVirtualMemory);
 
-	if (copy_to_user(Buffer, kbuf, NumberOfBytesToRead))
-		goto out_free_kbuf;
+/*
+ * NtReadVirtualMemoryVector
+ * Read several ranges of memory in one call
+ */
+NTSTATUS SERVICECALL
+NtReadVirtualMemoryVector(IN HANDLE ProcessHandle,
+		IN PVIRTUAL_MEMORY_VECTOR Vector,
+		IN ULONG Count,
+		OUT PULONG NumberOfBytesRead OPTIONAL)
+{
+	ktrace("ProcessHandle %p, Vector %p, Count %d\n", ProcessHandle, Vector, Count);
 
-	if (previous_mode == UserMode && NumberOfBytesRead) {
-		if (copy_to_user(NumberOfBytesRead, &NumberOfBytesToRead, sizeof(ULONG))) {
-			goto out_free_kbuf;
-		}
-	}
-	/* TODO
-	   else *NumberOfBytesRead = NumberOfBytesToRead;
-	   */
-	status = STATUS_SUCCESS;
+	return rw_virtual_memory_vector(ProcessHandle, Vector, Count, NumberOfBytesRead, 0);
+} /* end NtReadVirtualMemoryVector */
+EXPORT_SYMBOL(NtReadVirtualMemoryVector);
 
-out_free_kbuf:
-	kfree(kbuf);
+/*
+ * NtWriteVirtualMemoryVector
+ * Write several ranges of memory in one call
+ */
+NTSTATUS SERVICECALL
+NtWriteVirtualMemoryVector(IN HANDLE ProcessHandle,
+		IN PVIRTUAL_MEMORY_VECTOR Vector,
+		IN ULONG Count,
+		OUT PULONG NumberOfBytesWritten OPTIONAL)
+{
+	ktrace("ProcessHandle %p, Vector %p, Count %d\n", ProcessHandle, Vector, Count);
 
-out:
-	deref_object(process);
-	return status;
-} /* end NtReadVirtualMemory */
-EXPORT_SYMBOL(NtReadVirtualMemory);
+	return rw_virtual_memory_vector(ProcessHandle, Vector, Count, NumberOfBytesWritten, 1);
+} /* end NtWriteVirtualMemoryVector */
+EXPORT_SYMBOL(NtWriteVirtualMemoryVector);
 
 /*
  * NtFreeVirtualMemory
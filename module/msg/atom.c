@@ -193,11 +193,7 @@ found:
 /* compute the hash code for a string */
 static unsigned short atom_hash(struct atom_table *table, const WCHAR *str, data_size_t len)
 {
-	unsigned int i;
-	unsigned short hash = 0;
-	for (i = 0; i < len; i++)
-		hash ^= toupperW(str[i]) + i;
-	return hash % table->entries_count;
+	return hash_nocase_strW(str, len) % table->entries_count;
 }
 
 /* dump an atom table */
@@ -24,87 +24,142 @@
  * user.c:
  * Refered to Wine code
  */
+#include <linux/anon_inodes.h>
 #include "wineserver/lib.h"
+#include "virtual.h"
 
 #ifdef CONFIG_UNIFIED_KERNEL
+/* user handles live in fixed size segments that are never moved once allocated, */
+/* so a lookup racing with a table growth never sees a stale array */
+#define NB_USER_HANDLES      ((LAST_USER_HANDLE - FIRST_USER_HANDLE + 1) >> 1)
+#define HANDLE_SEGMENT_SHIFT 8
+#define HANDLE_SEGMENT_SIZE  (1 << HANDLE_SEGMENT_SHIFT)
+#define NB_HANDLE_SEGMENTS   ((NB_USER_HANDLES + HANDLE_SEGMENT_SIZE - 1) >> HANDLE_SEGMENT_SHIFT)
+#define NB_USER_TYPES        (USER_HOOK + 1)
+
 struct user_handle
 {
-	void          *ptr;          /* pointer to object */
+	void          *ptr;          /* pointer to object (next free entry if free) */
 	unsigned short type;         /* object type (0 if free) */
 	unsigned short generation;   /* generation counter */
+	unsigned short index;        /* index in the handle table */
 };
 
-static struct user_handle *handles;
-static struct user_handle *freelist;
-static int nb_handles;
-static int allocated_handles;
+static struct user_handle *segments[NB_HANDLE_SEGMENTS];
+static struct user_handle *freelists[NB_USER_TYPES];  /* free entries by type of their last object */
+static int nb_handles;                                /* number of entries ever handed out */
+
+static struct user_handle_shared *shared_handles;     /* read-only client view of the table */
+
+static inline struct user_handle *index_to_entry(int index)
+{
+	struct user_handle *segment = segments[index >> HANDLE_SEGMENT_SHIFT];
+
+	smp_read_barrier_depends();
+	return &segment[index & (HANDLE_SEGMENT_SIZE - 1)];
+}
 
 static struct user_handle *handle_to_entry(user_handle_t handle)
 {
+	struct user_handle *entry;
 	unsigned short generation;
 	int index = (((unsigned long)handle & 0xffff) - FIRST_USER_HANDLE) >> 1;
+
 	if (index < 0 || index >= nb_handles)
 		return NULL;
-	if (!handles[index].type)
+	smp_rmb();
+	entry = index_to_entry(index);
+	if (!entry->type)
 		return NULL;
 	generation = (unsigned long)handle >> 16;
-	if (generation == handles[index].generation || !generation || generation == 0xffff)
-		return &handles[index];
+	if (generation == entry->generation || !generation || generation == 0xffff)
+		return entry;
 	return NULL;
 }
 
 static inline user_handle_t entry_to_handle(struct user_handle *ptr)
 {
-	int index = ptr - handles;
-	return (user_handle_t)((((unsigned long)index << 1) + FIRST_USER_HANDLE) + (ptr->generation << 16));
+	return (user_handle_t)((((unsigned long)ptr->index << 1) + FIRST_USER_HANDLE) + (ptr->generation << 16));
+}
+
+/* update the client view of a handle entry, the generation is visible before the type */
+static inline void publish_user_entry(struct user_handle *ptr)
+{
+	if (!shared_handles)
+		return;
+	shared_handles[ptr->index].generation = ptr->generation;
+	smp_wmb();
+	shared_handles[ptr->index].type = ptr->type;
 }
 
-static inline struct user_handle *alloc_user_entry(void)
+static inline struct user_handle *pop_free_entry(enum user_object type)
 {
-	struct user_handle *handle;
+	struct user_handle *handle = freelists[type];
 
-	if (freelist) {
-		handle = freelist;
-		freelist = handle->ptr;
+	if (handle)
+		freelists[type] = handle->ptr;
+	return handle;
+}
+
+static inline struct user_handle *alloc_user_entry(enum user_object type)
+{
+	struct user_handle *handle, *segment;
+	int i;
+
+	/* reuse an entry of the same type first */
+	if ((handle = pop_free_entry(type)))
+		return handle;
+
+	if (nb_handles < NB_USER_HANDLES) {
+		if (!(segment = segments[nb_handles >> HANDLE_SEGMENT_SHIFT])) {
+			if (!(segment = mem_alloc(HANDLE_SEGMENT_SIZE * sizeof(*segment))))
+				return NULL;
+			smp_wmb();
+			segments[nb_handles >> HANDLE_SEGMENT_SHIFT] = segment;
+		}
+		handle = &segment[nb_handles & (HANDLE_SEGMENT_SIZE - 1)];
+		handle->type       = 0;
+		handle->generation = 0;
+		handle->index      = nb_handles;
+		smp_wmb();
+		nb_handles++;
 		return handle;
 	}
-	if (nb_handles >= allocated_handles) { /* need to grow the array */
-		struct user_handle *new_handles;
-		/* grow array by 50% (but at minimum 32 entries) */
-		int growth = max(32, allocated_handles / 2);
-		int new_size = min(allocated_handles + growth, (LAST_USER_HANDLE-FIRST_USER_HANDLE+1) >> 1);
-		if (new_size <= allocated_handles)
-			return NULL;
-		if (!(new_handles = realloc(handles, new_size * sizeof(*handles), allocated_handles * sizeof(*handles))))
-			return NULL;
-		handles = new_handles;
-		allocated_handles = new_size;
+
+	/* the table is full, take a free entry of any type */
+	for (i = 1; i < NB_USER_TYPES; i++) {
+		if ((handle = pop_free_entry(i)))
+			return handle;
 	}
-	handle = &handles[nb_handles++];
-	handle->generation = 0;
-	return handle;
+	return NULL;
 }
 
 static inline void *free_user_entry(struct user_handle *ptr)
 {
+	unsigned short type = ptr->type;
 	void *ret;
+
 	ret = ptr->ptr;
-	ptr->ptr  = freelist;
 	ptr->type = 0;
-	freelist  = ptr;
+	publish_user_entry(ptr);
+	smp_wmb();
+	ptr->ptr  = freelists[type];
+	freelists[type] = ptr;
 	return ret;
 }
 
 /* allocate a user handle for a given object */
 user_handle_t alloc_user_handle(void *ptr, enum user_object type)
 {
-	struct user_handle *entry = alloc_user_entry();
+	struct user_handle *entry = alloc_user_entry(type);
 	if (!entry)
 		return 0;
 	entry->ptr  = ptr;
-	entry->type = type;
 	if (++entry->generation >= 0xffff)
 		entry->generation = 1;
+	smp_wmb();
+	entry->type = type;
+	publish_user_entry(entry);
 	return entry_to_handle(entry);
 }
 
@@ -157,22 +212,207 @@ void *free_user_handle(user_handle_t handle)
 void *next_user_handle(user_handle_t *handle, enum user_object type)
 {
 	struct user_handle *entry;
+	int index;
 
 	if (!*handle)
-		entry = handles;
+		index = 0;
 	else {
-		int index = (((unsigned long)*handle & 0xffff) - FIRST_USER_HANDLE) >> 1;
+		index = (((unsigned long)*handle & 0xffff) - FIRST_USER_HANDLE) >> 1;
 		if (index < 0 || index >= nb_handles)
 			return NULL;
-		entry = handles + index + 1;  /* start from the next one */
+		index++;  /* start from the next one */
 	}
-	while (entry < handles + nb_handles) {
+	for ( ; index < nb_handles; index++) {
+		entry = index_to_entry(index);
 		if (!type || entry->type == type) {
 			*handle = entry_to_handle(entry);
 			return entry->ptr;
 		}
-		entry++;
 	}
 	return NULL;
 }
+
+/* the handle table view is global, it only tells which handles are in use; the window */
+/* state is published per desktop, and only mapped by processes that can read the desktop */
+#define SHARED_WINDOWS_SIZE  PAGE_ALIGN(NB_USER_HANDLES * sizeof(struct window_shared))
+#define SHARED_HANDLES_SIZE  PAGE_ALIGN(NB_USER_HANDLES * sizeof(struct user_handle_shared))
+#define SHARED_WINDOW_LOCKS  64
+
+static struct file *user_shared_file;
+static DEFINE_MUTEX(user_shared_mutex);  /* serializes the allocation of the shared views */
+
+/* serialize the writers of a shared window entry, hashed by entry index */
+static spinlock_t shared_window_locks[SHARED_WINDOW_LOCKS] =
+{
+	[0 ... SHARED_WINDOW_LOCKS - 1] = __SPIN_LOCK_UNLOCKED(shared_window_locks)
+};
+
+static int user_shared_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+	return remap_vmalloc_range(vma, file->private_data, vma->vm_pgoff);
+}
+
+/* the buffer goes away with the last mapping of it */
+static int user_shared_release(struct inode *inode, struct file *file)
+{
+	vfree(file->private_data);
+	return 0;
+}
+
+static const struct file_operations user_shared_fops =
+{
+	.mmap    = user_shared_mmap,
+	.release = user_shared_release,
+};
+
+/* allocate a buffer shown to the clients along with the file to map it from */
+static struct file *alloc_user_shared(const char *name, unsigned long size)
+{
+	struct file *file;
+	void *data;
+
+	if (!(data = vmalloc_user(size)))
+		return NULL;
+	file = anon_inode_getfile(name, &user_shared_fops, data, O_RDONLY);
+	if (IS_ERR(file)) {
+		vfree(data);
+		return NULL;
+	}
+	return file;
+}
+
+/* allocate the shared handle table on first use */
+static int init_user_shared(void)
+{
+	struct file *file;
+	int i;
+
+	if (user_shared_file)
+		return 1;
+
+	mutex_lock(&user_shared_mutex);
+	if (!user_shared_file && (file = alloc_user_shared("[win32_user]", SHARED_HANDLES_SIZE))) {
+		shared_handles = file->private_data;
+		/* handles allocated so far must be visible to the clients too */
+		for (i = 0; i < nb_handles; i++)
+			publish_user_entry(index_to_entry(i));
+		smp_wmb();
+		user_shared_file = file;
+	}
+	mutex_unlock(&user_shared_mutex);
+	return user_shared_file != NULL;
+}
+
+/* free the shared handle table on module exit */
+void exit_user_shared(void)
+{
+	if (!user_shared_file)
+		return;
+	shared_handles = NULL;
+	fput(user_shared_file);
+	user_shared_file = NULL;
+}
+
+/* allocate the shared window state of a desktop on first use and publish its windows */
+static int init_desktop_shared(struct desktop *desktop)
+{
+	struct file *file;
+
+	if (desktop->shared_file)
+		return 1;
+
+	mutex_lock(&user_shared_mutex);
+	if (!desktop->shared_file && (file = alloc_user_shared("[win32_desktop]", SHARED_WINDOWS_SIZE))) {
+		desktop->shared_windows = file->private_data;
+		smp_wmb();
+		publish_desktop_windows(desktop);
+		desktop->shared_file = file;
+	}
+	mutex_unlock(&user_shared_mutex);
+	return desktop->shared_file != NULL;
+}
+
+/* drop the shared window state of a destroyed desktop, the mappings keep it until unmapped */
+void free_desktop_shared(struct desktop *desktop)
+{
+	if (!desktop->shared_file)
+		return;
+	desktop->shared_windows = NULL;
+	fput(desktop->shared_file);
+	desktop->shared_file = NULL;
+}
+
+/* start updating the shared entry of a window, NULL if its desktop isn't shared */
+struct window_shared *begin_window_shared(struct desktop *desktop, user_handle_t handle)
+{
+	struct window_shared *shared = desktop->shared_windows;
+	int index = (((unsigned long)handle & 0xffff) - FIRST_USER_HANDLE) >> 1;
+
+	if (!shared || index < 0 || index >= NB_USER_HANDLES)
+		return NULL;
+	smp_read_barrier_depends();
+	shared += index;
+
+	/* the clients read the entry under the sequence count, which stays odd during the update */
+	spin_lock(&shared_window_locks[index % SHARED_WINDOW_LOCKS]);
+	shared->seq++;
+	smp_wmb();
+	return shared;
+}
+
+/* finish the update of a shared window entry */
+void end_window_shared(struct desktop *desktop, struct window_shared *shared)
+{
+	int index = shared - desktop->shared_windows;
+
+	smp_wmb();
+	shared->seq++;
+	spin_unlock(&shared_window_locks[index % SHARED_WINDOW_LOCKS]);
+}
+
+/* map the shared user state into the current process */
+DECL_HANDLER(map_user_shared)
+{
+	struct w32process *process = get_current_w32process();
+	struct desktop *desktop;
+	unsigned long addr;
+
+	ktrace("\n");
+	if (!process->user_shared) {
+		if (!init_user_shared()) {
+			set_error(STATUS_NO_MEMORY);
+			return;
+		}
+		addr = win32_do_mmap_pgoff(current, user_shared_file, 0, SHARED_HANDLES_SIZE,
+				PROT_READ, MAP_SHARED, 0);
+		if (IS_ERR((void *)addr)) {
+			set_error(STATUS_NO_MEMORY);
+			return;
+		}
+		process->user_shared = (void *)addr;
+	}
+	reply->handles = process->user_shared;
+	reply->windows = NULL;
+
+	/* without read access to the desktop, the window state goes through the requests */
+	if (!(desktop = get_thread_desktop(current_thread, DESKTOP_READOBJECTS))) {
+		clear_error();
+		return;
+	}
+	if (!process->windows_view && init_desktop_shared(desktop)) {
+		addr = win32_do_mmap_pgoff(current, desktop->shared_file, 0, SHARED_WINDOWS_SIZE,
+				PROT_READ, MAP_SHARED, 0);
+		if (!IS_ERR((void *)addr)) {
+			process->windows_view = (void *)addr;
+			process->windows_file = desktop->shared_file;
+		}
+	}
+	/* a process maps the view of a single desktop */
+	if (process->windows_view && process->windows_file == desktop->shared_file)
+		reply->windows = process->windows_view;
+	release_object(desktop);
+}
 #endif /* CONFIG_UNIFIED_KERNEL */
@@ -306,6 +306,8 @@ static struct desktop *create_desktop(const struct unicode_str *name, unsigned i
 			desktop->global_hooks = NULL;
 			desktop->close_timeout = NULL;
 			desktop->users = 0;
+			desktop->shared_windows = NULL;
+			desktop->shared_file = NULL;
 			list_add_before(&winstation->desktops, &desktop->entry);
 		}
 	}
@@ -348,6 +350,7 @@ static void desktop_destroy(struct object *obj)
 
 	if (desktop->top_window)
 		destroy_window(desktop->top_window);
+	free_desktop_shared(desktop);
 	if (desktop->global_hooks)
 		release_object(desktop->global_hooks);
 	if (desktop->close_timeout)
@@ -24,8 +24,10 @@
  * console.c:
  * Refered to Wine code
  */
+#include <linux/anon_inodes.h>
 #include "unistr.h"
 #include "handle.h"
+#include "virtual.h"
 #include "winuser.h"
 #include "wineserver/wincon.h" 
 
@@ -93,6 +95,7 @@ struct console_input_events
 	int                   num_alloc;   /* number of allocated events */
 	int                   num_used;    /* number of actually used events */
 	struct console_renderer_event*    events;
+	struct console_input *console;     /* console the events are for */
 };
 
 static const struct object_ops console_input_events_ops =
@@ -129,6 +132,8 @@ struct screen_buffer
 	int                   max_width;     /* size (w-h) of the window given font size */
 	int                   max_height;
 	char_info_t          *data;          /* the data for each cell - a width x height matrix */
+	struct screen_buffer_shared *shared; /* shared view holding the cells */
+	struct file          *shared_file;   /* file the shared view is mapped from */
 	unsigned short        attr;          /* default attribute for screen buffer */
 	rectangle_t           win;           /* current visible window on the screen buffer *
 										  * as seen in wineconsole */
@@ -157,6 +162,30 @@ static struct list_head screen_buffer_list = LIST_INIT(screen_buffer_list);
 
 static const char_info_t empty_char_info = { ' ', 0x000f };  /* white on black space */
 
+/* the cells of a screen buffer live in a vmalloc_user area behind an anonymous file, */
+/* so that the clients can map them; the area goes with the last reference to the file */
+#define SCREEN_BUFFER_SHARED_SIZE(width, height) \
+	PAGE_ALIGN(offsetof(struct screen_buffer_shared, cells[(width) * (height)]))
+
+static int screen_buffer_shared_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	if (!(vma->vm_flags & VM_WRITE))
+		vma->vm_flags &= ~VM_MAYWRITE;
+	return remap_vmalloc_range(vma, file->private_data, vma->vm_pgoff);
+}
+
+static int screen_buffer_shared_release(struct inode *inode, struct file *file)
+{
+	vfree(file->private_data);
+	return 0;
+}
+
+static const struct file_operations screen_buffer_shared_fops =
+{
+	.mmap    = screen_buffer_shared_mmap,
+	.release = screen_buffer_shared_release,
+};
+
 static WCHAR console_input_name[] = {'C','o','n','s','o','l','e','_','I','n','p','u','t',0};
 static WCHAR console_input_events_name[] =
     {'C','o','n','s','o','l','e','_','I','n','p','u','t','_','E','v','e','n','t','s',0};
@@ -329,6 +358,7 @@ static struct console_input_events *create_console_input_events(void)
 		return NULL;
 	evt->num_alloc = evt->num_used = 0;
 	evt->events = NULL;
+	evt->console = NULL;
 	return evt;
 }
 
@@ -377,14 +407,74 @@ static struct object *create_console_input(struct w32thread* renderer)
 		release_object(console_input);
 		return NULL;
 	}
+	console_input->evt->console = console_input;
 	return &console_input->obj;
 }
 
+/* allocate the shared view of a screen buffer */
+static struct screen_buffer_shared *alloc_screen_buffer_shared(int width, int height, struct file **file)
+{
+	struct screen_buffer_shared *shared;
+
+	if (!(shared = vmalloc_user(SCREEN_BUFFER_SHARED_SIZE(width, height)))) {
+		set_error(STATUS_NO_MEMORY);
+		return NULL;
+	}
+	*file = anon_inode_getfile("[win32_console]", &screen_buffer_shared_fops, shared, O_RDWR);
+	if (IS_ERR(*file)) {
+		vfree(shared);
+		set_error(STATUS_NO_MEMORY);
+		return NULL;
+	}
+	shared->width  = width;
+	shared->height = height;
+	shared->dirty  = SCREEN_BUFFER_CLEAN;
+	return shared;
+}
+
+/* drop the shared view of a screen buffer, the clients still mapping it find it stale */
+static void free_screen_buffer_shared(struct screen_buffer_shared *shared, struct file *file)
+{
+	shared->stale = 1;
+	fput(file);
+}
+
+/* bump the change count after the kernel changed some cells */
+static inline void screen_buffer_changed(struct screen_buffer *screen_buffer)
+{
+	smp_wmb();
+	screen_buffer->shared->seq++;
+}
+
+/* take the rows the clients changed in the shared view, and queue their update if asked to */
+static void flush_screen_buffer_dirty(struct screen_buffer *screen_buffer, int queue)
+{
+	struct console_renderer_event evt;
+	unsigned int dirty;
+	int top, bottom;
+
+	dirty  = xchg(&screen_buffer->shared->dirty, SCREEN_BUFFER_CLEAN);
+	top    = dirty >> 16;
+	bottom = min((int)(dirty & 0xffff), screen_buffer->height - 1);
+	if (!queue || top > bottom)
+		return;
+
+	evt.event = CONSOLE_RENDERER_UPDATE_EVENT;
+	memset(&evt.u, 0, sizeof(evt.u));
+	evt.u.update.top    = top;
+	evt.u.update.bottom = bottom;
+	console_input_events_append(screen_buffer->input->evt, &evt);
+}
+
 static void generate_sb_initial_events(struct console_input *console_input)
 {
 	struct screen_buffer *screen_buffer = console_input->active;
 	struct console_renderer_event evt;
 
+	/* the whole buffer gets redrawn, forget about the clients' changes */
+	xchg(&screen_buffer->shared->pending, 0);
+	flush_screen_buffer_dirty(screen_buffer, 0);
+
 	evt.event = CONSOLE_RENDERER_ACTIVE_SB_EVENT;
 	memset(&evt.u, 0, sizeof(evt.u));
 	console_input_events_append(console_input->evt, &evt);
@@ -456,13 +546,17 @@ static struct screen_buffer *create_console_output(struct console_input *console
 	screen_buffer->win.top        = 0;
 	screen_buffer->win.bottom     = screen_buffer->max_height - 1;
 
+	screen_buffer->shared         = NULL;
+
 	list_add_head(&screen_buffer_list, &screen_buffer->entry);
 
-	if (!(screen_buffer->data = malloc(screen_buffer->width * screen_buffer->height *
-					sizeof(*screen_buffer->data)))) {
+	if (!(screen_buffer->shared = alloc_screen_buffer_shared(screen_buffer->width,
+					screen_buffer->height, &screen_buffer->shared_file))) {
 		release_object(screen_buffer);
 		return NULL;
 	}
+	screen_buffer->shared->attr = screen_buffer->attr;
+	screen_buffer->data = screen_buffer->shared->cells;
 	/* clear the first row */
 	for (i = 0; i < screen_buffer->width; i++)
 		screen_buffer->data[i] = empty_char_info;
@@ -818,12 +912,14 @@ static int change_screen_buffer_size(struct screen_buffer *screen_buffer,
 						int new_width, int new_height)
 {
 	int i, old_width, old_height, copy_width, copy_height;
+	struct screen_buffer_shared *new_shared;
+	struct file *new_file;
 	char_info_t *new_data;
 
-	if (!(new_data = malloc(new_width * new_height * sizeof(*new_data)))) {
-		set_error(STATUS_NO_MEMORY);
+	if (!(new_shared = alloc_screen_buffer_shared(new_width, new_height, &new_file)))
 		return 0;
-	}
+	new_shared->attr = screen_buffer->attr;
+	new_data = new_shared->cells;
 	old_width = screen_buffer->width;
 	old_height = screen_buffer->height;
 	copy_width = min(old_width, new_width);
@@ -856,7 +952,9 @@ static int change_screen_buffer_size(struct screen_buffer *screen_buffer,
 			memcpy(&new_data[i * new_width], &new_data[old_height * new_width],
 					new_width * sizeof(char_info_t));
 	}
-	free(screen_buffer->data);
+	free_screen_buffer_shared(screen_buffer->shared, screen_buffer->shared_file);
+	screen_buffer->shared = new_shared;
+	screen_buffer->shared_file = new_file;
 	screen_buffer->data = new_data;
 	screen_buffer->width = new_width;
 	screen_buffer->height = new_height;
@@ -962,6 +1060,7 @@ static int set_console_output_info(struct screen_buffer *screen_buffer,
 	}
 	if (req->mask & SET_CONSOLE_OUTPUT_INFO_ATTR) {
 		screen_buffer->attr = req->attr;
+		screen_buffer->shared->attr = req->attr;
 	}
 	if (req->mask & SET_CONSOLE_OUTPUT_INFO_DISPLAY_WINDOW) {
 		if (req->win_left < 0 || req->win_left > req->win_right ||
@@ -1074,7 +1173,10 @@ static void console_input_destroy(struct object *obj)
 			curr->input = NULL;
 	}
 
-	release_object(console_in->evt);
+	if (console_in->evt) {
+		console_in->evt->console = NULL;
+		release_object(console_in->evt);
+	}
 	console_in->evt = NULL;
 	release_object(console_in->event);
 
@@ -1104,7 +1206,8 @@ static void screen_buffer_destroy(struct object *obj)
 			}
 		}
 	}
-	free(screen_buffer->data);
+	if (screen_buffer->shared)
+		free_screen_buffer_shared(screen_buffer->shared, screen_buffer->shared_file);
 }
 
 /* write data into a screen buffer */
@@ -1159,6 +1262,8 @@ static int write_console_output(struct screen_buffer *screen_buffer, data_size_t
 			return 0;
 	}
 
+	if (i)
+		screen_buffer_changed(screen_buffer);
 	if (i && screen_buffer == screen_buffer->input->active) {
 		struct console_renderer_event evt;
 		evt.event = CONSOLE_RENDERER_UPDATE_EVENT;
@@ -1212,6 +1317,8 @@ static int fill_console_output(struct screen_buffer *screen_buffer, char_info_t
 			return 0;
 	}
 
+	if (count > 0)
+		screen_buffer_changed(screen_buffer);
 	if (count && screen_buffer == screen_buffer->input->active) {
 		struct console_renderer_event evt;
 		evt.event = CONSOLE_RENDERER_UPDATE_EVENT;
@@ -1322,6 +1429,8 @@ static void scroll_console_output(obj_handle_t handle, int xsrc, int ysrc, int x
 		}
 	}
 
+	screen_buffer_changed(screen_buffer);
+
 	/* FIXME: this could be enhanced, by signalling scroll */
 	evt.event = CONSOLE_RENDERER_UPDATE_EVENT;
 	memset(&evt.u, 0, sizeof(evt.u));
@@ -1391,12 +1500,17 @@ DECL_HANDLER(free_console)
 DECL_HANDLER(get_console_renderer_events)
 {
 	struct console_input_events *evt;
+	struct console_input *console;
 
 	ktrace("\n");
 	evt = (struct console_input_events *)get_wine_handle_obj(get_current_w32process(), req->handle,
 			CONSOLE_READ, &console_input_events_ops);
 	if (!evt)
 		return;
+	/* the first fetch after the clients changed cells in the shared view gets their update */
+	console = evt->console;
+	if (console && console->active && xchg(&console->active->shared->pending, 0))
+		flush_screen_buffer_dirty(console->active, 1);
 	console_input_events_get(evt);
 	release_object(evt);
 }
@@ -1639,6 +1753,61 @@ DECL_HANDLER(move_console_output)
 			req->w, req->h);
 }
 
+/* map the shared view of a screen buffer into the current process */
+DECL_HANDLER(map_screen_buffer)
+{
+	struct screen_buffer *screen_buffer;
+	struct vm_area_struct *vma;
+	unsigned long addr;
+	unsigned long prot = PROT_READ;
+
+	ktrace("\n");
+	if (req->unmap) {
+		addr = (unsigned long)req->unmap;
+		down_write(&current->mm->mmap_sem);
+		vma = find_vma(current->mm, addr);
+		if (vma && vma->vm_start == addr && vma->vm_file &&
+				vma->vm_file->f_op == &screen_buffer_shared_fops)
+			do_munmap(current->mm, addr, vma->vm_end - vma->vm_start);
+		up_write(&current->mm->mmap_sem);
+	}
+
+	if (!(screen_buffer = (struct screen_buffer *)get_wine_handle_obj(get_current_w32process(), req->handle,
+					CONSOLE_READ, &screen_buffer_ops)))
+		return;
+	if (get_handle_access(get_current_eprocess(), req->handle) & CONSOLE_WRITE)
+		prot |= PROT_WRITE;
+	addr = win32_do_mmap_pgoff(current, screen_buffer->shared_file, 0,
+			SCREEN_BUFFER_SHARED_SIZE(screen_buffer->width, screen_buffer->height),
+			prot, MAP_SHARED, 0);
+	if (IS_ERR((void *)addr))
+		set_error(STATUS_NO_MEMORY);
+	else {
+		reply->view     = (void *)addr;
+		reply->writable = (prot & PROT_WRITE) != 0;
+	}
+	release_object(screen_buffer);
+}
+
+/* queue the update of the cells the clients changed in a shared view */
+DECL_HANDLER(notify_screen_buffer)
+{
+	struct screen_buffer *screen_buffer;
+
+	ktrace("\n");
+	if (!(screen_buffer = (struct screen_buffer *)get_wine_handle_obj(get_current_w32process(), req->handle,
+					CONSOLE_WRITE, &screen_buffer_ops)))
+		return;
+	if (screen_buffer->input && screen_buffer == screen_buffer->input->active)
+		flush_screen_buffer_dirty(screen_buffer, 1);
+	else {
+		/* nothing renders it, its activation redraws it all */
+		xchg(&screen_buffer->shared->pending, 0);
+		flush_screen_buffer_dirty(screen_buffer, 0);
+	}
+	release_object(screen_buffer);
+}
+
 /* sends a signal to a console (process, group...) */
 DECL_HANDLER(send_console_signal)
 {
@@ -25,15 +25,22 @@
  * Refered to Wine code
  */
 #include <linux/poll.h>
+#include <linux/inotify.h>
+#include <linux/workqueue.h>
+#include <linux/namei.h>
+#include <linux/mount.h>
+#include <linux/file.h>
+#include <linux/cred.h>
 
 #include "section.h"
 #include "handle.h"
 
 #ifdef CONFIG_UNIFIED_KERNEL
-/* dnotify support */
-
-extern int interlocked_xchg_add(int*, int);
-extern int interlocked_xchg(int*, int);
+/*
+ * Change notifications are fed by the in-kernel inotify interface.  Every
+ * watched directory inode has one change_watch, the directory handles hang
+ * off it and events go straight into a bounded ring of each handle.
+ */
 
 #define FILE_ACTION_ADDED               0x00000001
 #define FILE_ACTION_REMOVED             0x00000002
@@ -44,121 +51,64 @@ extern int interlocked_xchg(int*, int);
 #define FILE_ACTION_REMOVED_STREAM      0x00000007
 #define FILE_ACTION_MODIFIED_STREAM     0x00000008
 
-#ifdef linux
-#ifndef F_NOTIFY
-#define F_NOTIFY 1026
-#define DN_ACCESS       0x00000001      /* File accessed */
-#define DN_MODIFY       0x00000002      /* File modified */
-#define DN_CREATE       0x00000004      /* File created */
-#define DN_DELETE       0x00000008      /* File removed */
-#define DN_RENAME       0x00000010      /* File renamed */
-#define DN_ATTRIB       0x00000020      /* File changed attributes */
-#define DN_MULTISHOT    0x80000000      /* Don't remove notifier */
-#endif
-#endif
-
-/* inotify support */
-
-#if defined(__linux__) && defined(__i386__)
-
-#define SYS_inotify_init	291
-#define SYS_inotify_add_watch	292
-#define SYS_inotify_rm_watch	293
-
-struct inotify_event {
-	int           wd;
-	unsigned int  mask;
-	unsigned int  cookie;
-	unsigned int  len;
-	char          name[1];
-};
-
-#define IN_ACCESS        0x00000001
-#define IN_MODIFY        0x00000002
-#define IN_ATTRIB        0x00000004
-#define IN_CLOSE_WRITE   0x00000008
-#define IN_CLOSE_NOWRITE 0x00000010
-#define IN_OPEN          0x00000020
-#define IN_MOVED_FROM    0x00000040
-#define IN_MOVED_TO      0x00000080
-#define IN_CREATE        0x00000100
-#define IN_DELETE        0x00000200
-#define IN_DELETE_SELF   0x00000400
-
-#define USE_INOTIFY
-
-static inline int inotify_init(void)
-{
-#if 0     /* D.M. TBD */
-	int ret;
-	__asm__ __volatile__("int $0x80"
-			: "=a" (ret)
-			: "0" (SYS_inotify_init));
-	if (ret<0) { errno = -ret; ret = -1; }
-	return ret;
-#endif
-	return 0;
-}
-
-static inline int inotify_add_watch(int fd, const char *name, unsigned int mask)
-{
-#if 0      /* D.M. TBD */
-	int ret;
-	__asm__ __volatile__("pushl %%ebx;\n\t"
-			"movl %2,%%ebx;\n\t"
-			"int $0x80;\n\t"
-			"popl %%ebx"
-			: "=a" (ret) : "0" (SYS_inotify_add_watch),
-			"r" (fd), "c" (name), "d" (mask));
-	if (ret<0) { errno = -ret; ret = -1; }
-	return ret;
-#endif 
-	return 0;
-}
-
-static inline int inotify_remove_watch(int fd, int wd)
-{
-#if 0             /* D.M. TBD */
-	int ret;
-	__asm__ __volatile__("pushl %%ebx;\n\t"
-			"movl %2,%%ebx;\n\t"
-			"int $0x80;\n\t"
-			"popl %%ebx"
-			: "=a" (ret) : "0" (SYS_inotify_rm_watch),
-			"r" (fd), "c" (wd));
-	if (ret<0) { errno = -ret; ret = -1; }
-	return ret;
-#endif
-	return 0;
-}
-
-#endif
-
-struct uk_inode;
-
-static void free_inode(struct uk_inode *inode);
-
-static struct fd *inotify_fd;
+#define CHANGE_RING_SIZE	256	/* pending records per directory handle */
 
 struct change_record {
-	struct list_head entry;
+	struct change_record *next;   /* next record in a batch being read */
 	int action;
 	int len;
 	char name[1];
 };
 
+struct change_watch {
+	struct inotify_watch wdata;   /* inotify watch, holds the inode */
+	struct list_head dirs;        /* directory handles watching this inode */
+	struct change_watch *parent;  /* watch of the parent directory */
+	struct list_head children;    /* watches of the subdirectories */
+	struct list_head ch_entry;    /* entry in the parent's children list */
+	struct list_head rm_entry;    /* entry in a list of watches to remove */
+	int dead;                     /* detached, waiting for the inotify watch to go */
+	char *name;                   /* name in the parent directory */
+};
+
 struct dir
 {
 	struct object       obj;      /* object header */
 	struct fd          *fd;       /* file descriptor to the directory */
-	struct list_head    entry;    /* entry in global change notifications list */
 	unsigned int        filter;   /* notification filter */
-	int                 notified; /* SIGIO counter */
 	int                 want_data; /* return change data */
 	int                 subtree;  /* do we want to watch subdirectories? */
-	struct list_head    change_records;   /* data for the change */
-	struct list_head    in_entry; /* entry in the inode dirs list */
-	struct uk_inode    *inode;    /* inode of the associated directory */
+	struct change_watch *watch;   /* watch of the directory inode */
+	struct list_head    in_entry; /* entry in the watch dirs list */
+	struct work_struct  wake_work; /* wakes up the waiting asyncs */
+	spinlock_t          ring_lock; /* protects the ring */
+	unsigned int        ring_head; /* first pending record */
+	unsigned int        ring_count; /* number of pending records */
+	int                 overflow; /* records were dropped */
+	struct change_record *ring[CHANGE_RING_SIZE];
+};
+
+/* subdirectory watch to add or drop outside of the inotify callback */
+struct change_work {
+	struct work_struct work;
+	struct change_watch *watch;   /* parent of the watch to add, or the watch to drop */
+	struct inode *inode;
+	char name[1];
+};
+
+/* directory whose subdirectories are still to be watched */
+struct subdir_scan {
+	struct work_struct work;      /* starts a walk on the change workqueue */
+	struct list_head entry;
+	struct change_watch *watch;   /* watch of the directory, referenced */
+	struct path path;             /* the directory itself */
+	const struct cred *cred;      /* credentials of the walk, those of the requester */
+};
+
+/* subdirectory found by a scan */
+struct subdir_name {
+	struct list_head entry;
+	char name[1];
 };
 
 static struct fd *dir_get_fd(struct object *obj);
@@ -200,130 +150,31 @@ static const struct fd_ops dir_fd_ops =
 	default_fd_cancel_async      /* cancel_async */
 };
 
-static struct list_head change_list = LIST_INIT(change_list);
+static void change_handle_event(struct inotify_watch *wdata, u32 wd, u32 mask,
+		u32 cookie, const char *name, struct inode *inode);
+static void change_destroy_watch(struct inotify_watch *wdata);
 
-static void dnotify_adjust_changes(struct dir *dir)
+static const struct inotify_operations change_inotify_ops =
 {
-#if defined(F_SETSIG) && defined(F_NOTIFY)
-	int fd = get_unix_fd(dir->fd);
-	unsigned int filter = dir->filter;
-	unsigned int val;
-	if (0 > fcntl(fd, F_SETSIG, SIGIO))
-		return;
-
-	val = DN_MULTISHOT;
-	if (filter & FILE_NOTIFY_CHANGE_FILE_NAME)
-		val |= DN_RENAME | DN_DELETE | DN_CREATE;
-	if (filter & FILE_NOTIFY_CHANGE_DIR_NAME)
-		val |= DN_RENAME | DN_DELETE | DN_CREATE;
-	if (filter & FILE_NOTIFY_CHANGE_ATTRIBUTES)
-		val |= DN_ATTRIB;
-	if (filter & FILE_NOTIFY_CHANGE_SIZE)
-		val |= DN_MODIFY;
-	if (filter & FILE_NOTIFY_CHANGE_LAST_WRITE)
-		val |= DN_MODIFY;
-	if (filter & FILE_NOTIFY_CHANGE_LAST_ACCESS)
-		val |= DN_ACCESS;
-	if (filter & FILE_NOTIFY_CHANGE_CREATION)
-		val |= DN_CREATE;
-	if (filter & FILE_NOTIFY_CHANGE_SECURITY)
-		val |= DN_ATTRIB;
-	fcntl(fd, F_NOTIFY, val);
-#endif
-}
-
-/* insert change in the global list */
-static inline void insert_change(struct dir *dir)
-{
-    sigset_t sigset;
-
-    sigemptyset(&sigset);
-    sigaddset(&sigset, SIGIO);
-    sigprocmask(SIG_BLOCK, &sigset, NULL);
-    list_add(&dir->entry, &change_list);
-    sigprocmask(SIG_UNBLOCK, &sigset, NULL);
-}
+	.handle_event	= change_handle_event,
+	.destroy_watch	= change_destroy_watch,
+};
 
-/* remove change from the global list */
-static inline void remove_change(struct dir *dir)
-{
-	sigset_t sigset;
-
-	sigemptyset(&sigset);
-	sigaddset(&sigset, SIGIO);
-	sigprocmask(SIG_BLOCK, &sigset, NULL);
-	list_del(&dir->entry);
-	sigprocmask(SIG_UNBLOCK, &sigset, NULL);
-}
+static struct inotify_handle *change_ih;
+static struct workqueue_struct *change_wq;	/* adds and drops subdirectory watches */
+static DEFINE_MUTEX(change_mutex);	/* serializes watch creation and removal */
+static DEFINE_SPINLOCK(change_lock);	/* protects the watch tree and the dirs lists */
 
 static void dir_dump(struct object *obj, int verbose)
 {
 }
 
-/* enter here directly from SIGIO signal handler */
-void do_change_notify(int unix_fd)
-{
-	struct dir *dir;
-
-	/* FIXME: this is O(n) ... probably can be improved */
-	list_for_each_entry(dir, &change_list, entry) {
-		if (get_unix_fd(dir->fd) != unix_fd)
-			continue;
-		interlocked_xchg_add(&dir->notified, 1);
-		break;
-	}
-}
-
-/* SIGIO callback, called synchronously with the poll loop */
-void sigio_callback(void)
-{
-	struct dir *dir;
-
-	list_for_each_entry(dir, &change_list, entry) {
-		if (interlocked_xchg(&dir->notified, 0))
-			fd_async_wake_up(dir->fd, ASYNC_TYPE_WAIT, STATUS_NOTIFY_ENUM_DIR);
-	}
-}
-
 static struct fd *dir_get_fd(struct object *obj)
 {
     struct dir *dir = (struct dir *)obj;
     return (struct fd *)grab_object(dir->fd);
 }
 
-static struct change_record *get_first_change_record(struct dir *dir)
-{
-	struct list_head *ptr = ((&dir->change_records)->next == &dir->change_records) ? NULL: (&dir->change_records)->next;
-	if (!ptr)
-		return NULL;
-	list_del(ptr);
-	return list_entry(ptr, struct change_record, entry);
-}
-
-static void dir_destroy(struct object *obj)
-{
-	struct change_record *record;
-	struct dir *dir = (struct dir *)obj;
-
-	if (dir->filter)
-		remove_change(dir);
-
-	if (dir->inode) {
-		list_del(&dir->in_entry);
-		free_inode(dir->inode);
-	}
-
-	while ((record = get_first_change_record(dir)))
-		free(record);
-
-	release_object(dir->fd);
-
-	if (inotify_fd && list_empty(&change_list)) {
-		release_object(inotify_fd);
-		inotify_fd = NULL;
-	}
-}
-
 static struct dir *
 get_dir_obj(struct w32process *process, obj_handle_t handle, unsigned int access)
 {
@@ -340,647 +191,613 @@ static enum server_fd_type dir_get_fd_type(struct fd *fd)
 	return FD_TYPE_DIR;
 }
 
-#ifdef USE_INOTIFY
-
-#define HASH_SIZE 31
+static u32 map_flags(unsigned int filter)
+{
+	u32 mask;
 
-struct uk_inode {
-	struct list_head ch_entry;    /* entry in the children list */
-	struct list_head children;    /* children of this inode */
-	struct uk_inode *parent;    /* parent of this inode */
-	struct list_head dirs;        /* directory handles watching this inode */
-	struct list_head ino_entry;   /* entry in the inode hash */
-	struct list_head wd_entry;    /* entry in the watch descriptor hash */
-	dev_t dev;               /* device number */
-	ino_t ino;               /* device's inode number */
-	int wd;                  /* inotify's watch descriptor */
-	char *name;              /* basename name of the inode */
-};
+	/* always watch these so we can track subdirectories in recursive watches */
+	mask = (IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE | IN_CREATE | IN_DELETE_SELF);
 
-struct list_head inode_hash[HASH_SIZE];
-struct list_head wd_hash[HASH_SIZE];
+	if (filter & FILE_NOTIFY_CHANGE_ATTRIBUTES)
+		mask |= IN_ATTRIB;
+	if (filter & FILE_NOTIFY_CHANGE_SIZE)
+		mask |= IN_MODIFY;
+	if (filter & FILE_NOTIFY_CHANGE_LAST_WRITE)
+		mask |= IN_MODIFY;
+	if (filter & FILE_NOTIFY_CHANGE_LAST_ACCESS)
+		mask |= IN_ACCESS;
+	if (filter & FILE_NOTIFY_CHANGE_SECURITY)
+		mask |= IN_ATTRIB;
 
-static int inotify_add_dir(char *path, unsigned int filter);
+	return mask;
+}
 
-static struct uk_inode *inode_from_wd(int wd)
+static unsigned int filter_from_event(u32 mask)
 {
-	struct list_head *bucket = &wd_hash[wd % HASH_SIZE];
-	struct uk_inode *inode;
+	unsigned int filter = 0;
 
-	list_for_each_entry(inode, bucket, wd_entry)
-		if (inode->wd == wd)
-			return inode;
+	if (mask & (IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE | IN_CREATE))
+		filter |= (mask & IN_ISDIR) ? FILE_NOTIFY_CHANGE_DIR_NAME : FILE_NOTIFY_CHANGE_FILE_NAME;
+	if (mask & IN_MODIFY)
+		filter |= FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE;
+	if (mask & IN_ATTRIB)
+		filter |= FILE_NOTIFY_CHANGE_ATTRIBUTES | FILE_NOTIFY_CHANGE_SECURITY;
+	if (mask & IN_ACCESS)
+		filter |= FILE_NOTIFY_CHANGE_LAST_ACCESS;
+	if (mask & IN_CREATE)
+		filter |= FILE_NOTIFY_CHANGE_CREATION;
 
-	return NULL;
+	return filter;
 }
 
-static inline struct list_head *get_hash_list(dev_t dev, ino_t ino)
+static unsigned int action_from_event(u32 mask)
 {
-	return &inode_hash[(ino ^ dev) % HASH_SIZE];
+	if (mask & IN_CREATE)
+		return FILE_ACTION_ADDED;
+	if (mask & IN_DELETE)
+		return FILE_ACTION_REMOVED;
+	if (mask & IN_MOVED_FROM)
+		return FILE_ACTION_RENAMED_OLD_NAME;
+	if (mask & IN_MOVED_TO)
+		return FILE_ACTION_RENAMED_NEW_NAME;
+	return FILE_ACTION_MODIFIED;
 }
 
-static struct uk_inode *find_inode(dev_t dev, ino_t ino)
+/* the wake up only takes spinlocks and references, and asyncs carry the
+ * thread and task they complete for, so it doesn't depend on current */
+static void dir_wake_work(struct work_struct *work)
 {
-	struct list_head *bucket = get_hash_list(dev, ino);
-	struct uk_inode *inode;
-
-	list_for_each_entry(inode, bucket, ino_entry)
-		if (inode->ino == ino && inode->dev == dev)
-			return inode;
+	struct dir *dir = container_of(work, struct dir, wake_work);
 
-	return NULL;
+	fd_async_wake_up(dir->fd, ASYNC_TYPE_WAIT, STATUS_ALERTED);
 }
 
-static struct uk_inode *create_inode(dev_t dev, ino_t ino)
+/* append a record to the ring of a directory, change_lock held */
+static void queue_change_record(struct dir *dir, unsigned int action, const char *name, int len)
 {
-	struct uk_inode *inode;
-
-	inode = malloc(sizeof *inode);
-	if (inode) {
-		INIT_LIST_HEAD(&inode->children);
-		INIT_LIST_HEAD(&inode->dirs);
-		inode->ino = ino;
-		inode->dev = dev;
-		inode->wd = -1;
-		inode->parent = NULL;
-		inode->name = NULL;
-		list_add_before(get_hash_list(dev, ino), &inode->ino_entry);
-	}
-	return inode;
-}
+	struct change_record *record;
 
-static struct uk_inode *get_inode(dev_t dev, ino_t ino)
-{
-	struct uk_inode *inode;
+	if (!dir->want_data)
+		goto wake;
+
+	spin_lock(&dir->ring_lock);
+	if (dir->ring_count) {
+		record = dir->ring[(dir->ring_head + dir->ring_count - 1) % CHANGE_RING_SIZE];
+		if (record->action == action && record->len == len && !memcmp(record->name, name, len)) {
+			/* same as the last one, the reader has been woken already */
+			spin_unlock(&dir->ring_lock);
+			return;
+		}
+	}
+	if (dir->ring_count == CHANGE_RING_SIZE
+			|| !(record = kmalloc(offsetof(struct change_record, name[len]), GFP_ATOMIC)))
+		dir->overflow = 1;
+	else {
+		record->action = action;
+		record->len = len;
+		memcpy(record->name, name, len);
+		dir->ring[(dir->ring_head + dir->ring_count) % CHANGE_RING_SIZE] = record;
+		dir->ring_count++;
+	}
+	spin_unlock(&dir->ring_lock);
 
-	inode = find_inode(dev, ino);
-	if (inode)
-		return inode;
-	return create_inode(dev, ino);
+wake:
+	schedule_work(&dir->wake_work);
 }
 
-static void inode_set_wd(struct uk_inode *inode, int wd)
+/* filters of the recursive watches covering the subdirectories of a watch, change_lock held */
+static unsigned int subtree_filter(struct change_watch *watch)
 {
-	if (inode->wd != -1)
-		list_remove(&inode->wd_entry);
-	inode->wd = wd;
-	list_add_before(&wd_hash[wd % HASH_SIZE], &inode->wd_entry);
+	unsigned int filter = 0;
+	struct dir *dir;
+
+	for (; watch; watch = watch->parent)
+		list_for_each_entry(dir, &watch->dirs, in_entry)
+			if (dir->subtree)
+				filter |= dir->filter;
+	return filter;
 }
 
-static void inode_set_name(struct uk_inode *inode, const char *name)
+/* is the watch still needed by a handle on it or a recursive one above, change_lock held */
+static int watch_is_needed(struct change_watch *watch)
 {
-	free (inode->name);
-	inode->name = name ? strdup(name) : NULL;
+	return !list_empty(&watch->dirs) || subtree_filter(watch->parent);
 }
 
-static void free_inode(struct uk_inode *inode)
+/* unlink a watch from the tree and its handles, change_lock held */
+static void detach_watch(struct change_watch *watch)
 {
-	int subtree = 0, watches = 0;
-	struct uk_inode *tmp, *next;
-	struct dir *dir;
-
-	list_for_each_entry(dir, &inode->dirs, in_entry) {
-		subtree |= dir->subtree;
-		watches++;
-	}
-
-	if (!subtree && !inode->parent) {
-		list_for_each_entry_safe(tmp, next, &inode->children, ch_entry) {
-			free_inode(tmp);
-		}
-	}
+	struct change_watch *child, *next;
+	struct dir *dir, *dir_next;
 
-	if (watches)
+	if (watch->dead)
 		return;
+	watch->dead = 1;
 
-	if (inode->parent)
-		list_del(&inode->ch_entry);
-
-	/* disconnect remaining children from the parent */
-	list_for_each_entry_safe(tmp, next, &inode->children, ch_entry) {
-		list_del(&tmp->ch_entry);
-		tmp->parent = NULL;
+	if (watch->parent) {
+		list_del(&watch->ch_entry);
+		watch->parent = NULL;
 	}
-
-	if (inode->wd != -1) {
-		inotify_remove_watch(get_unix_fd(inotify_fd), inode->wd);
-		list_del(&inode->wd_entry);
+	list_for_each_entry_safe(child, next, &watch->children, ch_entry) {
+		list_del(&child->ch_entry);
+		child->parent = NULL;
+	}
+	list_for_each_entry_safe(dir, dir_next, &watch->dirs, in_entry) {
+		list_del_init(&dir->in_entry);
+		dir->watch = NULL;
 	}
-	list_del(&inode->ino_entry);
-
-	free(inode->name);
-	free(inode);
 }
 
-static struct uk_inode *inode_add(struct uk_inode *parent,
-				dev_t dev, ino_t ino, const char *name)
+/* collect the watches of a subtree nobody needs anymore, change_lock held */
+static void collect_unneeded_watches(struct change_watch *watch, struct list_head *rm_list)
 {
-	struct uk_inode *inode;
-
-	inode = get_inode(dev, ino);
-	if (!inode)
-		return NULL;
-
-	if (!inode->parent) {
-		list_add_before(&parent->children, &inode->ch_entry);
-		inode->parent = parent;
-	}
-	inode_set_name(inode, name);
+	struct change_watch *child, *next;
 
-	return inode;
-}
+	if (watch->dead || watch_is_needed(watch))
+		return;
 
-static struct uk_inode *inode_from_name(struct uk_inode *inode, const char *name)
-{
-	struct uk_inode *i;
+	list_for_each_entry_safe(child, next, &watch->children, ch_entry)
+		collect_unneeded_watches(child, rm_list);
 
-	list_for_each_entry(i, &inode->children, ch_entry)
-		if (i->name && !strcmp(i->name, name))
-			return i;
-	return NULL;
+	detach_watch(watch);
+	get_inotify_watch(&watch->wdata);
+	list_add_tail(&watch->rm_entry, rm_list);
 }
 
-static int inotify_get_poll_events(struct fd *fd);
-static void inotify_poll_event(struct fd *fd, int event);
-
-static const struct fd_ops inotify_fd_ops =
+/* remove collected watches, change_mutex held */
+static void remove_watches(struct list_head *rm_list)
 {
-	inotify_get_poll_events,     /* get_poll_events */
-	inotify_poll_event,          /* poll_event */
-	NULL,                        /* flush */
-	NULL,                        /* get_fd_type */
-	NULL,                        /* ioctl */
-	NULL,                        /* queue_async */
-	NULL,                        /* reselect_async */
-	NULL,                        /* cancel_async */
-};
+	struct change_watch *watch, *next;
 
-static int inotify_get_poll_events(struct fd *fd)
-{
-	return POLLIN;
+	list_for_each_entry_safe(watch, next, rm_list, rm_entry) {
+		list_del(&watch->rm_entry);
+		inotify_rm_watch(change_ih, &watch->wdata);
+		put_inotify_watch(&watch->wdata);
+	}
 }
 
-static void inotify_do_change_notify(struct dir *dir, unsigned int action,
-				const char *relpath)
+/* find or create the watch of an inode, returns it with a reference, change_mutex held */
+static struct change_watch *get_watch(struct inode *inode, unsigned int filter)
 {
-	struct change_record *record;
-
-	if (dir->want_data) {
-		size_t len = strlen(relpath);
-		record = malloc(offsetof(struct change_record, name[len]));
-		if (!record)
-			return;
-
-		record->action = action;
-		memcpy(record->name, relpath, len);
-		record->len = len;
+	struct inotify_watch *wdata;
+	struct change_watch *watch;
+	u32 mask = map_flags(filter);
 
-		list_add_before(&dir->change_records, &record->entry);
+	if (inotify_find_watch(change_ih, inode, &wdata) >= 0) {
+		inotify_find_update_watch(change_ih, inode, mask | IN_MASK_ADD);
+		return container_of(wdata, struct change_watch, wdata);
 	}
 
-	fd_async_wake_up(dir->fd, ASYNC_TYPE_WAIT, STATUS_ALERTED);
+	watch = kmalloc(sizeof(*watch), GFP_KERNEL);
+	if (!watch)
+		return NULL;
+	INIT_LIST_HEAD(&watch->dirs);
+	INIT_LIST_HEAD(&watch->children);
+	watch->parent = NULL;
+	watch->dead = 0;
+	watch->name = NULL;
+
+	/* the initial reference is dropped when inotify reports IN_IGNORED */
+	inotify_init_watch(&watch->wdata);
+	if (inotify_add_watch(change_ih, &watch->wdata, inode, mask) < 0) {
+		kfree(watch);
+		return NULL;
+	}
+	get_inotify_watch(&watch->wdata);
+	return watch;
 }
 
-static unsigned int filter_from_event(struct inotify_event *ie)
+/* hang the watch of a subdirectory under its parent, change_lock held, returns the name if unused */
+static char *link_subdir_watch(struct change_watch *parent, struct change_watch *watch, char *name)
 {
-	unsigned int filter = 0;
+	if (watch->dead || watch->parent || watch == parent || parent->dead)
+		return name;
 
-	if (ie->mask & (IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE | IN_CREATE))
-		filter |= FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME;
-	if (ie->mask & IN_MODIFY)
-		filter |= FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE;
-	if (ie->mask & IN_ATTRIB)
-		filter |= FILE_NOTIFY_CHANGE_ATTRIBUTES | FILE_NOTIFY_CHANGE_SECURITY;
-	if (ie->mask & IN_ACCESS)
-		filter |= FILE_NOTIFY_CHANGE_LAST_ACCESS;
-	if (ie->mask & IN_CREATE)
-		filter |= FILE_NOTIFY_CHANGE_CREATION;
-
-	return filter;
+	watch->parent = parent;
+	list_add_tail(&watch->ch_entry, &parent->children);
+	kfree(watch->name);
+	watch->name = name;
+	return NULL;
 }
 
-/* scan up the parent directories for watches */
-static unsigned int filter_from_inode(struct uk_inode *inode, int is_parent)
+/* mount of a recursive handle at or above a watch, change_lock held */
+static struct vfsmount *get_subtree_mnt(struct change_watch *watch)
 {
-	unsigned int filter = 0;
+	struct file *file;
 	struct dir *dir;
 
-	/* combine filters from parents watching subtrees */
-	while (inode) {
-		list_for_each_entry(dir, &inode->dirs, in_entry)
-			if (dir->subtree || !is_parent)
-				filter |= dir->filter;
-		is_parent = 1;
-		inode = inode->parent;
-	}
-
-	return filter;
+	for (; watch; watch = watch->parent)
+		list_for_each_entry(dir, &watch->dirs, in_entry)
+			if (dir->subtree && (file = get_unix_file(dir->fd)))
+				return mntget(file->f_path.mnt);
+	return NULL;
 }
 
-static char *inode_get_path(struct uk_inode *inode, int sz)
+static int subdir_filldir(void *ptr, const char *name, int len, loff_t offset, u64 ino, unsigned int d_type)
 {
-	struct list_head *head;
-	char *path;
-	int len;
+	struct list_head *names = ptr;
+	struct subdir_name *sn;
 
-	if (!inode)
-		return NULL;
-
-	head = ((&inode->dirs)->next == &inode->dirs) ? NULL : (&inode->dirs)->next;
-	if (head) {
-		int unix_fd = get_unix_fd(LIST_ENTRY(head, struct dir, in_entry)->fd);
-		path = malloc (32 + sz);
-		if (path)
-			sprintf(path, "/proc/self/fd/%u/", unix_fd);
-		return path;
-	}
+	if (d_type != DT_DIR && d_type != DT_UNKNOWN)
+		return 0;
+	if (name[0] == '.' && (len == 1 || (len == 2 && name[1] == '.')))
+		return 0;
+	if (!(sn = kmalloc(offsetof(struct subdir_name, name[len + 1]), GFP_KERNEL)))
+		return -ENOMEM;
+	memcpy(sn->name, name, len);
+	sn->name[len] = 0;
+	list_add_tail(&sn->entry, names);
+	return 0;
+}
 
-	if (!inode->name)
-		return NULL;
+static struct subdir_scan *alloc_subdir_scan(struct change_watch *watch, struct path *path,
+		const struct cred *cred)
+{
+	struct subdir_scan *scan;
 
-	len = strlen(inode->name);
-	path = inode_get_path(inode->parent, sz + len + 1);
-	if (!path)
+	if (!(scan = kmalloc(sizeof(*scan), GFP_KERNEL)))
 		return NULL;
-
-	strcat(path, inode->name);
-	strcat(path, "/");
-
-	return path;
+	get_inotify_watch(&watch->wdata);
+	scan->watch = watch;
+	scan->path = *path;
+	path_get(&scan->path);
+	scan->cred = get_cred(cred);
+	return scan;
 }
 
-static int inode_check_dir(struct uk_inode *parent, const char *name)
-{
-	char *path;
+/*
+ * watch the subdirectories already present under a recursive watch, a
+ * directory at a time so that events flow meanwhile, change_mutex is only
+ * taken to hook up each new watch, consumes the scan
+ */
+static void watch_subdirs(struct subdir_scan *scan)
+{
+	struct subdir_scan *sub;
+	struct subdir_name *sn, *sn_next;
+	struct change_watch *watch;
+	const struct cred *old_cred;
+	struct nameidata nd;
+	struct file *file;
+	LIST_HEAD(scan_list);
+	LIST_HEAD(names);
+	LIST_HEAD(rm_list);
 	unsigned int filter;
-	struct uk_inode *inode;
-	struct stat st;
-	int wd = -1, r = -1;
-
-	path = inode_get_path(parent, strlen(name));
-	if (!path)
-		return r;
+	int linked;
+	char *name;
+
+	/* breadth first, so that deep trees don't eat up the stack */
+	list_add_tail(&scan->entry, &scan_list);
+	while (!list_empty(&scan_list)) {
+		scan = list_first_entry(&scan_list, struct subdir_scan, entry);
+		list_del(&scan->entry);
+
+		/* stop descending once the recursive handles are gone */
+		spin_lock(&change_lock);
+		filter = scan->watch->dead ? 0 : subtree_filter(scan->watch);
+		spin_unlock(&change_lock);
+
+		/* the walk runs on the workqueue, but only sees what the requester may */
+		old_cred = override_creds(scan->cred);
+
+		/* the names are looked up once the directory lock is released */
+		if (filter) {
+			file = dentry_open(dget(scan->path.dentry), mntget(scan->path.mnt),
+					O_RDONLY | O_DIRECTORY, scan->cred);
+			if (!IS_ERR(file)) {
+				vfs_readdir(file, subdir_filldir, &names);
+				fput(file);
+			}
+		}
 
-	strcat(path, name);
+		list_for_each_entry_safe(sn, sn_next, &names, entry) {
+			list_del(&sn->entry);
+			if (vfs_path_lookup(scan->path.dentry, scan->path.mnt, sn->name, 0, &nd))
+				goto free_name;
+			if (!S_ISDIR(nd.path.dentry->d_inode->i_mode) || !(name = kstrdup(sn->name, GFP_KERNEL)))
+				goto put_path;
+
+			mutex_lock(&change_mutex);
+			if (!(watch = get_watch(nd.path.dentry->d_inode, filter))) {
+				mutex_unlock(&change_mutex);
+				kfree(name);
+				goto put_path;
+			}
+			spin_lock(&change_lock);
+			name = link_subdir_watch(scan->watch, watch, name);
+			linked = (watch->parent == scan->watch);
+			collect_unneeded_watches(watch, &rm_list);
+			spin_unlock(&change_lock);
+			remove_watches(&rm_list);
+			mutex_unlock(&change_mutex);
+
+			if (linked && (sub = alloc_subdir_scan(watch, &nd.path, scan->cred)))
+				list_add_tail(&sub->entry, &scan_list);
+			kfree(name);
+			put_inotify_watch(&watch->wdata);
+put_path:
+			path_put(&nd.path);
+free_name:
+			kfree(sn);
+		}
 
-	r = stat(path, &st);
-	if (r < 0)
-		goto end;
+		revert_creds(old_cred);
 
-	if (!S_ISDIR(st.st_mode)) {
-		r = 0;
-		goto end;
+		put_inotify_watch(&scan->watch->wdata);
+		path_put(&scan->path);
+		put_cred(scan->cred);
+		kfree(scan);
 	}
-
-	r = 1;
-
-	filter = filter_from_inode(parent, 1);
-	if (!filter)
-		goto end;
-
-	inode = inode_add(parent, st.st_dev, st.st_ino, name);
-	if (!inode || inode->wd != -1)
-		goto end;
-
-	wd = inotify_add_dir(path, filter);
-	if (wd != -1)
-		inode_set_wd(inode, wd);
-	else
-		free_inode(inode);
-
-end:
-	free(path);
-	return r;
 }
 
-static int prepend(char **path, const char *segment)
+static void subdir_scan_work(struct work_struct *work)
 {
-	int extra;
-	char *p;
-
-	extra = strlen(segment) + 1;
-	if (*path) {
-		int len = strlen(*path) + 1;
-		p = realloc(*path, len + extra , len);
-		if (!p)
-			return 0;
-		memmove(&p[ extra ], p, len);
-		p[extra - 1] = '/';
-		memcpy(p, segment, extra - 1);
-	}
-	else {
-		p = malloc(extra);
-		if (!p)
-			return 0;
-		memcpy(p, segment, extra);
-	}
-
-	*path = p;
-
-	return 1;
+	watch_subdirs(container_of(work, struct subdir_scan, work));
 }
 
-static void inotify_notify_all(struct inotify_event *ie)
+static void add_subdir_watch(struct work_struct *work)
 {
-	unsigned int filter, action;
-	struct uk_inode *inode, *i;
-	char *path = NULL;
-	struct dir *dir;
-
-	inode = inode_from_wd(ie->wd);
-	if (!inode) {
-		ktrace("no inode matches %d\n", ie->wd);
-		return;
-	}
-
-	filter = filter_from_event(ie);
-
-	if (ie->mask & IN_CREATE) {
-		switch (inode_check_dir(inode, ie->name)) {
-			case 1:
-				filter &= ~FILE_NOTIFY_CHANGE_FILE_NAME;
-				break;
-			case 0:
-				filter &= ~FILE_NOTIFY_CHANGE_DIR_NAME;
-				break;
-			default:
-				break;
-				/* Maybe the file disappeared before we could check it? */
+	struct change_work *cw = container_of(work, struct change_work, work);
+	struct change_watch *parent = cw->watch, *watch;
+	struct subdir_scan *scan = NULL;
+	struct vfsmount *mnt = NULL;
+	LIST_HEAD(rm_list);
+	unsigned int filter;
+	struct path path;
+	char *name;
+
+	name = kstrdup(cw->name, GFP_KERNEL);
+
+	mutex_lock(&change_mutex);
+	spin_lock(&change_lock);
+	filter = parent->dead ? 0 : subtree_filter(parent);
+	spin_unlock(&change_lock);
+
+	if (filter && name && (watch = get_watch(cw->inode, filter))) {
+		spin_lock(&change_lock);
+		name = link_subdir_watch(parent, watch, name);
+		if (watch->parent == parent)
+			mnt = get_subtree_mnt(parent);
+		collect_unneeded_watches(watch, &rm_list);
+		spin_unlock(&change_lock);
+
+		/* a directory moved in may have subdirectories already */
+		if (mnt) {
+			if ((path.dentry = d_find_alias(cw->inode))) {
+				path.mnt = mnt;
+				scan = alloc_subdir_scan(watch, &path, current_cred());
+				dput(path.dentry);
+			}
+			mntput(mnt);
 		}
-		action = FILE_ACTION_ADDED;
-	}
-	else if (ie->mask & IN_DELETE)
-		action = FILE_ACTION_REMOVED;
-	else
-		action = FILE_ACTION_MODIFIED;
-
-	/*
-	 * Work our way up the inode hierarchy
-	 *  extending the relative path as we go
-	 *  and notifying all recursive watches.
-	 */
-	if (!prepend(&path, ie->name))
-		return;
-
-	for (i = inode; i; i = i->parent) {
-		list_for_each_entry(dir, &i->dirs, in_entry)
-			if ((filter & dir->filter) && (i == inode || dir->subtree))
-				inotify_do_change_notify(dir, action, path);
-
-		if (!i->name || !prepend(&path, i->name))
-			break;
+		put_inotify_watch(&watch->wdata);
+		remove_watches(&rm_list);
 	}
+	mutex_unlock(&change_mutex);
 
-	free(path);
+	/* already on the change workqueue, walk them right away */
+	if (scan)
+		watch_subdirs(scan);
 
-	if (ie->mask & IN_DELETE) {
-		i = inode_from_name(inode, ie->name);
-		if (i)
-			free_inode(i);
-	}
+	kfree(name);
+	put_inotify_watch(&parent->wdata);
+	iput(cw->inode);
+	kfree(cw);
 }
 
-static void inotify_poll_event(struct fd *fd, int event)
+/* a subdirectory appeared under a recursive watch, watch it too */
+static void queue_subdir_watch(struct change_watch *parent, struct inode *inode, const char *name)
 {
-	int r, ofs, unix_fd;
-	char buffer[0x1000];
-	struct inotify_event *ie;
-
-	unix_fd = get_unix_fd(fd);
-	r = read(unix_fd, buffer, sizeof buffer);
-	if (r < 0) {
-		ktrace("inotify read failed!\n");
-		return;
-	}
+	struct change_work *cw;
 
-	for(ofs = 0; ofs < r - offsetof(struct inotify_event, name);) {
-		ie = (struct inotify_event*)&buffer[ofs];
-		if (!ie->len)
-			break;
-		ofs += offsetof(struct inotify_event, name[ie->len]);
-		if (ofs > r)
-			break;
-		inotify_notify_all(ie);
+	cw = kmalloc(offsetof(struct change_work, name[strlen(name) + 1]), GFP_NOFS);
+	if (!cw)
+		return;
+	if (!(cw->inode = igrab(inode))) {
+		kfree(cw);
+		return;
 	}
+	get_inotify_watch(&parent->wdata);
+	cw->watch = parent;
+	strcpy(cw->name, name);
+	INIT_WORK(&cw->work, add_subdir_watch);
+	queue_work(change_wq, &cw->work);
 }
 
-static inline struct fd *create_inotify_fd(void)
+static void drop_subdir_watch(struct work_struct *work)
 {
-	int unix_fd;
+	struct change_work *cw = container_of(work, struct change_work, work);
+	LIST_HEAD(rm_list);
 
-	unix_fd = inotify_init();
-	if (unix_fd<0)
-		return NULL;
-	return create_anonymous_fd(&inotify_fd_ops, unix_fd, NULL, 0);
+	mutex_lock(&change_mutex);
+	spin_lock(&change_lock);
+	collect_unneeded_watches(cw->watch, &rm_list);
+	spin_unlock(&change_lock);
+	remove_watches(&rm_list);
+	mutex_unlock(&change_mutex);
+
+	put_inotify_watch(&cw->watch->wdata);
+	kfree(cw);
 }
 
-static int map_flags(unsigned int filter)
+/* a subdirectory was moved away, unlink its watch until it shows up again, change_lock held */
+static void unlink_subdir_watch(struct change_watch *parent, const char *name, struct change_work *cw)
 {
-	unsigned int mask;
-
-	/* always watch these so we can track subdirectories in recursive watches */
-	mask = (IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE | IN_CREATE | IN_DELETE_SELF);
+	struct change_watch *watch;
 
-	if (filter & FILE_NOTIFY_CHANGE_ATTRIBUTES)
-		mask |= IN_ATTRIB;
-	if (filter & FILE_NOTIFY_CHANGE_SIZE)
-		mask |= IN_MODIFY;
-	if (filter & FILE_NOTIFY_CHANGE_LAST_WRITE)
-		mask |= IN_MODIFY;
-	if (filter & FILE_NOTIFY_CHANGE_LAST_ACCESS)
-		mask |= IN_ACCESS;
-	if (filter & FILE_NOTIFY_CHANGE_SECURITY)
-		mask |= IN_ATTRIB;
-
-	return mask;
+	list_for_each_entry(watch, &parent->children, ch_entry) {
+		if (!watch->name || strcmp(watch->name, name))
+			continue;
+		list_del(&watch->ch_entry);
+		watch->parent = NULL;
+		kfree(watch->name);
+		watch->name = NULL;
+
+		/* the watches nobody needs anymore can only be removed outside of the callback */
+		get_inotify_watch(&watch->wdata);
+		cw->watch = watch;
+		cw->inode = NULL;
+		INIT_WORK(&cw->work, drop_subdir_watch);
+		queue_work(change_wq, &cw->work);
+		return;
+	}
+	kfree(cw);
 }
 
-static int inotify_add_dir(char *path, unsigned int filter)
+/* called by inotify in the context of the task changing the directory */
+static void change_handle_event(struct inotify_watch *wdata, u32 wd, u32 mask,
+		u32 cookie, const char *name, struct inode *inode)
 {
-	int wd = inotify_add_watch(get_unix_fd(inotify_fd),
-			path, map_flags(filter));
-	if (wd != -1)
-		set_fd_events(inotify_fd, POLLIN);
-	return wd;
-}
+	struct change_watch *watch = container_of(wdata, struct change_watch, wdata), *w;
+	struct change_work *cw = NULL;
+	unsigned int filter, action;
+	char *path, *end, *p;
+	int len, subtree = 0;
+	struct dir *dir;
 
-static int init_inotify(void)
-{
-	int i;
+	if (mask & IN_IGNORED) {
+		spin_lock(&change_lock);
+		detach_watch(watch);
+		spin_unlock(&change_lock);
+		put_inotify_watch(wdata);
+		return;
+	}
 
-	if (inotify_fd)
-		return 1;
+	/* changes to the directory itself are reported by its parent */
+	if (!name)
+		return;
+	len = strlen(name);
+	if (len >= PATH_MAX)
+		return;
 
-	inotify_fd = create_inotify_fd();
-	if (!inotify_fd)
-		return 0;
+	filter = filter_from_event(mask);
+	action = action_from_event(mask);
 
-	for (i = 0; i < HASH_SIZE; i++) {
-		INIT_LIST_HEAD(&inode_hash[i]);
-		INIT_LIST_HEAD(&wd_hash[i]);
+	/* the relative path is built backwards from the end of the buffer */
+	if (!(path = kmalloc(PATH_MAX, GFP_NOFS)))
+		return;
+	end = path + PATH_MAX;
+	p = end - len;
+	memcpy(p, name, len);
+
+	if ((mask & IN_MOVED_FROM) && (mask & IN_ISDIR))
+		cw = kmalloc(sizeof(*cw), GFP_NOFS);
+
+	spin_lock(&change_lock);
+	for (w = watch; w; w = w->parent) {
+		list_for_each_entry(dir, &w->dirs, in_entry) {
+			subtree |= dir->subtree;
+			if ((w == watch || dir->subtree) && (filter & dir->filter))
+				queue_change_record(dir, action, p, end - p);
+		}
+		if (!w->parent || !w->name || p - path <= (int)strlen(w->name))
+			break;
+		*--p = '/';
+		p -= strlen(w->name);
+		memcpy(p, w->name, strlen(w->name));
 	}
+	/* the watch of a renamed subdirectory gets its new name and parent from IN_MOVED_TO */
+	if (cw)
+		unlink_subdir_watch(watch, name, cw);
+	spin_unlock(&change_lock);
+	kfree(path);
 
-	return 1;
+	if ((mask & (IN_CREATE | IN_MOVED_TO)) && (mask & IN_ISDIR) && subtree && inode)
+		queue_subdir_watch(watch, inode, name);
 }
 
-static int inotify_adjust_changes(struct dir *dir)
+static void change_destroy_watch(struct inotify_watch *wdata)
 {
-	unsigned int filter;
-	struct uk_inode *inode;
-	struct stat st;
-	char path[32];
-	int wd, unix_fd;
-
-	if (!inotify_fd)
-		return 0;
-
-	unix_fd = get_unix_fd(dir->fd);
-
-	inode = dir->inode;
-	if (!inode) {
-		/* check if this fd is already being watched */
-		if (-1 == fstat(unix_fd, &st))
-			return 0;
-
-		inode = get_inode(st.st_dev, st.st_ino);
-		if (!inode)
-			inode = create_inode(st.st_dev, st.st_ino);
-		if (!inode)
-			return 0;
-		list_add_before(&inode->dirs, &dir->in_entry);
-		dir->inode = inode;
-	}
-
-	filter = filter_from_inode(inode, 0);
-
-	sprintf(path, "/proc/self/fd/%u", unix_fd);
-	wd = inotify_add_dir(path, filter);
-	if (wd == -1)
-		return 0;
-
-	inode_set_wd(inode, wd);
+	struct change_watch *watch = container_of(wdata, struct change_watch, wdata);
 
-	return 1;
+	kfree(watch->name);
+	kfree(watch);
 }
 
-static char *get_basename(const char *link)
+/* hook a directory handle to the watch of its inode */
+static int attach_dir(struct dir *dir)
 {
-	char *buffer, *name = NULL;
-	int r, n = 0x100;
-
-	while (1) {
-		buffer = malloc(n);
-		if (!buffer)
-			return NULL;
+	struct file *file = get_unix_file(dir->fd);
+	struct subdir_scan *scan = NULL;
+	struct change_watch *watch;
+	struct inotify_handle *ih;
 
-		r = readlink(link, buffer, n);
-		if (r < 0)
-			break;
+	if (!file)
+		return 0;
 
-		if (r < n) {
-			name = buffer;
-			break;
+	mutex_lock(&change_mutex);
+	if (!change_wq)
+		change_wq = create_singlethread_workqueue("wine_change");
+	if (!change_ih && change_wq) {
+		ih = inotify_init(&change_inotify_ops);
+		if (!IS_ERR(ih))
+			change_ih = ih;
+	}
+	if (change_ih && (watch = get_watch(file->f_path.dentry->d_inode, dir->filter))) {
+		spin_lock(&change_lock);
+		if (!watch->dead) {
+			list_add_tail(&dir->in_entry, &watch->dirs);
+			dir->watch = watch;
 		}
-		free(buffer);
-		n *= 2;
+		spin_unlock(&change_lock);
+		if (dir->watch && dir->subtree)
+			scan = alloc_subdir_scan(watch, &file->f_path, current_cred());
+		put_inotify_watch(&watch->wdata);
 	}
+	mutex_unlock(&change_mutex);
 
-	if (name) {
-		while (r > 0 && name[r - 1] == '/')
-			r--;
-		name[r] = 0;
-
-		name = strrchr(name, '/');
-		if (name)
-			name = strdup(&name[1]);
+	/* the existing subtree is watched in the background, the request doesn't wait for it */
+	if (scan) {
+		INIT_WORK(&scan->work, subdir_scan_work);
+		queue_work(change_wq, &scan->work);
 	}
 
-	free(buffer);
-	return name;
+	return dir->watch != NULL;
 }
 
-static int dir_add_to_existing_notify(struct dir *dir)
+static void detach_dir(struct dir *dir)
 {
-	struct uk_inode *inode, *parent;
-	unsigned int filter = 0;
-	struct stat st, st_new;
-	char link[35], *name;
-	int wd, unix_fd;
-
-	if (!inotify_fd)
-		return 0;
-
-	unix_fd = get_unix_fd(dir->fd);
-
-	/* check if it's in the list of inodes we want to watch */
-	if (-1 == fstat(unix_fd, &st_new))
-		return 0;
-	inode = find_inode(st_new.st_dev, st_new.st_ino);
-	if (inode)
-		return 0;
+	LIST_HEAD(rm_list);
 
-	/* lookup the parent */
-	sprintf(link, "/proc/self/fd/%u/..", unix_fd);
-	if (-1 == stat(link, &st))
-		return 0;
-
-	/*
-	 * If there's no parent, stop.  We could keep going adding
-	 *  ../ to the path until we hit the root of the tree or
-	 *  find a recursively watched ancestor.
-	 * Assume it's too expensive to search up the tree for now.
-	 */
-	parent = find_inode(st.st_dev, st.st_ino);
-	if (!parent)
-		return 0;
-
-	if (parent->wd == -1)
-		return 0;
-
-	filter = filter_from_inode(parent, 1);
-	if (!filter)
-		return 0;
-
-	sprintf(link, "/proc/self/fd/%u", unix_fd);
-	name = get_basename(link);
-	if (!name)
-		return 0;
-	inode = inode_add(parent, st_new.st_dev, st_new.st_ino, name);
-	free(name);
-	if (!inode)
-		return 0;
-
-	/* Couldn't find this inode at the start of the function, must be new */
-	wd = inotify_add_dir(link, filter);
-	if (wd != -1)
-		inode_set_wd(inode, wd);
-
-	return 1;
+	mutex_lock(&change_mutex);
+	spin_lock(&change_lock);
+	if (dir->watch) {
+		list_del_init(&dir->in_entry);
+		collect_unneeded_watches(dir->watch, &rm_list);
+		dir->watch = NULL;
+	}
+	spin_unlock(&change_lock);
+	remove_watches(&rm_list);
+	mutex_unlock(&change_mutex);
 }
 
-#else
-
-static int init_inotify(void)
+void exit_change_notify(void)
 {
-	return 0;
+	if (change_wq) {
+		destroy_workqueue(change_wq);
+		change_wq = NULL;
+	}
+	flush_scheduled_work();
+	if (change_ih) {
+		inotify_destroy(change_ih);
+		change_ih = NULL;
+	}
 }
 
-static int inotify_adjust_changes(struct dir *dir)
+static void dir_destroy(struct object *obj)
 {
-	return 0;
-}
+	struct dir *dir = (struct dir *)obj;
 
-static void free_inode(struct uk_inode *inode)
-{
-	assert(0);
-}
+	detach_dir(dir);
+	cancel_work_sync(&dir->wake_work);
 
-static int dir_add_to_existing_notify(struct dir *dir)
-{
-	return 0;
-}
+	while (dir->ring_count) {
+		kfree(dir->ring[dir->ring_head]);
+		dir->ring_head = (dir->ring_head + 1) % CHANGE_RING_SIZE;
+		dir->ring_count--;
+	}
 
-#endif  /* USE_INOTIFY */
+	release_object(dir->fd);
+}
 
 struct object *create_dir_obj(struct fd *fd)
 {
@@ -991,17 +808,20 @@ struct object *create_dir_obj(struct fd *fd)
 		return NULL;
 
 	INIT_DISP_HEADER(&dir->obj.header, _DIR, sizeof(struct dir) / sizeof(ULONG), 0);
-	INIT_LIST_HEAD(&dir->change_records);
 	dir->filter = 0;
-	dir->notified = 0;
 	dir->want_data = 0;
-	dir->inode = NULL;
+	dir->subtree = 0;
+	dir->watch = NULL;
+	INIT_LIST_HEAD(&dir->in_entry);
+	INIT_WORK(&dir->wake_work, dir_wake_work);
+	spin_lock_init(&dir->ring_lock);
+	dir->ring_head = 0;
+	dir->ring_count = 0;
+	dir->overflow = 0;
 	grab_object(fd);
 	dir->fd = fd;
 	set_fd_user(fd, &dir_fd_ops, &dir->obj);
 
-	dir_add_to_existing_notify(dir);
-
 	return &dir->obj;
 }
 
@@ -1027,21 +847,16 @@ DECL_HANDLER(read_directory_changes)
 
 	/* assign it once */
 	if (!dir->filter) {
-		init_inotify();
-		insert_change(dir);
 		dir->filter = req->filter;
 		dir->subtree = req->subtree;
 		dir->want_data = req->want_data;
+		attach_dir(dir);
 	}
 
 	/* if there's already a change in the queue, send it */
-	if (!list_empty(&dir->change_records))
+	if (dir->ring_count || dir->overflow)
 		fd_async_wake_up(dir->fd, ASYNC_TYPE_WAIT, STATUS_ALERTED);
 
-	/* setup the real notification */
-	if (!inotify_adjust_changes(dir))
-		dnotify_adjust_changes(dir);
-
 	release_object(async);
 	set_error(STATUS_PENDING);
 
@@ -1049,23 +864,61 @@ end:
 	release_object(dir);
 }
 
+/* return as many pending changes as fit in the reply */
 DECL_HANDLER(read_change)
 {
-	struct change_record *record;
+	struct change_record *record, *list = NULL, **tail = &list;
+	struct filesystem_event *event;
+	data_size_t size = 0, event_size, max_size = get_reply_max_size();
 	struct dir *dir;
+	int overflow;
+	char *data;
 
 	ktrace("\n");
 	dir = get_dir_obj(get_current_w32process(), req->handle, 0);
 	if (!dir)
 		return;
 
-	if ((record = get_first_change_record(dir)) != NULL) {
-		reply->action = record->action;
-		set_reply_data(record->name, record->len);
-		free(record);
+	spin_lock(&dir->ring_lock);
+	overflow = dir->overflow;
+	dir->overflow = 0;
+	while (dir->ring_count) {
+		record = dir->ring[dir->ring_head];
+		event_size = (offsetof(struct filesystem_event, name[record->len]) + 3) & ~3;
+		if (size + event_size > max_size) {
+			if (size)
+				break;
+			/* doesn't fit in an empty buffer either, lost like on overflow */
+			overflow = 1;
+		}
+		dir->ring_head = (dir->ring_head + 1) % CHANGE_RING_SIZE;
+		dir->ring_count--;
+		record->next = NULL;
+		*tail = record;
+		tail = &record->next;
+		size += event_size;
 	}
-	else
+	spin_unlock(&dir->ring_lock);
+
+	if (overflow)
+		set_error(STATUS_NOTIFY_ENUM_DIR);
+	else if (!size)
 		set_error(STATUS_NO_DATA_DETECTED);
+	else if ((data = set_reply_data_size(size))) {
+		memset(data, 0, size);
+		for (record = list; record; record = record->next) {
+			event = (struct filesystem_event *)data;
+			event->action = record->action;
+			event->len = record->len;
+			memcpy(event->name, record->name, record->len);
+			data += (offsetof(struct filesystem_event, name[record->len]) + 3) & ~3;
+		}
+	}
+
+	while ((record = list)) {
+		list = record->next;
+		kfree(record);
+	}
 
 	release_object(dir);
 }
@@ -35,11 +35,14 @@
 
 extern struct object_type *get_object_type(const struct unicode_str *name);
 
+/* the handlers of the port run concurrently, and add_completion is also
+ * called by kernel transfers, so the queue is locked */
 struct uk_completion
 {
 	struct object  obj;
 	struct list_head    queue;
 	unsigned int   depth;
+	spinlock_t     lock;       /* protects queue and depth */
 };
 
 static void completion_dump(struct object*, int);
@@ -130,6 +133,7 @@ static int completion_signaled(struct object *obj, struct w32thread *thread)
 {
 	struct uk_completion *completion = (struct uk_completion *)obj;
 
+	/* a single read, it may be done with the dispatcher lock held */
 	return !list_empty(&completion->queue);
 }
 
@@ -144,6 +148,7 @@ static struct uk_completion *create_completion(struct directory *root,
 					sizeof(struct completion) / sizeof(ULONG), 0);
 			INIT_LIST_HEAD(&completion->queue);
 			completion->depth = 0;
+			spin_lock_init(&completion->lock);
 		}
 	}
 
@@ -167,8 +172,10 @@ void add_completion(struct uk_completion *completion, unsigned long ckey,
 	msg->cvalue = cvalue;
 	msg->status = status;
 	msg->information = information;
+	spin_lock(&completion->lock);
 	list_add_before(&completion->queue, &msg->queue_entry);
 	completion->depth++;
+	spin_unlock(&completion->lock);
 	uk_wake_up(&completion->obj, 1);
 }
 
@@ -241,12 +248,16 @@ DECL_HANDLER(remove_completion)
 	if (!completion)
 		return;
 
-	entry = list_head(&completion->queue);
+	spin_lock(&completion->lock);
+	if ((entry = list_head(&completion->queue))) {
+		list_del(entry);
+		completion->depth--;
+	}
+	spin_unlock(&completion->lock);
+
 	if (!entry)
 		set_error(STATUS_PENDING);
 	else {
-		list_del(entry);
-		completion->depth--;
 		msg = LIST_ENTRY(entry, struct comp_msg, queue_entry);
 		reply->ckey = msg->ckey;
 		reply->cvalue = msg->cvalue;
@@ -31,130 +31,224 @@
 #include "win32.h"
 #include <asm/page.h>
 #include <asm/pgtable.h>
+#include <linux/rbtree.h>
 
 #ifdef CONFIG_UNIFIED_KERNEL
 
+/*
+ * Areas of a process are kept in two rb-trees (reserved and mapped) ordered
+ * by start address.  Areas of one tree may nest (MEM_SYSTEM registrations),
+ * so every node also caches the highest end address found in its subtree,
+ * which lets a lookup skip subtrees that can't contain the address.
+ */
 struct win32_area_struct {
-	struct list_head	wa_list;
+	struct rb_node	wa_node;
+	struct rb_root	*wa_root;
 	unsigned long	start;
 	unsigned long	end;
+	unsigned long	subtree_end;
 	unsigned long	prot;
 	void	*section_object;
 };
 
-static inline void insert_win32_area(struct list_head *head, unsigned long start,
-		unsigned long end, unsigned long prot, void *object)
+#define rb_to_area(node)	rb_entry(node, struct win32_area_struct, wa_node)
+
+static inline unsigned long area_subtree_end(struct rb_node *node)
 {
-	struct list_head	*pos;
-	struct win32_area_struct	*wa;
+	return node ? rb_to_area(node)->subtree_end : 0;
+}
 
-	if (list_empty(head)) {
-		pos = head;
-		goto ready;
-	}
+static inline void area_update_end(struct rb_node *node)
+{
+	struct win32_area_struct	*wa = rb_to_area(node);
+	unsigned long	end = wa->end;
 
-	list_for_each(pos, head) {
-		wa = list_entry(pos, struct win32_area_struct, wa_list);
-		if (wa->start >= end)
+	if (area_subtree_end(node->rb_left) > end)
+		end = area_subtree_end(node->rb_left);
+	if (area_subtree_end(node->rb_right) > end)
+		end = area_subtree_end(node->rb_right);
+	wa->subtree_end = end;
+}
+
+/* refresh subtree_end from node up to the root, including the siblings
+ * that a rotation may have moved off the path */
+static inline void area_update_path(struct rb_node *node)
+{
+	struct rb_node	*parent;
+
+	while (node) {
+		area_update_end(node);
+		parent = rb_parent(node);
+		if (!parent)
 			break;
+		if (node == parent->rb_left && parent->rb_right)
+			area_update_end(parent->rb_right);
+		else if (node == parent->rb_right && parent->rb_left)
+			area_update_end(parent->rb_left);
+		node = parent;
 	}
+}
+
+static inline void insert_win32_area(struct rb_root *root, unsigned long start,
+		unsigned long end, unsigned long prot, void *object)
+{
+	struct rb_node	**link = &root->rb_node, *parent = NULL;
+	struct win32_area_struct	*wa;
 
-ready:
 	wa = kmalloc(sizeof(struct win32_area_struct), GFP_KERNEL);
+	if (!wa)
+		return;
+	wa->wa_root = root;
 	wa->start = start;
 	wa->end = end;
+	wa->subtree_end = end;
 	wa->prot = prot;
 	if (object)
 		ref_object(object);
 	wa->section_object = object;
-	list_add_tail(&wa->wa_list, pos);
+
+	while (*link) {
+		parent = *link;
+		if (start < rb_to_area(parent)->start)
+			link = &parent->rb_left;
+		else
+			link = &parent->rb_right;
+	}
+
+	rb_link_node(&wa->wa_node, parent, link);
+	rb_insert_color(&wa->wa_node, root);
+	if (wa->wa_node.rb_left)
+		area_update_path(wa->wa_node.rb_left);
+	else if (wa->wa_node.rb_right)
+		area_update_path(wa->wa_node.rb_right);
+	else
+		area_update_path(&wa->wa_node);
 }
 
-static inline struct win32_area_struct *find_win32_area(
-		struct list_head *head, unsigned long start, unsigned long end)
+/* lowest area containing [start, end] in the subtree of node */
+static inline struct win32_area_struct *__find_win32_area(
+		struct rb_node *node, unsigned long start, unsigned long end)
 {
-	struct list_head	*pos;
-	struct win32_area_struct	*wa;
+	struct win32_area_struct	*wa, *found;
 
-	if (list_empty(head))
-		return NULL;
-
-	list_for_each(pos, head) {
-		wa = list_entry(pos, struct win32_area_struct, wa_list);
-		if (wa->start <= start && wa->end >= end && wa->end > start)
+	while (node) {
+		wa = rb_to_area(node);
+		if (wa->subtree_end < end || wa->subtree_end <= start)
+			return NULL;
+		if (node->rb_left && (found = __find_win32_area(node->rb_left, start, end)))
+			return found;
+		if (wa->start > start)
+			return NULL;
+		if (wa->end >= end && wa->end > start)
 			return wa;
+		node = node->rb_right;
 	}
 
 	return NULL;
 }
 
+static inline struct win32_area_struct *find_win32_area(
+		struct rb_root *root, unsigned long start, unsigned long end)
+{
+	return __find_win32_area(root->rb_node, start, end);
+}
+
 static inline void remove_win32_area(struct win32_area_struct *wa)
 {
-	list_del(&wa->wa_list);
+	struct rb_node	*node = &wa->wa_node, *deepest;
+
+	/* the lowest node whose subtree changes once wa is erased */
+	if (!node->rb_left && !node->rb_right)
+		deepest = rb_parent(node);
+	else if (!node->rb_right)
+		deepest = node->rb_left;
+	else if (!node->rb_left)
+		deepest = node->rb_right;
+	else {
+		deepest = rb_next(node);
+		if (deepest->rb_right)
+			deepest = deepest->rb_right;
+		else if (rb_parent(deepest) != node)
+			deepest = rb_parent(deepest);
+	}
+
+	rb_erase(node, wa->wa_root);
+	area_update_path(deepest);
+
 	if (wa->section_object)
 		deref_object(wa->section_object);
 	kfree(wa);
 }
 
-static inline void remove_all_win32_area(struct list_head *head)
+static inline void remove_all_win32_area(struct rb_root *root)
 {
-	struct list_head	*pos = head->next;
+	struct rb_node	*node;
 	struct win32_area_struct	*wa;
 
-	while (pos != head) {
-		wa = list_entry(pos, struct win32_area_struct, wa_list);
-		remove_win32_area(wa);
-		pos = head->next;
+	while ((node = root->rb_node)) {
+		wa = rb_to_area(node);
+		rb_erase(node, root);
+		if (wa->section_object)
+			deref_object(wa->section_object);
+		kfree(wa);
 	}
 }
 
 static inline void insert_reserved_area(struct eprocess *process,
 		unsigned long start, unsigned long end, unsigned long prot)
 {
-	insert_win32_area(&process->ep_reserved_head, start, end, prot, NULL);
+	insert_win32_area(&process->ep_reserved_areas, start, end, prot, NULL);
 }
 
 static inline void insert_mapped_area(struct eprocess *process,
 		unsigned long start, unsigned long end, unsigned long prot, void *object)
 {
-	insert_win32_area(&process->ep_mapped_head, start, end, prot, object);
+	insert_win32_area(&process->ep_mapped_areas, start, end, prot, object);
 }
 
 static inline struct win32_area_struct *find_reserved_area(
 		struct eprocess *process, unsigned long start, unsigned long end)
 {
-	return find_win32_area(&process->ep_reserved_head, start, end);
+	return find_win32_area(&process->ep_reserved_areas, start, end);
 }
 
 static inline struct win32_area_struct *find_mapped_area(
 		struct eprocess *process, unsigned long start, unsigned long end)
 {
-	return find_win32_area(&process->ep_mapped_head, start, end);
+	return find_win32_area(&process->ep_mapped_areas, start, end);
 }
 
 /* address NOT in any reserved area and mapped area */
 static inline size_t get_free_area_size(struct eprocess *process, unsigned long address)
 {
-	struct list_head	*pos, *head;
-	struct win32_area_struct	*wa, *prev_wa = NULL;
+	struct rb_root	*root = &process->ep_reserved_areas;
+	struct rb_node	*node, *next;
+	struct win32_area_struct	*wa, *prev_wa;
 	int	ntry = 0;
 
-	head = &process->ep_reserved_head;
-
 retry:
-	if (list_empty(head))
+	if (RB_EMPTY_ROOT(root))
 		return 0;
 
-	list_for_each(pos, head) {
-		wa = list_entry(pos, struct win32_area_struct, wa_list);
-		if (wa->start > address)
-			return prev_wa ? (wa->start - prev_wa->end) : wa->start;
-		prev_wa = wa;
+	/* first area starting above address */
+	next = NULL;
+	node = root->rb_node;
+	while (node) {
+		if (rb_to_area(node)->start > address) {
+			next = node;
+			node = node->rb_left;
+		} else
+			node = node->rb_right;
+	}
+
+	if (next) {
+		wa = rb_to_area(next);
+		prev_wa = rb_prev(next) ? rb_to_area(rb_prev(next)) : NULL;
+		return prev_wa ? (wa->start - prev_wa->end) : wa->start;
 	}
 
 	if (!ntry) {
-		head = &process->ep_mapped_head;
-		prev_wa = NULL;
+		root = &process->ep_mapped_areas;
 		ntry++;
 		goto retry;
 	}
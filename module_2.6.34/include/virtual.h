@@ -144,6 +144,18 @@ NtReadVirtualMemory(IN HANDLE ProcessHandle,
 		IN ULONG NumberOfBytesToRead,
 		OUT PULONG NumberOfBytesRead OPTIONAL);
 
+NTSTATUS SERVICECALL
+NtReadVirtualMemoryVector(IN HANDLE ProcessHandle,
+		IN PVIRTUAL_MEMORY_VECTOR Vector,
+		IN ULONG Count,
+		OUT PULONG NumberOfBytesRead OPTIONAL);
+
+NTSTATUS SERVICECALL
+NtWriteVirtualMemoryVector(IN HANDLE ProcessHandle,
+		IN PVIRTUAL_MEMORY_VECTOR Vector,
+		IN ULONG Count,
+		OUT PULONG NumberOfBytesWritten OPTIONAL);
+
 NTSTATUS SERVICECALL
 NtFreeVirtualMemory(IN HANDLE ProcessHandle,
 		IN PVOID*  PBaseAddress,
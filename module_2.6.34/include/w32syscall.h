@@ -1494,5 +1494,17 @@ NtYieldExecution(VOID);
 NTSTATUS SERVICECALL
 NtWineService(PSERVER_REQUEST_INFO ReqMsg);
 
+NTSTATUS SERVICECALL
+NtReadVirtualMemoryVector(IN  HANDLE ProcessHandle,
+		IN  PVIRTUAL_MEMORY_VECTOR Vector,
+		IN  ULONG  Count,
+		OUT PULONG NumberOfBytesRead OPTIONAL);
+
+NTSTATUS SERVICECALL
+NtWriteVirtualMemoryVector(IN  HANDLE ProcessHandle,
+		IN  PVIRTUAL_MEMORY_VECTOR Vector,
+		IN  ULONG  Count,
+		OUT PULONG NumberOfBytesWritten OPTIONAL);
+
 #endif /* CONFIG_UNIFIED_KERNEL */
 #endif /* _W32SYSCALL_H */
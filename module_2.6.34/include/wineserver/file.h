@@ -67,6 +67,7 @@ extern struct fd *open_fd(const char *name, int flags, mode_t *mode, unsigned in
 extern void *get_fd_user(struct fd *fd);
 extern void set_fd_user(struct fd *fd, const struct fd_ops *ops, struct object *user);
 extern unsigned int get_fd_options(struct fd *fd);
+extern struct file *get_unix_file(struct fd *fd);
 extern int is_same_file_fd(struct fd *fd1, struct fd *fd2);
 extern int is_fd_removable(struct fd *fd);
 extern int fd_close_handle(struct object *obj, struct w32process *process, obj_handle_t handle);
@@ -123,8 +124,6 @@ extern int grow_file(struct uk_file *file, file_pos_t size);
 
 /* change notification functions */
 
-extern void do_change_notify(int unix_fd);
-extern void sigio_callback(void);
 extern struct object *create_dir_obj(struct fd *fd);
 
 /* serial port functions */
@@ -141,6 +140,10 @@ extern void async_set_timeout(struct async *async, timeout_t timeout, unsigned i
 extern int async_waiting(struct async_queue *queue);
 extern void async_terminate(struct async *async, unsigned int status);
 extern void async_wake_up(struct async_queue *queue, unsigned int status);
+extern void async_set_kernel_io(struct async *async, void *io);
+extern struct async *async_claim(struct async_queue *queue, void **io, struct task_struct **tsk);
+extern void async_unclaim(struct async *async);
+extern void async_complete(struct async *async, unsigned int status, unsigned long total);
 /* access rights that require Unix read permission */
 #define FILE_UNIX_READ_ACCESS (FILE_READ_DATA|FILE_READ_ATTRIBUTES|FILE_READ_EA)
 
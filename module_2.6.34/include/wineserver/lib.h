@@ -79,6 +79,7 @@ void *realloc(void *ptr, size_t new_size, size_t old_size);
 WCHAR toupperW(WCHAR ch);
 WCHAR tolowerW(WCHAR ch);
 int memicmpW(const WCHAR *str1, const WCHAR *str2, int n);
+unsigned int hash_nocase_strW(const WCHAR *str, data_size_t len);
 
 void no_flush(struct fd *fd, struct kevent **event);
 int no_add_queue(struct object *obj, struct wait_queue_entry *entry);
@@ -168,6 +168,92 @@ typedef struct
 	int  bottom;
 } rectangle_t;
 
+/* window state published read-only to the clients, indexed like the user handles */
+struct window_shared
+{
+	unsigned int   seq;           /* update sequence, odd while the entry is being written */
+	user_handle_t  handle;        /* full window handle, 0 if the entry is unused */
+	thread_id_t    tid;           /* thread owning the window */
+	process_id_t   pid;           /* process owning the window */
+	user_handle_t  parent;        /* parent window */
+	user_handle_t  owner;         /* owner window */
+	unsigned int   style;         /* window style */
+	unsigned int   ex_style;      /* window extended style */
+	rectangle_t    window;        /* window rectangle (relative to parent client area) */
+	rectangle_t    client;        /* client rectangle (relative to parent client area) */
+};
+
+/* user handle table entry published read-only to the clients */
+struct user_handle_shared
+{
+	unsigned short type;          /* object type (0 if free, 1 for windows, 2 for hooks) */
+	unsigned short generation;    /* generation counter, high word of the full handle */
+};
+
+/* directory change event returned by read_change */
+struct filesystem_event
+{
+	int            action;        /* FILE_ACTION_* */
+	data_size_t    len;           /* length of the name */
+	char           name[1];       /* path relative to the directory, padded to 4 bytes */
+};
+
+/* directory entry returned by read_directory */
+struct dir_entry_info
+{
+	file_pos_t     next_pos;      /* directory position of the following entry */
+	file_pos_t     size;          /* file size */
+	file_pos_t     blocks;        /* number of allocated 512-byte blocks */
+	int            atime;         /* Unix access, modification and change times */
+	int            mtime;
+	int            ctime;
+	unsigned int   mode;          /* Unix mode, 0 if the attributes are not available */
+	unsigned int   flags;         /* DIR_ENTRY_* flags */
+	data_size_t    len;           /* length of the name */
+	char           name[1];       /* name, null-terminated and padded to 8 bytes */
+};
+#define DIR_ENTRY_SYMLINK  0x01       /* entry is a symlink, attributes are those of the target */
+
+/* user buffer of an overlapped socket transfer */
+struct sock_iovec
+{
+	void           *base;         /* start of the buffer */
+	data_size_t     len;          /* length of the buffer */
+};
+
+/* process entry returned by next_processes */
+struct snapshot_process
+{
+	int            count;         /* process refcount */
+	process_id_t   pid;           /* process id */
+	process_id_t   ppid;          /* parent process id */
+	int            threads;       /* number of threads */
+	int            priority;      /* priority class */
+	int            handles;       /* number of handles */
+	data_size_t    namelen;       /* length of the exe file name */
+	WCHAR          name[1];       /* exe file name, padded to 4 bytes */
+};
+
+/* thread entry returned by next_threads */
+struct snapshot_thread
+{
+	int            count;         /* thread refcount */
+	process_id_t   pid;           /* owner process id */
+	thread_id_t    tid;           /* thread id */
+	int            base_pri;      /* base priority */
+	int            delta_pri;     /* delta priority */
+};
+
+/* performance counter calibration kept by the kernel in the user shared data page */
+#define USER_SHARED_QPC_OFFSET  0x800
+struct user_shared_qpc
+{
+	unsigned int       seq;       /* odd while the kernel updates the fields */
+	unsigned int       tsc_mult;  /* counter ticks per TSC cycle in 0.32 fixed point, 0 without a usable TSC */
+	unsigned long long tsc_base;  /* TSC value at the last rebase */
+	unsigned long long qpc_base;  /* counter value at tsc_base */
+};
+
 typedef struct
 {
 	void           *callback;
@@ -206,6 +292,21 @@ typedef struct
 	unsigned short attr;
 } char_info_t;
 
+/* shared view of a screen buffer, the header is followed by the width x height cells */
+struct screen_buffer_shared
+{
+	unsigned int   seq;           /* change count, bumped after each change of the cells */
+	int            stale;         /* set when the screen buffer was resized or destroyed */
+	int            width;         /* size of the cell matrix */
+	int            height;
+	unsigned int   dirty;         /* rows changed by the clients, top << 16 | bottom */
+	int            pending;       /* the clients' changes were signaled to the renderer */
+	unsigned short attr;          /* default attribute of the screen buffer */
+	unsigned short __pad;
+	char_info_t    cells[1];
+};
+#define SCREEN_BUFFER_CLEAN  0xffff0000  /* dirty value when no row changed */
+
 typedef struct
 {
 	unsigned int low_part;
@@ -1220,8 +1321,7 @@ struct read_change_request
 struct read_change_reply
 {
 	struct reply_header __header;
-	int          action;
-	/* VARARG(name,string); */
+	/* VARARG(events,filesystem_events); */
 };
 
 struct create_mapping_request
@@ -1975,6 +2075,7 @@ struct get_message_request
 	unsigned int    hw_id;
 	unsigned int    wake_mask;
 	unsigned int    changed_mask;
+	timeout_t       timeout;
 };
 
 struct get_message_reply
@@ -3696,6 +3797,111 @@ struct save_branch_reply
 	/*FIXME */
 }; 
 
+/* Map the shared user state into the current process */
+struct map_user_shared_request
+{
+	struct request_header __header;
+};
+struct map_user_shared_reply
+{
+	struct reply_header __header;
+	void*          windows;       /* window_shared entries of the thread desktop, or NULL */
+	void*          handles;       /* read-only array of user_handle_shared entries */
+};
+
+/* Read entries from a directory, along with their attributes */
+struct read_directory_request
+{
+	struct request_header __header;
+	obj_handle_t   handle;        /* handle to the directory */
+	unsigned int   flags;         /* READ_DIRECTORY_* flags */
+};
+struct read_directory_reply
+{
+	struct reply_header __header;
+	/* VARARG(entries,dir_entries); */
+};
+#define READ_DIRECTORY_NAMES_ONLY  0x01  /* don't retrieve the attributes */
+
+/* Queue an overlapped socket transfer done by the kernel into the given buffers */
+struct register_sock_io_request
+{
+	struct request_header __header;
+	obj_handle_t   handle;        /* socket handle */
+	int            type;          /* ASYNC_TYPE_READ or ASYNC_TYPE_WRITE */
+	unsigned int   flags;         /* recv/send flags */
+	async_data_t   async;         /* async I/O parameters */
+	/* VARARG(iov,sock_iovecs); */
+};
+struct register_sock_io_reply
+{
+	struct reply_header __header;
+};
+
+/* Map the shared view of a screen buffer into the current process */
+struct map_screen_buffer_request
+{
+	struct request_header __header;
+	obj_handle_t   handle;        /* handle to the screen buffer */
+	void*          unmap;         /* previous view to unmap, or NULL */
+};
+struct map_screen_buffer_reply
+{
+	struct reply_header __header;
+	void*          view;          /* the screen_buffer_shared view */
+	int            writable;      /* whether the view was mapped writable */
+};
+
+/* Tell the renderer about cells the clients changed in a shared view */
+struct notify_screen_buffer_request
+{
+	struct request_header __header;
+	obj_handle_t   handle;        /* handle to the screen buffer */
+};
+struct notify_screen_buffer_reply
+{
+	struct reply_header __header;
+};
+
+/* Get as many of the next processes of a snapshot as fit in the reply */
+struct next_processes_request
+{
+	struct request_header __header;
+	obj_handle_t   handle;        /* handle to the snapshot */
+	int            reset;         /* start from the first process */
+};
+struct next_processes_reply
+{
+	struct reply_header __header;
+	int            count;         /* number of entries returned */
+	/* VARARG(processes,snapshot_processes); */
+};
+
+/* Get as many of the next threads of a snapshot as fit in the reply */
+struct next_threads_request
+{
+	struct request_header __header;
+	obj_handle_t   handle;        /* handle to the snapshot */
+	int            reset;         /* start from the first thread */
+	process_id_t   pid;           /* only return threads of this process, 0 for all */
+};
+struct next_threads_reply
+{
+	struct reply_header __header;
+	int            count;         /* number of entries returned */
+	/* VARARG(threads,snapshot_threads); */
+};
+
+/* Map the kernel maintained user shared data page over USER_SHARED_DATA */
+struct map_user_shared_data_request
+{
+	struct request_header __header;
+};
+struct map_user_shared_data_reply
+{
+	struct reply_header __header;
+};
+
 enum request
 {
 	REQ_new_process,
@@ -3933,6 +4139,14 @@ enum request
 	REQ_add_fd_completion,
 	REQ_load_init_registry,
 	REQ_save_branch,
+	REQ_map_user_shared,
+	REQ_read_directory,
+	REQ_register_sock_io,
+	REQ_map_screen_buffer,
+	REQ_notify_screen_buffer,
+	REQ_next_processes,
+	REQ_next_threads,
+	REQ_map_user_shared_data,
 	REQ_NB_REQUESTS
 };
 
@@ -4146,6 +4360,14 @@ union generic_request
 	struct add_fd_completion_request add_fd_completion_request;
 	struct load_init_registry_request load_init_registry_request;
 	struct save_branch_request save_branch_request;
+	struct map_user_shared_request map_user_shared_request;
+	struct read_directory_request read_directory_request;
+	struct register_sock_io_request register_sock_io_request;
+	struct map_screen_buffer_request map_screen_buffer_request;
+	struct notify_screen_buffer_request notify_screen_buffer_request;
+	struct next_processes_request next_processes_request;
+	struct next_threads_request next_threads_request;
+	struct map_user_shared_data_request map_user_shared_data_request;
 };
 union generic_reply
 {
@@ -4357,9 +4579,17 @@ union generic_reply
 	struct add_fd_completion_reply add_fd_completion_reply;
 	struct load_init_registry_reply load_init_registry_reply;
 	struct save_branch_reply save_branch_reply;
+	struct map_user_shared_reply map_user_shared_reply;
+	struct read_directory_reply read_directory_reply;
+	struct register_sock_io_reply register_sock_io_reply;
+	struct map_screen_buffer_reply map_screen_buffer_reply;
+	struct notify_screen_buffer_reply notify_screen_buffer_reply;
+	struct next_processes_reply next_processes_reply;
+	struct next_threads_reply next_threads_reply;
+	struct map_user_shared_data_reply map_user_shared_data_reply;
 };
 
-#define SERVER_PROTOCOL_VERSION 341
+#define SERVER_PROTOCOL_VERSION 350
 
 #endif /* CONFIG_UNIFIED_KERNEL */
 #endif /* _WINESERVER_UK_PROTOCOL_H */
@@ -752,6 +752,7 @@ typedef struct tagRAWMOUSE {
 #define WM_PENWINFIRST      0x0380
 #define WM_PENWINLAST       0x038F
 
+#define WM_USER              0x0400
 #define WM_APP               0x8000
 
 #define UNICODE_NOCHAR       0xFFFF
@@ -0,0 +1,254 @@
+/*
+ * kuser.c
+ *
+ * Copyright (C) 2006  Insigme Co., Ltd
+ *
+ * This software has been developed while working on the Linux Unified Kernel
+ * project (http://www.longene.org) in the Insigma Research Institute,
+ * which is a subdivision of Insigma Co., Ltd (http://www.insigma.com.cn).
+ *
+ * The project is sponsored by Insigma Co., Ltd.
+ *
+ * The authors can be reached at linux@insigma.com.cn.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of  the GNU General  Public License as published by the
+ * Free Software Foundation; either version 2 of the  License, or (at your
+ * option) any later version.
+ *
+ * Revision History:
+ *   Oct 2026 - Created.
+ */
+
+/*
+ * kuser.c:
+ * the user shared data page, with its clock fields kept current by a timer
+ */
+#include <linux/anon_inodes.h>
+#include <linux/timer.h>
+#include <linux/math64.h>
+#include <asm/tsc.h>
+#include "handle.h"
+#include "virtual.h"
+
+#ifdef CONFIG_UNIFIED_KERNEL
+/*
+ * A single page is mapped read-only at USER_SHARED_DATA in every process,
+ * so GetTickCount, GetSystemTimeAsFileTime and QueryPerformanceCounter read
+ * it instead of asking the kernel.  Only the kernel writes it, it also
+ * fills the system directory and version fields ntdll used to store in its
+ * private copy.  The clock fields are refreshed at the Windows clock
+ * interval, and only while some process has the page mapped.
+ */
+
+#define QPC_FREQUENCY	1193182		/* what the clients report, see ntdll */
+#define KUSER_INTERVAL	msecs_to_jiffies(15)	/* about the Windows clock interval */
+
+static KUSER_SHARED_DATA *kuser_data;
+static struct user_shared_qpc *kuser_qpc;
+static struct file *kuser_file;
+static struct timer_list kuser_timer;
+static struct timespec kuser_start;	/* monotonic time of the first mapping */
+static unsigned long kuser_rebase;	/* jiffies of the next qpc rebase */
+static int kuser_users;			/* mappings of the page, the timer runs while there are some */
+static DEFINE_SPINLOCK(kuser_lock);	/* protects kuser_users and the timer */
+static DEFINE_MUTEX(kuser_mutex);	/* serializes the allocation of the page */
+
+static const WCHAR kuser_system_root[] = {'C',':','\\','w','i','n','d','o','w','s',0};
+
+static void set_ksystem_time(volatile KSYSTEM_TIME *time, ULONGLONG value)
+{
+	time->High2Time = value >> 32;
+	smp_wmb();
+	time->LowPart = (ULONG)value;
+	smp_wmb();
+	time->High1Time = value >> 32;
+}
+
+/* move the qpc base to the current TSC, before the product overflows;
+ * after the timer was stopped it is recomputed from the interrupt time */
+static void rebase_qpc(ULONGLONG interrupt_time, int restart)
+{
+	unsigned long long tsc;
+	u32 rem;
+
+	rdtscll(tsc);
+	kuser_qpc->seq++;
+	smp_wmb();
+	if (check_tsc_unstable())
+		kuser_qpc->tsc_mult = 0;  /* the clients fall back to the system time */
+	else if (restart)
+		kuser_qpc->qpc_base = div_u64_rem(interrupt_time, TICKS_PER_SEC, &rem) * QPC_FREQUENCY +
+			div_u64((ULONGLONG)rem * QPC_FREQUENCY, TICKS_PER_SEC);
+	else
+		kuser_qpc->qpc_base += ((tsc - kuser_qpc->tsc_base) * kuser_qpc->tsc_mult) >> 32;
+	kuser_qpc->tsc_base = tsc;
+	smp_wmb();
+	kuser_qpc->seq++;
+}
+
+static void update_kuser_fields(int restart)
+{
+	struct timespec now;
+	ULONGLONG interrupt_time, system_time, ticks;
+
+	getnstimeofday(&now);
+	system_time = (ULONGLONG)now.tv_sec * TICKS_PER_SEC + now.tv_nsec / 100 + TICKS_1601_TO_1970;
+
+	ktime_get_ts(&now);
+	now = timespec_sub(now, kuser_start);
+	interrupt_time = (ULONGLONG)now.tv_sec * TICKS_PER_SEC + now.tv_nsec / 100;
+	ticks = div_u64(interrupt_time, 10000);
+
+	set_ksystem_time(&kuser_data->InterruptTime, interrupt_time);
+	set_ksystem_time(&kuser_data->SystemTime, system_time);
+	set_ksystem_time(&kuser_data->u.TickCount, ticks);
+	kuser_data->TickCountLowDeprecated = (ULONG)ticks;
+
+	if (kuser_qpc->tsc_mult && (restart || time_after_eq(jiffies, kuser_rebase))) {
+		rebase_qpc(interrupt_time, restart);
+		kuser_rebase = jiffies + HZ;
+	}
+}
+
+static void update_kuser_time(unsigned long data)
+{
+	spin_lock(&kuser_lock);
+	if (kuser_users) {
+		update_kuser_fields(0);
+		mod_timer(&kuser_timer, jiffies + KUSER_INTERVAL);
+	}
+	spin_unlock(&kuser_lock);
+}
+
+/* the TSC only makes a performance counter if it runs at a constant rate on every cpu */
+static void init_kuser_qpc(void)
+{
+	kuser_qpc = (struct user_shared_qpc *)((char *)kuser_data + USER_SHARED_QPC_OFFSET);
+	if (!boot_cpu_has(X86_FEATURE_CONSTANT_TSC) || !boot_cpu_has(X86_FEATURE_NONSTOP_TSC) ||
+			!tsc_khz || check_tsc_unstable())
+		return;
+
+	kuser_qpc->tsc_mult = div64_u64((ULONGLONG)QPC_FREQUENCY << 32, tsc_khz * 1000ULL);
+	rdtscll(kuser_qpc->tsc_base);
+	kuser_qpc->qpc_base = 0;
+	kuser_rebase = jiffies + HZ;
+}
+
+/* the fields ntdll stored in its private copy, with the defaults of ntdll */
+static void init_kuser_system(void)
+{
+	memcpy(kuser_data->NtSystemRoot, kuser_system_root, sizeof(kuser_system_root));
+	kuser_data->NtProductType = 1;  /* VER_NT_WORKSTATION */
+	kuser_data->ProductTypeIsValid = TRUE;
+	kuser_data->MajorNtVersion = 5;
+	kuser_data->MinorNtVersion = 0;
+	kuser_data->SuiteMask = 0;
+}
+
+static void kuser_vma_open(struct vm_area_struct *vma)
+{
+	spin_lock_bh(&kuser_lock);
+	if (!kuser_users++) {
+		/* the fields went stale while nobody had the page mapped */
+		update_kuser_fields(1);
+		mod_timer(&kuser_timer, jiffies + KUSER_INTERVAL);
+	}
+	spin_unlock_bh(&kuser_lock);
+}
+
+static void kuser_vma_close(struct vm_area_struct *vma)
+{
+	spin_lock_bh(&kuser_lock);
+	if (!--kuser_users)
+		del_timer(&kuser_timer);
+	spin_unlock_bh(&kuser_lock);
+}
+
+static struct vm_operations_struct kuser_vm_ops =
+{
+	.open = kuser_vma_open,
+	.close = kuser_vma_close,
+};
+
+static int kuser_mmap(struct file *file, struct vm_area_struct *vma)
+{
+	int ret;
+
+	/* no process may write what all the others read */
+	if (vma->vm_flags & VM_WRITE)
+		return -EPERM;
+	vma->vm_flags &= ~VM_MAYWRITE;
+
+	if ((ret = remap_vmalloc_range(vma, kuser_data, vma->vm_pgoff)))
+		return ret;
+	vma->vm_ops = &kuser_vm_ops;
+	kuser_vma_open(vma);
+	return 0;
+}
+
+static const struct file_operations kuser_fops =
+{
+	.mmap = kuser_mmap,
+};
+
+/* allocate the page on first use, processes may start concurrently */
+static int init_user_shared_data(void)
+{
+	struct file *file;
+	int ret = 1;
+
+	mutex_lock(&kuser_mutex);
+	if (kuser_file)
+		goto out;
+	ret = 0;
+	if (!(kuser_data = vmalloc_user(PAGE_SIZE)))
+		goto out;
+	file = anon_inode_getfile("[win32_kuser]", &kuser_fops, NULL, O_RDONLY);
+	if (IS_ERR(file)) {
+		vfree(kuser_data);
+		kuser_data = NULL;
+		goto out;
+	}
+
+	kuser_data->TickCountMultiplier = 1 << 24;
+	init_kuser_system();
+	init_kuser_qpc();
+	ktime_get_ts(&kuser_start);
+	setup_timer(&kuser_timer, update_kuser_time, 0);
+	kuser_file = file;
+	ret = 1;
+out:
+	mutex_unlock(&kuser_mutex);
+	return ret;
+}
+
+/* stop the timer and free the page on module exit */
+void exit_user_shared_data(void)
+{
+	if (!kuser_file)
+		return;
+	del_timer_sync(&kuser_timer);
+	fput(kuser_file);
+	vfree(kuser_data);
+	kuser_file = NULL;
+	kuser_data = NULL;
+	kuser_qpc = NULL;
+}
+
+/* map the user shared data page into the current process */
+DECL_HANDLER(map_user_shared_data)
+{
+	unsigned long addr;
+
+	ktrace("\n");
+	if (!init_user_shared_data()) {
+		set_error(STATUS_NO_MEMORY);
+		return;
+	}
+	addr = win32_do_mmap_pgoff(current, kuser_file, USER_SHARED_DATA, PAGE_SIZE,
+			PROT_READ, MAP_SHARED | MAP_FIXED, 0);
+	if (IS_ERR((void *)addr))
+		set_error(STATUS_NO_MEMORY);
+}
+#endif /* CONFIG_UNIFIED_KERNEL */
@@ -44,21 +44,11 @@ void query_sys_time(large_integer_t *CurrentTime)
 EXPORT_SYMBOL(query_sys_time);
 
 /* stubs from Wine server */
-struct process_snapshot *process_snap(int *count)
-{
-	return NULL;
-}
-
 struct module_snapshot *module_snap(struct w32process *process, int *count)
 {
 	return NULL;
 }
 
-struct thread_snapshot *thread_snap(int *count)
-{
-	return NULL;
-}
-
 struct object_type *no_get_type(struct object *obj)
 {
 	/* ERR: gets called! */
@@ -25,6 +25,7 @@
  */
 #include "mutex.h"
 #include "event.h"
+#include "keyedevent.h"
 #include "semaphore.h"
 #include "handle.h"
 
@@ -64,6 +65,9 @@ extern void init_section_implement(void);
 extern void display_object_dir(POBJECT_DIRECTORY DirectoryObject, LONG Depth);
 extern void display_name_info(void);
 extern void exit_object(void);
+extern void exit_user_shared(void);
+extern void exit_user_shared_data(void);
+extern void exit_change_notify(void);
 extern void init_named_pipe(void);
 extern void init_directories(void);
 extern struct task_struct* save_kernel_task;
@@ -200,6 +204,7 @@ static int w32_init(void)
 	init_section_implement();
 	init_semaphore_implement();
 	init_event_implement();
+	init_keyed_event_implement();
 	init_mutant_implement();
 	kernel_init_registry();
 	init_tet_ops(&tet_ops);
@@ -224,6 +229,9 @@ static void w32_exit(void)
 
 	destroy_cid_table();
 	exit_object();
+	exit_user_shared();
+	exit_user_shared_data();
+	exit_change_notify();
 #ifdef EXE_SO
 	exit_exeso_binfmt();
 #endif
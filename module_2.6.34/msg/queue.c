@@ -45,6 +45,14 @@
 enum message_kind { SEND_MESSAGE, POST_MESSAGE };
 #define NB_MSG_KINDS (POST_MESSAGE+1)
 
+#define TIMER_HASH_SIZE 64     /* buckets of the (win,msg,id) timer hash */
+
+/* posted messages are also indexed by message range, so that filtered
+ * PeekMessage calls only look at the ranges overlapping their filter:
+ * 16 ranges of system messages, then WM_USER, WM_APP and registered messages */
+#define NB_POST_RANGES  19
+#define MAX_POOLED_MSGS 64     /* max free posted messages kept per queue */
+
 extern int get_tick_count(void);
 
 struct message_result
@@ -79,11 +87,15 @@ struct message
 	unsigned int           data_size; /* size of message data */
 	unsigned int           unique_id; /* unique id for nested hw message waits */
 	struct message_result *result;    /* result in sender queue */
+	struct list_head       range_entry; /* entry in posted message range list */
+	unsigned int           seq;       /* posted message sequence number */
 };
 
 struct timer
 {
-	struct list_head     entry;     /* entry in timer list */
+	struct list_head     entry;     /* entry in expired timer list */
+	struct list_head     hash_entry; /* entry in timer hash table */
+	int                  heap_index; /* index in pending timers heap, -1 if expired */
 	timeout_t            when;      /* next expiration */
 	unsigned int         rate;      /* timer rate in ms */
 	user_handle_t        win;       /* window handle */
@@ -121,17 +133,26 @@ struct msg_queue
 	int                    quit_message;    /* is there a pending quit message? */
 	int                    exit_code;       /* exit code of pending quit message */
 	struct list_head       msg_list[NB_MSG_KINDS];  /* lists of messages */
+	struct list_head       post_ranges[NB_POST_RANGES]; /* posted messages by message range */
+	unsigned int           post_seq;        /* sequence number of the next posted message */
+	struct list_head       msg_pool;        /* free posted messages for reuse */
+	unsigned int           pool_size;       /* number of messages in the pool */
 	struct list_head       send_result;     /* stack of sent messages waiting for result */
 	struct list_head       callback_result; /* list of callback messages waiting for result */
 	struct message_result *recv_result;     /* stack of received messages waiting for result */
-	struct list_head       pending_timers;  /* list of pending timers */
+	struct timer         **pending_timers;  /* heap of pending timers, earliest first */
+	unsigned int           pending_count;   /* number of pending timers */
+	unsigned int           pending_size;    /* allocated size of the heap */
 	struct list_head       expired_timers;  /* list of expired timers */
+	struct list_head       timer_hash[TIMER_HASH_SIZE]; /* all timers by (win,msg,id) */
+	timeout_t              timeout_when;    /* expiration the current timeout is set for */
 	unsigned long          next_timer_id;   /* id for the next timer with a 0 window */
 	struct timer_list 	  *timeout; 		/* timeout for next timer to expire */ 
 	struct thread_input   *input;           /* thread input descriptor */
 	struct hook_table     *hooks;           /* hook table */
 	timeout_t              last_get_msg;    /* time of last get message call */
 	struct w32thread      *w32thread;
+	wait_queue_head_t      msg_wait;        /* owner thread blocked in get_message */
 };
 
 static int msg_queue_signaled(struct object *obj, struct w32thread *thread);
@@ -362,10 +383,20 @@ static struct msg_queue *create_msg_queue(struct w32thread *thread, struct threa
 		queue->last_get_msg    = current_time;
 		INIT_LIST_HEAD(&queue->send_result);
 		INIT_LIST_HEAD(&queue->callback_result);
-		INIT_LIST_HEAD(&queue->pending_timers);
+		queue->pending_timers  = NULL;
+		queue->pending_count   = 0;
+		queue->pending_size    = 0;
 		INIT_LIST_HEAD(&queue->expired_timers);
+		for (i = 0; i < TIMER_HASH_SIZE; i++)
+			INIT_LIST_HEAD(&queue->timer_hash[i]);
 		for (i = 0; i < NB_MSG_KINDS; i++)
 			INIT_LIST_HEAD(&queue->msg_list[i]);
+		for (i = 0; i < NB_POST_RANGES; i++)
+			INIT_LIST_HEAD(&queue->post_ranges[i]);
+		queue->post_seq        = 0;
+		INIT_LIST_HEAD(&queue->msg_pool);
+		queue->pool_size       = 0;
+		init_waitqueue_head(&queue->msg_wait);
 
 		thread->queue = queue;
 		if (!thread->process->queue)
@@ -441,8 +472,11 @@ static inline void set_queue_bits(struct msg_queue *queue, unsigned int bits)
 	queue->changed_bits |= bits;
 	((struct object*)queue)->header.signal_state = 1;
 	queue->w32thread->wake_up = 1;  /* used in dummyfile_poll() */
-	if (is_signaled(queue))
+	if (is_signaled(queue)) {
 		uk_wake_up(&queue->obj, 0);
+		/* the owner may be blocked in get_message without any wait block */
+		wake_up_interruptible(&queue->msg_wait);
+	}
 }
 
 /* clear some queue bits */
@@ -609,6 +643,69 @@ static void free_message(struct message *msg)
 	free(msg);
 }
 
+/* get the index of the posted message range containing a message code */
+static inline unsigned int get_post_range(unsigned int msg)
+{
+	if (msg < WM_USER)
+		return msg >> 6;
+	if (msg < WM_APP)
+		return NB_POST_RANGES - 3;
+	if (msg < 0xc000)
+		return NB_POST_RANGES - 2;
+	return NB_POST_RANGES - 1;
+}
+
+/* check if a posted message range overlaps the message filter */
+static inline int post_range_in_filter(unsigned int range, unsigned int first, unsigned int last)
+{
+	static const unsigned int range_first[3] = { WM_USER, WM_APP, 0xc000 };
+	static const unsigned int range_last[3]  = { WM_APP - 1, 0xbfff, ~0U };
+	unsigned int lo, hi;
+
+	if (range < NB_POST_RANGES - 3) {
+		lo = range << 6;
+		hi = lo + 63;
+	}
+	else {
+		lo = range_first[range - (NB_POST_RANGES - 3)];
+		hi = range_last[range - (NB_POST_RANGES - 3)];
+	}
+	return (lo <= last && hi >= first);
+}
+
+/* allocate a posted message, reusing one from the queue pool if possible */
+static struct message *alloc_posted_message(struct msg_queue *queue)
+{
+	struct list_head *ptr;
+
+	if ((ptr = list_head(&queue->msg_pool))) {
+		list_remove(ptr);
+		queue->pool_size--;
+		return LIST_ENTRY(ptr, struct message, entry);
+	}
+	return mem_alloc(sizeof(struct message));
+}
+
+/* add a message at the end of the posted messages */
+static void queue_posted_message(struct msg_queue *queue, struct message *msg)
+{
+	msg->seq = queue->post_seq++;
+	list_add_before(&queue->msg_list[POST_MESSAGE], &msg->entry);
+	list_add_before(&queue->post_ranges[get_post_range(msg->msg)], &msg->range_entry);
+	set_queue_bits(queue, QS_POSTMESSAGE|QS_ALLPOSTMESSAGE);
+}
+
+/* free a posted message, keeping it in the queue pool if possible */
+static void release_posted_message(struct msg_queue *queue, struct message *msg)
+{
+	if (!msg->data && !msg->result && queue->pool_size < MAX_POOLED_MSGS) {
+		list_add_head(&queue->msg_pool, &msg->entry);
+		queue->pool_size++;
+	}
+	else
+		free_message(msg);
+}
+
 /* remove (and free) a message from a message list */
 static void remove_queue_message(struct msg_queue *queue, struct message *msg,
                                   enum message_kind kind)
@@ -618,13 +715,15 @@ static void remove_queue_message(struct msg_queue *queue, struct message *msg,
 		case SEND_MESSAGE:
 			if (list_empty(&queue->msg_list[kind]))
 				clear_queue_bits(queue, QS_SENDMESSAGE);
+			free_message(msg);
 			break;
 		case POST_MESSAGE:
+			list_remove(&msg->range_entry);
 			if (list_empty(&queue->msg_list[kind]) && !queue->quit_message)
 				clear_queue_bits(queue, QS_POSTMESSAGE|QS_ALLPOSTMESSAGE);
+			release_posted_message(queue, msg);
 			break;
 	}
-	free_message(msg);
 }
 
 /* message timed out without getting a reply */
@@ -760,6 +859,44 @@ static void reply_message(struct msg_queue *queue, unsigned long result,
 	}
 }
 
+/* find the oldest posted message matching the filters */
+static struct message *find_posted_message(struct msg_queue *queue, user_handle_t win,
+				unsigned int first, unsigned int last)
+{
+	struct message *msg, *found = NULL;
+	user_handle_t skip_win = 0;  /* last window known not to match the filter */
+	struct list_head *ptr;
+	unsigned int i;
+
+	if (!win && !first && last == ~0U) {
+		if (!(ptr = list_head(&queue->msg_list[POST_MESSAGE])))
+			return NULL;
+		return LIST_ENTRY(ptr, struct message, entry);
+	}
+
+	for (i = 0; i < NB_POST_RANGES; i++) {
+		if (!post_range_in_filter(i, first, last))
+			continue;
+		LIST_FOR_EACH_ENTRY(msg, &queue->post_ranges[i], struct message, range_entry) {
+			if (found && (int)(msg->seq - found->seq) > 0)
+				break;  /* newer than what we already have */
+			if (!check_msg_filter(msg->msg, first, last))
+				continue;
+			if (win && msg->win && msg->win != win) {
+				if (msg->win == skip_win)
+					continue;
+				if (!is_child_window(win, msg->win)) {
+					skip_win = msg->win;
+					continue;
+				}
+			}
+			found = msg;
+			break;
+		}
+	}
+	return found;
+}
+
 /* retrieve a posted message */
 static int get_posted_message(struct msg_queue *queue, user_handle_t win,
 				unsigned int first, unsigned int last, unsigned int flags,
@@ -767,18 +904,10 @@ static int get_posted_message(struct msg_queue *queue, user_handle_t win,
 {
 	struct message *msg;
 
-	/* check against the filters */
-	LIST_FOR_EACH_ENTRY(msg, &queue->msg_list[POST_MESSAGE], struct message, entry) {
-		if (win && msg->win && msg->win != win && !is_child_window(win, msg->win))
-			continue;
-		if (!check_msg_filter(msg->msg, first, last))
-			continue;
-		goto found; /* found one */
-	}
-	return 0;
+	if (!(msg = find_posted_message(queue, win, first, last)))
+		return 0;
 
 	/* return it to the app */
-found:
 	reply->total = msg->data_size;
 	if (msg->data_size > get_reply_max_size()) {
 		set_error(STATUS_BUFFER_OVERFLOW);
@@ -929,12 +1058,14 @@ static void msg_queue_destroy(struct object *obj)
 	cleanup_results(queue);
 	for (i = 0; i < NB_MSG_KINDS; i++)
 		empty_msg_list(&queue->msg_list[i]);
-
-	while ((ptr = list_head(&queue->pending_timers))) {
-		struct timer *timer = LIST_ENTRY(ptr, struct timer, entry);
-		list_remove(&timer->entry);
-		free(timer);
+	while ((ptr = list_head(&queue->msg_pool))) {
+		list_remove(ptr);
+		free(LIST_ENTRY(ptr, struct message, entry));
 	}
+
+	while (queue->pending_count)
+		free(queue->pending_timers[--queue->pending_count]);
+	free(queue->pending_timers);
 	while ((ptr = list_head(&queue->expired_timers))) {
 		struct timer *timer = LIST_ENTRY(ptr, struct timer, entry);
 		list_remove(&timer->entry);
@@ -1065,19 +1196,108 @@ void detach_thread_input(struct w32thread *thread_from)
 }
 
 
+/* hash a timer key */
+static inline unsigned int timer_hash(user_handle_t win, unsigned int msg, unsigned long id)
+{
+	unsigned long key = (unsigned long)win ^ (msg << 8) ^ (id * 31);
+	return (key ^ (key >> 6) ^ (key >> 12)) % TIMER_HASH_SIZE;
+}
+
+/* move a pending timer up the heap until its parent expires before it */
+static void timer_heap_up(struct msg_queue *queue, unsigned int index)
+{
+	struct timer **heap = queue->pending_timers;
+	struct timer *timer = heap[index];
+
+	while (index) {
+		unsigned int parent = (index - 1) / 2;
+		if (heap[parent]->when <= timer->when)
+			break;
+		heap[index] = heap[parent];
+		heap[index]->heap_index = index;
+		index = parent;
+	}
+	heap[index] = timer;
+	timer->heap_index = index;
+}
+
+/* move a pending timer down the heap until its children expire after it */
+static void timer_heap_down(struct msg_queue *queue, unsigned int index)
+{
+	struct timer **heap = queue->pending_timers;
+	struct timer *timer = heap[index];
+
+	for (;;) {
+		unsigned int child = index * 2 + 1;
+		if (child >= queue->pending_count)
+			break;
+		if (child + 1 < queue->pending_count && heap[child + 1]->when < heap[child]->when)
+			child++;
+		if (timer->when <= heap[child]->when)
+			break;
+		heap[index] = heap[child];
+		heap[index]->heap_index = index;
+		index = child;
+	}
+	heap[index] = timer;
+	timer->heap_index = index;
+}
+
+/* add a timer to the pending heap */
+static int link_timer(struct msg_queue *queue, struct timer *timer)
+{
+	if (queue->pending_count == queue->pending_size) {
+		unsigned int new_size = max(queue->pending_size * 2, 16U);
+		struct timer **new_heap;
+
+		if (!(new_heap = realloc(queue->pending_timers, new_size * sizeof(*new_heap),
+						queue->pending_size * sizeof(*new_heap))))
+			return 0;
+		queue->pending_timers = new_heap;
+		queue->pending_size = new_size;
+	}
+	queue->pending_timers[queue->pending_count] = timer;
+	timer_heap_up(queue, queue->pending_count++);
+	return 1;
+}
+
+/* remove a timer from the pending heap */
+static void unlink_timer(struct msg_queue *queue, struct timer *timer)
+{
+	unsigned int index = timer->heap_index;
+	struct timer *last = queue->pending_timers[--queue->pending_count];
+
+	timer->heap_index = -1;
+	if (last == timer)
+		return;
+	queue->pending_timers[index] = last;
+	last->heap_index = index;
+	if (index && queue->pending_timers[(index - 1) / 2]->when > last->when)
+		timer_heap_up(queue, index);
+	else
+		timer_heap_down(queue, index);
+}
+
 /* set the next timer to expire */
 static void set_next_timer(struct msg_queue *queue)
 {
-	struct list_head *ptr;
+	if (queue->pending_count) {
+		timeout_t when = queue->pending_timers[0]->when;
 
-	if (queue->timeout) {
+		/* keep the current timeout if the earliest timer didn't change */
+		if (!queue->timeout || queue->timeout_when != when) {
+			timeout_t now = current_time;
+
+			if (queue->timeout)
+				remove_linux_timer(queue->timeout);
+			queue->timeout = add_linux_timer(when > now ? when - now : 0, timer_callback, queue);
+			queue->timeout_when = when;
+		}
+	}
+	else if (queue->timeout) {
 		remove_linux_timer(queue->timeout);
 		queue->timeout = NULL;
 	}
-	if ((ptr = list_head(&queue->pending_timers))) {
-		struct timer *timer = LIST_ENTRY(ptr, struct timer, entry);
-		queue->timeout = add_linux_timer(timer->rate * 10000, timer_callback, queue);
-	}
 	/* set/clear QS_TIMER bit */
 	if (list_empty(&queue->expired_timers))
 		clear_queue_bits(queue, QS_TIMER);
@@ -1089,17 +1309,9 @@ static void set_next_timer(struct msg_queue *queue)
 static struct timer *find_timer(struct msg_queue *queue, user_handle_t win,
 				unsigned int msg, unsigned long id)
 {
-	struct list_head *ptr;
-
-	/* we need to search both lists */
+	struct timer *timer;
 
-	LIST_FOR_EACH(ptr, &queue->pending_timers) {
-		struct timer *timer = LIST_ENTRY(ptr, struct timer, entry);
-		if (timer->win == win && timer->msg == msg && timer->id == id)
-			return timer;
-	}
-	LIST_FOR_EACH(ptr, &queue->expired_timers) {
-		struct timer *timer = LIST_ENTRY(ptr, struct timer, entry);
+	LIST_FOR_EACH_ENTRY(timer, &queue->timer_hash[timer_hash(win, msg, id)], struct timer, hash_entry) {
 		if (timer->win == win && timer->msg == msg && timer->id == id)
 			return timer;
 	}
@@ -1110,36 +1322,29 @@ static struct timer *find_timer(struct msg_queue *queue, user_handle_t win,
 static void timer_callback(void *private)
 {
 	struct msg_queue *queue = private;
-	struct list_head *ptr;
+	timeout_t now = current_time;
 
 	kdebug("\n");
 	remove_linux_timer(queue->timeout);
 	queue->timeout = NULL;
-	/* move on to the next timer */
-	ptr = list_head(&queue->pending_timers);
-	list_remove(ptr);
-	list_add_before(&queue->expired_timers, ptr);
-	set_next_timer(queue);
-}
-
-/* link a timer at its rightful place in the queue list */
-static void link_timer(struct msg_queue *queue, struct timer *timer)
-{
-	struct list_head *ptr;
-
-	for (ptr = queue->pending_timers.next; ptr != &queue->pending_timers; ptr = ptr->next) {
-		struct timer *t = LIST_ENTRY(ptr, struct timer, entry);
-		if (t->when >= timer->when)
-			break;
+	/* expire all the timers that are due in one go */
+	while (queue->pending_count && queue->pending_timers[0]->when <= now) {
+		struct timer *timer = queue->pending_timers[0];
+		unlink_timer(queue, timer);
+		list_add_before(&queue->expired_timers, &timer->entry);
 	}
-	list_add_before(ptr, &timer->entry);
+	set_next_timer(queue);
 }
 
-/* remove a timer from the queue timer list and free it */
+/* remove a timer from the queue timer lists and free it */
 static void free_timer(struct msg_queue *queue, struct timer *timer)
 {
 	kdebug("\n");
-	list_remove(&timer->entry);
+	if (timer->heap_index >= 0)
+		unlink_timer(queue, timer);
+	else
+		list_remove(&timer->entry);
+	list_remove(&timer->hash_entry);
 	free(timer);
 	set_next_timer(queue);
 }
@@ -1150,7 +1355,11 @@ static void restart_timer(struct msg_queue *queue, struct timer *timer)
 	list_remove(&timer->entry);
 	while (timer->when <= current_time)
 		timer->when += (timeout_t)timer->rate * 10000;
-	link_timer(queue, timer);
+	if (!link_timer(queue, timer)) {
+		/* keep it expired rather than losing it */
+		list_add_before(&queue->expired_timers, &timer->entry);
+		return;
+	}
 	set_next_timer(queue);
 }
 
@@ -1175,16 +1384,25 @@ static struct timer *find_expired_timer(struct msg_queue *queue, user_handle_t w
 }
 
 /* add a timer */
-static struct timer *set_timer(struct msg_queue *queue, unsigned int rate)
+static struct timer *set_timer(struct msg_queue *queue, unsigned int rate, user_handle_t win,
+				unsigned int msg, unsigned long id, unsigned long lparam)
 {
 	struct timer *timer = mem_alloc(sizeof(*timer));
 	kdebug("\n");
 	if (timer) {
-		timer->rate = max(rate, (unsigned int)1);
-		timer->when = current_time + (timeout_t)timer->rate * 10000;
-		link_timer(queue, timer);
+		timer->rate   = max(rate, (unsigned int)1);
+		timer->when   = current_time + (timeout_t)timer->rate * 10000;
+		timer->win    = win;
+		timer->msg    = msg;
+		timer->id     = id;
+		timer->lparam = lparam;
+		if (!link_timer(queue, timer)) {
+			free(timer);
+			return NULL;
+		}
+		list_add_head(&queue->timer_hash[timer_hash(win, msg, id)], &timer->hash_entry);
 		/* check if we replaced the next timer */
-		if (list_head(&queue->pending_timers) == &timer->entry)
+		if (queue->pending_timers[0] == timer)
 			set_next_timer(queue);
 	}
 	return timer;
@@ -1511,29 +1729,20 @@ void inc_queue_paint_count(struct w32thread *thread, int incr)
 void queue_cleanup_window(struct w32thread *thread, user_handle_t win)
 {
 	struct msg_queue *queue = thread->queue;
-	struct list_head *ptr;
 	int i;
 
 	if (!queue)
 		return;
 
-	/* remove timers */
+	/* remove timers, pending and expired ones are all in the hash */
+	for (i = 0; i < TIMER_HASH_SIZE; i++) {
+		struct list_head *ptr, *next;
 
-	ptr = list_head(&queue->pending_timers);
-	while (ptr) {
-		struct list_head *next = list_next(&queue->pending_timers, ptr);
-		struct timer *timer = LIST_ENTRY(ptr, struct timer, entry);
-		if (timer->win == win)
-			free_timer(queue, timer);
-		ptr = next;
-	}
-	ptr = list_head(&queue->expired_timers);
-	while (ptr) {
-		struct list_head *next = list_next(&queue->expired_timers, ptr);
-		struct timer *timer = LIST_ENTRY(ptr, struct timer, entry);
-		if (timer->win == win)
-			free_timer(queue, timer);
-		ptr = next;
+		LIST_FOR_EACH_SAFE(ptr, next, &queue->timer_hash[i]) {
+			struct timer *timer = LIST_ENTRY(ptr, struct timer, hash_entry);
+			if (timer->win == win)
+				free_timer(queue, timer);
+		}
 	}
 
 	/* remove messages */
@@ -1550,6 +1759,25 @@ void queue_cleanup_window(struct w32thread *thread, user_handle_t win)
 	thread_input_cleanup_window(queue, win);
 }
 
+/* check if a kernel notification is a duplicate of the last posted message */
+static int coalesce_posted_message(struct msg_queue *queue, user_handle_t win, unsigned int message,
+				unsigned long wparam, unsigned long lparam)
+{
+	struct message *prev;
+	struct list_head *ptr = list_tail(&queue->msg_list[POST_MESSAGE]);
+
+	if (!ptr)
+		return 0;
+	prev = LIST_ENTRY(ptr, struct message, entry);
+	if (prev->win != win || prev->msg != message || prev->data)
+		return 0;
+	if (prev->wparam != wparam || prev->lparam != lparam)
+		return 0;
+	/* the pending one already carries the same notification */
+	prev->time = get_tick_count();
+	return 1;
+}
+
 /* post a message to a window; used by socket handling */
 void post_message(user_handle_t win, unsigned int message,
 				unsigned long wparam, unsigned long lparam)
@@ -1560,9 +1788,11 @@ void post_message(user_handle_t win, unsigned int message,
 	if (!thread)
 		return;
 
-	if (thread->queue && (msg = mem_alloc(sizeof(*msg)))) {
+	win = get_user_full_handle(win);
+	if (thread->queue && !coalesce_posted_message(thread->queue, win, message, wparam, lparam) &&
+			(msg = alloc_posted_message(thread->queue))) {
 		msg->type      = MSG_POSTED;
-		msg->win       = get_user_full_handle(win);
+		msg->win       = win;
 		msg->msg       = message;
 		msg->wparam    = wparam;
 		msg->lparam    = lparam;
@@ -1574,8 +1804,7 @@ void post_message(user_handle_t win, unsigned int message,
 		msg->data      = NULL;
 		msg->data_size = 0;
 
-		list_add_before(&thread->queue->msg_list[POST_MESSAGE], &msg->entry);
-		set_queue_bits(thread->queue, QS_POSTMESSAGE|QS_ALLPOSTMESSAGE);
+		queue_posted_message(thread->queue, msg);
 	}
 	release_object(thread);
 }
@@ -1762,7 +1991,12 @@ DECL_HANDLER(send_message)
 		return;
 	}
 
-	if ((msg = mem_alloc(sizeof(*msg)))) {
+	if (req->type == MSG_POSTED)
+		msg = alloc_posted_message(recv_queue);
+	else
+		msg = mem_alloc(sizeof(*msg));
+
+	if (msg) {
 		msg->type      = req->type;
 		msg->win       = get_user_full_handle(req->win);
 		msg->msg       = req->msg;
@@ -1797,8 +2031,7 @@ DECL_HANDLER(send_message)
 				set_queue_bits(recv_queue, QS_SENDMESSAGE);
 				break;
 			case MSG_POSTED:
-				list_add_before(&recv_queue->msg_list[POST_MESSAGE], &msg->entry);
-				set_queue_bits(recv_queue, QS_POSTMESSAGE|QS_ALLPOSTMESSAGE);
+				queue_posted_message(recv_queue, msg);
 				break;
 			case MSG_HARDWARE:  /* should use send_hardware_message instead */
 			case MSG_CALLBACK_RESULT:  /* cannot send this one */
@@ -1864,22 +2097,14 @@ DECL_HANDLER(post_quit_message)
 	set_queue_bits(queue, QS_POSTMESSAGE|QS_ALLPOSTMESSAGE);
 }
 
-/* get a message from the current queue */
-DECL_HANDLER(get_message)
+/* look for a message matching the request filter, return 1 if one was found */
+static int find_queue_message(struct msg_queue *queue, const struct get_message_request *req,
+				user_handle_t get_win, struct get_message_reply *reply)
 {
 	struct timer *timer;
 	struct list_head *ptr;
-	struct msg_queue *queue;
-	user_handle_t get_win;
 	unsigned int filter = req->flags >> 16;
 
-	ktrace("\n");
-	queue = get_current_queue();
-	get_win = get_user_full_handle(req->get_win);
-	reply->active_hooks = get_active_hooks();
-
-	if (!queue)
-		return;
 	queue->last_get_msg = current_time;
 	if (!filter)
 		filter = QS_ALLINPUT;
@@ -1888,7 +2113,7 @@ DECL_HANDLER(get_message)
 	if ((ptr = list_head(&queue->msg_list[SEND_MESSAGE]))) {
 		struct message *msg = LIST_ENTRY(ptr, struct message, entry);
 		receive_message(queue, msg, reply);
-		return;
+		return 1;
 	}
 
 	/* clear changed bits so we can wait on them if we don't find a message */
@@ -1905,18 +2130,18 @@ DECL_HANDLER(get_message)
 	/* then check for posted messages */
 	if ((filter & QS_POSTMESSAGE) &&
 			get_posted_message(queue, get_win, req->get_first, req->get_last, req->flags, reply))
-		return;
+		return 1;
 
 	/* only check for quit messages if not posted messages pending.
 	 * note: the quit message isn't filtered */
 	if (get_quit_message(queue, req->flags, reply))
-		return;
+		return 1;
 
 	/* then check for any raw hardware message */
 	if ((filter & QS_INPUT) &&
 			filter_contains_hw_range(req->get_first, req->get_last) &&
 			get_hardware_message(current_thread, req->hw_id, get_win, req->get_first, req->get_last, reply))
-		return;
+		return 1;
 
 	/* now check for WM_PAINT */
 	if ((filter & QS_PAINT) &&
@@ -1931,7 +2156,7 @@ DECL_HANDLER(get_message)
 		reply->y      = 0;
 		reply->time   = get_tick_count();
 		reply->info   = 0;
-		return;
+		return 1;
 	}
 	/* now check for timer */
 	if ((filter & QS_TIMER) &&
@@ -1946,11 +2171,82 @@ DECL_HANDLER(get_message)
 		reply->y      = 0;
 		reply->time   = get_tick_count();
 		reply->info   = 0;
-		return;
+		return 1;
 	}
 
 	queue->wake_mask = req->wake_mask;
 	queue->changed_mask = req->changed_mask;
+	return 0;
+}
+
+/* block the owner thread on its queue until the wake mask is satisfied
+ * return 0 if the wait timed out or was interrupted */
+static int wait_queue_message(struct msg_queue *queue, timeout_t when)
+{
+	struct w32process *process = queue->w32thread->process;
+	long timeout = MAX_SCHEDULE_TIMEOUT;
+	int next, ret;
+
+	/* run the expired timeouts, they may post WM_TIMER to us */
+	next = get_next_timeout();
+	if (is_signaled(queue))
+		return 1;
+
+	if (when != TIMEOUT_INFINITE) {
+		timeout_t diff = when - current_time;
+
+		if (diff <= 0)
+			return 0;
+		diff += 9999;
+		do_div(diff, 10000);
+		timeout = msecs_to_jiffies((unsigned int)diff);
+	}
+	if (next >= 0)
+		timeout = min(timeout, (long)msecs_to_jiffies(next) + 1);
+
+	/* waiting on the main process queue means we are idle */
+	if (process->queue == queue && process->idle_event)
+		set_event(process->idle_event, EVENT_INCREMENT, FALSE);
+
+	ret = wait_event_interruptible_timeout(queue->msg_wait, is_signaled(queue), timeout);
+
+	if (process->queue == queue && process->idle_event)
+		reset_event(process->idle_event);
+
+	if (ret < 0)
+		return 0;  /* signal pending, let the client handle it */
+	if (!ret && next < 0)
+		return 0;
+	return 1;
+}
+
+/* get a message from the current queue, optionally blocking until one arrives */
+DECL_HANDLER(get_message)
+{
+	struct msg_queue *queue;
+	user_handle_t get_win;
+	timeout_t when = req->timeout;
+
+	ktrace("\n");
+	queue = get_current_queue();
+	get_win = get_user_full_handle(req->get_win);
+	reply->active_hooks = get_active_hooks();
+
+	if (!queue)
+		return;
+	if (when != TIMEOUT_INFINITE && when < 0)
+		when = current_time - when;
+
+	for (;;) {
+		if (find_queue_message(queue, req, get_win, reply))
+			return;
+		/* only queue-only waits can block here, a queue with a driver fd
+		 * must return so that the client can process its own events */
+		if (!req->timeout || queue->fd)
+			break;
+		if (!wait_queue_message(queue, when))
+			break;
+	}
 	set_error(STATUS_PENDING);  /* FIXME */
 }
 
@@ -2063,13 +2359,8 @@ DECL_HANDLER(set_win_timer)
 		}
 	}
 
-	if ((timer = set_timer(queue, req->rate))) {
-		timer->win    = win;
-		timer->msg    = req->msg;
-		timer->id     = id;
-		timer->lparam = req->lparam;
-		reply->id     = id;
-	}
+	if ((timer = set_timer(queue, req->rate, win, req->msg, id, req->lparam)))
+		reply->id = id;
 	if (thread)
 		release_object(thread);
 }
@@ -247,6 +247,58 @@ static inline int is_desktop_window(const struct window *win)
 	return !win->parent;  /* only desktop windows have no parent */
 }
 
+/* publish the window state in the shared view of its desktop */
+static void update_window_shared(struct window *win)
+{
+	struct window_shared *shared;
+
+	/* the handle is freed first thing when the window is destroyed */
+	if (get_user_object(win->handle, USER_WINDOW) != win)
+		return;
+	if (!(shared = begin_window_shared(win->desktop, win->handle)))
+		return;
+	shared->handle   = win->handle;
+	shared->tid      = win->thread ? get_thread_id(win->thread) : 0;
+	shared->pid      = win->thread ? get_process_id(win->thread->process) : 0;
+	shared->parent   = win->parent ? win->parent->handle : 0;
+	shared->owner    = win->parent ? win->owner : 0;
+	shared->style    = win->style;
+	shared->ex_style = win->ex_style;
+	shared->window   = win->window_rect;
+	shared->client   = win->client_rect;
+	end_window_shared(win->desktop, shared);
+}
+
+/* remove a destroyed window from the shared view */
+static void clear_window_shared(struct window *win)
+{
+	struct window_shared *shared = begin_window_shared(win->desktop, win->handle);
+
+	if (!shared)
+		return;
+	shared->handle = 0;
+	end_window_shared(win->desktop, shared);
+}
+
+/* publish a window and all its descendants */
+static void publish_window_tree(struct window *win)
+{
+	struct window *child;
+
+	update_window_shared(win);
+	LIST_FOR_EACH_ENTRY(child, &win->children, struct window, entry)
+		publish_window_tree(child);
+	LIST_FOR_EACH_ENTRY(child, &win->unlinked, struct window, entry)
+		publish_window_tree(child);
+}
+
+/* publish the windows that exist when the shared view of a desktop is created */
+void publish_desktop_windows(struct desktop *desktop)
+{
+	if (desktop->top_window)
+		publish_window_tree(desktop->top_window);
+}
+
 /* get next window in Z-order list */
 static inline struct window *get_next_window(struct window *win)
 {
@@ -345,6 +397,7 @@ static int set_parent_window(struct window *win, struct window *parent)
 		list_add_head(&win->parent->unlinked, &win->entry);
 		win->is_linked = 0;
 	}
+	update_window_shared(win);
 	return 1;
 }
 
@@ -475,10 +528,12 @@ static void detach_window_thread(struct window *win)
 	release_class(win->class);
 	win->class = NULL;
 
+	win->thread = NULL;
+	update_window_shared(win);
+
 	/* don't hold a reference to the desktop so that the desktop window can be */
 	/* destroyed when the desktop ref count reaches zero */
 	release_object(win->desktop);
-	win->thread = NULL;
 }
 
 /* destroy a window */
@@ -505,6 +560,7 @@ void destroy_window(struct window *win)
 	if (is_desktop_window(win)) {
 		win->desktop->top_window = NULL;
 	}
+	clear_window_shared(win);
 	detach_window_thread(win);
 	if (win->win_region)
 		free_region(win->win_region);
@@ -618,6 +674,7 @@ static struct window *create_window(struct window *parent, struct window *owner,
 	}
 
 	current_thread->desktop_users++;
+	update_window_shared(win);
 	return win;
 
 failed:
@@ -660,6 +717,7 @@ static struct window *get_desktop_window(struct w32thread *thread, int create)
 		if ((top_window = create_window(NULL, NULL, DESKTOP_ATOM, 0))) {
 			detach_window_thread(top_window);
 			top_window->style  = WS_POPUP | WS_VISIBLE | WS_CLIPSIBLINGS | WS_CLIPCHILDREN;
+			update_window_shared(top_window);
 		}
 	}
 	release_object(desktop);
@@ -1939,6 +1997,7 @@ DECL_HANDLER(set_window_owner)
 	}
 	reply->prev_owner = win->owner;
 	reply->full_owner = win->owner = owner ? owner->handle : 0;
+	update_window_shared(win);
 }
 
 /* get information from a window handle */
@@ -2016,6 +2075,9 @@ DECL_HANDLER(set_window_info)
 		memcpy(win->extra_bytes + req->extra_offset,
 				&req->extra_value, req->extra_size);
 
+	if (req->flags & (SET_WIN_STYLE | SET_WIN_EXSTYLE))
+		update_window_shared(win);
+
 	/* changing window style triggers a non-client paint */
 	if (req->flags & SET_WIN_STYLE)
 		win->paint_flags |= PAINT_NONCLIENT;
@@ -2213,6 +2275,7 @@ DECL_HANDLER(set_window_pos)
 	if (get_req_data_size() >= 2 * sizeof(rectangle_t))
 		valid_rects = get_req_data();
 	set_window_pos(win, previous, flags, &req->window, &req->client, valid_rects);
+	update_window_shared(win);
 	reply->new_style = win->style;
 	reply->new_ex_style = win->ex_style;
 	reply->visible = win->visible_rect;
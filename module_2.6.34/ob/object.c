@@ -855,7 +855,6 @@ lookup_obdir_entry(
 	POBJECT_HEADER ObjectHeader;
 	POBJECT_HEADER_NAME_INFO NameInfo;
 	PWCH Buffer;
-	WCHAR Wchar;
 	ULONG HashIndex;
 	ULONG WcharLength;
 	BOOLEAN CaseInSensitive;
@@ -872,20 +871,7 @@ lookup_obdir_entry(
 		return NULL;
 
 	/* Compute the HASH value */
-	HashIndex = 0;
-	while (WcharLength--) {
-		Wchar = *Buffer++;
-		HashIndex += (HashIndex << 1) + (HashIndex >> 1);
-
-		if (Wchar < 'a')
-			HashIndex += Wchar;
-		else if (Wchar > 'z')
-			HashIndex += Wchar;	/* FIXME: RtlUpcaseUnicodeChar(Wchar); */
-		else
-			HashIndex += (Wchar - ('a'-'A'));
-	}
-
-	HashIndex %= NUMBER_HASH_BUCKETS;
+	HashIndex = hash_nocase_strW(Buffer, WcharLength) % NUMBER_HASH_BUCKETS;
 	HeadDirectoryEntry = (POBJECT_DIRECTORY_ENTRY *)&Directory->HashBuckets[HashIndex];
 	Directory->LookupBucket = HeadDirectoryEntry;
 
@@ -63,8 +63,8 @@ void __exit_process(struct eprocess * process)
 	__destroy_handle_table(process->object_table, delete_handle_callback, process);
 
 	/* remove all reserved area and mapped area */
-	remove_all_win32_area(&process->ep_reserved_head);
-	remove_all_win32_area(&process->ep_mapped_head);
+	remove_all_win32_area(&process->ep_reserved_areas);
+	remove_all_win32_area(&process->ep_mapped_areas);
 
 	/* FIXME: spin_lock_irq(&t); */
 	local_irq_disable();
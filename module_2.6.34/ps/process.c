@@ -203,8 +203,8 @@ void eprocess_init(struct eprocess *parent, BOOLEAN inherit, struct eprocess *pr
 	 */
 	kprocess_init(&process->pcb, PROCESS_PRIO_NORMAL, 1, dir_table_base);
 
-	INIT_LIST_HEAD(&process->ep_reserved_head);
-	INIT_LIST_HEAD(&process->ep_mapped_head);
+	process->ep_reserved_areas = RB_ROOT;
+	process->ep_mapped_areas = RB_ROOT;
 	
 	process->watch_fd = -1;
 	process->watch_thread = 0;
@@ -1048,6 +1048,9 @@ struct w32process *create_w32process(struct w32process *parent, int inherit_all,
 	process->token           = NULL;
 	process->trace_data      = 0;
 	process->dummyfd         = -1;
+	process->user_shared     = NULL;
+	process->windows_view    = NULL;
+	process->windows_file    = NULL;
 	INIT_LIST_HEAD(&process->thread_list);
 	INIT_LIST_HEAD(&process->locks);
 	INIT_LIST_HEAD(&process->classes);
@@ -1163,6 +1166,63 @@ void enum_processes(int (*cb)(struct w32process*, void*), void *user)
 	}
 }
 
+/* take a snapshot of the running processes */
+struct process_snapshot *process_snap(int *count)
+{
+	struct process_snapshot *snapshot, *ptr;
+	struct w32process *process;
+	int total = 0;
+
+	LIST_FOR_EACH_ENTRY(process, &process_list, struct w32process, entry)
+		if (process->running_threads)
+			total++;
+	if (!total || !(snapshot = mem_alloc(sizeof(*snapshot) * total)))
+		return NULL;
+
+	ptr = snapshot;
+	/* mem_alloc may sleep, processes started meanwhile don't fit */
+	LIST_FOR_EACH_ENTRY(process, &process_list, struct w32process, entry) {
+		if (!process->running_threads || ptr == snapshot + total)
+			continue;
+		ptr->process  = (struct w32process *)grab_object(process);
+		ptr->threads  = process->running_threads;
+		ptr->count    = atomic_read(&BODY_TO_HEADER(process)->PointerCount);
+		ptr->priority = process->priority;
+		ptr->handles  = process->eprocess->object_table ? process->eprocess->object_table->handle_count : 0;
+		ptr++;
+	}
+	*count = ptr - snapshot;
+	return snapshot;
+}
+
+/* take a snapshot of the running threads, grouped by process */
+struct thread_snapshot *thread_snap(int *count)
+{
+	struct thread_snapshot *snapshot, *ptr;
+	struct w32process *process;
+	struct w32thread *thread;
+	int total = 0;
+
+	LIST_FOR_EACH_ENTRY(process, &process_list, struct w32process, entry)
+		total += process->running_threads;
+	if (!total || !(snapshot = mem_alloc(sizeof(*snapshot) * total)))
+		return NULL;
+
+	ptr = snapshot;
+	LIST_FOR_EACH_ENTRY(process, &process_list, struct w32process, entry) {
+		LIST_FOR_EACH_ENTRY(thread, &process->thread_list, struct w32thread, proc_entry) {
+			if (thread->state == TERMINATED || ptr == snapshot + total)
+				continue;
+			ptr->thread   = (struct w32thread *)grab_object(thread);
+			ptr->count    = atomic_read(&BODY_TO_HEADER(thread)->PointerCount);
+			ptr->priority = thread->priority;
+			ptr++;
+		}
+	}
+	*count = ptr - snapshot;
+	return snapshot;
+}
+
 /* create a new process */
 DECL_HANDLER(new_process)
 {
@@ -25,6 +25,7 @@
  * Refered to Wine code
  */
 
+#include <asm/unaligned.h>
 #include "wineserver/lib.h"
 
 #ifdef CONFIG_UNIFIED_KERNEL
@@ -143,15 +144,66 @@ WCHAR tolowerW(WCHAR ch)
 	return ch + wine_casemap_lower[wine_casemap_lower[ch >> 8] + (ch & 0xff)];
 }
 
+/*
+ * Names are mostly ASCII, so the case-insensitive helpers below look at two
+ * characters at a time and only go through the case map tables when one of
+ * them isn't ASCII.  This relies on the little-endian x86 layout.
+ */
+#define ASCII_PAIR_MASK		0xff80ff80
+
+/* lower case the two ASCII characters packed in a word */
+static inline u32 fold_ascii_pair(u32 x)
+{
+	/* 0x80 is set in the lanes holding 'A' to 'Z' */
+	u32 upper = (x + 0x003f003f) & ~(x + 0x00250025) & 0x00800080;
+
+	return x | (upper >> 2);
+}
+
 int memicmpW(const WCHAR *str1, const WCHAR *str2, int n)
 {
-	int ret = 0;
+	u32 a, b;
+	int ret;
 
-	for (; n > 0; n--, str1++, str2++)
-		if ((ret = tolowerW(*str1) - tolowerW(*str2))) 
-			break;
+	while (n > 0) {
+		if (n >= 2) {
+			a = get_unaligned((const u32 *)str1);
+			b = get_unaligned((const u32 *)str2);
+			if (a == b || (!((a | b) & ASCII_PAIR_MASK) && fold_ascii_pair(a) == fold_ascii_pair(b))) {
+				str1 += 2;
+				str2 += 2;
+				n -= 2;
+				continue;
+			}
+		}
+		if ((ret = tolowerW(*str1) - tolowerW(*str2)))
+			return ret;
+		str1++;
+		str2++;
+		n--;
+	}
 
-	return ret;
+	return 0;
+}
+
+/* case-insensitive hash of a string, matching memicmpW, used by the name tables */
+unsigned int hash_nocase_strW(const WCHAR *str, data_size_t len)
+{
+	unsigned int hash = 0;
+	u32 x;
+
+	for (; len >= 2; len -= 2, str += 2) {
+		x = get_unaligned((const u32 *)str);
+		if (x & ASCII_PAIR_MASK)
+			x = tolowerW(str[0]) | ((u32)tolowerW(str[1]) << 16);
+		else
+			x = fold_ascii_pair(x);
+		hash = hash * 31 + x;
+	}
+	if (len)
+		hash = hash * 31 + tolowerW(*str);
+
+	return hash;
 }
 
 void no_flush(struct fd *fd, struct kevent **event)
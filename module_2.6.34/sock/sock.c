@@ -150,8 +150,17 @@ struct sock
 	struct sock        *deferred;    /* socket that waits for a deferred accept */
 	struct async_queue *read_q;      /* queue for asynchronous reads */
 	struct async_queue *write_q;     /* queue for asynchronous writes */
+	struct sock_io     *io;          /* transfers done by the kernel */
 };
 
+struct sock_io;
+struct sock_io_op;
+extern struct sock_io *create_sock_io(struct fd *fd);
+extern void free_sock_io(struct sock_io *io);
+extern void sock_io_wake_up(struct sock_io *io, struct async_queue *read_q, struct async_queue *write_q);
+extern struct sock_io_op *create_sock_io_op(const struct sock_iovec *iov, data_size_t size,
+		unsigned int flags);
+
 static struct fd *sock_get_fd(struct object *obj);
 static void sock_destroy(struct object *obj);
 
@@ -162,7 +171,7 @@ static enum server_fd_type sock_get_fd_type(struct fd *fd);
 static void sock_queue_async(struct fd *fd, const async_data_t *data, int type, int count);
 static void sock_reselect_async(struct fd *fd, struct async_queue *queue);
 static void sock_cancel_async(struct fd *fd);
-static int sock_get_error(int err);
+int sock_get_error(int err);
 static void sock_set_error(void);
 extern unsigned int default_fd_map_access(struct object *obj, unsigned int access);
 
@@ -553,28 +562,33 @@ static enum server_fd_type sock_get_fd_type(struct fd *fd)
 	return FD_TYPE_SOCKET;
 }
 
-static void sock_queue_async(struct fd *fd, const async_data_t *data, int type, int count)
+/* get the queue of an async type, creating it if needed */
+static struct async_queue *sock_get_async_queue(struct sock *sock, int type)
 {
-	struct sock *sock = get_fd_user(fd);
-	struct async_queue *queue;
-	int pollev;
-
 	switch (type) {
 		case ASYNC_TYPE_READ:
 			if (!sock->read_q && !(sock->read_q = create_async_queue(sock->fd))) 
-				return;
-			queue = sock->read_q;
+				return NULL;
 			sock->hmask &= ~FD_CLOSE;
-			break;
+			return sock->read_q;
 		case ASYNC_TYPE_WRITE:
 			if (!sock->write_q && !(sock->write_q = create_async_queue(sock->fd))) 
-				return;
-			queue = sock->write_q;
-			break;
+				return NULL;
+			return sock->write_q;
 		default:
 			set_error(STATUS_INVALID_PARAMETER);
-			return;
+			return NULL;
 	}
+}
+
+static void sock_queue_async(struct fd *fd, const async_data_t *data, int type, int count)
+{
+	struct sock *sock = get_fd_user(fd);
+	struct async_queue *queue;
+	int pollev;
+
+	if (!(queue = sock_get_async_queue(sock, type)))
+		return;
 
 	if ((!(sock->state & FD_READ) && type == ASYNC_TYPE_READ ) ||
 			(!(sock->state & FD_WRITE) && type == ASYNC_TYPE_WRITE)) {
@@ -623,6 +637,8 @@ static void sock_destroy(struct object *obj)
 	if (sock->deferred)
 		release_object(sock->deferred);
 
+	if (sock->io)
+		free_sock_io(sock->io);
 	free_async_queue(sock->read_q);
 	free_async_queue(sock->write_q);
 	if (sock->event) 
@@ -679,6 +695,7 @@ static struct object *create_socket(int family, int type, int protocol, unsigned
 		sock->deferred = NULL;
 		sock->read_q  = NULL;
 		sock->write_q = NULL;
+		sock->io      = NULL;
 		if (!(sock->fd = create_anonymous_fd(&sock_fd_ops, sockfd, &sock->obj,
 						(flags & WSA_FLAG_OVERLAPPED) ? 0 : FILE_SYNCHRONOUS_IO_NONALERT))) {
 			release_object(sock);
@@ -752,6 +769,7 @@ static struct sock *accept_socket(obj_handle_t handle)
 		acceptsock->deferred = NULL;
 		acceptsock->read_q  = NULL;
 		acceptsock->write_q = NULL;
+		acceptsock->io      = NULL;
 		if (!(acceptsock->fd = create_anonymous_fd(&sock_fd_ops, acceptfd, &acceptsock->obj,
 						get_fd_options(sock->fd)))) {
 			release_object(acceptsock);
@@ -768,7 +786,7 @@ static struct sock *accept_socket(obj_handle_t handle)
 }
 
 /* set the last error depending on errno */
-static int sock_get_error(int err)
+int sock_get_error(int err)
 {
 	switch (err)
 	{
@@ -988,4 +1006,45 @@ DECL_HANDLER(set_socket_deferred)
 	sock->deferred = acceptsock;
 	release_object(sock);
 }
+
+/* queue an overlapped transfer the kernel does straight into the client buffers */
+DECL_HANDLER(register_sock_io)
+{
+	struct sock *sock;
+	struct async_queue *queue;
+	struct async *async;
+	struct sock_io_op *op;
+	unsigned int access = (req->type == ASYNC_TYPE_WRITE) ? FILE_WRITE_DATA : FILE_READ_DATA;
+
+	ktrace("\n");
+	if (!(sock = (struct sock *)get_wine_handle_obj(get_current_w32process(), req->handle,
+					access, &sock_ops)))
+		return;
+
+	if (!(queue = sock_get_async_queue(sock, req->type)))
+		goto done;
+	if ((!(sock->state & FD_READ) && req->type == ASYNC_TYPE_READ) ||
+			(!(sock->state & FD_WRITE) && req->type == ASYNC_TYPE_WRITE)) {
+		set_error(STATUS_PIPE_DISCONNECTED);
+		goto done;
+	}
+	if (!sock->io && !(sock->io = create_sock_io(sock->fd)))
+		goto done;
+	if (!(op = create_sock_io_op(get_req_data(), get_req_data_size(), req->flags)))
+		goto done;
+
+	if (!(async = create_async(current_thread, queue, &req->async))) {
+		free(op);
+		goto done;
+	}
+	async_set_kernel_io(async, op);
+	release_object(async);
+	set_error(STATUS_PENDING);
+
+	/* the data may have arrived before the socket was hooked */
+	sock_io_wake_up(sock->io, sock->read_q, sock->write_q);
+
+done:
+	release_object(sock);
+}
 #endif /* CONFIG_UNIFIED_KERNEL */
@@ -0,0 +1,279 @@
+/*
+ * sockio.c
+ *
+ * Copyright (C) 2006  Insigme Co., Ltd
+ *
+ * This software has been developed while working on the Linux Unified Kernel
+ * project (http://www.longene.org) in the Insigma Research Institute,
+ * which is a subdivision of Insigma Co., Ltd (http://www.insigma.com.cn).
+ *
+ * The project is sponsored by Insigma Co., Ltd.
+ *
+ * The authors can be reached at linux@insigma.com.cn.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of  the GNU General  Public License as published by the
+ * Free Software Foundation; either version 2 of the  License, or (at your
+ * option) any later version.
+ *
+ * Revision History:
+ *   Oct 2026 - Created.
+ */
+
+/*
+ * sockio.c:
+ * overlapped socket transfers done by the kernel
+ *
+ * This lives apart from sock.c, which can't include the Unix socket headers.
+ */
+#include <linux/net.h>
+#include <linux/poll.h>
+#include <linux/uio.h>
+#include <linux/highmem.h>
+#include <linux/workqueue.h>
+#include <net/sock.h>
+#include "handle.h"
+#include "virtual.h"
+
+#ifdef CONFIG_UNIFIED_KERNEL
+/*
+ * The async of such a transfer carries the user buffers instead of a
+ * client callback.  A wait queue entry on the socket schedules a work item
+ * whenever the socket is woken up; the work item pins the buffers of the
+ * owning process, moves the data with kernel_recvmsg/kernel_sendmsg and
+ * completes the async itself, so the client only sees the completion.
+ * The async queues are locked, so a claimed async stays alive while the
+ * handlers cancel or close concurrently, and the task of the owning thread
+ * is pinned by the async for as long as it exists.
+ */
+
+#define SOCK_IO_MAX_IOVECS	16	/* WS_MSG_MAXIOVLEN of ws2_32 */
+#define SOCK_IO_MAX_PAGES	64	/* pages a single transfer may pin */
+
+struct sock_io_op
+{
+	unsigned int       flags;     /* recv/send flags */
+	int                count;     /* number of buffers */
+	int                nr_pages;  /* pages spanned by the buffers */
+	struct sock_iovec  iov[1];
+};
+
+struct sock_io
+{
+	struct socket       *socket;   /* the unix socket */
+	struct async_queue  *read_q;   /* queues of the socket */
+	struct async_queue  *write_q;
+	poll_table           pt;       /* to hook on the socket wait queue */
+	wait_queue_head_t   *whead;    /* socket wait queue */
+	wait_queue_t         wait;     /* our entry in it */
+	struct work_struct   work;     /* does the pending transfers */
+	struct mutex         mutex;    /* serializes the transfers */
+};
+
+extern int sock_get_error(int err);
+
+static int sock_io_wake(wait_queue_t *wait, unsigned mode, int sync, void *key)
+{
+	struct sock_io *io = container_of(wait, struct sock_io, wait);
+
+	schedule_work(&io->work);
+	return 0;
+}
+
+static void sock_io_queue_proc(struct file *file, wait_queue_head_t *whead, poll_table *pt)
+{
+	struct sock_io *io = container_of(pt, struct sock_io, pt);
+
+	if (io->whead)
+		return;
+	io->whead = whead;
+	init_waitqueue_func_entry(&io->wait, sock_io_wake);
+	add_wait_queue(whead, &io->wait);
+}
+
+/* pin the buffers of a transfer and do it, returns the size or a negative errno */
+static int sock_io_transfer(struct socket *socket, struct task_struct *tsk, struct mm_struct *mm,
+		struct sock_io_op *op, int send)
+{
+	struct page **pages;
+	struct kvec *kv;
+	struct msghdr msg;
+	unsigned long addr, len, offset, bytes;
+	size_t total = 0;
+	int i, j, nr, pinned = 0, mapped = 0, ret = 0;
+
+	pages = kmalloc(op->nr_pages * sizeof(*pages), GFP_KERNEL);
+	kv = kmalloc(op->nr_pages * sizeof(*kv), GFP_KERNEL);
+	if (!pages || !kv) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (i = 0; i < op->count; i++) {
+		addr = (unsigned long)op->iov[i].base;
+		len = op->iov[i].len;
+		if (!len)
+			continue;
+
+		nr = ((addr & ~PAGE_MASK) + len + PAGE_SIZE - 1) >> PAGE_SHIFT;
+		down_read(&mm->mmap_sem);
+		ret = get_user_pages(tsk, mm, addr & PAGE_MASK, nr, !send, 0, pages + pinned, NULL);
+		up_read(&mm->mmap_sem);
+		if (ret > 0)
+			pinned += ret;
+		if (ret < nr) {
+			ret = -EFAULT;
+			goto out;
+		}
+
+		for (j = 0; j < nr; j++, mapped++) {
+			offset = addr & ~PAGE_MASK;
+			bytes = min(PAGE_SIZE - offset, len);
+			kv[mapped].iov_base = kmap(pages[mapped]) + offset;
+			kv[mapped].iov_len = bytes;
+			addr += bytes;
+			len -= bytes;
+			total += bytes;
+		}
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	if (send) {
+		msg.msg_flags = op->flags | MSG_DONTWAIT | MSG_NOSIGNAL;
+		ret = kernel_sendmsg(socket, &msg, kv, mapped, total);
+	}
+	else
+		ret = kernel_recvmsg(socket, &msg, kv, mapped, total, op->flags | MSG_DONTWAIT);
+
+out:
+	for (i = 0; i < mapped; i++)
+		kunmap(pages[i]);
+	for (i = 0; i < pinned; i++) {
+		if (!send && ret > 0)
+			set_page_dirty_lock(pages[i]);
+		page_cache_release(pages[i]);
+	}
+	kfree(kv);
+	kfree(pages);
+	return ret;
+}
+
+/* do the transfers of a queue until one would block */
+static void sock_io_run(struct sock_io *io, struct async_queue *queue, int send)
+{
+	struct sock_io_op *op;
+	struct async *async;
+	struct task_struct *tsk;
+	struct mm_struct *mm;
+	int ret;
+
+	while ((async = async_claim(queue, (void **)&op, &tsk))) {
+		if (!(mm = get_task_mm(tsk))) {
+			async_complete(async, STATUS_CANCELLED, 0);
+			continue;
+		}
+		ret = sock_io_transfer(io->socket, tsk, mm, op, send);
+		mmput(mm);
+
+		if (ret == -EAGAIN || ret == -EINTR) {
+			async_unclaim(async);
+			break;
+		}
+		if (ret >= 0)
+			async_complete(async, STATUS_SUCCESS, ret);
+		else  /* a winsock error, like the client-side callbacks report */
+			async_complete(async, sock_get_error(-ret), 0);
+	}
+}
+
+static void sock_io_work(struct work_struct *work)
+{
+	struct sock_io *io = container_of(work, struct sock_io, work);
+
+	mutex_lock(&io->mutex);
+	sock_io_run(io, io->read_q, 0);
+	sock_io_run(io, io->write_q, 1);
+	mutex_unlock(&io->mutex);
+}
+
+/* hook on the wait queue of the unix socket behind a socket fd */
+struct sock_io *create_sock_io(struct fd *fd)
+{
+	struct file *file = get_unix_file(fd);
+	struct sock_io *io;
+
+	if (!file || !S_ISSOCK(file->f_path.dentry->d_inode->i_mode)) {
+		set_error(STATUS_NOT_SUPPORTED);
+		return NULL;
+	}
+	if (!(io = mem_alloc(sizeof(*io))))
+		return NULL;
+
+	io->socket = SOCKET_I(file->f_path.dentry->d_inode);
+	io->read_q = NULL;
+	io->write_q = NULL;
+	io->whead = NULL;
+	INIT_WORK(&io->work, sock_io_work);
+	mutex_init(&io->mutex);
+	init_poll_funcptr(&io->pt, sock_io_queue_proc);
+	file->f_op->poll(file, &io->pt);
+	if (!io->whead) {
+		free(io);
+		set_error(STATUS_NOT_SUPPORTED);
+		return NULL;
+	}
+	return io;
+}
+
+void free_sock_io(struct sock_io *io)
+{
+	remove_wait_queue(io->whead, &io->wait);
+	cancel_work_sync(&io->work);
+	free(io);
+}
+
+/* set the queues the transfers are taken from and look for ready ones */
+void sock_io_wake_up(struct sock_io *io, struct async_queue *read_q, struct async_queue *write_q)
+{
+	io->read_q = read_q;
+	io->write_q = write_q;
+	schedule_work(&io->work);
+}
+
+/* check the buffers of a transfer and build its state for the async */
+struct sock_io_op *create_sock_io_op(const struct sock_iovec *iov, data_size_t size, unsigned int flags)
+{
+	struct sock_io_op *op;
+	unsigned long addr, len;
+	int i, count = size / sizeof(*iov), nr_pages = 0;
+
+	if (!count || count > SOCK_IO_MAX_IOVECS || size % sizeof(*iov)) {
+		set_error(STATUS_INVALID_PARAMETER);
+		return NULL;
+	}
+	for (i = 0; i < count; i++) {
+		addr = (unsigned long)iov[i].base;
+		len = iov[i].len;
+		if (!len)
+			continue;
+		if (addr + len < addr || addr + len > WIN32_TASK_SIZE) {
+			set_error(STATUS_INVALID_PARAMETER);
+			return NULL;
+		}
+		nr_pages += ((addr & ~PAGE_MASK) + len + PAGE_SIZE - 1) >> PAGE_SHIFT;
+	}
+	if (nr_pages > SOCK_IO_MAX_PAGES) {
+		/* too large to pin at once, the client does it */
+		set_error(STATUS_NOT_SUPPORTED);
+		return NULL;
+	}
+
+	if (!(op = mem_alloc(offsetof(struct sock_io_op, iov[count]))))
+		return NULL;
+	op->flags = flags;
+	op->count = count;
+	op->nr_pages = nr_pages;
+	memcpy(op->iov, iov, size);
+	return op;
+}
+#endif /* CONFIG_UNIFIED_KERNEL */
@@ -127,6 +127,343 @@ static void char_info_AtoW( CHAR_INFO *buffer, int count )
     }
 }
 
+/* shared views of the screen buffers, protected by CONSOLE_CritSect
+ * the cells are read and written in place; the server only hears about
+ * the rows we changed when the renderer has fetched the previous ones */
+struct screen_buffer_view
+{
+    HANDLE                       handle;    /* server handle of the screen buffer, 0 if unused */
+    struct screen_buffer_shared *shared;    /* the view, NULL if it couldn't be mapped */
+    BOOL                         writable;  /* whether the view is mapped writable */
+};
+
+#define NB_SCREEN_BUFFER_VIEWS 4
+static struct screen_buffer_view screen_buffer_views[NB_SCREEN_BUFFER_VIEWS];
+static unsigned int next_screen_buffer_view;
+
+/******************************************************************
+ *		get_screen_buffer_view
+ *
+ * get the shared view of a screen buffer, mapping it if needed
+ * must be called with CONSOLE_CritSect held
+ */
+static struct screen_buffer_shared *get_screen_buffer_view( HANDLE handle, BOOL write )
+{
+    struct screen_buffer_view *view = NULL;
+    void *unmap;
+    unsigned int i;
+
+    if (!is_console_handle( handle )) return NULL;
+    handle = console_handle_unmap( handle );
+
+    for (i = 0; i < NB_SCREEN_BUFFER_VIEWS; i++)
+    {
+        if (screen_buffer_views[i].handle != handle) continue;
+        view = &screen_buffer_views[i];
+        if (!view->shared) return NULL;
+        if (!view->shared->stale) return (!write || view->writable) ? view->shared : NULL;
+        break;  /* the screen buffer was resized, map its new view */
+    }
+    if (!view) view = &screen_buffer_views[next_screen_buffer_view++ % NB_SCREEN_BUFFER_VIEWS];
+
+    unmap = view->shared;
+    view->handle   = handle;
+    view->shared   = NULL;
+    view->writable = FALSE;
+    SERVER_START_REQ( map_screen_buffer )
+    {
+        req->handle = handle;
+        req->unmap  = unmap;
+        if (!wine_server_call( req ))
+        {
+            view->shared   = reply->view;
+            view->writable = reply->writable;
+        }
+    }
+    SERVER_END_REQ;
+    if (!view->shared || (write && !view->writable)) return NULL;
+    return view->shared;
+}
+
+/******************************************************************
+ *		release_screen_buffer_view
+ *
+ * forget the view of a screen buffer handle being closed
+ * the view itself is unmapped when its slot gets reused
+ */
+static void release_screen_buffer_view( HANDLE handle )
+{
+    unsigned int i;
+
+    handle = console_handle_unmap( handle );
+    RtlEnterCriticalSection( &CONSOLE_CritSect );
+    for (i = 0; i < NB_SCREEN_BUFFER_VIEWS; i++)
+        if (screen_buffer_views[i].handle == handle) screen_buffer_views[i].handle = 0;
+    RtlLeaveCriticalSection( &CONSOLE_CritSect );
+}
+
+/******************************************************************
+ *		screen_buffer_view_changed
+ *
+ * add rows we changed in a view to its dirty range, and have the server
+ * queue their update unless an earlier one hasn't been fetched yet
+ */
+static void screen_buffer_view_changed( HANDLE handle, struct screen_buffer_shared *shared,
+                                        int top, int bottom )
+{
+    LONG dirty, new_dirty;
+
+    InterlockedIncrement( (LONG *)&shared->seq );
+    do
+    {
+        dirty = shared->dirty;
+        new_dirty = ((DWORD)min( (int)((DWORD)dirty >> 16), top ) << 16) | max( dirty & 0xffff, bottom );
+    } while (InterlockedCompareExchange( (LONG *)&shared->dirty, new_dirty, dirty ) != dirty);
+
+    if (InterlockedExchange( (LONG *)&shared->pending, 1 )) return;
+    SERVER_START_REQ( notify_screen_buffer )
+    {
+        req->handle = console_handle_unmap( handle );
+        wine_server_call( req );
+    }
+    SERVER_END_REQ;
+}
+
+/******************************************************************
+ *		write_console_cells
+ *
+ * write cells into a screen buffer, straight into its shared view when possible
+ * (see write_console_output in the server for the semantics)
+ */
+static BOOL write_console_cells( HANDLE handle, const void *data, int count, int mode,
+                                 int x, int y, BOOL wrap, DWORD *written, COORD *size )
+{
+    struct screen_buffer_shared *shared;
+    char_info_t *dest, *end;
+    int i = -1;
+    BOOL ret;
+
+    RtlEnterCriticalSection( &CONSOLE_CritSect );
+    if (x >= 0 && y >= 0 && (shared = get_screen_buffer_view( handle, TRUE )))
+    {
+        i = 0;
+        if (y < shared->height)
+        {
+            dest = shared->cells + y * shared->width + x;
+            end  = shared->cells + (wrap ? shared->height : y + 1) * shared->width;
+            switch (mode)
+            {
+            case CHAR_INFO_MODE_TEXT:
+                for ( ; i < count && dest < end; dest++, i++)
+                    dest->ch = ((const WCHAR *)data)[i];
+                break;
+            case CHAR_INFO_MODE_ATTR:
+                for ( ; i < count && dest < end; dest++, i++)
+                    dest->attr = ((const WORD *)data)[i];
+                break;
+            case CHAR_INFO_MODE_TEXTATTR:
+                for ( ; i < count && dest < end; dest++, i++)
+                    *dest = ((const char_info_t *)data)[i];
+                break;
+            case CHAR_INFO_MODE_TEXTSTDATTR:
+                for ( ; i < count && dest < end; dest++, i++)
+                {
+                    dest->ch   = ((const WCHAR *)data)[i];
+                    dest->attr = shared->attr;
+                }
+                break;
+            }
+        }
+        if (shared->stale) i = -1;  /* resized meanwhile, let the server do it */
+        else
+        {
+            if (i) screen_buffer_view_changed( handle, shared, y + x / shared->width,
+                                               y + (x + i - 1) / shared->width );
+            if (size)
+            {
+                size->X = shared->width;
+                size->Y = shared->height;
+            }
+        }
+    }
+    RtlLeaveCriticalSection( &CONSOLE_CritSect );
+    if (i >= 0)
+    {
+        *written = i;
+        return TRUE;
+    }
+
+    SERVER_START_REQ( write_console_output )
+    {
+        req->handle = console_handle_unmap(handle);
+        req->x      = x;
+        req->y      = y;
+        req->mode   = mode;
+        req->wrap   = wrap;
+        wine_server_add_data( req, data, count * (mode == CHAR_INFO_MODE_TEXTATTR ?
+                                                  sizeof(char_info_t) : sizeof(WCHAR)) );
+        if ((ret = !wine_server_call_err( req )))
+        {
+            *written = reply->written;
+            if (size)
+            {
+                size->X = reply->width;
+                size->Y = reply->height;
+            }
+        }
+    }
+    SERVER_END_REQ;
+    return ret;
+}
+
+/******************************************************************
+ *		fill_console_cells
+ *
+ * fill cells of a screen buffer, straight in its shared view when possible
+ * (see fill_console_output in the server for the semantics)
+ */
+static BOOL fill_console_cells( HANDLE handle, char_info_t data, int mode, int x, int y,
+                                int count, BOOL wrap, DWORD *written )
+{
+    struct screen_buffer_shared *shared;
+    char_info_t *dest;
+    int i = -1, max;
+    BOOL ret;
+
+    RtlEnterCriticalSection( &CONSOLE_CritSect );
+    if (x >= 0 && y >= 0 && (shared = get_screen_buffer_view( handle, TRUE )))
+    {
+        i = 0;
+        if (y < shared->height)
+        {
+            dest = shared->cells + y * shared->width + x;
+            max  = (wrap ? shared->height * shared->width : (y + 1) * shared->width) -
+                   (y * shared->width + x);
+            if (count > max) count = max;
+            switch (mode)
+            {
+            case CHAR_INFO_MODE_TEXT:
+                for ( ; i < count; i++) dest[i].ch = data.ch;
+                break;
+            case CHAR_INFO_MODE_ATTR:
+                for ( ; i < count; i++) dest[i].attr = data.attr;
+                break;
+            case CHAR_INFO_MODE_TEXTATTR:
+                for ( ; i < count; i++) dest[i] = data;
+                break;
+            case CHAR_INFO_MODE_TEXTSTDATTR:
+                for ( ; i < count; i++)
+                {
+                    dest[i].ch   = data.ch;
+                    dest[i].attr = shared->attr;
+                }
+                break;
+            }
+        }
+        if (shared->stale) i = -1;  /* resized meanwhile, let the server do it */
+        else if (i) screen_buffer_view_changed( handle, shared, y + x / shared->width,
+                                                y + (x + i - 1) / shared->width );
+    }
+    RtlLeaveCriticalSection( &CONSOLE_CritSect );
+    if (i >= 0)
+    {
+        if (written) *written = i;
+        return TRUE;
+    }
+
+    SERVER_START_REQ( fill_console_output )
+    {
+        req->handle = console_handle_unmap(handle);
+        req->x      = x;
+        req->y      = y;
+        req->mode   = mode;
+        req->wrap   = wrap;
+        req->data   = data;
+        req->count  = count;
+        if ((ret = !wine_server_call_err( req )))
+        {
+            if (written) *written = reply->written;
+        }
+    }
+    SERVER_END_REQ;
+    return ret;
+}
+
+/******************************************************************
+ *		read_console_cells
+ *
+ * read cells from a screen buffer, straight from its shared view when possible
+ * (see read_console_output in the server for the semantics)
+ */
+static BOOL read_console_cells( HANDLE handle, void *data, int count, int mode,
+                                int x, int y, BOOL wrap, DWORD *read, COORD *size )
+{
+    struct screen_buffer_shared *shared;
+    const char_info_t *src;
+    int i = -1, max;
+    BOOL ret;
+
+    RtlEnterCriticalSection( &CONSOLE_CritSect );
+    if (x >= 0 && y >= 0 && (shared = get_screen_buffer_view( handle, FALSE )))
+    {
+        i = 0;
+        if (y < shared->height)
+        {
+            src = shared->cells + y * shared->width + x;
+            max = (wrap ? shared->height * shared->width : (y + 1) * shared->width) -
+                  (y * shared->width + x);
+            if (count > max) count = max;
+            switch (mode)
+            {
+            case CHAR_INFO_MODE_TEXT:
+                for ( ; i < count; i++) ((WCHAR *)data)[i] = src[i].ch;
+                break;
+            case CHAR_INFO_MODE_ATTR:
+                for ( ; i < count; i++) ((WORD *)data)[i] = src[i].attr;
+                break;
+            case CHAR_INFO_MODE_TEXTATTR:
+                for ( ; i < count; i++) ((char_info_t *)data)[i] = src[i];
+                break;
+            }
+        }
+        if (shared->stale) i = -1;  /* resized meanwhile, ask the server */
+        else if (size)
+        {
+            size->X = shared->width;
+            size->Y = shared->height;
+        }
+    }
+    RtlLeaveCriticalSection( &CONSOLE_CritSect );
+    if (i >= 0)
+    {
+        if (read) *read = i;
+        return TRUE;
+    }
+
+    SERVER_START_REQ( read_console_output )
+    {
+        req->handle = console_handle_unmap(handle);
+        req->x      = x;
+        req->y      = y;
+        req->mode   = mode;
+        req->wrap   = wrap;
+        wine_server_set_reply( req, data, count * (mode == CHAR_INFO_MODE_TEXTATTR ?
+                                                   sizeof(char_info_t) : sizeof(WCHAR)) );
+        if ((ret = !wine_server_call_err( req )))
+        {
+            if (read) *read = wine_server_reply_size(reply) / (mode == CHAR_INFO_MODE_TEXTATTR ?
+                                                               sizeof(char_info_t) : sizeof(WCHAR));
+            if (size)
+            {
+                size->X = reply->width;
+                size->Y = reply->height;
+            }
+        }
+    }
+    SERVER_END_REQ;
+    return ret;
+}
+
 
 /******************************************************************************
  * GetConsoleWindow [KERNEL32.@] Get hwnd of the console window.
@@ -371,6 +708,7 @@ BOOL WINAPI CloseConsoleHandle(HANDLE handle)
         SetLastError(ERROR_INVALID_PARAMETER);
         return FALSE;
     }
+    release_screen_buffer_view(handle);
     return CloseHandle(console_handle_unmap(handle));
 }
 
@@ -479,6 +817,8 @@ BOOL WINAPI WriteConsoleOutputW( HANDLE hConsoleOutput, const CHAR_INFO *lpBuffe
                                  COORD size, COORD coord, LPSMALL_RECT region )
 {
     int width, height, y;
+    DWORD written;
+    COORD sb_size;
     BOOL ret = TRUE;
 
     TRACE("(%p,%p,(%d,%d),(%d,%d),(%d,%dx%d,%d)\n",
@@ -492,23 +832,12 @@ BOOL WINAPI WriteConsoleOutputW( HANDLE hConsoleOutput, const CHAR_INFO *lpBuffe
     {
         for (y = 0; y < height; y++)
         {
-            SERVER_START_REQ( write_console_output )
-            {
-                req->handle = console_handle_unmap(hConsoleOutput);
-                req->x      = region->Left;
-                req->y      = region->Top + y;
-                req->mode   = CHAR_INFO_MODE_TEXTATTR;
-                req->wrap   = FALSE;
-                wine_server_add_data( req, &lpBuffer[(y + coord.Y) * size.X + coord.X],
-                                      width * sizeof(CHAR_INFO));
-                if ((ret = !wine_server_call_err( req )))
-                {
-                    width  = min( width, reply->width - region->Left );
-                    height = min( height, reply->height - region->Top );
-                }
-            }
-            SERVER_END_REQ;
-            if (!ret) break;
+            if (!(ret = write_console_cells( hConsoleOutput, &lpBuffer[(y + coord.Y) * size.X + coord.X],
+                                             width, CHAR_INFO_MODE_TEXTATTR, region->Left,
+                                             region->Top + y, FALSE, &written, &sb_size )))
+                break;
+            width  = min( width, sb_size.X - region->Left );
+            height = min( height, sb_size.Y - region->Top );
         }
     }
     region->Bottom = region->Top + height - 1;
@@ -564,24 +893,14 @@ BOOL WINAPI WriteConsoleOutputCharacterA( HANDLE hConsoleOutput, LPCSTR str, DWO
 BOOL WINAPI WriteConsoleOutputAttribute( HANDLE hConsoleOutput, CONST WORD *attr, DWORD length,
                                          COORD coord, LPDWORD lpNumAttrsWritten )
 {
+    DWORD written;
     BOOL ret;
 
     TRACE("(%p,%p,%d,%dx%d,%p)\n", hConsoleOutput,attr,length,coord.X,coord.Y,lpNumAttrsWritten);
 
-    SERVER_START_REQ( write_console_output )
-    {
-        req->handle = console_handle_unmap(hConsoleOutput);
-        req->x      = coord.X;
-        req->y      = coord.Y;
-        req->mode   = CHAR_INFO_MODE_ATTR;
-        req->wrap   = TRUE;
-        wine_server_add_data( req, attr, length * sizeof(WORD) );
-        if ((ret = !wine_server_call_err( req )))
-        {
-            if (lpNumAttrsWritten) *lpNumAttrsWritten = reply->written;
-        }
-    }
-    SERVER_END_REQ;
+    ret = write_console_cells( hConsoleOutput, attr, length, CHAR_INFO_MODE_ATTR,
+                               coord.X, coord.Y, TRUE, &written, NULL );
+    if (ret && lpNumAttrsWritten) *lpNumAttrsWritten = written;
     return ret;
 }
 
@@ -618,27 +937,15 @@ BOOL WINAPI FillConsoleOutputCharacterA( HANDLE hConsoleOutput, CHAR ch, DWORD l
 BOOL WINAPI FillConsoleOutputCharacterW( HANDLE hConsoleOutput, WCHAR ch, DWORD length,
                                          COORD coord, LPDWORD lpNumCharsWritten)
 {
-    BOOL ret;
+    char_info_t data;
 
     TRACE("(%p,%s,%d,(%dx%d),%p)\n",
           hConsoleOutput, debugstr_wn(&ch, 1), length, coord.X, coord.Y, lpNumCharsWritten);
 
-    SERVER_START_REQ( fill_console_output )
-    {
-        req->handle  = console_handle_unmap(hConsoleOutput);
-        req->x       = coord.X;
-        req->y       = coord.Y;
-        req->mode    = CHAR_INFO_MODE_TEXT;
-        req->wrap    = TRUE;
-        req->data.ch = ch;
-        req->count   = length;
-        if ((ret = !wine_server_call_err( req )))
-        {
-            if (lpNumCharsWritten) *lpNumCharsWritten = reply->written;
-        }
-    }
-    SERVER_END_REQ;
-    return ret;
+    data.ch   = ch;
+    data.attr = 0;
+    return fill_console_cells( hConsoleOutput, data, CHAR_INFO_MODE_TEXT, coord.X, coord.Y,
+                               length, TRUE, lpNumCharsWritten );
 }
 
 
@@ -659,27 +966,15 @@ BOOL WINAPI FillConsoleOutputCharacterW( HANDLE hConsoleOutput, WCHAR ch, DWORD
 BOOL WINAPI FillConsoleOutputAttribute( HANDLE hConsoleOutput, WORD attr, DWORD length,
                                         COORD coord, LPDWORD lpNumAttrsWritten )
 {
-    BOOL ret;
+    char_info_t data;
 
     TRACE("(%p,%d,%d,(%dx%d),%p)\n",
           hConsoleOutput, attr, length, coord.X, coord.Y, lpNumAttrsWritten);
 
-    SERVER_START_REQ( fill_console_output )
-    {
-        req->handle    = console_handle_unmap(hConsoleOutput);
-        req->x         = coord.X;
-        req->y         = coord.Y;
-        req->mode      = CHAR_INFO_MODE_ATTR;
-        req->wrap      = TRUE;
-        req->data.attr = attr;
-        req->count     = length;
-        if ((ret = !wine_server_call_err( req )))
-        {
-            if (lpNumAttrsWritten) *lpNumAttrsWritten = reply->written;
-        }
-    }
-    SERVER_END_REQ;
-    return ret;
+    data.ch   = 0;
+    data.attr = attr;
+    return fill_console_cells( hConsoleOutput, data, CHAR_INFO_MODE_ATTR, coord.X, coord.Y,
+                               length, TRUE, lpNumAttrsWritten );
 }
 
 
@@ -714,25 +1009,10 @@ BOOL WINAPI ReadConsoleOutputCharacterA(HANDLE hConsoleOutput, LPSTR lpstr, DWOR
 BOOL WINAPI ReadConsoleOutputCharacterW( HANDLE hConsoleOutput, LPWSTR buffer, DWORD count,
                                          COORD coord, LPDWORD read_count )
 {
-    BOOL ret;
-
     TRACE( "(%p,%p,%d,%dx%d,%p)\n", hConsoleOutput, buffer, count, coord.X, coord.Y, read_count );
 
-    SERVER_START_REQ( read_console_output )
-    {
-        req->handle = console_handle_unmap(hConsoleOutput);
-        req->x      = coord.X;
-        req->y      = coord.Y;
-        req->mode   = CHAR_INFO_MODE_TEXT;
-        req->wrap   = TRUE;
-        wine_server_set_reply( req, buffer, count * sizeof(WCHAR) );
-        if ((ret = !wine_server_call_err( req )))
-        {
-            if (read_count) *read_count = wine_server_reply_size(reply) / sizeof(WCHAR);
-        }
-    }
-    SERVER_END_REQ;
-    return ret;
+    return read_console_cells( hConsoleOutput, buffer, count, CHAR_INFO_MODE_TEXT,
+                               coord.X, coord.Y, TRUE, read_count, NULL );
 }
 
 
@@ -742,26 +1022,11 @@ BOOL WINAPI ReadConsoleOutputCharacterW( HANDLE hConsoleOutput, LPWSTR buffer, D
 BOOL WINAPI ReadConsoleOutputAttribute(HANDLE hConsoleOutput, LPWORD lpAttribute, DWORD length,
                                        COORD coord, LPDWORD read_count)
 {
-    BOOL ret;
-
     TRACE("(%p,%p,%d,%dx%d,%p)\n",
           hConsoleOutput, lpAttribute, length, coord.X, coord.Y, read_count);
 
-    SERVER_START_REQ( read_console_output )
-    {
-        req->handle = console_handle_unmap(hConsoleOutput);
-        req->x      = coord.X;
-        req->y      = coord.Y;
-        req->mode   = CHAR_INFO_MODE_ATTR;
-        req->wrap   = TRUE;
-        wine_server_set_reply( req, lpAttribute, length * sizeof(WORD) );
-        if ((ret = !wine_server_call_err( req )))
-        {
-            if (read_count) *read_count = wine_server_reply_size(reply) / sizeof(WORD);
-        }
-    }
-    SERVER_END_REQ;
-    return ret;
+    return read_console_cells( hConsoleOutput, lpAttribute, length, CHAR_INFO_MODE_ATTR,
+                               coord.X, coord.Y, TRUE, read_count, NULL );
 }
 
 
@@ -798,6 +1063,7 @@ BOOL WINAPI ReadConsoleOutputW( HANDLE hConsoleOutput, LPCHAR_INFO lpBuffer, COO
                                 COORD coord, LPSMALL_RECT region )
 {
     int width, height, y;
+    COORD sb_size;
     BOOL ret = TRUE;
 
     width = min( region->Right - region->Left + 1, size.X - coord.X );
@@ -807,23 +1073,12 @@ BOOL WINAPI ReadConsoleOutputW( HANDLE hConsoleOutput, LPCHAR_INFO lpBuffer, COO
     {
         for (y = 0; y < height; y++)
         {
-            SERVER_START_REQ( read_console_output )
-            {
-                req->handle = console_handle_unmap(hConsoleOutput);
-                req->x      = region->Left;
-                req->y      = region->Top + y;
-                req->mode   = CHAR_INFO_MODE_TEXTATTR;
-                req->wrap   = FALSE;
-                wine_server_set_reply( req, &lpBuffer[(y+coord.Y) * size.X + coord.X],
-                                       width * sizeof(CHAR_INFO) );
-                if ((ret = !wine_server_call_err( req )))
-                {
-                    width  = min( width, reply->width - region->Left );
-                    height = min( height, reply->height - region->Top );
-                }
-            }
-            SERVER_END_REQ;
-            if (!ret) break;
+            if (!(ret = read_console_cells( hConsoleOutput, &lpBuffer[(y+coord.Y) * size.X + coord.X],
+                                            width, CHAR_INFO_MODE_TEXTATTR, region->Left,
+                                            region->Top + y, FALSE, NULL, &sb_size )))
+                break;
+            width  = min( width, sb_size.X - region->Left );
+            height = min( height, sb_size.Y - region->Top );
         }
     }
     region->Bottom = region->Top + height - 1;
@@ -1438,25 +1693,15 @@ BOOL WINAPI ReadConsoleInputW(HANDLE hConsoleInput, PINPUT_RECORD lpBuffer,
 BOOL WINAPI WriteConsoleOutputCharacterW( HANDLE hConsoleOutput, LPCWSTR str, DWORD length,
                                           COORD coord, LPDWORD lpNumCharsWritten )
 {
+    DWORD written;
     BOOL ret;
 
     TRACE("(%p,%s,%d,%dx%d,%p)\n", hConsoleOutput,
           debugstr_wn(str, length), length, coord.X, coord.Y, lpNumCharsWritten);
 
-    SERVER_START_REQ( write_console_output )
-    {
-        req->handle = console_handle_unmap(hConsoleOutput);
-        req->x      = coord.X;
-        req->y      = coord.Y;
-        req->mode   = CHAR_INFO_MODE_TEXT;
-        req->wrap   = TRUE;
-        wine_server_add_data( req, str, length * sizeof(WCHAR) );
-        if ((ret = !wine_server_call_err( req )))
-        {
-            if (lpNumCharsWritten) *lpNumCharsWritten = reply->written;
-        }
-    }
-    SERVER_END_REQ;
+    ret = write_console_cells( hConsoleOutput, str, length, CHAR_INFO_MODE_TEXT,
+                               coord.X, coord.Y, TRUE, &written, NULL );
+    if (ret && lpNumCharsWritten) *lpNumCharsWritten = written;
     return ret;
 }
 
@@ -1930,21 +2175,13 @@ BOOL WINAPI SetConsoleMode(HANDLE hcon, DWORD mode)
  */
 static int CONSOLE_WriteChars(HANDLE hCon, LPCWSTR lpBuffer, int nc, COORD* pos)
 {
-    int written = -1;
+    DWORD written;
 
     if (!nc) return 0;
 
-    SERVER_START_REQ( write_console_output )
-    {
-        req->handle = console_handle_unmap(hCon);
-        req->x      = pos->X;
-        req->y      = pos->Y;
-        req->mode   = CHAR_INFO_MODE_TEXTSTDATTR;
-        req->wrap   = FALSE;
-        wine_server_add_data( req, lpBuffer, nc * sizeof(WCHAR) );
-        if (!wine_server_call_err( req )) written = reply->written;
-    }
-    SERVER_END_REQ;
+    if (!write_console_cells( hCon, lpBuffer, nc, CHAR_INFO_MODE_TEXTSTDATTR,
+                              pos->X, pos->Y, FALSE, &written, NULL ))
+        return -1;
 
     if (written > 0) pos->X += written;
     return written;
@@ -2397,19 +2634,11 @@ BOOL WINAPI ScrollConsoleScreenBufferA(HANDLE hConsoleOutput, LPSMALL_RECT lpScr
  */
 void CONSOLE_FillLineUniform(HANDLE hConsoleOutput, int i, int j, int len, LPCHAR_INFO lpFill)
 {
-    SERVER_START_REQ( fill_console_output )
-    {
-        req->handle    = console_handle_unmap(hConsoleOutput);
-        req->mode      = CHAR_INFO_MODE_TEXTATTR;
-        req->x         = i;
-        req->y         = j;
-        req->count     = len;
-        req->wrap      = FALSE;
-        req->data.ch   = lpFill->Char.UnicodeChar;
-        req->data.attr = lpFill->Attributes;
-        wine_server_call_err( req );
-    }
-    SERVER_END_REQ;
+    char_info_t data;
+
+    data.ch   = lpFill->Char.UnicodeChar;
+    data.attr = lpFill->Attributes;
+    fill_console_cells( hConsoleOutput, data, CHAR_INFO_MODE_TEXTATTR, i, j, len, FALSE, NULL );
 }
 
 /******************************************************************************
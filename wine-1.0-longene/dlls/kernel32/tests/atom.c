@@ -615,6 +615,56 @@ static void test_local_error_handling(void)
     }
 }
 
+/* global atoms are looked up case-insensitively by the server */
+static void test_find_atom_case(void)
+{
+    ATOM atoms[500];
+    const unsigned int count = sizeof(atoms) / sizeof(atoms[0]), loops = 20;
+    DWORD start, exact_time, mixed_time, missing_time;
+    char name[64];
+    unsigned int i, j;
+    ATOM atom;
+
+    for (i = 0; i < count; i++)
+    {
+        sprintf(name, "Wine_Test_Mixed_Case_Atom_Name_%03u", i);
+        atoms[i] = GlobalAddAtomA(name);
+        ok(atoms[i] != 0, "GlobalAddAtomA %s failed, error %d\n", name, GetLastError());
+    }
+
+    start = GetTickCount();
+    for (j = 0; j < loops; j++)
+        for (i = 0; i < count; i++)
+        {
+            sprintf(name, "Wine_Test_Mixed_Case_Atom_Name_%03u", i);
+            if ((atom = GlobalFindAtomA(name)) != atoms[i]) ok(0, "%s: got %x, expected %x\n", name, atom, atoms[i]);
+        }
+    exact_time = GetTickCount() - start;
+
+    start = GetTickCount();
+    for (j = 0; j < loops; j++)
+        for (i = 0; i < count; i++)
+        {
+            sprintf(name, "wINE_tEST_mIXED_cASE_aTOM_nAME_%03u", i);
+            if ((atom = GlobalFindAtomA(name)) != atoms[i]) ok(0, "%s: got %x, expected %x\n", name, atom, atoms[i]);
+        }
+    mixed_time = GetTickCount() - start;
+
+    start = GetTickCount();
+    for (j = 0; j < loops; j++)
+        for (i = 0; i < count; i++)
+        {
+            sprintf(name, "wine_test_mixed_case_atom_nome_%03u", i);
+            if ((atom = GlobalFindAtomA(name))) ok(0, "%s: found %x\n", name, atom);
+        }
+    missing_time = GetTickCount() - start;
+
+    trace("%u atom lookups: exact case %u ms, mixed case %u ms, missing %u ms\n",
+          count * loops, exact_time, mixed_time, missing_time);
+
+    for (i = 0; i < count; i++) GlobalDeleteAtom(atoms[i]);
+}
+
 START_TEST(atom)
 {
     test_add_atom();
@@ -623,4 +673,5 @@ START_TEST(atom)
     test_local_add_atom();
     test_local_get_atom_name();
     test_local_error_handling();
+    test_find_atom_case();
 }
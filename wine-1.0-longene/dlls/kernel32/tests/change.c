@@ -785,6 +785,103 @@ static void test_readdirectorychanges_filedir(void)
     ok( r == TRUE, "failed to remove directory\n");
 }
 
+static void test_readdirectorychanges_batch(void)
+{
+    static const char *names[] = { "a", "bb", "ccc" };
+    char path[MAX_PATH], file[MAX_PATH];
+    DWORD buffer[0x400], r, i;
+    PFILE_NOTIFY_INFORMATION pfni;
+    HANDLE hdir, hfile;
+    OVERLAPPED ov;
+
+    r = GetTempPathA( MAX_PATH, path );
+    ok( r != 0, "temp path failed\n");
+    if (!r) return;
+    lstrcatA( path, "batch" );
+    for (i = 0; i < sizeof(names)/sizeof(names[0]); i++)
+    {
+        sprintf( file, "%s\\%s", path, names[i] );
+        DeleteFileA( file );
+    }
+    sprintf( file, "%s\\first", path );
+    DeleteFileA( file );
+    RemoveDirectoryA( path );
+
+    r = CreateDirectoryA( path, NULL );
+    ok( r == TRUE, "failed to create directory\n");
+
+    hdir = CreateFileA( path, GENERIC_READ|SYNCHRONIZE|FILE_LIST_DIRECTORY,
+                        FILE_SHARE_READ|FILE_SHARE_WRITE|FILE_SHARE_DELETE, NULL,
+                        OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, NULL );
+    ok( hdir != INVALID_HANDLE_VALUE, "failed to open directory\n");
+
+    ov.hEvent = CreateEvent( NULL, 0, 0, NULL );
+
+    /* the first change completes the pending read */
+    r = pReadDirectoryChangesW( hdir, buffer, sizeof(buffer), FALSE,
+                                FILE_NOTIFY_CHANGE_FILE_NAME, NULL, &ov, NULL );
+    ok( r == TRUE, "should return true\n");
+
+    hfile = CreateFileA( file, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL );
+    ok( hfile != INVALID_HANDLE_VALUE, "failed to create file\n");
+    CloseHandle( hfile );
+
+    r = WaitForSingleObject( ov.hEvent, 1000 );
+    ok( r == WAIT_OBJECT_0, "event should be ready\n" );
+
+    /* changes made while no read is pending are queued and returned together */
+    for (i = 0; i < sizeof(names)/sizeof(names[0]); i++)
+    {
+        sprintf( file, "%s\\%s", path, names[i] );
+        hfile = CreateFileA( file, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL );
+        ok( hfile != INVALID_HANDLE_VALUE, "failed to create file\n");
+        CloseHandle( hfile );
+    }
+
+    memset( buffer, 0, sizeof(buffer) );
+    r = pReadDirectoryChangesW( hdir, buffer, sizeof(buffer), FALSE,
+                                FILE_NOTIFY_CHANGE_FILE_NAME, NULL, &ov, NULL );
+    ok( r == TRUE, "should return true\n");
+
+    r = WaitForSingleObject( ov.hEvent, 1000 );
+    ok( r == WAIT_OBJECT_0, "event should be ready\n" );
+    ok( ov.Internal == STATUS_SUCCESS, "ov.Internal wrong %lx\n", ov.Internal );
+
+    pfni = (PFILE_NOTIFY_INFORMATION)buffer;
+    for (i = 0; i < sizeof(names)/sizeof(names[0]); i++)
+    {
+        DWORD k, len = strlen( names[i] );
+
+        ok( pfni->Action == FILE_ACTION_ADDED, "%u: action wrong %u\n", i, pfni->Action );
+        ok( pfni->FileNameLength == len * sizeof(WCHAR), "%u: len wrong %u\n", i, pfni->FileNameLength );
+        for (k = 0; k < len; k++) if (pfni->FileName[k] != names[i][k]) break;
+        ok( k == len, "%u: name wrong\n", i );
+        if (i == sizeof(names)/sizeof(names[0]) - 1)
+            ok( !pfni->NextEntryOffset, "last offset wrong %u\n", pfni->NextEntryOffset );
+        else if (!pfni->NextEntryOffset)
+        {
+            ok( 0, "%u: missing next entry\n", i );
+            break;
+        }
+        else ok( !(pfni->NextEntryOffset & 3), "%u: unaligned offset %u\n", i, pfni->NextEntryOffset );
+        pfni = (PFILE_NOTIFY_INFORMATION)((char *)pfni + pfni->NextEntryOffset);
+    }
+
+    CloseHandle( ov.hEvent );
+    CloseHandle( hdir );
+
+    sprintf( file, "%s\\first", path );
+    DeleteFileA( file );
+    for (i = 0; i < sizeof(names)/sizeof(names[0]); i++)
+    {
+        sprintf( file, "%s\\%s", path, names[i] );
+        r = DeleteFileA( file );
+        ok( r == TRUE, "failed to delete file\n");
+    }
+    r = RemoveDirectoryA( path );
+    ok( r == TRUE, "failed to remove directory\n");
+}
+
 static void test_ffcn_directory_overlap(void)
 {
     HANDLE parent_watch, child_watch, parent_thread, child_thread;
@@ -886,5 +983,6 @@ START_TEST(change)
     test_readdirectorychanges();
     test_readdirectorychanges_null();
     test_readdirectorychanges_filedir();
+    test_readdirectorychanges_batch();
     test_ffcn_directory_overlap();
 }
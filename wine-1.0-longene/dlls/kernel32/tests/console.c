@@ -537,6 +537,76 @@ static void testScroll(HANDLE hCon, COORD sbSize)
     }
 }
 
+/*
+ * Test the cell functions on two handles to the same screen buffer, one of
+ * them read-only, and across a resize of the buffer
+ */
+static void testOutputCells(HANDLE hCon, COORD sbSize)
+{
+    static const WCHAR textW[] = {'a','b','c','d'};
+    HANDLE hConRO;
+    CHAR_INFO cells[4], readback[4];
+    WCHAR chars[4];
+    WORD attrs[4];
+    COORD size = {4, 1}, origin = {0, 0}, pos, newSize;
+    SMALL_RECT region;
+    DWORD count;
+    int i;
+
+    hConRO = CreateFileA("CONOUT$", GENERIC_READ, FILE_SHARE_READ|FILE_SHARE_WRITE,
+                         NULL, OPEN_EXISTING, 0, 0);
+    ok(hConRO != INVALID_HANDLE_VALUE, "Couldn't open a read-only CONOUT$\n");
+
+    for (i = 0; i < 4; i++)
+    {
+        cells[i].Char.UnicodeChar = textW[i];
+        cells[i].Attributes = i + 1;
+    }
+    region.Left = 2; region.Top = 3; region.Right = 5; region.Bottom = 3;
+    ok(WriteConsoleOutputW(hCon, cells, size, origin, &region), "WriteConsoleOutputW failed\n");
+    ok(region.Right == 5 && region.Bottom == 3, "Bad region %d,%d\n", region.Right, region.Bottom);
+
+    region.Left = 2; region.Top = 3; region.Right = 5; region.Bottom = 3;
+    memset(readback, 0, sizeof(readback));
+    ok(ReadConsoleOutputW(hConRO, readback, size, origin, &region), "ReadConsoleOutputW failed\n");
+    for (i = 0; i < 4; i++)
+        ok(readback[i].Char.UnicodeChar == textW[i] && readback[i].Attributes == i + 1,
+           "Bad cell %d: %x/%x\n", i, readback[i].Char.UnicodeChar, readback[i].Attributes);
+
+    /* writes through a read-only handle still fail */
+    SetLastError(0xdeadbeef);
+    pos.X = 0; pos.Y = 0;
+    ok(!WriteConsoleOutputCharacterW(hConRO, textW, 4, pos, &count), "Shouldn't succeed\n");
+    ok(GetLastError() == ERROR_ACCESS_DENIED, "Bad error %u\n", GetLastError());
+
+    /* wrapping at the end of a line */
+    pos.X = sbSize.X - 2; pos.Y = 4;
+    ok(WriteConsoleOutputCharacterW(hCon, textW, 4, pos, &count) && count == 4,
+       "WriteConsoleOutputCharacterW failed\n");
+    ok(FillConsoleOutputAttribute(hCon, 0x1e, 4, pos, &count) && count == 4,
+       "FillConsoleOutputAttribute failed\n");
+    ok(ReadConsoleOutputCharacterW(hConRO, chars, 4, pos, &count) && count == 4,
+       "ReadConsoleOutputCharacterW failed\n");
+    ok(!memcmp(chars, textW, sizeof(textW)), "Bad chars %x %x %x %x\n", chars[0], chars[1], chars[2], chars[3]);
+    ok(ReadConsoleOutputAttribute(hConRO, attrs, 4, pos, &count) && count == 4,
+       "ReadConsoleOutputAttribute failed\n");
+    for (i = 0; i < 4; i++) ok(attrs[i] == 0x1e, "Bad attribute %d: %x\n", i, attrs[i]);
+
+    /* the contents survive a resize */
+    newSize.X = sbSize.X + 10; newSize.Y = sbSize.Y + 10;
+    ok(SetConsoleScreenBufferSize(hCon, newSize), "Couldn't resize the screen buffer\n");
+    pos.X = 2; pos.Y = 3;
+    ok(ReadConsoleOutputCharacterW(hConRO, chars, 4, pos, &count) && count == 4,
+       "ReadConsoleOutputCharacterW failed\n");
+    ok(!memcmp(chars, textW, sizeof(textW)), "Bad chars %x %x %x %x\n", chars[0], chars[1], chars[2], chars[3]);
+    pos.X = newSize.X - 1; pos.Y = newSize.Y - 1;
+    ok(WriteConsoleOutputCharacterW(hCon, textW, 4, pos, &count) && count == 1,
+       "Wrote %u chars at the end of the buffer\n", count);
+    ok(SetConsoleScreenBufferSize(hCon, sbSize), "Couldn't restore the screen buffer size\n");
+
+    CloseHandle(hConRO);
+}
+
 static int mch_count;
 /* we need the event as Wine console event generation isn't synchronous
  * (ie GenerateConsoleCtrlEvent returns before all ctrl-handlers in all
@@ -869,6 +939,8 @@ START_TEST(console)
     /* testBottomScroll(); */
     /* will test all the scrolling operations */
     testScroll(hConOut, sbi.dwSize);
+    /* will test the cell functions through several handles */
+    testOutputCells(hConOut, sbi.dwSize);
     /* will test sb creation / modification / codepage handling */
     testScreenBuffer(hConOut);
     testCtrlHandler();
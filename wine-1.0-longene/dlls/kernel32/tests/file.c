@@ -20,6 +20,7 @@
  */
 
 #include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 
@@ -2181,6 +2182,109 @@ static void test_ReplaceFileW(void)
     ok(ret, "DeleteFileW: error %d\n", GetLastError());
 }
 
+/* time a round of lookups of the test files in the wrong case */
+static DWORD time_path_lookups(const char *root, unsigned int files, unsigned int loops)
+{
+    char path[MAX_PATH];
+    unsigned int i, j;
+    DWORD start;
+
+    start = GetTickCount();
+    for (i = 0; i < loops; i++)
+        for (j = 0; j < files; j++)
+        {
+            sprintf(path, "%s\\mixedcase_file%u.TXT", root, j);
+            if (GetFileAttributesA(path) == INVALID_FILE_ATTRIBUTES) ok(0, "%s not found\n", path);
+        }
+    return GetTickCount() - start;
+}
+
+static void test_path_resolution(void)
+{
+    const unsigned int files = 200, loops = 5;
+    char windir[MAX_PATH], temp_path[MAX_PATH], root[MAX_PATH], path[MAX_PATH];
+    DWORD fresh_time, cached_time;
+    unsigned int i;
+    HANDLE file;
+    DWORD attr;
+    BOOL ret;
+
+    /* the listing of the windows directory is old enough to be cached,
+     * so the second round of lookups is served from the cache */
+    GetWindowsDirectoryA(windir, MAX_PATH);
+    for (i = 0; i < 2; i++)
+    {
+        sprintf(path, "%s\\SyStEm32", windir);
+        attr = GetFileAttributesA(path);
+        ok(attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY),
+           "%u: %s not found, error %d\n", i, path, GetLastError());
+        sprintf(path, "%s\\No_Such_File.Txt", windir);
+        SetLastError(0xdeadbeef);
+        attr = GetFileAttributesA(path);
+        ok(attr == INVALID_FILE_ATTRIBUTES, "%u: %s found\n", i, path);
+        ok(GetLastError() == ERROR_FILE_NOT_FOUND, "%u: wrong error %d\n", i, GetLastError());
+    }
+
+    GetTempPathA(MAX_PATH, temp_path);
+    sprintf(root, "%sPathRes%x", temp_path, GetCurrentProcessId());
+    ret = CreateDirectoryA(root, NULL);
+    ok(ret, "CreateDirectoryA error %d\n", GetLastError());
+    if (!ret) return;
+
+    for (i = 0; i < files; i++)
+    {
+        sprintf(path, "%s\\MixedCase_File%u.Txt", root, i);
+        file = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_NEW, 0, NULL);
+        ok(file != INVALID_HANDLE_VALUE, "CreateFileA %s error %d\n", path, GetLastError());
+        CloseHandle(file);
+    }
+
+    /* a directory modified in the last seconds is read again on every lookup */
+    fresh_time = time_path_lookups(root, files, 1);
+
+    /* its change time can't be set back, so wait until the listing may be kept;
+     * the first lookup then caches it and the others are served from the cache */
+    Sleep(3000);
+    cached_time = time_path_lookups(root, files, loops);
+    trace("%u wrong case lookups: %u ms in a fresh directory, %u ms x%u in a settled one\n",
+          files, fresh_time, cached_time, loops);
+
+    sprintf(path, "%s\\MixedCase_File%u.Txt", root, files);
+    SetLastError(0xdeadbeef);
+    attr = GetFileAttributesA(path);
+    ok(attr == INVALID_FILE_ATTRIBUTES, "%s found\n", path);
+    ok(GetLastError() == ERROR_FILE_NOT_FOUND, "wrong error %d\n", GetLastError());
+
+    /* a file added to a cached directory has to show up */
+    sprintf(path, "%s\\Added_Later.Txt", root);
+    file = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_NEW, 0, NULL);
+    ok(file != INVALID_HANDLE_VALUE, "CreateFileA error %d\n", GetLastError());
+    CloseHandle(file);
+    sprintf(path, "%s\\ADDED_LATER.TXT", root);
+    attr = GetFileAttributesA(path);
+    ok(attr != INVALID_FILE_ATTRIBUTES, "new file not found, error %d\n", GetLastError());
+
+    /* and a file deleted from one has to go away */
+    Sleep(3000);
+    attr = GetFileAttributesA(path);
+    ok(attr != INVALID_FILE_ATTRIBUTES, "new file not found after a while, error %d\n", GetLastError());
+    ret = DeleteFileA(path);
+    ok(ret, "DeleteFileA error %d\n", GetLastError());
+    SetLastError(0xdeadbeef);
+    attr = GetFileAttributesA(path);
+    ok(attr == INVALID_FILE_ATTRIBUTES, "deleted file still found\n");
+    ok(GetLastError() == ERROR_FILE_NOT_FOUND, "wrong error %d\n", GetLastError());
+
+    for (i = 0; i < files; i++)
+    {
+        sprintf(path, "%s\\MixedCase_File%u.Txt", root, i);
+        ret = DeleteFileA(path);
+        ok(ret, "DeleteFileA %s error %d\n", path, GetLastError());
+    }
+    ret = RemoveDirectoryA(root);
+    ok(ret, "RemoveDirectoryA error %d\n", GetLastError());
+}
+
 START_TEST(file)
 {
     InitFunctionPointers();
@@ -2215,6 +2319,7 @@ START_TEST(file)
     test_OpenFile();
     test_overlapped();
     test_RemoveDirectory();
+    test_path_resolution();
     test_ReplaceFileA();
     test_ReplaceFileW();
 }
@@ -34,6 +34,225 @@ static SIZE_T resize_9x(SIZE_T size)
     return max(dwSizeAligned, 12); /* at least 12 bytes */
 }
 
+static BOOL (WINAPI *pHeapQueryInformation)(HANDLE,HEAP_INFORMATION_CLASS,PVOID,SIZE_T,PSIZE_T);
+
+#define LFH_THREADS  4
+#define LFH_BLOCKS   64
+#define LFH_ROUNDS   200000
+
+static DWORD WINAPI lfh_thread(void *arg)
+{
+    HANDLE heap = arg;
+    char *blocks[LFH_BLOCKS] = { NULL };
+    int i, j;
+
+    for (i = 0; i < LFH_ROUNDS; i++)
+    {
+        j = i % LFH_BLOCKS;
+        HeapFree(heap, 0, blocks[j]);
+        if (!(blocks[j] = HeapAlloc(heap, 0, 16 + (i * 7) % 500))) return 1;
+        blocks[j][0] = j;
+    }
+    for (j = 0; j < LFH_BLOCKS; j++) HeapFree(heap, 0, blocks[j]);
+    return 0;
+}
+
+/* returns the time the threads took to allocate and free their blocks */
+static DWORD run_lfh_threads(HANDLE heap)
+{
+    HANDLE threads[LFH_THREADS];
+    DWORD start, code, i;
+
+    start = GetTickCount();
+    for (i = 0; i < LFH_THREADS; i++)
+        threads[i] = CreateThread(NULL, 0, lfh_thread, heap, 0, NULL);
+    WaitForMultipleObjects(LFH_THREADS, threads, TRUE, INFINITE);
+    start = GetTickCount() - start;
+    for (i = 0; i < LFH_THREADS; i++)
+    {
+        GetExitCodeThread(threads[i], &code);
+        ok(!code, "thread %u failed to allocate\n", i);
+        CloseHandle(threads[i]);
+    }
+    return start;
+}
+
+struct lfh_locked_data
+{
+    HANDLE heap;
+    HANDLE ready;
+    HANDLE go;
+};
+
+/* frees and reallocates its blocks once the main thread holds the heap lock */
+static DWORD WINAPI lfh_locked_thread(void *arg)
+{
+    struct lfh_locked_data *data = arg;
+    char *blocks[16];
+    int i, j;
+
+    for (i = 0; i < 16; i++)
+        if (!(blocks[i] = HeapAlloc(data->heap, 0, 100))) return 1;
+    SetEvent(data->ready);
+    WaitForSingleObject(data->go, INFINITE);
+    for (j = 0; j < 1000; j++)
+    {
+        for (i = 0; i < 16; i++)
+            if (!HeapFree(data->heap, 0, blocks[i])) return 2;
+        for (i = 0; i < 16; i++)
+            if (!(blocks[i] = HeapAlloc(data->heap, 0, 100))) return 3;
+    }
+    for (i = 0; i < 16; i++) HeapFree(data->heap, 0, blocks[i]);
+    return 0;
+}
+
+static void test_heap_lfh(void)
+{
+    HANDLE heap;
+    ULONG info;
+    SIZE_T needed, i;
+    BYTE *mem;
+    BOOL ret;
+    DWORD standard, lfh, code;
+    struct lfh_locked_data locked;
+    HANDLE thread;
+
+    heap = HeapCreate(0, 0, 0);
+    info = 2;
+    ret = HeapSetInformation(heap, HeapCompatibilityInformation, &info, sizeof(info));
+    ok(ret, "HeapSetInformation failed with %d\n", GetLastError());
+    if (pHeapQueryInformation)
+    {
+        info = 0xdeadbeef;
+        needed = 0;
+        ret = pHeapQueryInformation(heap, HeapCompatibilityInformation, &info, sizeof(info), &needed);
+        ok(ret, "HeapQueryInformation failed with %d\n", GetLastError());
+        ok(info == 2, "expected the low-fragmentation heap, got %u\n", info);
+        ok(needed == sizeof(info), "wrong size %lu\n", needed);
+    }
+
+    /* blocks going through the front end are still regular heap blocks */
+    mem = HeapAlloc(heap, 0, 100);
+    memset(mem, 0xcc, 100);
+    HeapFree(heap, 0, mem);
+    ok(HeapValidate(heap, 0, NULL), "heap is invalid with a freed block\n");
+    mem = HeapAlloc(heap, HEAP_ZERO_MEMORY, 100);
+    ok(mem != NULL, "memory not allocated\n");
+    ok(HeapSize(heap, 0, mem) == 100, "HeapSize returned %lu\n", HeapSize(heap, 0, mem));
+    for (i = 0; i < 100; i++) if (mem[i]) break;
+    ok(i == 100, "byte %lu not cleared\n", i);
+    mem = HeapReAlloc(heap, 0, mem, 4000);
+    ok(mem != NULL, "memory not reallocated\n");
+    ok(HeapSize(heap, 0, mem) == 4000, "HeapSize returned %lu\n", HeapSize(heap, 0, mem));
+    HeapFree(heap, 0, mem);
+    ok(HeapValidate(heap, 0, NULL), "heap is invalid\n");
+
+    /* a cached block can't be freed twice */
+    mem = HeapAlloc(heap, 0, 100);
+    ok(HeapFree(heap, 0, mem), "HeapFree failed with %d\n", GetLastError());
+    ok(!HeapFree(heap, 0, mem), "block freed twice\n");
+    ok(HeapValidate(heap, 0, NULL), "heap is invalid after a double free\n");
+    HeapDestroy(heap);
+
+    /* nor do frees and allocations served by the front end contend on the heap lock */
+    heap = HeapCreate(0, 0, 0);
+    info = 2;
+    HeapSetInformation(heap, HeapCompatibilityInformation, &info, sizeof(info));
+    locked.heap = heap;
+    locked.ready = CreateEventA(NULL, FALSE, FALSE, NULL);
+    locked.go = CreateEventA(NULL, FALSE, FALSE, NULL);
+    thread = CreateThread(NULL, 0, lfh_locked_thread, &locked, 0, NULL);
+    WaitForSingleObject(locked.ready, INFINITE);
+    ok(HeapLock(heap), "HeapLock failed with %d\n", GetLastError());
+    SetEvent(locked.go);
+    code = WaitForSingleObject(thread, 5000);
+    ok(code == WAIT_OBJECT_0, "front end blocked on the heap lock\n");
+    HeapUnlock(heap);
+    WaitForSingleObject(thread, INFINITE);
+    GetExitCodeThread(thread, &code);
+    ok(!code, "thread failed at step %u\n", code);
+    CloseHandle(thread);
+    CloseHandle(locked.ready);
+    CloseHandle(locked.go);
+    ok(HeapValidate(heap, 0, NULL), "heap is invalid\n");
+    HeapDestroy(heap);
+
+    /* the front end needs serialization */
+    heap = HeapCreate(HEAP_NO_SERIALIZE, 0, 0);
+    info = 2;
+    ret = HeapSetInformation(heap, HeapCompatibilityInformation, &info, sizeof(info));
+    ok(!ret, "HeapSetInformation succeeded on a HEAP_NO_SERIALIZE heap\n");
+    HeapDestroy(heap);
+
+    heap = HeapCreate(0, 0, 0);
+    standard = run_lfh_threads(heap);
+    ok(HeapValidate(heap, 0, NULL), "heap is invalid\n");
+    HeapDestroy(heap);
+
+    heap = HeapCreate(0, 0, 0);
+    info = 2;
+    HeapSetInformation(heap, HeapCompatibilityInformation, &info, sizeof(info));
+    lfh = run_lfh_threads(heap);
+    ok(HeapValidate(heap, 0, NULL), "heap is invalid\n");
+    HeapDestroy(heap);
+
+    trace("%d threads, %d allocations each: %u ms on the standard heap, %u ms on the low-fragmentation heap\n",
+          LFH_THREADS, LFH_ROUNDS, standard, lfh);
+}
+
+static void test_large_blocks(void)
+{
+    PROCESS_HEAP_ENTRY walk;
+    HANDLE heap;
+    BYTE *mem, *blocks[32];
+    SIZE_T size = 8 * 1024 * 1024;
+    BOOL found = FALSE;
+    int i;
+
+    heap = HeapCreate(0, 0, 0);
+    mem = HeapAlloc(heap, HEAP_ZERO_MEMORY, size);
+    ok(mem != NULL, "memory not allocated\n");
+    ok(HeapSize(heap, 0, mem) == size, "HeapSize returned %lu\n", HeapSize(heap, 0, mem));
+    ok(!mem[0] && !mem[size - 1], "memory not cleared\n");
+    mem[0] = 1;
+    mem[size - 1] = 2;
+
+    mem = HeapReAlloc(heap, HEAP_ZERO_MEMORY, mem, 2 * size);
+    ok(mem != NULL, "memory not reallocated\n");
+    ok(HeapSize(heap, 0, mem) == 2 * size, "HeapSize returned %lu\n", HeapSize(heap, 0, mem));
+    ok(mem[0] == 1 && mem[size - 1] == 2, "contents not kept\n");
+    ok(!mem[size] && !mem[2 * size - 1], "memory not cleared\n");
+
+    mem = HeapReAlloc(heap, 0, mem, size / 2);
+    ok(mem != NULL, "memory not reallocated\n");
+    ok(HeapSize(heap, 0, mem) == size / 2, "HeapSize returned %lu\n", HeapSize(heap, 0, mem));
+    ok(mem[0] == 1, "contents not kept\n");
+    ok(HeapValidate(heap, 0, mem), "block is invalid\n");
+    ok(HeapValidate(heap, 0, NULL), "heap is invalid\n");
+
+    memset(&walk, 0, sizeof(walk));
+    while (HeapWalk(heap, &walk))
+        if (walk.lpData == mem) found = (walk.wFlags & PROCESS_HEAP_ENTRY_BUSY) != 0;
+    ok(found, "large block not found by HeapWalk\n");
+
+    ok(HeapFree(heap, 0, mem), "HeapFree failed\n");
+    ok(!HeapValidate(heap, 0, mem), "freed block is still valid\n");
+
+    /* blocks that come and go don't leave anything behind */
+    for (i = 0; i < 32; i++)
+    {
+        blocks[i] = HeapAlloc(heap, 0, size + i * 4096);
+        ok(blocks[i] != NULL, "memory not allocated for block %d\n", i);
+    }
+    for (i = 0; i < 32; i += 2) HeapFree(heap, 0, blocks[i]);
+    for (i = 1; i < 32; i += 2)
+        ok(HeapSize(heap, 0, blocks[i]) == size + i * 4096, "HeapSize returned %lu\n",
+           HeapSize(heap, 0, blocks[i]));
+    for (i = 1; i < 32; i += 2) HeapFree(heap, 0, blocks[i]);
+    ok(HeapValidate(heap, 0, NULL), "heap is invalid\n");
+    HeapDestroy(heap);
+}
+
 START_TEST(heap)
 {
     LPVOID  mem;
@@ -317,4 +536,8 @@ START_TEST(heap)
         "MAGIC_DEAD)\n", mem, GetLastError(), GetLastError());
 
     GlobalFree(gbl);
+
+    pHeapQueryInformation = (void *)GetProcAddress(GetModuleHandleA("kernel32.dll"), "HeapQueryInformation");
+    test_heap_lfh();
+    test_large_blocks();
 }
@@ -103,6 +103,186 @@ static IMAGE_SECTION_HEADER section =
     IMAGE_SCN_CNT_INITIALIZED_DATA | IMAGE_SCN_MEM_READ, /* Characteristics */
 };
 
+#define BIND_IMAGE_SIZE  0x800
+#define BIND_DATA_RVA    0x200
+
+/* build a dll whose only section starts at BIND_DATA_RVA, alignments
+ * below the page size make the loader map it flat, rva == file offset */
+static void init_bind_image( BYTE *image, ULONG_PTR base, DWORD dir, DWORD dir_size )
+{
+    IMAGE_NT_HEADERS nt = nt_header;
+    IMAGE_SECTION_HEADER sec = section;
+
+    memset( image, 0, BIND_IMAGE_SIZE );
+    nt.OptionalHeader.ImageBase = base;
+    nt.OptionalHeader.SectionAlignment = 0x200;
+    nt.OptionalHeader.FileAlignment = 0x200;
+    nt.OptionalHeader.SizeOfImage = BIND_IMAGE_SIZE;
+    nt.OptionalHeader.SizeOfHeaders = BIND_DATA_RVA;
+    nt.OptionalHeader.NumberOfRvaAndSizes = IMAGE_NUMBEROF_DIRECTORY_ENTRIES;
+    nt.OptionalHeader.DataDirectory[dir].VirtualAddress = BIND_DATA_RVA;
+    nt.OptionalHeader.DataDirectory[dir].Size = dir_size;
+    sec.Misc.VirtualSize = BIND_IMAGE_SIZE - BIND_DATA_RVA;
+    sec.VirtualAddress = BIND_DATA_RVA;
+    sec.SizeOfRawData = BIND_IMAGE_SIZE - BIND_DATA_RVA;
+    sec.PointerToRawData = BIND_DATA_RVA;
+    sec.Characteristics |= IMAGE_SCN_MEM_WRITE;
+    memcpy( image, &dos_header, sizeof(dos_header) );
+    memcpy( image + sizeof(dos_header), &nt, sizeof(nt) );
+    memcpy( image + sizeof(dos_header) + sizeof(nt), &sec, sizeof(sec) );
+}
+
+/* target exporting func1 and func2 at rva func_rva and func_rva + 0x10 */
+static void write_bind_target( const char *name, DWORD func_rva )
+{
+    BYTE image[BIND_IMAGE_SIZE];
+    IMAGE_EXPORT_DIRECTORY *exp = (IMAGE_EXPORT_DIRECTORY *)(image + BIND_DATA_RVA);
+    DWORD *functions = (DWORD *)(image + 0x240), *names = (DWORD *)(image + 0x250);
+    WORD *ordinals = (WORD *)(image + 0x260);
+    DWORD written;
+    HANDLE file;
+
+    init_bind_image( image, 0x11000000, IMAGE_DIRECTORY_ENTRY_EXPORT, 0x100 );
+    exp->Name = 0x280;
+    exp->Base = 1;
+    exp->NumberOfFunctions = 2;
+    exp->NumberOfNames = 2;
+    exp->AddressOfFunctions = 0x240;
+    exp->AddressOfNames = 0x250;
+    exp->AddressOfNameOrdinals = 0x260;
+    functions[0] = func_rva;
+    functions[1] = func_rva + 0x10;
+    names[0] = 0x2a0;
+    names[1] = 0x2b0;
+    ordinals[0] = 0;
+    ordinals[1] = 1;
+    strcpy( (char *)image + 0x280, "bindtgt.dll" );
+    strcpy( (char *)image + 0x2a0, "func1" );
+    strcpy( (char *)image + 0x2b0, "func2" );
+
+    file = CreateFileA( name, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, 0 );
+    ok( file != INVALID_HANDLE_VALUE, "CreateFile error %d\n", GetLastError() );
+    ok( WriteFile( file, image, sizeof(image), &written, NULL ), "WriteFile error %d\n", GetLastError() );
+    CloseHandle( file );
+}
+
+/* importer binding func1 and func2 of the target, iat at rva 0x260 */
+static void write_bind_importer( const char *name, const char *target )
+{
+    BYTE image[BIND_IMAGE_SIZE];
+    IMAGE_IMPORT_DESCRIPTOR *imp = (IMAGE_IMPORT_DESCRIPTOR *)(image + BIND_DATA_RVA);
+    IMAGE_THUNK_DATA *ilt = (IMAGE_THUNK_DATA *)(image + 0x240);
+    IMAGE_THUNK_DATA *iat = (IMAGE_THUNK_DATA *)(image + 0x260);
+    DWORD written;
+    HANDLE file;
+
+    init_bind_image( image, 0x12000000, IMAGE_DIRECTORY_ENTRY_IMPORT, 2 * sizeof(*imp) );
+    imp->OriginalFirstThunk = 0x240;
+    imp->Name = 0x400;
+    imp->FirstThunk = 0x260;
+    ilt[0].u1.AddressOfData = iat[0].u1.AddressOfData = 0x2a0;
+    ilt[1].u1.AddressOfData = iat[1].u1.AddressOfData = 0x2c0;
+    strcpy( (char *)image + 0x2a2, "func1" );
+    strcpy( (char *)image + 0x2c2, "func2" );
+    strcpy( (char *)image + 0x400, target );
+
+    file = CreateFileA( name, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, 0 );
+    ok( file != INVALID_HANDLE_VALUE, "CreateFile error %d\n", GetLastError() );
+    ok( WriteFile( file, image, sizeof(image), &written, NULL ), "WriteFile error %d\n", GetLastError() );
+    CloseHandle( file );
+}
+
+static void check_bind_iat( HMODULE importer, const char *target, DWORD func_rva, const char *when )
+{
+    const ULONG_PTR *iat = (const ULONG_PTR *)((const char *)importer + 0x260);
+    HMODULE tgt = GetModuleHandleA( target );
+
+    ok( tgt != 0, "%s: target not loaded\n", when );
+    if (!tgt) return;
+    ok( iat[0] == (ULONG_PTR)tgt + func_rva, "%s: func1 bound to %lx, expected %lx\n",
+        when, iat[0], (ULONG_PTR)tgt + func_rva );
+    ok( iat[1] == (ULONG_PTR)tgt + func_rva + 0x10, "%s: func2 bound to %lx, expected %lx\n",
+        when, iat[1], (ULONG_PTR)tgt + func_rva + 0x10 );
+    ok( iat[0] == (ULONG_PTR)GetProcAddress( tgt, "func1" ), "%s: func1 differs from GetProcAddress\n", when );
+}
+
+/* the loader keeps the resolved imports of a dll in a cache keyed on the
+ * export tables of its targets, a changed target must not reuse it */
+static void test_import_binding(void)
+{
+    char temp_path[MAX_PATH], target[MAX_PATH], importer[MAX_PATH];
+    const IMAGE_EXPORT_DIRECTORY *exp;
+    const DWORD *names;
+    HMODULE kernel32, hlib;
+    DWORD start, i, j, hash;
+    const char *p;
+    ULONG size;
+
+    GetTempPathA( MAX_PATH, temp_path );
+    GetTempFileNameA( temp_path, "bnd", 0, target );
+    GetTempFileNameA( temp_path, "bnd", 0, importer );
+    write_bind_target( target, 0x300 );
+    write_bind_importer( importer, target );
+
+    start = GetTickCount();
+    hlib = LoadLibraryA( importer );
+    trace( "first load %u ms\n", GetTickCount() - start );
+    ok( hlib != 0, "LoadLibrary error %d\n", GetLastError() );
+    if (!hlib) goto done;
+    check_bind_iat( hlib, target, 0x300, "first load" );
+    ok( FreeLibrary( hlib ), "FreeLibrary error %d\n", GetLastError() );
+    ok( !GetModuleHandleA( target ), "target still loaded\n" );
+
+    start = GetTickCount();
+    for (i = 0; i < 100; i++)
+    {
+        hlib = LoadLibraryA( importer );
+        if (!hlib) break;
+        if (!i) check_bind_iat( hlib, target, 0x300, "reload" );
+        FreeLibrary( hlib );
+    }
+    ok( i == 100, "LoadLibrary %u error %d\n", i, GetLastError() );
+    trace( "100 bound reloads %u ms\n", GetTickCount() - start );
+
+    /* same exports at other addresses, the cached binding must be dropped */
+    write_bind_target( target, 0x320 );
+    hlib = LoadLibraryA( importer );
+    ok( hlib != 0, "LoadLibrary error %d\n", GetLastError() );
+    if (!hlib) goto done;
+    check_bind_iat( hlib, target, 0x320, "modified target" );
+    FreeLibrary( hlib );
+
+    hlib = LoadLibraryA( importer );
+    ok( hlib != 0, "LoadLibrary error %d\n", GetLastError() );
+    if (!hlib) goto done;
+    check_bind_iat( hlib, target, 0x320, "modified target reload" );
+    FreeLibrary( hlib );
+
+    /* the export hash checked on each start walks every export name,
+     * compare it with what binding those names costs */
+    kernel32 = GetModuleHandleA( "kernel32.dll" );
+    exp = (const IMAGE_EXPORT_DIRECTORY *)((const char *)kernel32 +
+          ((const IMAGE_NT_HEADERS *)((const char *)kernel32 +
+          ((const IMAGE_DOS_HEADER *)kernel32)->e_lfanew))->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT].VirtualAddress);
+    names = (const DWORD *)((const char *)kernel32 + exp->AddressOfNames);
+    size = exp->NumberOfNames;
+    hash = 0x811c9dc5;
+    start = GetTickCount();
+    for (j = 0; j < 100; j++)
+        for (i = 0; i < size; i++)
+            for (p = (const char *)kernel32 + names[i]; *p; p++) hash = (hash ^ (BYTE)*p) * 0x01000193;
+    trace( "hashing %u kernel32 export names x100: %u ms (%08x)\n", size, GetTickCount() - start, hash );
+    start = GetTickCount();
+    for (j = 0; j < 100; j++)
+        for (i = 0; i < size; i++)
+            GetProcAddress( kernel32, (const char *)kernel32 + names[i] );
+    trace( "resolving %u kernel32 export names x100: %u ms\n", size, GetTickCount() - start );
+
+done:
+    ok( DeleteFileA( importer ), "DeleteFile error %d\n", GetLastError() );
+    ok( DeleteFileA( target ), "DeleteFile error %d\n", GetLastError() );
+}
+
 START_TEST(loader)
 {
     static const struct test_data
@@ -479,4 +659,6 @@ endloop:
         SetLastError(0xdeadbeef);
         ok(DeleteFile(dll_name), "DeleteFile error %d\n", GetLastError());
     }
+
+    test_import_binding();
 }
@@ -216,6 +216,118 @@ static void testGetProcAddress_Wrong(void)
         "Expected ERROR_MOD_NOT_FOUND or ERROR_INVALID_HANDLE(win9x), got %d\n", GetLastError());
 }
 
+static void testModuleLookup(void)
+{
+    static const char * const dlls[] =
+        { "advapi32.dll", "user32.dll", "gdi32.dll", "shell32.dll", "ole32.dll", "version.dll" };
+    BOOL (WINAPI *pGetModuleHandleExA)(DWORD, LPCSTR, HMODULE *);
+    HMODULE modules[sizeof(dlls) / sizeof(dlls[0])], hmod;
+    char path[MAX_PATH], upper[MAX_PATH];
+    unsigned int i;
+
+    pGetModuleHandleExA = (void *)GetProcAddress(GetModuleHandleA("kernel32.dll"), "GetModuleHandleExA");
+
+    for (i = 0; i < sizeof(dlls) / sizeof(dlls[0]); i++)
+    {
+        modules[i] = LoadLibraryA(dlls[i]);
+        ok(modules[i] != NULL, "%s should be loadable\n", dlls[i]);
+    }
+    for (i = 0; i < sizeof(dlls) / sizeof(dlls[0]); i++)
+    {
+        if (!modules[i]) continue;
+
+        hmod = GetModuleHandleA(dlls[i]);
+        ok(hmod == modules[i], "%s: got %p instead of %p\n", dlls[i], hmod, modules[i]);
+        lstrcpyA(upper, dlls[i]);
+        CharUpperA(upper);
+        hmod = GetModuleHandleA(upper);
+        ok(hmod == modules[i], "%s: got %p instead of %p\n", upper, hmod, modules[i]);
+
+        ok(GetModuleFileNameA(modules[i], path, MAX_PATH) != 0, "%s: no file name\n", dlls[i]);
+        hmod = GetModuleHandleA(path);
+        ok(hmod == modules[i], "%s: got %p instead of %p\n", path, hmod, modules[i]);
+
+        if (pGetModuleHandleExA)
+        {
+            hmod = NULL;
+            ok(pGetModuleHandleExA(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS |
+                                   GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+                                   (LPCSTR)modules[i] + 0x1000, &hmod),
+               "%s: address not found\n", dlls[i]);
+            ok(hmod == modules[i], "%s: got %p instead of %p\n", dlls[i], hmod, modules[i]);
+        }
+    }
+    for (i = 0; i < sizeof(dlls) / sizeof(dlls[0]); i++)
+        if (modules[i]) FreeLibrary(modules[i]);
+
+    /* modules loaded before the system directory was known, found by full path too */
+    for (i = 0; i < 2; i++)
+    {
+        static const char * const early[] = { "kernel32.dll", "ntdll.dll" };
+        HMODULE early_mod = GetModuleHandleA(early[i]);
+
+        ok(early_mod != NULL, "%s not loaded\n", early[i]);
+        ok(GetModuleFileNameA(early_mod, path, MAX_PATH) != 0, "%s: no file name\n", early[i]);
+        hmod = GetModuleHandleA(path);
+        ok(hmod == early_mod, "%s: got %p instead of %p\n", path, hmod, early_mod);
+        hmod = LoadLibraryA(path);
+        ok(hmod == early_mod, "%s: loaded %p instead of %p\n", path, hmod, early_mod);
+        if (hmod) FreeLibrary(hmod);
+    }
+}
+
+static void testGetProcAddressAll(void)
+{
+    static const char * const dlls[] = { "kernel32.dll", "user32.dll", "gdi32.dll" };
+    const IMAGE_DOS_HEADER *dos;
+    const IMAGE_NT_HEADERS *nt;
+    const IMAGE_EXPORT_DIRECTORY *exports;
+    const DWORD *names;
+    const WORD *ordinals;
+    HMODULE hmod;
+    FARPROC proc;
+    DWORD i, j, start, count;
+
+    for (i = 0; i < sizeof(dlls) / sizeof(dlls[0]); i++)
+    {
+        hmod = LoadLibraryA(dlls[i]);
+        ok(hmod != NULL, "%s should be loadable\n", dlls[i]);
+        if (!hmod) continue;
+
+        dos = (const IMAGE_DOS_HEADER *)hmod;
+        nt = (const IMAGE_NT_HEADERS *)((const char *)hmod + dos->e_lfanew);
+        exports = (const IMAGE_EXPORT_DIRECTORY *)((const char *)hmod +
+                  nt->OptionalHeader.DataDirectory[IMAGE_DIRECTORY_ENTRY_EXPORT].VirtualAddress);
+        names = (const DWORD *)((const char *)hmod + exports->AddressOfNames);
+        ordinals = (const WORD *)((const char *)hmod + exports->AddressOfNameOrdinals);
+
+        /* every name must resolve to the same function as its ordinal */
+        for (j = 0; j < exports->NumberOfNames; j++)
+        {
+            const char *name = (const char *)hmod + names[j];
+            FARPROC by_ordinal = GetProcAddress(hmod, (LPCSTR)(ULONG_PTR)(exports->Base + ordinals[j]));
+
+            proc = GetProcAddress(hmod, name);
+            ok(proc != NULL, "%s: %s not found\n", dlls[i], name);
+            ok(proc == by_ordinal, "%s: %s is %p by name, %p by ordinal\n", dlls[i], name, proc, by_ordinal);
+        }
+
+        SetLastError(0xdeadbeef);
+        proc = GetProcAddress(hmod, "NoSuchExportAtAll");
+        ok(proc == NULL, "%s: got %p for a missing export\n", dlls[i], proc);
+        ok(GetLastError() == ERROR_PROC_NOT_FOUND, "%s: wrong error %u\n", dlls[i], GetLastError());
+
+        start = GetTickCount();
+        for (count = 0; GetTickCount() - start < 200; count++)
+            for (j = 0; j < exports->NumberOfNames; j++)
+                GetProcAddress(hmod, (const char *)hmod + names[j]);
+        trace("%s: %u names resolved %u times in %u ms\n", dlls[i], exports->NumberOfNames,
+              count, GetTickCount() - start);
+
+        FreeLibrary(hmod);
+    }
+}
+
 START_TEST(module)
 {
     WCHAR filenameW[MAX_PATH];
@@ -238,4 +350,6 @@ START_TEST(module)
     testNestedLoadLibraryA();
     testLoadLibraryA_Wrong();
     testGetProcAddress_Wrong();
+    testModuleLookup();
+    testGetProcAddressAll();
 }
@@ -526,6 +526,62 @@ static void test_iocp_callback(void)
     ok(GetLastError() == ERROR_INVALID_HANDLE, "Last error is %d\n", GetLastError());
 }
 
+static CRITICAL_SECTION contended_cs;
+static LONG contended_counter;
+
+static DWORD WINAPI critsec_thread(void *arg)
+{
+    DWORD i, count = (DWORD)(ULONG_PTR)arg;
+
+    for (i = 0; i < count; i++)
+    {
+        EnterCriticalSection(&contended_cs);
+        contended_counter++;
+        LeaveCriticalSection(&contended_cs);
+    }
+    return 0;
+}
+
+static void test_critsec_contention(void)
+{
+    HANDLE threads[4];
+    DWORD i, start, ret;
+
+    InitializeCriticalSection(&contended_cs);
+    contended_counter = 0;
+
+    /* a thread that has to wait for the owner shows up in the statistics */
+    EnterCriticalSection(&contended_cs);
+    threads[0] = CreateThread(NULL, 0, critsec_thread, (void *)1, 0, NULL);
+    ok(threads[0] != NULL, "CreateThread failed with %u\n", GetLastError());
+    Sleep(200);
+    ok(contended_counter == 0, "section entered while owned\n");
+    LeaveCriticalSection(&contended_cs);
+    ret = WaitForSingleObject(threads[0], 5000);
+    ok(ret == WAIT_OBJECT_0, "thread didn't get the section: %u\n", ret);
+    CloseHandle(threads[0]);
+    ok(contended_counter == 1, "got counter %d\n", contended_counter);
+    if (contended_cs.DebugInfo)
+        ok(contended_cs.DebugInfo->ContentionCount >= 1, "wait not counted\n");
+
+    /* many threads hammering the same section */
+    start = GetTickCount();
+    for (i = 0; i < sizeof(threads) / sizeof(threads[0]); i++)
+    {
+        threads[i] = CreateThread(NULL, 0, critsec_thread, (void *)100000, 0, NULL);
+        ok(threads[i] != NULL, "CreateThread failed with %u\n", GetLastError());
+    }
+    ret = WaitForMultipleObjects(sizeof(threads) / sizeof(threads[0]), threads, TRUE, 60000);
+    ok(ret == WAIT_OBJECT_0, "threads didn't finish: %u\n", ret);
+    ok(contended_counter == 1 + 400000, "got counter %d\n", contended_counter);
+    if (contended_cs.DebugInfo)
+        trace("400000 entries in %u ms, %u contended, %u waits\n", GetTickCount() - start,
+              contended_cs.DebugInfo->EntryCount, contended_cs.DebugInfo->ContentionCount);
+    for (i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) CloseHandle(threads[i]);
+
+    DeleteCriticalSection(&contended_cs);
+}
+
 START_TEST(sync)
 {
     HMODULE hdll = GetModuleHandle("kernel32");
@@ -539,4 +595,5 @@ START_TEST(sync)
     test_semaphore();
     test_waitable_timer();
     test_iocp_callback();
+    test_critsec_contention();
 }
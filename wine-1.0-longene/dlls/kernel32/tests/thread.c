@@ -74,6 +74,9 @@ static RegisterWaitForSingleObject_t pRegisterWaitForSingleObject=NULL;
 typedef BOOL (WINAPI *UnregisterWait_t)(HANDLE);
 static UnregisterWait_t pUnregisterWait=NULL;
 
+typedef BOOL (WINAPI *UnregisterWaitEx_t)(HANDLE,HANDLE);
+static UnregisterWaitEx_t pUnregisterWaitEx=NULL;
+
 static HANDLE create_target_process(const char *arg)
 {
     char **argv;
@@ -953,6 +956,240 @@ static void test_RegisterWaitForSingleObject(void)
     ok(ret, "UnregisterWait failed with error %d\n", GetLastError());
 }
 
+static LONG waits_signaled;
+
+static void CALLBACK count_signaled_function(PVOID p, BOOLEAN TimerOrWaitFired)
+{
+    HANDLE event = p;
+    ok(!TimerOrWaitFired, "wait shouldn't have timed out\n");
+    if (InterlockedIncrement(&waits_signaled) == 200)
+        SetEvent(event);
+}
+
+static LONG waits_timed_out;
+
+static void CALLBACK count_timeout_function(PVOID p, BOOLEAN TimerOrWaitFired)
+{
+    HANDLE event = p;
+    ok(TimerOrWaitFired, "wait should have timed out\n");
+    if (InterlockedIncrement(&waits_timed_out) == 200)
+        SetEvent(event);
+}
+
+static void test_RegisterWaitForMultipleObjects(void)
+{
+    HANDLE wait_handles[200];
+    HANDLE handles[200];
+    HANDLE complete_event;
+    DWORD before, after, wait_result;
+    BOOL ret;
+    int i;
+
+    if (!pRegisterWaitForSingleObject || !pUnregisterWait)
+    {
+        skip("RegisterWaitForSingleObject or UnregisterWait not implemented\n");
+        return;
+    }
+
+    /* more waits than a single thread can wait on */
+
+    complete_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+    before = GetTickCount();
+    for (i = 0; i < 200; i++)
+    {
+        handles[i] = CreateEvent(NULL, FALSE, FALSE, NULL);
+        ret = pRegisterWaitForSingleObject(&wait_handles[i], handles[i], count_signaled_function,
+                                           complete_event, INFINITE, WT_EXECUTEONLYONCE);
+        ok(ret, "RegisterWaitForSingleObject failed with error %d\n", GetLastError());
+    }
+    after = GetTickCount();
+    trace("200 RegisterWaitForSingleObject calls took %dms\n", after - before);
+
+    for (i = 0; i < 200; i++)
+        SetEvent(handles[i]);
+
+    wait_result = WaitForSingleObject(complete_event, 10000);
+    ok(wait_result == WAIT_OBJECT_0, "wait failed with error 0x%x\n", wait_result);
+    ok(waits_signaled == 200, "only %d of the waits were signaled\n", waits_signaled);
+    /* give worker threads chance to complete */
+    Sleep(100);
+
+    for (i = 0; i < 200; i++)
+    {
+        ret = pUnregisterWait(wait_handles[i]);
+        ok(ret, "UnregisterWait failed with error %d\n", GetLastError());
+    }
+
+    /* the same number of waits timing out, with different timeouts */
+
+    ResetEvent(complete_event);
+    for (i = 0; i < 200; i++)
+    {
+        ret = pRegisterWaitForSingleObject(&wait_handles[i], handles[i], count_timeout_function,
+                                           complete_event, 10 + i % 50, WT_EXECUTEONLYONCE);
+        ok(ret, "RegisterWaitForSingleObject failed with error %d\n", GetLastError());
+    }
+
+    wait_result = WaitForSingleObject(complete_event, 10000);
+    ok(wait_result == WAIT_OBJECT_0, "wait failed with error 0x%x\n", wait_result);
+    ok(waits_timed_out == 200, "only %d of the waits timed out\n", waits_timed_out);
+    Sleep(100);
+
+    for (i = 0; i < 200; i++)
+    {
+        ret = pUnregisterWait(wait_handles[i]);
+        ok(ret, "UnregisterWait failed with error %d\n", GetLastError());
+        CloseHandle(handles[i]);
+    }
+    CloseHandle(complete_event);
+}
+
+struct rearm_context
+{
+    HANDLE event;           /* set by each callback */
+    LONG   calls;           /* number of callbacks */
+    BOOL   timed_out;       /* expected value of TimerOrWaitFired */
+};
+
+static void CALLBACK rearm_function(PVOID p, BOOLEAN TimerOrWaitFired)
+{
+    struct rearm_context *context = p;
+    ok(TimerOrWaitFired == context->timed_out, "got TimerOrWaitFired %d\n", TimerOrWaitFired);
+    InterlockedIncrement(&context->calls);
+    SetEvent(context->event);
+}
+
+static void test_RegisterWaitRearm(void)
+{
+    struct rearm_context context;
+    HANDLE wait_handle, handle;
+    DWORD wait_result;
+    LONG calls;
+    BOOL ret;
+    int i;
+
+    if (!pRegisterWaitForSingleObject || !pUnregisterWaitEx)
+    {
+        skip("RegisterWaitForSingleObject or UnregisterWaitEx not implemented\n");
+        return;
+    }
+
+    context.event = CreateEvent(NULL, FALSE, FALSE, NULL);
+    handle = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+    /* a wait that isn't WT_EXECUTEONLYONCE times out again and again */
+
+    context.calls = 0;
+    context.timed_out = TRUE;
+    ret = pRegisterWaitForSingleObject(&wait_handle, handle, rearm_function, &context, 20, 0);
+    ok(ret, "RegisterWaitForSingleObject failed with error %d\n", GetLastError());
+    for (i = 0; i < 3; i++)
+    {
+        wait_result = WaitForSingleObject(context.event, 5000);
+        ok(wait_result == WAIT_OBJECT_0, "timeout %d: wait failed with error 0x%x\n", i, wait_result);
+    }
+    ret = pUnregisterWaitEx(wait_handle, INVALID_HANDLE_VALUE);
+    ok(ret, "UnregisterWaitEx failed with error %d\n", GetLastError());
+    calls = context.calls;
+    ok(calls >= 3, "expected at least 3 callbacks, got %d\n", calls);
+    Sleep(100);
+    ok(context.calls == calls, "callback called after UnregisterWaitEx returned\n");
+
+    /* and is signaled again each time its object is */
+
+    context.calls = 0;
+    context.timed_out = FALSE;
+    ret = pRegisterWaitForSingleObject(&wait_handle, handle, rearm_function, &context, INFINITE, 0);
+    ok(ret, "RegisterWaitForSingleObject failed with error %d\n", GetLastError());
+    for (i = 0; i < 3; i++)
+    {
+        SetEvent(handle);
+        wait_result = WaitForSingleObject(context.event, 5000);
+        ok(wait_result == WAIT_OBJECT_0, "signal %d: wait failed with error 0x%x\n", i, wait_result);
+    }
+    ret = pUnregisterWaitEx(wait_handle, INVALID_HANDLE_VALUE);
+    ok(ret, "UnregisterWaitEx failed with error %d\n", GetLastError());
+    ok(context.calls == 3, "expected 3 callbacks, got %d\n", context.calls);
+
+    CloseHandle(handle);
+    CloseHandle(context.event);
+}
+
+struct pending_context
+{
+    HANDLE started;         /* set when the callback starts */
+    HANDLE release;         /* lets the callback return, or NULL to sleep a bit */
+    LONG   done;            /* set when the callback returns */
+};
+
+static void CALLBACK pending_function(PVOID p, BOOLEAN TimerOrWaitFired)
+{
+    struct pending_context *context = p;
+    SetEvent(context->started);
+    if (context->release)
+        WaitForSingleObject(context->release, 5000);
+    else
+        Sleep(200);
+    InterlockedExchange(&context->done, 1);
+}
+
+static void test_UnregisterWaitEx(void)
+{
+    struct pending_context context;
+    HANDLE wait_handle, handle, complete_event;
+    DWORD wait_result;
+    BOOL ret;
+
+    if (!pRegisterWaitForSingleObject || !pUnregisterWaitEx)
+    {
+        skip("RegisterWaitForSingleObject or UnregisterWaitEx not implemented\n");
+        return;
+    }
+
+    handle = CreateEvent(NULL, TRUE, TRUE, NULL);
+    complete_event = CreateEvent(NULL, TRUE, FALSE, NULL);
+    context.started = CreateEvent(NULL, FALSE, FALSE, NULL);
+    context.release = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+    /* with an event, the callback in progress is reported and the event set once it returns */
+
+    context.done = 0;
+    ret = pRegisterWaitForSingleObject(&wait_handle, handle, pending_function, &context, INFINITE, WT_EXECUTEONLYONCE);
+    ok(ret, "RegisterWaitForSingleObject failed with error %d\n", GetLastError());
+    wait_result = WaitForSingleObject(context.started, 5000);
+    ok(wait_result == WAIT_OBJECT_0, "callback didn't start, wait returned 0x%x\n", wait_result);
+
+    SetLastError(0xdeadbeef);
+    ret = pUnregisterWaitEx(wait_handle, complete_event);
+    ok(ret || GetLastError() == ERROR_IO_PENDING,
+       "UnregisterWaitEx failed with error %d\n", GetLastError());
+    wait_result = WaitForSingleObject(complete_event, 0);
+    ok(wait_result == WAIT_TIMEOUT, "event set while the callback runs\n");
+
+    SetEvent(context.release);
+    wait_result = WaitForSingleObject(complete_event, 5000);
+    ok(wait_result == WAIT_OBJECT_0, "event not set after the callback, wait returned 0x%x\n", wait_result);
+    ok(context.done, "callback didn't return\n");
+
+    /* with INVALID_HANDLE_VALUE, it waits for the callback to return */
+
+    context.done = 0;
+    CloseHandle(context.release);
+    context.release = NULL;
+    ret = pRegisterWaitForSingleObject(&wait_handle, handle, pending_function, &context, INFINITE, WT_EXECUTEONLYONCE);
+    ok(ret, "RegisterWaitForSingleObject failed with error %d\n", GetLastError());
+    wait_result = WaitForSingleObject(context.started, 5000);
+    ok(wait_result == WAIT_OBJECT_0, "callback didn't start, wait returned 0x%x\n", wait_result);
+
+    ret = pUnregisterWaitEx(wait_handle, INVALID_HANDLE_VALUE);
+    ok(ret, "UnregisterWaitEx failed with error %d\n", GetLastError());
+    ok(context.done, "UnregisterWaitEx returned before the callback\n");
+
+    CloseHandle(context.started);
+    CloseHandle(complete_event);
+    CloseHandle(handle);
+}
+
 START_TEST(thread)
 {
    HINSTANCE lib;
@@ -971,6 +1208,7 @@ START_TEST(thread)
    pSetThreadPriorityBoost=(SetThreadPriorityBoost_t)GetProcAddress(lib,"SetThreadPriorityBoost");
    pRegisterWaitForSingleObject=(RegisterWaitForSingleObject_t)GetProcAddress(lib,"RegisterWaitForSingleObject");
    pUnregisterWait=(UnregisterWait_t)GetProcAddress(lib,"UnregisterWait");
+   pUnregisterWaitEx=(UnregisterWaitEx_t)GetProcAddress(lib,"UnregisterWaitEx");
 
    if (argc >= 3)
    {
@@ -1012,4 +1250,7 @@ START_TEST(thread)
 #endif
    test_QueueUserWorkItem();
    test_RegisterWaitForSingleObject();
+   test_RegisterWaitForMultipleObjects();
+   test_RegisterWaitRearm();
+   test_UnregisterWaitEx();
 }
@@ -599,6 +599,44 @@ static void test_TzSpecificLocalTimeToSystemTime(void)
     }        
 }
 
+static void test_clocks(void)
+{
+    LARGE_INTEGER freq, start, prev, now;
+    FILETIME ft_start, ft_end;
+    ULONGLONG elapsed;
+    DWORD tick_start, tick_end;
+    int i;
+
+    ok(QueryPerformanceFrequency(&freq), "QueryPerformanceFrequency failed\n");
+    ok(freq.QuadPart > 0, "bad frequency %x%08x\n", freq.u.HighPart, freq.u.LowPart);
+
+    QueryPerformanceCounter(&start);
+    prev = start;
+    for (i = 0; i < 100000; i++)
+    {
+        QueryPerformanceCounter(&now);
+        if (now.QuadPart < prev.QuadPart) break;
+        prev = now;
+    }
+    ok(i == 100000, "performance counter went backwards\n");
+
+    GetSystemTimeAsFileTime(&ft_start);
+    tick_start = GetTickCount();
+    QueryPerformanceCounter(&start);
+    Sleep(200);
+    QueryPerformanceCounter(&now);
+    tick_end = GetTickCount();
+    GetSystemTimeAsFileTime(&ft_end);
+
+    elapsed = (now.QuadPart - start.QuadPart) * 1000 / freq.QuadPart;
+    ok(elapsed >= 150 && elapsed < 1000, "performance counter measured %u ms\n", (DWORD)elapsed);
+    ok(tick_end - tick_start >= 150 && tick_end - tick_start < 1000,
+       "tick count measured %u ms\n", tick_end - tick_start);
+    elapsed = ((((ULONGLONG)ft_end.dwHighDateTime << 32) | ft_end.dwLowDateTime) -
+               (((ULONGLONG)ft_start.dwHighDateTime << 32) | ft_start.dwLowDateTime)) / TICKSPERMSEC;
+    ok(elapsed >= 150 && elapsed < 1000, "system time measured %u ms\n", (DWORD)elapsed);
+}
+
 START_TEST(time)
 {
     HMODULE hKernel = GetModuleHandle("kernel32");
@@ -611,4 +649,5 @@ START_TEST(time)
     test_FileTimeToSystemTime();
     test_FileTimeToLocalFileTime();
     test_TzSpecificLocalTimeToSystemTime();
+    test_clocks();
 }
@@ -202,6 +202,58 @@ static void test_thread(DWORD curr_pid, DWORD sub_pcs_pid)
     ok(!pThread32First( hSnapshot, &te ), "shouldn't return a thread\n");
 }
 
+static DWORD WINAPI waiting_thread(void *arg)
+{
+    WaitForSingleObject((HANDLE)arg, INFINITE);
+    return 0;
+}
+
+/* enough threads to need several rounds of fetching them */
+#define NUM_THREADS 300
+
+static void test_many_threads(DWORD curr_pid)
+{
+    HANDLE              hSnapshot, ev, threads[NUM_THREADS];
+    DWORD               tids[NUM_THREADS];
+    THREADENTRY32       te;
+    unsigned            curr_found = 0, tids_found = 0;
+    int                 i, created;
+
+    ev = CreateEvent(NULL, TRUE, FALSE, NULL);
+    for (created = 0; created < NUM_THREADS; created++)
+    {
+        threads[created] = CreateThread(NULL, 0, waiting_thread, ev, 0, &tids[created]);
+        if (!threads[created]) break;
+    }
+    ok(created == NUM_THREADS, "created only %d threads\n", created);
+
+    hSnapshot = pCreateToolhelp32Snapshot( TH32CS_SNAPTHREAD, 0 );
+    ok(hSnapshot != NULL, "Cannot create snapshot\n");
+
+    te.dwSize = sizeof(te);
+    if (pThread32First( hSnapshot, &te ))
+    {
+        do
+        {
+            if (te.th32OwnerProcessID != curr_pid) continue;
+            curr_found++;
+            for (i = 0; i < created; i++)
+                if (te.th32ThreadID == tids[i]) tids_found++;
+        } while (pThread32Next( hSnapshot, &te ));
+    }
+    ok(curr_found == created + 1, "found %u threads of self instead of %d\n", curr_found, created + 1);
+    ok(tids_found == created, "found %u of the %d created threads\n", tids_found, created);
+    CloseHandle(hSnapshot);
+
+    SetEvent(ev);
+    for (i = 0; i < created; i++)
+    {
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+    }
+    CloseHandle(ev);
+}
+
 static const char* curr_expected_modules[] =
 {
     "kernel32.dll",
@@ -332,6 +384,7 @@ START_TEST(toolhelp)
 
     test_process(pid, info.dwProcessId);
     test_thread(pid, info.dwProcessId);
+    test_many_threads(pid);
     test_module(pid, curr_expected_modules, NUM_OF(curr_expected_modules));
     test_module(info.dwProcessId, sub_expected_modules, NUM_OF(sub_expected_modules));
 
@@ -33,6 +33,16 @@ static HINSTANCE hkernel32;
 static LPVOID (WINAPI *pVirtualAllocEx)(HANDLE, LPVOID, SIZE_T, DWORD, DWORD);
 static BOOL   (WINAPI *pVirtualFreeEx)(HANDLE, LPVOID, SIZE_T, DWORD);
 
+typedef struct
+{
+    PVOID RemoteAddress;
+    PVOID Buffer;
+    ULONG Length;
+} VIRTUAL_MEMORY_VECTOR;
+
+static LONG (WINAPI *pNtReadVirtualMemoryVector)(HANDLE, const VIRTUAL_MEMORY_VECTOR *, ULONG, SIZE_T *);
+static LONG (WINAPI *pNtWriteVirtualMemoryVector)(HANDLE, const VIRTUAL_MEMORY_VECTOR *, ULONG, SIZE_T *);
+
 /* ############################### */
 
 static HANDLE create_target_process(const char *arg)
@@ -185,6 +195,84 @@ static void test_VirtualAllocEx(void)
     CloseHandle(hProcess);
 }
 
+static void test_VirtualMemoryVector(void)
+{
+    const unsigned int page = 0x1000;
+    VIRTUAL_MEMORY_VECTOR vec[3];
+    char src[0x2000], dst[0x2000], small[16];
+    SIZE_T done;
+    HANDLE hProcess;
+    DWORD old_prot;
+    char *addr;
+    LONG status;
+    unsigned int i;
+    BOOL b;
+
+    if (!pNtReadVirtualMemoryVector || !pNtWriteVirtualMemoryVector || !pVirtualAllocEx)
+    {
+        skip("NtRead/WriteVirtualMemoryVector not found\n");
+        return;
+    }
+
+    hProcess = create_target_process("sleep");
+    ok(hProcess != NULL, "Can't start process\n");
+
+    addr = pVirtualAllocEx(hProcess, NULL, 2 * page, MEM_COMMIT, PAGE_READWRITE);
+    ok(addr != NULL, "VirtualAllocEx error %u\n", GetLastError());
+    for (i = 0; i < sizeof(src); i++) src[i] = i * 7;
+    b = WriteProcessMemory(hProcess, addr, src, sizeof(src), &done);
+    ok(b && done == sizeof(src), "%lu bytes written\n", done);
+    /* split the allocation in two mappings */
+    b = VirtualProtectEx(hProcess, addr + page, page, PAGE_READONLY, &old_prot);
+    ok(b, "VirtualProtectEx error %u\n", GetLastError());
+
+    /* read ranges that cross the protection boundary, in any order */
+    memset(dst, 0, sizeof(dst));
+    vec[0].RemoteAddress = addr + page - 100;
+    vec[0].Buffer        = dst;
+    vec[0].Length        = 200;
+    vec[1].RemoteAddress = addr;
+    vec[1].Buffer        = small;
+    vec[1].Length        = sizeof(small);
+    vec[2].RemoteAddress = addr + 2 * page - 8;
+    vec[2].Buffer        = dst + 200;
+    vec[2].Length        = 8;
+    done = 0;
+    status = pNtReadVirtualMemoryVector(hProcess, vec, 3, &done);
+    ok(!status, "NtReadVirtualMemoryVector failed %x\n", status);
+    ok(done == 200 + sizeof(small) + 8, "%lu bytes read\n", done);
+    ok(!memcmp(dst, src + page - 100, 200), "data differs\n");
+    ok(!memcmp(small, src, sizeof(small)), "data differs\n");
+    ok(!memcmp(dst + 200, src + 2 * page - 8, 8), "data differs\n");
+
+    /* a range running past the allocation is copied partially */
+    vec[0].RemoteAddress = addr + 2 * page - 16;
+    vec[0].Buffer        = dst;
+    vec[0].Length        = 32;
+    done = 0;
+    status = pNtReadVirtualMemoryVector(hProcess, vec, 1, &done);
+    ok(status == 0x8000000d /* STATUS_PARTIAL_COPY */, "wrong status %x\n", status);
+    ok(done == 16, "%lu bytes read\n", done);
+
+    /* writes stop at the read-only page */
+    memset(small, 0xcc, sizeof(small));
+    vec[0].RemoteAddress = addr + 64;
+    vec[0].Buffer        = small;
+    vec[0].Length        = sizeof(small);
+    vec[1].RemoteAddress = addr + page;
+    vec[1].Buffer        = small;
+    vec[1].Length        = sizeof(small);
+    done = 0;
+    status = pNtWriteVirtualMemoryVector(hProcess, vec, 2, &done);
+    ok(status == 0x8000000d /* STATUS_PARTIAL_COPY */, "wrong status %x\n", status);
+    ok(done == sizeof(small), "%lu bytes written\n", done);
+    b = ReadProcessMemory(hProcess, addr + 64, dst, sizeof(small), &done);
+    ok(b && !memcmp(dst, small, sizeof(small)), "data not written\n");
+
+    TerminateProcess(hProcess, 0);
+    CloseHandle(hProcess);
+}
+
 static void test_VirtualAlloc(void)
 {
     void *addr1, *addr2;
@@ -267,6 +355,63 @@ static void test_VirtualAlloc(void)
     ok(VirtualFree(addr1, 0, MEM_RELEASE), "VirtualFree failed\n");
 }
 
+static void test_VirtualAlloc_many(void)
+{
+    const unsigned int count = 10000;
+    MEMORY_BASIC_INFORMATION info;
+    DWORD start, alloc_time, query_time, free_time;
+    unsigned int i, n;
+    char **regions;
+    SIZE_T ret;
+    BOOL b;
+
+    regions = HeapAlloc(GetProcessHeap(), 0, count * sizeof(*regions));
+    ok(regions != NULL, "HeapAlloc failed\n");
+    if (!regions) return;
+
+    /* with the 64k granularity of Windows this takes 640Mb of address space */
+    start = GetTickCount();
+    for (n = 0; n < count; n++)
+    {
+        regions[n] = VirtualAlloc(NULL, 0x1000, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        if (!regions[n]) break;
+        regions[n][0] = 1;
+    }
+    alloc_time = GetTickCount() - start;
+    ok(n == count, "region %u not allocated, error %u\n", n, GetLastError());
+
+    start = GetTickCount();
+    for (i = 0; i < n; i++)
+    {
+        ret = VirtualQuery(regions[i] + 0x800, &info, sizeof(info));
+        ok(ret == sizeof(info), "VirtualQuery failed %u\n", GetLastError());
+        if (info.AllocationBase != regions[i] || info.State != MEM_COMMIT)
+        {
+            ok(0, "region %u: base %p state %x\n", i, info.AllocationBase, info.State);
+            break;
+        }
+    }
+    query_time = GetTickCount() - start;
+
+    /* free in a different order than allocated */
+    start = GetTickCount();
+    for (i = 0; i < n; i += 2)
+    {
+        b = VirtualFree(regions[i], 0, MEM_RELEASE);
+        ok(b, "VirtualFree failed %u\n", GetLastError());
+    }
+    for (i = 1; i < n; i += 2)
+    {
+        b = VirtualFree(regions[i], 0, MEM_RELEASE);
+        ok(b, "VirtualFree failed %u\n", GetLastError());
+    }
+    free_time = GetTickCount() - start;
+
+    trace("%u regions: alloc %u ms, query %u ms, free %u ms\n",
+          n, alloc_time, query_time, free_time);
+    HeapFree(GetProcessHeap(), 0, regions);
+}
+
 static void test_MapViewOfFile(void)
 {
     static const char testfile[] = "testfile.xxx";
@@ -701,9 +846,13 @@ START_TEST(virtual)
     hkernel32 = GetModuleHandleA("kernel32.dll");
     pVirtualAllocEx = (void *) GetProcAddress(hkernel32, "VirtualAllocEx");
     pVirtualFreeEx = (void *) GetProcAddress(hkernel32, "VirtualFreeEx");
+    pNtReadVirtualMemoryVector = (void *) GetProcAddress(GetModuleHandleA("ntdll.dll"), "NtReadVirtualMemoryVector");
+    pNtWriteVirtualMemoryVector = (void *) GetProcAddress(GetModuleHandleA("ntdll.dll"), "NtWriteVirtualMemoryVector");
 
     test_VirtualAllocEx();
+    test_VirtualMemoryVector();
     test_VirtualAlloc();
+    test_VirtualAlloc_many();
     test_MapViewOfFile();
     test_NtMapViewOfSection();
     test_CreateFileMapping();
@@ -38,6 +38,7 @@
 #include "winnls.h"
 #include "winternl.h"
 
+#include "wine/server.h"
 #include "wine/debug.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(toolhelp);
@@ -177,113 +178,177 @@ static void fill_module( struct snapshot* snap, ULONG* offset, ULONG process,
     *offset += num * sizeof(MODULEENTRY32W);
 }
 
-static BOOL fetch_process_thread( DWORD flags, SYSTEM_PROCESS_INFORMATION** pspi,
-                                  ULONG* num_pcs, ULONG* num_thd)
+/* the processes of a server snapshot, fetched as many per request as fit */
+static BOOL fetch_processes( HANDLE handle, PROCESSENTRY32W** pcs, ULONG* num )
 {
-    NTSTATUS                    status;
-    ULONG                       size, offset;
-    PSYSTEM_PROCESS_INFORMATION spi;
+    const struct snapshot_process* entry;
+    PROCESSENTRY32W*    pcs_entry;
+    const WCHAR*        name;
+    NTSTATUS            status;
+    ULONG               size = 0, alloc = 0, count, i;
+    SIZE_T              l;
+    char*               buffer;
+    BOOL                reset = TRUE;
 
-    *num_pcs = *num_thd = 0;
-    if (!(flags & (TH32CS_SNAPPROCESS | TH32CS_SNAPTHREAD))) return TRUE;
+    if (!(buffer = HeapAlloc( GetProcessHeap(), 0, 8192 ))) return FALSE;
+    for (;;)
+    {
+        SERVER_START_REQ( next_processes )
+        {
+            req->handle = handle;
+            req->reset = reset;
+            wine_server_set_reply( req, buffer, 8192 );
+            status = wine_server_call( req );
+            count = reply->count;
+        }
+        SERVER_END_REQ;
+        if (status) break;
+        reset = FALSE;
+
+        if (*num + count > alloc)
+        {
+            alloc = max( alloc * 2, *num + count );
+            pcs_entry = *pcs ? HeapReAlloc( GetProcessHeap(), 0, *pcs, alloc * sizeof(**pcs) )
+                             : HeapAlloc( GetProcessHeap(), 0, alloc * sizeof(**pcs) );
+            if (!pcs_entry)
+            {
+                status = STATUS_NO_MEMORY;
+                break;
+            }
+            *pcs = pcs_entry;
+        }
+
+        for (i = size = 0; i < count; i++)
+        {
+            entry = (const struct snapshot_process *)(buffer + size);
+            pcs_entry = &(*pcs)[(*num)++];
+            pcs_entry->dwSize = sizeof(PROCESSENTRY32W);
+            pcs_entry->cntUsage = 0; /* MSDN says no longer used, always 0 */
+            pcs_entry->th32ProcessID = entry->pid;
+            pcs_entry->th32DefaultHeapID = 0; /* MSDN says no longer used, always 0 */
+            pcs_entry->th32ModuleID = 0; /* MSDN says no longer used, always 0 */
+            pcs_entry->cntThreads = entry->threads;
+            pcs_entry->th32ParentProcessID = entry->ppid;
+            pcs_entry->pcPriClassBase = entry->priority;
+            pcs_entry->dwFlags = 0; /* MSDN says no longer used, always 0 */
+
+            /* only the file part of the exe path */
+            l = entry->namelen / sizeof(WCHAR);
+            for (name = entry->name + l; name > entry->name; name--)
+                if (name[-1] == '\\' || name[-1] == '/') break;
+            l = min( (entry->name + l - name) * sizeof(WCHAR), sizeof(pcs_entry->szExeFile) - sizeof(WCHAR) );
+            memcpy( pcs_entry->szExeFile, name, l );
+            pcs_entry->szExeFile[l / sizeof(WCHAR)] = 0;
+
+            size += (FIELD_OFFSET( struct snapshot_process, name ) + entry->namelen + 3) & ~3;
+        }
+    }
+    HeapFree( GetProcessHeap(), 0, buffer );
+    if (status == STATUS_NO_MORE_FILES) return TRUE;
+    SetLastError( RtlNtStatusToDosError( status ) );
+    return FALSE;
+}
+
+/* the threads of a server snapshot, fetched as many per request as fit */
+static BOOL fetch_threads( HANDLE handle, THREADENTRY32** thd, ULONG* num )
+{
+    struct snapshot_thread  buffer[128];
+    THREADENTRY32*          thd_entry;
+    NTSTATUS                status;
+    ULONG                   alloc = 0, count, i;
+    BOOL                    reset = TRUE;
 
-    *pspi = HeapAlloc( GetProcessHeap(), 0, size = 4096 );
     for (;;)
     {
-        status = NtQuerySystemInformation( SystemProcessInformation, *pspi,
-                                           size, NULL );
-        switch (status)
+        SERVER_START_REQ( next_threads )
+        {
+            req->handle = handle;
+            req->reset = reset;
+            req->pid = 0;
+            wine_server_set_reply( req, buffer, sizeof(buffer) );
+            status = wine_server_call( req );
+            count = reply->count;
+        }
+        SERVER_END_REQ;
+        if (status) break;
+        reset = FALSE;
+
+        if (*num + count > alloc)
         {
-        case STATUS_SUCCESS:
-            *num_pcs = *num_thd = offset = 0;
-            spi = *pspi;
-            do
+            alloc = max( alloc * 2, *num + count );
+            thd_entry = *thd ? HeapReAlloc( GetProcessHeap(), 0, *thd, alloc * sizeof(**thd) )
+                             : HeapAlloc( GetProcessHeap(), 0, alloc * sizeof(**thd) );
+            if (!thd_entry)
             {
-                spi = (SYSTEM_PROCESS_INFORMATION*)((char*)spi + offset);
-                if (flags & TH32CS_SNAPPROCESS) (*num_pcs)++;
-                if (flags & TH32CS_SNAPTHREAD) *num_thd += spi->dwThreadCount;
-            } while ((offset = spi->dwOffset));
-            return TRUE;
-        case STATUS_INFO_LENGTH_MISMATCH:
-            *pspi = HeapReAlloc( GetProcessHeap(), 0, *pspi, size *= 2 );
-            break;
-        default:
-            SetLastError( RtlNtStatusToDosError( status ) );
-            break;
+                status = STATUS_NO_MEMORY;
+                break;
+            }
+            *thd = thd_entry;
+        }
+
+        for (i = 0; i < count; i++)
+        {
+            thd_entry = &(*thd)[(*num)++];
+            thd_entry->dwSize = sizeof(THREADENTRY32);
+            thd_entry->cntUsage = 0; /* MSDN says no longer used, always 0 */
+            thd_entry->th32ThreadID = buffer[i].tid;
+            thd_entry->th32OwnerProcessID = buffer[i].pid;
+            thd_entry->tpBasePri = buffer[i].base_pri;
+            thd_entry->tpDeltaPri = 0; /* MSDN says no longer used, always 0 */
+            thd_entry->dwFlags = 0; /* MSDN says no longer used, always 0" */
         }
     }
+    if (status == STATUS_NO_MORE_FILES) return TRUE;
+    SetLastError( RtlNtStatusToDosError( status ) );
+    return FALSE;
 }
 
-static void fill_process( struct snapshot* snap, ULONG* offset, 
-                          SYSTEM_PROCESS_INFORMATION* spi, ULONG num )
+static BOOL fetch_process_thread( DWORD flags, PROCESSENTRY32W** pcs, ULONG* num_pcs,
+                                  THREADENTRY32** thd, ULONG* num_thd )
 {
-    PROCESSENTRY32W*            pcs_entry;
-    ULONG                       poff = 0;
-    SIZE_T                      l;
+    HANDLE      handle;
+    BOOL        ret;
 
+    *num_pcs = *num_thd = 0;
+    if (!(flags & (TH32CS_SNAPPROCESS | TH32CS_SNAPTHREAD))) return TRUE;
+
+    SERVER_START_REQ( create_snapshot )
+    {
+        req->flags = 0;
+        if (flags & TH32CS_SNAPPROCESS) req->flags |= SNAP_PROCESS;
+        if (flags & TH32CS_SNAPTHREAD) req->flags |= SNAP_THREAD;
+        req->attributes = 0;
+        req->pid = 0;
+        ret = !wine_server_call_err( req );
+        handle = reply->handle;
+    }
+    SERVER_END_REQ;
+    if (!ret) return FALSE;
+
+    if (flags & TH32CS_SNAPPROCESS) ret = fetch_processes( handle, pcs, num_pcs );
+    if (ret && (flags & TH32CS_SNAPTHREAD)) ret = fetch_threads( handle, thd, num_thd );
+    CloseHandle( handle );
+    return ret;
+}
+
+static void fill_process( struct snapshot* snap, ULONG* offset,
+                          PROCESSENTRY32W* pcs, ULONG num )
+{
     snap->process_count = num;
     snap->process_pos = 0;
     if (!num) return;
     snap->process_offset = *offset;
-
-    pcs_entry = (PROCESSENTRY32W*)&snap->data[*offset];
-
-    do
-    {
-        spi = (SYSTEM_PROCESS_INFORMATION*)((char*)spi + poff);
-
-        pcs_entry->dwSize = sizeof(PROCESSENTRY32W);
-        pcs_entry->cntUsage = 0; /* MSDN says no longer used, always 0 */
-        pcs_entry->th32ProcessID = spi->dwProcessID;
-        pcs_entry->th32DefaultHeapID = 0; /* MSDN says no longer used, always 0 */
-        pcs_entry->th32ModuleID = 0; /* MSDN says no longer used, always 0 */
-        pcs_entry->cntThreads = spi->dwThreadCount;
-        pcs_entry->th32ParentProcessID = spi->dwParentProcessID;
-        pcs_entry->pcPriClassBase = spi->dwBasePriority;
-        pcs_entry->dwFlags = 0; /* MSDN says no longer used, always 0 */
-        l = min(spi->ProcessName.Length, sizeof(pcs_entry->szExeFile) - sizeof(WCHAR));
-        memcpy(pcs_entry->szExeFile, spi->ProcessName.Buffer, l);
-        pcs_entry->szExeFile[l / sizeof(WCHAR)] = '\0';
-        pcs_entry++;
-    } while ((poff = spi->dwOffset));
-
+    memcpy( &snap->data[*offset], pcs, num * sizeof(PROCESSENTRY32W) );
     *offset += num * sizeof(PROCESSENTRY32W);
 }
 
-static void fill_thread( struct snapshot* snap, ULONG* offset, LPVOID info, ULONG num )
+static void fill_thread( struct snapshot* snap, ULONG* offset, THREADENTRY32* thd, ULONG num )
 {
-    THREADENTRY32*              thd_entry;
-    SYSTEM_PROCESS_INFORMATION* spi;
-    SYSTEM_THREAD_INFORMATION*  sti;
-    ULONG                       i, poff = 0;
-
     snap->thread_count = num;
     snap->thread_pos = 0;
     if (!num) return;
     snap->thread_offset = *offset;
-
-    thd_entry = (THREADENTRY32*)&snap->data[*offset];
-
-    spi = (SYSTEM_PROCESS_INFORMATION*)info;
-    do
-    {
-        spi = (SYSTEM_PROCESS_INFORMATION*)((char*)spi + poff);
-        sti = &spi->ti[0];
-
-        for (i = 0; i < spi->dwThreadCount; i++)
-        {
-            thd_entry->dwSize = sizeof(THREADENTRY32);
-            thd_entry->cntUsage = 0; /* MSDN says no longer used, always 0 */
-            thd_entry->th32ThreadID = sti->dwThreadID;
-            thd_entry->th32OwnerProcessID = sti->dwOwningPID;
-            thd_entry->tpBasePri = sti->dwBasePriority;
-            thd_entry->tpDeltaPri = 0; /* MSDN says no longer used, always 0 */
-            thd_entry->dwFlags = 0; /* MSDN says no longer used, always 0" */
-
-            sti++;
-            thd_entry++;
-      }
-    } while ((poff = spi->dwOffset));
+    memcpy( &snap->data[*offset], thd, num * sizeof(THREADENTRY32) );
     *offset += num * sizeof(THREADENTRY32);
 }
 
@@ -292,7 +357,8 @@ static void fill_thread( struct snapshot* snap, ULONG* offset, LPVOID info, ULON
  */
 HANDLE WINAPI CreateToolhelp32Snapshot( DWORD flags, DWORD process )
 {
-    SYSTEM_PROCESS_INFORMATION* spi = NULL;
+    PROCESSENTRY32W*    pcs = NULL;
+    THREADENTRY32*      thd = NULL;
     LDR_MODULE*         mod = NULL;
     ULONG               num_pcs, num_thd, num_mod;
     HANDLE              hSnapShot = 0;
@@ -306,7 +372,7 @@ HANDLE WINAPI CreateToolhelp32Snapshot( DWORD flags, DWORD process )
     }
 
     if (fetch_module( process, flags, &mod, &num_mod ) &&
-        fetch_process_thread( flags, &spi, &num_pcs, &num_thd ))
+        fetch_process_thread( flags, &pcs, &num_pcs, &thd, &num_thd ))
     {
         ULONG sect_size;
         struct snapshot*snap;
@@ -330,8 +396,8 @@ HANDLE WINAPI CreateToolhelp32Snapshot( DWORD flags, DWORD process )
             DWORD   offset = 0;
 
             fill_module( snap, &offset, process, mod, num_mod );
-            fill_process( snap, &offset, spi, num_pcs );
-            fill_thread( snap, &offset, spi, num_thd );
+            fill_process( snap, &offset, pcs, num_pcs );
+            fill_thread( snap, &offset, thd, num_thd );
             UnmapViewOfFile( snap );
         }
     }
@@ -342,7 +408,8 @@ HANDLE WINAPI CreateToolhelp32Snapshot( DWORD flags, DWORD process )
         HeapFree( GetProcessHeap(), 0, mod[num_mod].FullDllName.Buffer );
     }
     HeapFree( GetProcessHeap(), 0, mod );
-    HeapFree( GetProcessHeap(), 0, spi );
+    HeapFree( GetProcessHeap(), 0, pcs );
+    HeapFree( GetProcessHeap(), 0, thd );
 
     if (!hSnapShot) return INVALID_HANDLE_VALUE;
     return hSnapShot;
@@ -37,6 +37,16 @@
 WINE_DEFAULT_DEBUG_CHANNEL(ntdll);
 WINE_DECLARE_DEBUG_CHANNEL(relay);
 
+/* Contended sections keep statistics in their debug info: EntryCount
+ * counts the entries that found them owned by another thread, and
+ * ContentionCount the ones that had to wait, so the difference is the
+ * number of times spinning paid off.  The spin estimate is kept in
+ * CreatorBackTraceIndex, which we have no other use for.  All of them
+ * are only updated by the owner of the section. */
+
+#define CRITSEC_DEFAULT_SPIN 1024  /* spin count of RtlInitializeCriticalSection */
+#define CRITSEC_MIN_SPIN     16    /* spin at least this much when spinning at all */
+
 static inline LONG interlocked_inc( PLONG dest )
 {
     return interlocked_xchg_add( dest, 1 ) + 1;
@@ -198,6 +208,28 @@ static inline void close_semaphore( RTL_CRITICAL_SECTION *crit )
 
 #endif
 
+/***********************************************************************
+ *           use_keyed_events
+ *
+ * Check once whether the kernel provides keyed events.  Sections then
+ * wait on the process-wide one, keyed by their address, instead of
+ * getting a semaphore each.
+ */
+static inline int use_keyed_events(void)
+{
+    static int supported = -1;
+
+    if (supported == -1)
+    {
+        LARGE_INTEGER zero;
+
+        /* nobody waits on a NULL key, so this times out at once */
+        zero.QuadPart = 0;
+        supported = (NtReleaseKeyedEvent( 0, NULL, FALSE, &zero ) == STATUS_TIMEOUT);
+    }
+    return supported;
+}
+
 /***********************************************************************
  *           get_semaphore
  */
@@ -226,15 +258,59 @@ static inline NTSTATUS wait_semaphore( RTL_CRITICAL_SECTION *crit, int timeout )
     /* debug info is cleared by MakeCriticalSectionGlobal */
     if (!crit->DebugInfo || ((ret = fast_wait( crit, timeout )) == STATUS_NOT_IMPLEMENTED))
     {
-        HANDLE sem = get_semaphore( crit );
         LARGE_INTEGER time;
 
         time.QuadPart = timeout * (LONGLONG)-10000000;
-        ret = NTDLL_wait_for_multiple_objects( 1, &sem, 0, &time, 0 );
+        if (crit->DebugInfo && use_keyed_events())
+            ret = NtWaitForKeyedEvent( 0, crit, FALSE, &time );
+        else
+        {
+            HANDLE sem = get_semaphore( crit );
+            ret = NTDLL_wait_for_multiple_objects( 1, &sem, 0, &time, 0 );
+        }
     }
     return ret;
 }
 
+/***********************************************************************
+ *           get_spin_limit
+ *
+ * How long to spin on a busy section: about twice what it took to get it
+ * recently, within its spin count.  Sections without debug info spin the
+ * whole count.
+ */
+static inline ULONG get_spin_limit( const RTL_CRITICAL_SECTION *crit )
+{
+    RTL_CRITICAL_SECTION_DEBUG *debug = crit->DebugInfo;
+    ULONG limit;
+
+    if (!debug) return crit->SpinCount;
+    limit = 2 * debug->CreatorBackTraceIndex + CRITSEC_MIN_SPIN;
+    return min( limit, crit->SpinCount );
+}
+
+/***********************************************************************
+ *           record_spin
+ *
+ * Update the statistics of a section after spinning on it.  The spin
+ * estimate is a running average of the iterations it took to get it.
+ * Must be called by the owner of the section.
+ */
+static inline void record_spin( RTL_CRITICAL_SECTION *crit, ULONG count, ULONG limit, BOOL acquired )
+{
+    RTL_CRITICAL_SECTION_DEBUG *debug = crit->DebugInfo;
+    LONG avg;
+
+    if (!debug) return;
+    debug->EntryCount++;
+    avg = debug->CreatorBackTraceIndex;
+    if (acquired)
+        avg += ((LONG)min( count, 0xffff ) - avg) / 8;
+    else if (count == limit)  /* held longer than we spun, spin less next time */
+        avg /= 2;
+    debug->CreatorBackTraceIndex = avg;
+}
+
 /***********************************************************************
  *           RtlInitializeCriticalSection   (NTDLL.@)
  *
@@ -246,6 +322,9 @@ static inline NTSTATUS wait_semaphore( RTL_CRITICAL_SECTION *crit, int timeout )
  * RETURNS
  *  STATUS_SUCCESS.
  *
+ * NOTES
+ *  The section spins adaptively before waiting, up to CRITSEC_DEFAULT_SPIN.
+ *
  * SEE
  *  RtlInitializeCriticalSectionAndSpinCount(), RtlDeleteCriticalSection(),
  *  RtlEnterCriticalSection(), RtlLeaveCriticalSection(),
@@ -253,7 +332,7 @@ static inline NTSTATUS wait_semaphore( RTL_CRITICAL_SECTION *crit, int timeout )
  */
 NTSTATUS WINAPI RtlInitializeCriticalSection( RTL_CRITICAL_SECTION *crit )
 {
-    return RtlInitializeCriticalSectionAndSpinCount( crit, 0 );
+    return RtlInitializeCriticalSectionAndSpinCount( crit, CRITSEC_DEFAULT_SPIN );
 }
 
 /***********************************************************************
@@ -435,7 +514,7 @@ NTSTATUS WINAPI RtlpWaitForCriticalSection( RTL_CRITICAL_SECTION *crit )
  *
  * RETURNS
  *  Success: STATUS_SUCCESS.
- *  Failure: Any error returned by NtReleaseSemaphore()
+ *  Failure: Any error returned by NtReleaseSemaphore() or NtReleaseKeyedEvent()
  *
  * NOTES
  *  Use RtlLeaveCriticalSection() instead of this function as it is often much
@@ -453,8 +532,14 @@ NTSTATUS WINAPI RtlpUnWaitCriticalSection( RTL_CRITICAL_SECTION *crit )
     /* debug info is cleared by MakeCriticalSectionGlobal */
     if (!crit->DebugInfo || ((ret = fast_wake( crit )) == STATUS_NOT_IMPLEMENTED))
     {
-        HANDLE sem = get_semaphore( crit );
-        ret = NtReleaseSemaphore( sem, 1, NULL );
+        /* the waiter is already counted in LockCount, so this doesn't block for long */
+        if (crit->DebugInfo && use_keyed_events())
+            ret = NtReleaseKeyedEvent( 0, crit, FALSE, NULL );
+        else
+        {
+            HANDLE sem = get_semaphore( crit );
+            ret = NtReleaseSemaphore( sem, 1, NULL );
+        }
     }
     if (ret) RtlRaiseStatus( ret );
     return ret;
@@ -479,20 +564,27 @@ NTSTATUS WINAPI RtlpUnWaitCriticalSection( RTL_CRITICAL_SECTION *crit )
  */
 NTSTATUS WINAPI RtlEnterCriticalSection( RTL_CRITICAL_SECTION *crit )
 {
+    ULONG count = 0, limit = 0;
+    BOOL spun = FALSE;
+
     if (crit->SpinCount)
     {
-        ULONG count;
-
         if (RtlTryEnterCriticalSection( crit )) return STATUS_SUCCESS;
-        for (count = crit->SpinCount; count > 0; count--)
+        limit = get_spin_limit( crit );
+        for (count = 0; count < limit; count++)
         {
             if (crit->LockCount > 0) break;  /* more than one waiter, don't bother spinning */
             if (crit->LockCount == -1)       /* try again */
             {
-                if (interlocked_cmpxchg( &crit->LockCount, 0, -1 ) == -1) goto done;
+                if (interlocked_cmpxchg( &crit->LockCount, 0, -1 ) == -1)
+                {
+                    record_spin( crit, count, limit, TRUE );
+                    goto done;
+                }
             }
             small_pause();
         }
+        spun = TRUE;
     }
 
     if (interlocked_inc( &crit->LockCount ))
@@ -505,7 +597,10 @@ NTSTATUS WINAPI RtlEnterCriticalSection( RTL_CRITICAL_SECTION *crit )
 
         /* Now wait for it */
         RtlpWaitForCriticalSection( crit );
+        if (!spun && crit->DebugInfo) crit->DebugInfo->EntryCount++;
     }
+    /* the statistics are only updated once we own the section */
+    if (spun) record_spin( crit, count, limit, FALSE );
 done:
     crit->OwningThread   = ULongToHandle(GetCurrentThreadId());
     crit->RecursionCount = 1;
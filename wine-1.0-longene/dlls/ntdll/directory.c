@@ -69,6 +69,7 @@
 #include "wine/unicode.h"
 #include "wine/server.h"
 #include "wine/library.h"
+#include "wine/list.h"
 #include "wine/debug.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(file);
@@ -136,6 +137,15 @@ static inline int getdents64( int fd, char *de, unsigned int size )
 
 static const unsigned int max_dir_info_size = FIELD_OFFSET( FILE_BOTH_DIR_INFORMATION, FileName[MAX_DIR_ENTRY_LEN] );
 
+union file_directory_info
+{
+    ULONG                              next;
+    FILE_DIRECTORY_INFORMATION         dir;
+    FILE_FULL_DIRECTORY_INFORMATION    full;
+    FILE_BOTH_DIRECTORY_INFORMATION    both;
+    FILE_NAMES_INFORMATION             names;
+};
+
 static int show_dot_files = -1;
 
 /* at some point we may want to allow Winelib apps to set this */
@@ -865,20 +875,91 @@ static BOOLEAN match_filename( const UNICODE_STRING *name_str, const UNICODE_STR
 }
 
 
+/***********************************************************************
+ *           dir_info_size
+ *
+ * Size of the information returned for a directory entry, 0 if the class isn't supported.
+ */
+static inline unsigned int dir_info_size( FILE_INFORMATION_CLASS class, unsigned int len )
+{
+    switch (class)
+    {
+    case FileDirectoryInformation:
+        return FIELD_OFFSET( FILE_DIRECTORY_INFORMATION, FileName[len] );
+    case FileFullDirectoryInformation:
+        return FIELD_OFFSET( FILE_FULL_DIRECTORY_INFORMATION, FileName[len] );
+    case FileBothDirectoryInformation:
+        return FIELD_OFFSET( FILE_BOTH_DIRECTORY_INFORMATION, FileName[len] );
+    case FileNamesInformation:
+        return FIELD_OFFSET( FILE_NAMES_INFORMATION, FileName[len] );
+    default:
+        return 0;
+    }
+}
+
+
+/***********************************************************************
+ *           get_short_name
+ *
+ * Get the short name of a directory entry, generating one if the long name isn't a valid 8.3 name.
+ * Returns the length of the short name, 0 if the entry doesn't need one.
+ */
+static int get_short_name( const UNICODE_STRING *long_str, const char *short_name, WCHAR short_nameW[12] )
+{
+    BOOLEAN spaces;
+    int short_len;
+
+    if (short_name)
+    {
+        short_len = ntdll_umbstowcs( 0, short_name, strlen(short_name), short_nameW, 12 );
+        if (short_len == -1) short_len = 12;
+        return short_len;
+    }
+    if (!RtlIsNameLegalDOS8Dot3( long_str, NULL, &spaces ) || spaces)
+        return hash_short_file_name( long_str, short_nameW );
+    return 0;
+}
+
+
+/***********************************************************************
+ *           get_entry_stat
+ *
+ * Get the Unix attributes of a directory entry, following symlinks.
+ */
+static BOOL get_entry_stat( const char *name, struct stat *st, ULONG *attributes )
+{
+    *attributes = 0;
+    if (lstat( name, st ) == -1) return FALSE;
+    if (S_ISLNK( st->st_mode ))
+    {
+        if (stat( name, st ) == -1) return FALSE;
+        if (S_ISDIR( st->st_mode )) *attributes |= FILE_ATTRIBUTE_REPARSE_POINT;
+    }
+    return TRUE;
+}
+
+
 /***********************************************************************
  *           append_entry
  *
  * helper for NtQueryDirectoryFile
+ * The entry is checked against the mask before anything else is done with it, and only
+ * the information needed by the class is retrieved. If st is NULL the attributes are
+ * fetched with stat(), otherwise st and attributes hold them already.
+ * io->u.Status is set to STATUS_BUFFER_OVERFLOW if the entry doesn't fit in the buffer.
  */
-static FILE_BOTH_DIR_INFORMATION *append_entry( void *info_ptr, ULONG_PTR *pos, ULONG max_length,
+static union file_directory_info *append_entry( void *info_ptr, IO_STATUS_BLOCK *io, ULONG max_length,
                                                 const char *long_name, const char *short_name,
-                                                const UNICODE_STRING *mask )
+                                                const UNICODE_STRING *mask, FILE_INFORMATION_CLASS class,
+                                                const struct stat *st, ULONG attributes )
 {
-    FILE_BOTH_DIR_INFORMATION *info;
-    int i, long_len, short_len, total_len;
-    struct stat st;
+    union file_directory_info *info;
+    int i, long_len, short_len = -1, total_len;
+    ULONG name_space;
+    struct stat entry_st;
     WCHAR long_nameW[MAX_DIR_ENTRY_LEN];
     WCHAR short_nameW[12];
+    WCHAR *filename;
     UNICODE_STRING str;
 
     long_len = ntdll_umbstowcs( 0, long_name, strlen(long_name), long_nameW, MAX_DIR_ENTRY_LEN );
@@ -888,80 +969,99 @@ static FILE_BOTH_DIR_INFORMATION *append_entry( void *info_ptr, ULONG_PTR *pos,
     str.Length = long_len * sizeof(WCHAR);
     str.MaximumLength = sizeof(long_nameW);
 
-    if (short_name)
-    {
-        short_len = ntdll_umbstowcs( 0, short_name, strlen(short_name),
-                                     short_nameW, sizeof(short_nameW) / sizeof(WCHAR) );
-        if (short_len == -1) short_len = sizeof(short_nameW) / sizeof(WCHAR);
-    }
-    else  /* generate a short name if necessary */
+    if (mask && !match_filename( &str, mask ))
     {
-        BOOLEAN spaces;
+        UNICODE_STRING short_str;
 
-        short_len = 0;
-        if (!RtlIsNameLegalDOS8Dot3( &str, NULL, &spaces ) || spaces)
-            short_len = hash_short_file_name( &str, short_nameW );
+        if (!(short_len = get_short_name( &str, short_name, short_nameW )))
+            return NULL;  /* no short name to match */
+        short_str.Buffer = short_nameW;
+        short_str.Length = short_len * sizeof(WCHAR);
+        short_str.MaximumLength = sizeof(short_nameW);
+        if (!match_filename( &short_str, mask )) return NULL;
     }
+    if (class == FileBothDirectoryInformation && short_len == -1)
+        short_len = get_short_name( &str, short_name, short_nameW );
 
     TRACE( "long %s short %s mask %s\n",
-           debugstr_us(&str), debugstr_wn(short_nameW, short_len), debugstr_us(mask) );
+           debugstr_us(&str), short_len > 0 ? debugstr_wn(short_nameW, short_len) : "\"\"",
+           debugstr_us(mask) );
 
-    if (mask && !match_filename( &str, mask ))
+    if (class != FileNamesInformation && !st)
     {
-        if (!short_len) return NULL;  /* no short name to match */
-        str.Buffer = short_nameW;
-        str.Length = short_len * sizeof(WCHAR);
-        str.MaximumLength = sizeof(short_nameW);
-        if (!match_filename( &str, mask )) return NULL;
+        if (!get_entry_stat( long_name, &entry_st, &attributes )) return NULL;
+        st = &entry_st;
     }
 
-    total_len = (sizeof(*info) - sizeof(info->FileName) + long_len*sizeof(WCHAR) + 3) & ~3;
-    info = (FILE_BOTH_DIR_INFORMATION *)((char *)info_ptr + *pos);
+    total_len = (dir_info_size( class, long_len ) + 3) & ~3;
+    info = (union file_directory_info *)((char *)info_ptr + io->Information);
 
-    if (*pos + total_len > max_length) total_len = max_length - *pos;
-
-    info->FileAttributes = 0;
-    if (lstat( long_name, &st ) == -1) return NULL;
-    if (S_ISLNK( st.st_mode ))
+    if (io->Information + total_len > max_length)
     {
-        if (stat( long_name, &st ) == -1) return NULL;
-        if (S_ISDIR( st.st_mode )) info->FileAttributes |= FILE_ATTRIBUTE_REPARSE_POINT;
+        total_len = max_length - io->Information;
+        io->u.Status = STATUS_BUFFER_OVERFLOW;
     }
 
-    info->NextEntryOffset = total_len;
-    info->FileIndex = 0;  /* NTFS always has 0 here, so let's not bother with it */
-
-    RtlSecondsSince1970ToTime( st.st_mtime, &info->CreationTime );
-    RtlSecondsSince1970ToTime( st.st_mtime, &info->LastWriteTime );
-    RtlSecondsSince1970ToTime( st.st_atime, &info->LastAccessTime );
-    RtlSecondsSince1970ToTime( st.st_ctime, &info->ChangeTime );
-
-    if (S_ISDIR(st.st_mode))
-    {
-        info->EndOfFile.QuadPart = info->AllocationSize.QuadPart = 0;
-        info->FileAttributes |= FILE_ATTRIBUTE_DIRECTORY;
-    }
-    else
+    if (class != FileNamesInformation)
     {
-        info->EndOfFile.QuadPart = st.st_size;
-        info->AllocationSize.QuadPart = (ULONGLONG)st.st_blocks * 512;
-        info->FileAttributes |= FILE_ATTRIBUTE_ARCHIVE;
-    }
-
-    if (!(st.st_mode & (S_IWUSR | S_IWGRP | S_IWOTH)))
-        info->FileAttributes |= FILE_ATTRIBUTE_READONLY;
+        /* these classes share the same layout up to the file name length */
+        info->dir.FileIndex = 0;  /* NTFS always has 0 here, so let's not bother with it */
 
-    if (!show_dot_files && long_name[0] == '.' && long_name[1] && (long_name[1] != '.' || long_name[2]))
-        info->FileAttributes |= FILE_ATTRIBUTE_HIDDEN;
+        RtlSecondsSince1970ToTime( st->st_mtime, &info->dir.CreationTime );
+        RtlSecondsSince1970ToTime( st->st_mtime, &info->dir.LastWriteTime );
+        RtlSecondsSince1970ToTime( st->st_atime, &info->dir.LastAccessTime );
+        RtlSecondsSince1970ToTime( st->st_ctime, &info->dir.ChangeTime );
 
-    info->EaSize = 0; /* FIXME */
-    info->ShortNameLength = short_len * sizeof(WCHAR);
-    for (i = 0; i < short_len; i++) info->ShortName[i] = toupperW(short_nameW[i]);
-    info->FileNameLength = long_len * sizeof(WCHAR);
-    memcpy( info->FileName, long_nameW,
-            min( info->FileNameLength, total_len-sizeof(*info)+sizeof(info->FileName) ));
+        if (S_ISDIR(st->st_mode))
+        {
+            info->dir.EndOfFile.QuadPart = info->dir.AllocationSize.QuadPart = 0;
+            attributes |= FILE_ATTRIBUTE_DIRECTORY;
+        }
+        else
+        {
+            info->dir.EndOfFile.QuadPart = st->st_size;
+            info->dir.AllocationSize.QuadPart = (ULONGLONG)st->st_blocks * 512;
+            attributes |= FILE_ATTRIBUTE_ARCHIVE;
+        }
 
-    *pos += total_len;
+        if (!(st->st_mode & (S_IWUSR | S_IWGRP | S_IWOTH)))
+            attributes |= FILE_ATTRIBUTE_READONLY;
+
+        if (!show_dot_files && long_name[0] == '.' && long_name[1] && (long_name[1] != '.' || long_name[2]))
+            attributes |= FILE_ATTRIBUTE_HIDDEN;
+
+        info->dir.FileAttributes = attributes;
+    }
+
+    switch (class)
+    {
+    case FileDirectoryInformation:
+        info->dir.FileNameLength = long_len * sizeof(WCHAR);
+        filename = info->dir.FileName;
+        break;
+    case FileFullDirectoryInformation:
+        info->full.EaSize = 0; /* FIXME */
+        info->full.FileNameLength = long_len * sizeof(WCHAR);
+        filename = info->full.FileName;
+        break;
+    case FileBothDirectoryInformation:
+        info->both.EaSize = 0; /* FIXME */
+        info->both.ShortNameLength = short_len * sizeof(WCHAR);
+        for (i = 0; i < short_len; i++) info->both.ShortName[i] = toupperW(short_nameW[i]);
+        info->both.FileNameLength = long_len * sizeof(WCHAR);
+        filename = info->both.FileName;
+        break;
+    default:
+        info->names.FileIndex = 0;
+        info->names.FileNameLength = long_len * sizeof(WCHAR);
+        filename = info->names.FileName;
+        break;
+    }
+    info->next = total_len;
+    name_space = total_len - ((char *)filename - (char *)info);
+    memcpy( filename, long_nameW, min( long_len * sizeof(WCHAR), name_space ));
+
+    io->Information += total_len;
     return info;
 }
 
@@ -1015,13 +1115,13 @@ static KERNEL_DIRENT *start_vfat_ioctl( int fd )
  * Read a directory using the VFAT ioctl; helper for NtQueryDirectoryFile.
  */
 static int read_directory_vfat( int fd, IO_STATUS_BLOCK *io, void *buffer, ULONG length,
-                                BOOLEAN single_entry, const UNICODE_STRING *mask,
-                                BOOLEAN restart_scan )
+                                FILE_INFORMATION_CLASS class, BOOLEAN single_entry,
+                                const UNICODE_STRING *mask, BOOLEAN restart_scan )
 
 {
     size_t len;
     KERNEL_DIRENT *de;
-    FILE_BOTH_DIR_INFORMATION *info, *last_info = NULL;
+    union file_directory_info *info, *last_info = NULL;
 
     io->u.Status = STATUS_SUCCESS;
 
@@ -1042,19 +1142,16 @@ static int read_directory_vfat( int fd, IO_STATUS_BLOCK *io, void *buffer, ULONG
             de[1].d_name[len] = 0;
 
             if (de[1].d_name[0])
-                info = append_entry( buffer, &io->Information, length,
-                                     de[1].d_name, de[0].d_name, mask );
+                info = append_entry( buffer, io, length,
+                                     de[1].d_name, de[0].d_name, mask, class, NULL, 0 );
             else
-                info = append_entry( buffer, &io->Information, length,
-                                     de[0].d_name, NULL, mask );
+                info = append_entry( buffer, io, length,
+                                     de[0].d_name, NULL, mask, class, NULL, 0 );
             if (info)
             {
                 last_info = info;
-                if ((char *)info->FileName + info->FileNameLength > (char *)buffer + length)
-                {
-                    io->u.Status = STATUS_BUFFER_OVERFLOW;
+                if (io->u.Status == STATUS_BUFFER_OVERFLOW)
                     lseek( fd, old_pos, SEEK_SET );  /* restore pos to previous entry */
-                }
                 break;
             }
             old_pos = lseek( fd, 0, SEEK_CUR );
@@ -1074,11 +1171,11 @@ static int read_directory_vfat( int fd, IO_STATUS_BLOCK *io, void *buffer, ULONG
             de[1].d_name[len] = 0;
 
             if (de[1].d_name[0])
-                info = append_entry( buffer, &io->Information, length,
-                                     de[1].d_name, de[0].d_name, mask );
+                info = append_entry( buffer, io, length,
+                                     de[1].d_name, de[0].d_name, mask, class, NULL, 0 );
             else
-                info = append_entry( buffer, &io->Information, length,
-                                     de[0].d_name, NULL, mask );
+                info = append_entry( buffer, io, length,
+                                     de[0].d_name, NULL, mask, class, NULL, 0 );
             if (info)
             {
                 last_info = info;
@@ -1090,13 +1187,174 @@ static int read_directory_vfat( int fd, IO_STATUS_BLOCK *io, void *buffer, ULONG
         }
     }
 
-    if (last_info) last_info->NextEntryOffset = 0;
+    if (last_info) last_info->next = 0;
     else io->u.Status = restart_scan ? STATUS_NO_SUCH_FILE : STATUS_NO_MORE_FILES;
     return 0;
 }
 #endif /* VFAT_IOCTL_READDIR_BOTH */
 
 
+/* check if a mask matches all names, like "*" or "*.*" */
+static BOOL is_match_all_mask( const UNICODE_STRING *mask )
+{
+    const WCHAR *p = mask->Buffer, *end = p + mask->Length / sizeof(WCHAR);
+
+    while (p < end && *p == '*') p++;
+    if (p < end && *p == '.' && p > mask->Buffer) p++;
+    while (p < end && *p == '*') p++;
+    return p == end && p > mask->Buffer;
+}
+
+/***********************************************************************
+ *           read_directory_server
+ *
+ * Read a directory with the read_directory request, which returns the entries
+ * together with their attributes; helper for NtQueryDirectoryFile.
+ */
+static int read_directory_server( HANDLE handle, int fd, IO_STATUS_BLOCK *io, void *buffer, ULONG length,
+                                  FILE_INFORMATION_CLASS class, BOOLEAN single_entry,
+                                  const UNICODE_STRING *mask, BOOLEAN restart_scan )
+{
+    off_t old_pos;
+    size_t size = min( max( length, 8192 ), 65536 );
+    data_size_t pos, res;
+    int fake_dot_dot = 1, first = 1;
+    char *data, local_buffer[8192];
+    struct dir_entry_info *de;
+    struct stat st;
+    ULONG attributes;
+    NTSTATUS status;
+    union file_directory_info *info, *last_info = NULL;
+    BOOL want_attributes;
+
+    /* with a selective mask, only the few matching entries are worth a stat() */
+    want_attributes = (class != FileNamesInformation && (!mask || is_match_all_mask( mask )));
+
+    if (single_entry || size <= sizeof(local_buffer) ||
+        !(data = RtlAllocateHeap( GetProcessHeap(), 0, size )))
+    {
+        size = sizeof(local_buffer);
+        data = local_buffer;
+    }
+
+    if (restart_scan) lseek( fd, 0, SEEK_SET );
+    old_pos = lseek( fd, 0, SEEK_CUR );
+    io->u.Status = STATUS_SUCCESS;
+
+    for (;;)
+    {
+        SERVER_START_REQ( read_directory )
+        {
+            req->handle = handle;
+            req->flags  = want_attributes ? 0 : READ_DIRECTORY_NAMES_ONLY;
+            wine_server_set_reply( req, data, size );
+            status = wine_server_call( req );
+            res = wine_server_reply_size( reply );
+        }
+        SERVER_END_REQ;
+
+        if (status && first)  /* let the other methods handle it */
+        {
+            if (data != local_buffer) RtlFreeHeap( GetProcessHeap(), 0, data );
+            lseek( fd, old_pos, SEEK_SET );
+            return -1;
+        }
+        if (status)
+        {
+            io->u.Status = status;
+            break;
+        }
+
+        if (restart_scan && first)
+        {
+            /* check if we got . and .. from the file system */
+            de = (struct dir_entry_info *)data;
+            if (res && !strcmp( de->name, "." ))
+            {
+                pos = (FIELD_OFFSET( struct dir_entry_info, name[de->len + 1] ) + 7) & ~7;
+                if (pos < res && !strcmp( ((struct dir_entry_info *)(data + pos))->name, ".." ))
+                    fake_dot_dot = 0;
+            }
+            /* make sure we have enough room for both entries */
+            if (fake_dot_dot)
+            {
+                const ULONG min_info_size = (dir_info_size( class, 1 ) + dir_info_size( class, 2 ) + 3) & ~3;
+                if (length < min_info_size || single_entry)
+                {
+                    FIXME( "not enough room %u/%u for fake . and .. entries\n", length, single_entry );
+                    fake_dot_dot = 0;
+                }
+            }
+            if (fake_dot_dot)
+            {
+                if ((info = append_entry( buffer, io, length, ".", NULL, mask, class, NULL, 0 )))
+                    last_info = info;
+                if ((info = append_entry( buffer, io, length, "..", NULL, mask, class, NULL, 0 )))
+                    last_info = info;
+
+                /* check if we still have enough space for the largest possible entry */
+                if (last_info && io->Information + max_dir_info_size > length)
+                {
+                    lseek( fd, 0, SEEK_SET );  /* reset pos to first entry */
+                    break;
+                }
+            }
+        }
+        first = 0;
+        if (!res) break;  /* end of directory */
+
+        for (pos = 0; pos < res; pos += (FIELD_OFFSET( struct dir_entry_info, name[de->len + 1] ) + 7) & ~7)
+        {
+            de = (struct dir_entry_info *)(data + pos);
+            if (fake_dot_dot && (!strcmp( de->name, "." ) || !strcmp( de->name, ".." )))
+            {
+                old_pos = de->next_pos;
+                continue;
+            }
+
+            if (de->mode)
+            {
+                memset( &st, 0, sizeof(st) );
+                st.st_mode   = de->mode;
+                st.st_size   = de->size;
+                st.st_blocks = de->blocks;
+                st.st_atime  = de->atime;
+                st.st_mtime  = de->mtime;
+                st.st_ctime  = de->ctime;
+                attributes = ((de->flags & DIR_ENTRY_SYMLINK) && S_ISDIR( de->mode )) ?
+                             FILE_ATTRIBUTE_REPARSE_POINT : 0;
+                info = append_entry( buffer, io, length, de->name, NULL, mask, class, &st, attributes );
+            }
+            else info = append_entry( buffer, io, length, de->name, NULL, mask, class, NULL, 0 );
+
+            if (info)
+            {
+                last_info = info;
+                if (io->u.Status == STATUS_BUFFER_OVERFLOW)
+                {
+                    lseek( fd, old_pos, SEEK_SET );  /* restore pos to this entry */
+                    goto done;
+                }
+                /* check if we still have enough space for the largest possible entry */
+                if (single_entry || io->Information + max_dir_info_size > length)
+                {
+                    lseek( fd, de->next_pos, SEEK_SET );  /* set pos to next entry */
+                    goto done;
+                }
+            }
+            old_pos = de->next_pos;
+        }
+    }
+
+done:
+    if (last_info) last_info->next = 0;
+    else if (io->u.Status == STATUS_SUCCESS)
+        io->u.Status = restart_scan ? STATUS_NO_SUCH_FILE : STATUS_NO_MORE_FILES;
+    if (data != local_buffer) RtlFreeHeap( GetProcessHeap(), 0, data );
+    return 0;
+}
+
+
 /***********************************************************************
  *           read_directory_getdents
  *
@@ -1104,15 +1362,15 @@ static int read_directory_vfat( int fd, IO_STATUS_BLOCK *io, void *buffer, ULONG
  */
 #ifdef USE_GETDENTS
 static int read_directory_getdents( int fd, IO_STATUS_BLOCK *io, void *buffer, ULONG length,
-                                    BOOLEAN single_entry, const UNICODE_STRING *mask,
-                                    BOOLEAN restart_scan )
+                                    FILE_INFORMATION_CLASS class, BOOLEAN single_entry,
+                                    const UNICODE_STRING *mask, BOOLEAN restart_scan )
 {
     off_t old_pos = 0;
     size_t size = length;
     int res, fake_dot_dot = 1;
     char *data, local_buffer[8192];
     KERNEL_DIRENT64 *de;
-    FILE_BOTH_DIR_INFORMATION *info, *last_info = NULL;
+    union file_directory_info *info, *last_info = NULL;
 
     if (size <= sizeof(local_buffer) || !(data = RtlAllocateHeap( GetProcessHeap(), 0, size )))
     {
@@ -1161,8 +1419,7 @@ static int read_directory_getdents( int fd, IO_STATUS_BLOCK *io, void *buffer, U
         /* make sure we have enough room for both entries */
         if (fake_dot_dot)
         {
-            static const ULONG min_info_size = (FIELD_OFFSET(FILE_BOTH_DIR_INFORMATION, FileName[1]) +
-                                                FIELD_OFFSET(FILE_BOTH_DIR_INFORMATION, FileName[2]) + 3) & ~3;
+            const ULONG min_info_size = (dir_info_size( class, 1 ) + dir_info_size( class, 2 ) + 3) & ~3;
             if (length < min_info_size || single_entry)
             {
                 FIXME( "not enough room %u/%u for fake . and .. entries\n", length, single_entry );
@@ -1172,9 +1429,9 @@ static int read_directory_getdents( int fd, IO_STATUS_BLOCK *io, void *buffer, U
 
         if (fake_dot_dot)
         {
-            if ((info = append_entry( buffer, &io->Information, length, ".", NULL, mask )))
+            if ((info = append_entry( buffer, io, length, ".", NULL, mask, class, NULL, 0 )))
                 last_info = info;
-            if ((info = append_entry( buffer, &io->Information, length, "..", NULL, mask )))
+            if ((info = append_entry( buffer, io, length, "..", NULL, mask, class, NULL, 0 )))
                 last_info = info;
 
             /* check if we still have enough space for the largest possible entry */
@@ -1190,12 +1447,11 @@ static int read_directory_getdents( int fd, IO_STATUS_BLOCK *io, void *buffer, U
     {
         res -= de->d_reclen;
         if (!(fake_dot_dot && (!strcmp( de->d_name, "." ) || !strcmp( de->d_name, ".." ))) &&
-            (info = append_entry( buffer, &io->Information, length, de->d_name, NULL, mask )))
+            (info = append_entry( buffer, io, length, de->d_name, NULL, mask, class, NULL, 0 )))
         {
             last_info = info;
-            if ((char *)info->FileName + info->FileNameLength > (char *)buffer + length)
+            if (io->u.Status == STATUS_BUFFER_OVERFLOW)
             {
-                io->u.Status = STATUS_BUFFER_OVERFLOW;
                 lseek( fd, old_pos, SEEK_SET );  /* restore pos to previous entry */
                 break;
             }
@@ -1216,7 +1472,7 @@ static int read_directory_getdents( int fd, IO_STATUS_BLOCK *io, void *buffer, U
         }
     }
 
-    if (last_info) last_info->NextEntryOffset = 0;
+    if (last_info) last_info->next = 0;
     else io->u.Status = restart_scan ? STATUS_NO_SUCH_FILE : STATUS_NO_MORE_FILES;
     res = 0;
 done:
@@ -1252,8 +1508,8 @@ static inline int wine_getdirentries(int fd, char *buf, int nbytes, long *basep)
  * Read a directory using the BSD getdirentries system call; helper for NtQueryDirectoryFile.
  */
 static int read_directory_getdirentries( int fd, IO_STATUS_BLOCK *io, void *buffer, ULONG length,
-                                         BOOLEAN single_entry, const UNICODE_STRING *mask,
-                                         BOOLEAN restart_scan )
+                                         FILE_INFORMATION_CLASS class, BOOLEAN single_entry,
+                                         const UNICODE_STRING *mask, BOOLEAN restart_scan )
 {
     long restart_pos;
     ULONG_PTR restart_info_pos = 0;
@@ -1261,7 +1517,7 @@ static int read_directory_getdirentries( int fd, IO_STATUS_BLOCK *io, void *buff
     int res, fake_dot_dot = 1;
     char *data, local_buffer[8192];
     struct dirent *de;
-    FILE_BOTH_DIR_INFORMATION *info, *last_info = NULL, *restart_last_info = NULL;
+    union file_directory_info *info, *last_info = NULL, *restart_last_info = NULL;
 
     size = initial_size;
     data = local_buffer;
@@ -1300,8 +1556,7 @@ static int read_directory_getdirentries( int fd, IO_STATUS_BLOCK *io, void *buff
         /* make sure we have enough room for both entries */
         if (fake_dot_dot)
         {
-            static const ULONG min_info_size = (FIELD_OFFSET(FILE_BOTH_DIR_INFORMATION, FileName[1]) +
-                                                FIELD_OFFSET(FILE_BOTH_DIR_INFORMATION, FileName[2]) + 3) & ~3;
+            const ULONG min_info_size = (dir_info_size( class, 1 ) + dir_info_size( class, 2 ) + 3) & ~3;
             if (length < min_info_size || single_entry)
             {
                 FIXME( "not enough room %u/%u for fake . and .. entries\n", length, single_entry );
@@ -1311,9 +1566,9 @@ static int read_directory_getdirentries( int fd, IO_STATUS_BLOCK *io, void *buff
 
         if (fake_dot_dot)
         {
-            if ((info = append_entry( buffer, &io->Information, length, ".", NULL, mask )))
+            if ((info = append_entry( buffer, io, length, ".", NULL, mask, class, NULL, 0 )))
                 last_info = info;
-            if ((info = append_entry( buffer, &io->Information, length, "..", NULL, mask )))
+            if ((info = append_entry( buffer, io, length, "..", NULL, mask, class, NULL, 0 )))
                 last_info = info;
 
             restart_last_info = last_info;
@@ -1333,25 +1588,23 @@ static int read_directory_getdirentries( int fd, IO_STATUS_BLOCK *io, void *buff
         res -= de->d_reclen;
         if (de->d_fileno &&
             !(fake_dot_dot && (!strcmp( de->d_name, "." ) || !strcmp( de->d_name, ".." ))) &&
-            ((info = append_entry( buffer, &io->Information, length, de->d_name, NULL, mask ))))
+            ((info = append_entry( buffer, io, length, de->d_name, NULL, mask, class, NULL, 0 ))))
         {
             last_info = info;
-            if ((char *)info->FileName + info->FileNameLength > (char *)buffer + length)
+            if (io->u.Status == STATUS_BUFFER_OVERFLOW)
             {
                 lseek( fd, (unsigned long)restart_pos, SEEK_SET );
                 if (restart_info_pos)  /* if we have a complete read already, return it */
                 {
+                    io->u.Status = STATUS_SUCCESS;
                     io->Information = restart_info_pos;
                     last_info = restart_last_info;
                     break;
                 }
                 /* otherwise restart from the start with a smaller size */
                 size = (char *)de - data;
-                if (!size)
-                {
-                    io->u.Status = STATUS_BUFFER_OVERFLOW;
-                    break;
-                }
+                if (!size) break;
+                io->u.Status = STATUS_SUCCESS;
                 io->Information = 0;
                 last_info = NULL;
                 goto restart;
@@ -1383,7 +1636,7 @@ static int read_directory_getdirentries( int fd, IO_STATUS_BLOCK *io, void *buff
         de = (struct dirent *)data;
     }
 
-    if (last_info) last_info->NextEntryOffset = 0;
+    if (last_info) last_info->next = 0;
     else io->u.Status = restart_scan ? STATUS_NO_SUCH_FILE : STATUS_NO_MORE_FILES;
     res = 0;
 done:
@@ -1399,13 +1652,13 @@ done:
  * Read a directory using the POSIX readdir interface; helper for NtQueryDirectoryFile.
  */
 static void read_directory_readdir( int fd, IO_STATUS_BLOCK *io, void *buffer, ULONG length,
-                                    BOOLEAN single_entry, const UNICODE_STRING *mask,
-                                    BOOLEAN restart_scan )
+                                    FILE_INFORMATION_CLASS class, BOOLEAN single_entry,
+                                    const UNICODE_STRING *mask, BOOLEAN restart_scan )
 {
     DIR *dir;
     off_t i, old_pos = 0;
     struct dirent *de;
-    FILE_BOTH_DIR_INFORMATION *info, *last_info = NULL;
+    union file_directory_info *info, *last_info = NULL;
 
     if (!(dir = opendir( "." )))
     {
@@ -1432,13 +1685,13 @@ static void read_directory_readdir( int fd, IO_STATUS_BLOCK *io, void *buffer, U
     for (;;)
     {
         if (old_pos == 0)
-            info = append_entry( buffer, &io->Information, length, ".", NULL, mask );
+            info = append_entry( buffer, io, length, ".", NULL, mask, class, NULL, 0 );
         else if (old_pos == 1)
-            info = append_entry( buffer, &io->Information, length, "..", NULL, mask );
+            info = append_entry( buffer, io, length, "..", NULL, mask, class, NULL, 0 );
         else if ((de = readdir( dir )))
         {
             if (strcmp( de->d_name, "." ) && strcmp( de->d_name, ".." ))
-                info = append_entry( buffer, &io->Information, length, de->d_name, NULL, mask );
+                info = append_entry( buffer, io, length, de->d_name, NULL, mask, class, NULL, 0 );
             else
                 info = NULL;
         }
@@ -1448,9 +1701,8 @@ static void read_directory_readdir( int fd, IO_STATUS_BLOCK *io, void *buffer, U
         if (info)
         {
             last_info = info;
-            if ((char *)info->FileName + info->FileNameLength > (char *)buffer + length)
+            if (io->u.Status == STATUS_BUFFER_OVERFLOW)
             {
-                io->u.Status = STATUS_BUFFER_OVERFLOW;
                 old_pos--;  /* restore pos to previous entry */
                 break;
             }
@@ -1463,7 +1715,7 @@ static void read_directory_readdir( int fd, IO_STATUS_BLOCK *io, void *buffer, U
     lseek( fd, old_pos, SEEK_SET );  /* store dir offset as filepos for fd */
     closedir( dir );
 
-    if (last_info) last_info->NextEntryOffset = 0;
+    if (last_info) last_info->next = 0;
     else io->u.Status = restart_scan ? STATUS_NO_SUCH_FILE : STATUS_NO_MORE_FILES;
 }
 
@@ -1474,8 +1726,8 @@ static void read_directory_readdir( int fd, IO_STATUS_BLOCK *io, void *buffer, U
  * identified by mask exists using stat.
  */
 static int read_directory_stat( int fd, IO_STATUS_BLOCK *io, void *buffer, ULONG length,
-                                BOOLEAN single_entry, const UNICODE_STRING *mask,
-                                BOOLEAN restart_scan )
+                                FILE_INFORMATION_CLASS class, BOOLEAN single_entry,
+                                const UNICODE_STRING *mask, BOOLEAN restart_scan )
 {
     int unix_len, ret, used_default;
     char *unix_name;
@@ -1508,14 +1760,12 @@ static int read_directory_stat( int fd, IO_STATUS_BLOCK *io, void *buffer, ULONG
         ret = stat( unix_name, &st );
         if (!ret)
         {
-            FILE_BOTH_DIR_INFORMATION *info = append_entry( buffer, &io->Information, length, unix_name, NULL, mask );
+            union file_directory_info *info = append_entry( buffer, io, length, unix_name, NULL, mask,
+                                                            class, NULL, 0 );
             if (info)
             {
-                info->NextEntryOffset = 0;
-                if ((char *)info->FileName + info->FileNameLength > (char *)buffer + length)
-                    io->u.Status = STATUS_BUFFER_OVERFLOW;
-                else
-                    lseek( fd, 1, SEEK_CUR );
+                info->next = 0;
+                if (io->u.Status != STATUS_BUFFER_OVERFLOW) lseek( fd, 1, SEEK_CUR );
             }
         }
     }
@@ -1558,16 +1808,16 @@ NTSTATUS WINAPI NtQueryDirectoryFile( HANDLE handle, HANDLE event,
           length, info_class, single_entry, debugstr_us(mask),
           restart_scan);
 
-    if (length < sizeof(FILE_BOTH_DIR_INFORMATION)) return STATUS_INFO_LENGTH_MISMATCH;
-
-    if (event || apc_routine)
+    if (!dir_info_size( info_class, 1 ))
     {
-        FIXME( "Unsupported yet option\n" );
+        FIXME( "Unsupported file info class %d\n", info_class );
         return io->u.Status = STATUS_NOT_IMPLEMENTED;
     }
-    if (info_class != FileBothDirectoryInformation)
+    if (length < dir_info_size( info_class, 1 )) return STATUS_INFO_LENGTH_MISMATCH;
+
+    if (event || apc_routine)
     {
-        FIXME( "Unsupported file info class %d\n", info_class );
+        FIXME( "Unsupported yet option\n" );
         return io->u.Status = STATUS_NOT_IMPLEMENTED;
     }
 
@@ -1584,20 +1834,23 @@ NTSTATUS WINAPI NtQueryDirectoryFile( HANDLE handle, HANDLE event,
     if (fchdir( fd ) != -1)
     {
 #ifdef VFAT_IOCTL_READDIR_BOTH
-        if ((read_directory_vfat( fd, io, buffer, length, single_entry, mask, restart_scan )) != -1)
+        if ((read_directory_vfat( fd, io, buffer, length, info_class, single_entry, mask, restart_scan )) != -1)
             goto done;
 #endif
         if (mask && !mempbrkW( mask->Buffer, wszWildcards, mask->Length / sizeof(WCHAR) ) &&
-            read_directory_stat( fd, io, buffer, length, single_entry, mask, restart_scan ) != -1)
+            read_directory_stat( fd, io, buffer, length, info_class, single_entry, mask, restart_scan ) != -1)
+            goto done;
+        if (read_directory_server( handle, fd, io, buffer, length, info_class,
+                                   single_entry, mask, restart_scan ) != -1)
             goto done;
 #ifdef USE_GETDENTS
-        if ((read_directory_getdents( fd, io, buffer, length, single_entry, mask, restart_scan )) != -1)
+        if ((read_directory_getdents( fd, io, buffer, length, info_class, single_entry, mask, restart_scan )) != -1)
             goto done;
 #elif defined HAVE_GETDIRENTRIES
-        if ((read_directory_getdirentries( fd, io, buffer, length, single_entry, mask, restart_scan )) != -1)
+        if ((read_directory_getdirentries( fd, io, buffer, length, info_class, single_entry, mask, restart_scan )) != -1)
             goto done;
 #endif
-        read_directory_readdir( fd, io, buffer, length, single_entry, mask, restart_scan );
+        read_directory_readdir( fd, io, buffer, length, info_class, single_entry, mask, restart_scan );
 
     done:
         if (cwd == -1 || fchdir( cwd ) == -1) chdir( "/" );
@@ -1613,142 +1866,399 @@ NTSTATUS WINAPI NtQueryDirectoryFile( HANDLE handle, HANDLE event,
 }
 
 
-/***********************************************************************
- *           find_file_in_dir
- *
- * Find a file in a directory the hard way, by doing a case-insensitive search.
- * The file found is appended to unix_name at pos.
- * There must be at least MAX_DIR_ENTRY_LEN+2 chars available at pos.
- */
-static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, int length,
-                                  int check_case )
+/* cache of directory listings used for case-insensitive lookups */
+
+#define DIR_CACHE_MAX      128  /* max number of cached directories */
+#define DIR_CACHE_MIN_AGE  2    /* don't keep listings of directories modified more recently (in seconds) */
+#define DIR_CACHE_MAX_BYTES    (256 * 1024)   /* don't keep listings using more memory */
+#define DIR_CACHE_TOTAL_BYTES  (4096 * 1024)  /* max memory used by all cached listings */
+
+struct dir_cache_name
 {
-    WCHAR buffer[MAX_DIR_ENTRY_LEN];
-    UNICODE_STRING str;
-    BOOLEAN spaces;
-    DIR *dir;
-    struct dirent *de;
-    struct stat st;
-    int ret, used_default, is_name_8_dot_3;
+    struct dir_cache_name *next;      /* next name in the same hash bucket */
+    ULONG                  hash;      /* hash of the folded name */
+    unsigned short         len;       /* length of the folded name in WCHARs */
+    unsigned short         is_short;  /* short (8.3) alias of another entry */
+    unsigned int           index;     /* position in the directory scan */
+    const char            *unix_name; /* Unix name of the directory entry */
+    WCHAR                  name[1];   /* folded name, followed by the Unix name for long names */
+};
 
-    /* try a shortcut for this directory */
+struct dir_cache
+{
+    struct list             entry;    /* entry in LRU list */
+    dev_t                   dev;      /* device and inode of the directory */
+    ino_t                   ino;
+    time_t                  mtime;    /* directory times when the listing was read */
+    time_t                  ctime;
+    unsigned int            count;    /* number of names */
+    unsigned int            size;     /* number of hash buckets */
+    SIZE_T                  bytes;    /* memory used by the listing */
+    struct dir_cache_name **buckets;
+};
 
-    unix_name[pos++] = '/';
-    ret = ntdll_wcstoumbs( 0, name, length, unix_name + pos, MAX_DIR_ENTRY_LEN,
-                           NULL, &used_default );
-    /* if we used the default char, the Unix name won't round trip properly back to Unicode */
-    /* so it cannot match the file we are looking for */
-    if (ret >= 0 && !used_default)
+/* protected by dir_section */
+static struct list dir_cache_list = LIST_INIT( dir_cache_list );
+static unsigned int dir_cache_count;
+static SIZE_T dir_cache_bytes;
+
+static inline ULONG hash_folded_name( const WCHAR *name, unsigned int len )
+{
+    ULONG hash = 0;
+    while (len--) hash = hash * 31 + *name++;
+    return hash;
+}
+
+/* double the number of hash buckets of a directory listing */
+static void grow_dir_cache( struct dir_cache *cache )
+{
+    struct dir_cache_name **buckets, *entry, *next;
+    unsigned int i, size = cache->size * 2;
+
+    if (!(buckets = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY, size * sizeof(*buckets) )))
+        return;  /* keep the current buckets, lookups will just be slower */
+
+    for (i = 0; i < cache->size; i++)
     {
-        unix_name[pos + ret] = 0;
-        if (!stat( unix_name, &st )) return STATUS_SUCCESS;
+        for (entry = cache->buckets[i]; entry; entry = next)
+        {
+            next = entry->next;
+            entry->next = buckets[entry->hash % size];
+            buckets[entry->hash % size] = entry;
+        }
     }
-    if (check_case) goto not_found;  /* we want an exact match */
+    RtlFreeHeap( GetProcessHeap(), 0, cache->buckets );
+    cache->bytes += (size - cache->size) * sizeof(*buckets);
+    cache->buckets = buckets;
+    cache->size = size;
+}
 
-    if (pos > 1) unix_name[pos - 1] = 0;
-    else unix_name[1] = 0;  /* keep the initial slash */
+/* add a name to a directory listing; a short name refers to the Unix name of its long entry */
+static struct dir_cache_name *add_dir_cache_name( struct dir_cache *cache, const WCHAR *name,
+                                                  unsigned int len, const char *unix_name, int is_short )
+{
+    struct dir_cache_name *entry;
+    SIZE_T size = FIELD_OFFSET( struct dir_cache_name, name[len] );
+    unsigned int i;
+
+    if (!is_short) size += strlen( unix_name ) + 1;
+    if (!(entry = RtlAllocateHeap( GetProcessHeap(), 0, size ))) return NULL;
+    cache->bytes += size;
+
+    for (i = 0; i < len; i++) entry->name[i] = tolowerW( name[i] );
+    entry->len = len;
+    entry->is_short = is_short;
+    entry->hash = hash_folded_name( entry->name, len );
+    entry->index = cache->count;
+    if (is_short) entry->unix_name = unix_name;
+    else entry->unix_name = strcpy( (char *)&entry->name[len], unix_name );
+
+    entry->next = cache->buckets[entry->hash % cache->size];
+    cache->buckets[entry->hash % cache->size] = entry;
+    if (++cache->count > 2 * cache->size) grow_dir_cache( cache );
+    return entry;
+}
+
+static void free_dir_cache( struct dir_cache *cache )
+{
+    struct dir_cache_name *entry, *next;
+    unsigned int i;
+
+    for (i = 0; i < cache->size; i++)
+    {
+        for (entry = cache->buckets[i]; entry; entry = next)
+        {
+            next = entry->next;
+            RtlFreeHeap( GetProcessHeap(), 0, entry );
+        }
+    }
+    RtlFreeHeap( GetProcessHeap(), 0, cache->buckets );
+    RtlFreeHeap( GetProcessHeap(), 0, cache );
+}
 
-    /* check if it fits in 8.3 so that we don't look for short names if we won't need them */
+/* look up a name in a directory listing, returns the matching Unix name */
+static const char *lookup_dir_cache( const struct dir_cache *cache, const WCHAR *name, unsigned int len )
+{
+    WCHAR folded[MAX_DIR_ENTRY_LEN];
+    const struct dir_cache_name *entry, *match = NULL;
+    unsigned int i;
+    ULONG hash;
 
-    str.Buffer = (WCHAR *)name;
-    str.Length = length * sizeof(WCHAR);
-    str.MaximumLength = str.Length;
-    is_name_8_dot_3 = RtlIsNameLegalDOS8Dot3( &str, NULL, &spaces ) && !spaces;
+    if (len > MAX_DIR_ENTRY_LEN) return NULL;
+    for (i = 0; i < len; i++) folded[i] = tolowerW( name[i] );
+    hash = hash_folded_name( folded, len );
 
-    /* now look for it through the directory */
+    for (entry = cache->buckets[hash % cache->size]; entry; entry = entry->next)
+    {
+        if (entry->hash != hash || entry->len != len) continue;
+        if (memcmp( entry->name, folded, len * sizeof(WCHAR) )) continue;
+        /* long names win over short names, then the first one in the directory */
+        if (match && (entry->is_short > match->is_short ||
+                      (entry->is_short == match->is_short && entry->index > match->index))) continue;
+        match = entry;
+    }
+    return match ? match->unix_name : NULL;
+}
+
+static struct dir_cache *alloc_dir_cache( const struct stat *st )
+{
+    struct dir_cache *cache;
+
+    if (!(cache = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*cache) ))) return NULL;
+    cache->dev   = st->st_dev;
+    cache->ino   = st->st_ino;
+    cache->mtime = st->st_mtime;
+    cache->ctime = st->st_ctime;
+    cache->count = 0;
+    cache->size  = 64;
+    cache->bytes = sizeof(*cache) + cache->size * sizeof(*cache->buckets);
+    if (!(cache->buckets = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                            cache->size * sizeof(*cache->buckets) )))
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, cache );
+        return NULL;
+    }
+    return cache;
+}
 
 #ifdef VFAT_IOCTL_READDIR_BOTH
-    if (is_name_8_dot_3)
+/***********************************************************************
+ *           read_dir_cache_vfat
+ *
+ * Read a directory listing using the VFAT ioctl, which returns the real short names.
+ * Returns STATUS_NOT_SUPPORTED if the ioctl cannot be used for this directory.
+ * dir_section must be held by caller.
+ */
+static NTSTATUS read_dir_cache_vfat( const char *unix_name, struct dir_cache *cache )
+{
+    WCHAR buffer[MAX_DIR_ENTRY_LEN];
+    struct dir_cache_name *entry;
+    KERNEL_DIRENT *de;
+    NTSTATUS status = STATUS_SUCCESS;
+    int fd, len;
+
+    if ((fd = open( unix_name, O_RDONLY | O_DIRECTORY )) == -1) return STATUS_NOT_SUPPORTED;
+    if (!(de = start_vfat_ioctl( fd )))
     {
-        int fd = open( unix_name, O_RDONLY | O_DIRECTORY );
-        if (fd != -1)
-        {
-            KERNEL_DIRENT *de;
+        close( fd );
+        return STATUS_NOT_SUPPORTED;
+    }
 
-            RtlEnterCriticalSection( &dir_section );
-            if ((de = start_vfat_ioctl( fd )))
-            {
-                unix_name[pos - 1] = '/';
-                while (de[0].d_reclen)
-                {
-                    /* make sure names are null-terminated to work around an x86-64 kernel bug */
-                    size_t len = min(de[0].d_reclen, sizeof(de[0].d_name) - 1 );
-                    de[0].d_name[len] = 0;
-                    len = min(de[1].d_reclen, sizeof(de[1].d_name) - 1 );
-                    de[1].d_name[len] = 0;
+    while (de[0].d_reclen)
+    {
+        /* make sure names are null-terminated to work around an x86-64 kernel bug */
+        size_t name_len = min(de[0].d_reclen, sizeof(de[0].d_name) - 1 );
+        de[0].d_name[name_len] = 0;
+        name_len = min(de[1].d_reclen, sizeof(de[1].d_name) - 1 );
+        de[1].d_name[name_len] = 0;
 
-                    if (de[1].d_name[0])
-                    {
-                        ret = ntdll_umbstowcs( 0, de[1].d_name, strlen(de[1].d_name),
-                                               buffer, MAX_DIR_ENTRY_LEN );
-                        if (ret == length && !memicmpW( buffer, name, length))
-                        {
-                            strcpy( unix_name + pos, de[1].d_name );
-                            RtlLeaveCriticalSection( &dir_section );
-                            close( fd );
-                            return STATUS_SUCCESS;
-                        }
-                    }
-                    ret = ntdll_umbstowcs( 0, de[0].d_name, strlen(de[0].d_name),
-                                           buffer, MAX_DIR_ENTRY_LEN );
-                    if (ret == length && !memicmpW( buffer, name, length))
-                    {
-                        strcpy( unix_name + pos,
-                                de[1].d_name[0] ? de[1].d_name : de[0].d_name );
-                        RtlLeaveCriticalSection( &dir_section );
-                        close( fd );
-                        return STATUS_SUCCESS;
-                    }
-                    if (ioctl( fd, VFAT_IOCTL_READDIR_BOTH, (long)de ) == -1)
-                    {
-                        RtlLeaveCriticalSection( &dir_section );
-                        close( fd );
-                        goto not_found;
-                    }
-                }
-            }
-            RtlLeaveCriticalSection( &dir_section );
-            close( fd );
+        if (de[1].d_name[0])
+        {
+            len = ntdll_umbstowcs( 0, de[1].d_name, strlen(de[1].d_name), buffer, MAX_DIR_ENTRY_LEN );
+            if (!(entry = add_dir_cache_name( cache, buffer, len, de[1].d_name, FALSE ))) goto no_memory;
+            len = ntdll_umbstowcs( 0, de[0].d_name, strlen(de[0].d_name), buffer, MAX_DIR_ENTRY_LEN );
+            if (!add_dir_cache_name( cache, buffer, len, entry->unix_name, TRUE )) goto no_memory;
+        }
+        else
+        {
+            len = ntdll_umbstowcs( 0, de[0].d_name, strlen(de[0].d_name), buffer, MAX_DIR_ENTRY_LEN );
+            if (!add_dir_cache_name( cache, buffer, len, de[0].d_name, FALSE )) goto no_memory;
+        }
+        if (ioctl( fd, VFAT_IOCTL_READDIR_BOTH, (long)de ) == -1)
+        {
+            status = STATUS_NOT_SUPPORTED;
+            break;
         }
-        /* fall through to normal handling */
     }
+    close( fd );
+    return status;
+
+no_memory:
+    close( fd );
+    return STATUS_NO_MEMORY;
+}
 #endif /* VFAT_IOCTL_READDIR_BOTH */
 
+/***********************************************************************
+ *           read_dir_cache_readdir
+ *
+ * Read a directory listing using readdir, generating the short names.
+ */
+static NTSTATUS read_dir_cache_readdir( const char *unix_name, struct dir_cache *cache )
+{
+    WCHAR buffer[MAX_DIR_ENTRY_LEN];
+    UNICODE_STRING str;
+    BOOLEAN spaces;
+    struct dir_cache_name *entry;
+    DIR *dir;
+    struct dirent *de;
+    int len;
+
     if (!(dir = opendir( unix_name )))
     {
         if (errno == ENOENT) return STATUS_OBJECT_PATH_NOT_FOUND;
         else return FILE_GetNtStatus();
     }
-    unix_name[pos - 1] = '/';
     str.Buffer = buffer;
     str.MaximumLength = sizeof(buffer);
     while ((de = readdir( dir )))
     {
-        ret = ntdll_umbstowcs( 0, de->d_name, strlen(de->d_name), buffer, MAX_DIR_ENTRY_LEN );
-        if (ret == length && !memicmpW( buffer, name, length ))
+        len = ntdll_umbstowcs( 0, de->d_name, strlen(de->d_name), buffer, MAX_DIR_ENTRY_LEN );
+        if (!(entry = add_dir_cache_name( cache, buffer, len, de->d_name, FALSE ))) goto no_memory;
+
+        str.Length = len * sizeof(WCHAR);
+        if (!RtlIsNameLegalDOS8Dot3( &str, NULL, &spaces ) || spaces)
         {
-            strcpy( unix_name + pos, de->d_name );
-            closedir( dir );
+            WCHAR short_nameW[12];
+            len = hash_short_file_name( &str, short_nameW );
+            if (!add_dir_cache_name( cache, short_nameW, len, entry->unix_name, TRUE )) goto no_memory;
+        }
+    }
+    closedir( dir );
+    return STATUS_SUCCESS;
+
+no_memory:
+    closedir( dir );
+    return STATUS_NO_MEMORY;
+}
+
+/***********************************************************************
+ *           read_dir_cache
+ *
+ * Read the listing of a directory, with the short names of all entries.
+ * dir_section must be held by caller.
+ */
+static NTSTATUS read_dir_cache( const char *unix_name, const struct stat *st, struct dir_cache **ret )
+{
+    struct dir_cache *cache;
+    NTSTATUS status;
+
+    if (!(cache = alloc_dir_cache( st ))) return STATUS_NO_MEMORY;
+
+#ifdef VFAT_IOCTL_READDIR_BOTH
+    status = read_dir_cache_vfat( unix_name, cache );
+    if (status == STATUS_NOT_SUPPORTED)
+    {
+        /* start over, the ioctl may have failed half way through the directory */
+        free_dir_cache( cache );
+        if (!(cache = alloc_dir_cache( st ))) return STATUS_NO_MEMORY;
+        status = read_dir_cache_readdir( unix_name, cache );
+    }
+#else
+    status = read_dir_cache_readdir( unix_name, cache );
+#endif
+
+    if (status) free_dir_cache( cache );
+    else *ret = cache;
+    return status;
+}
+
+/***********************************************************************
+ *           get_dir_cache
+ *
+ * Get the listing of a directory, reading it again if the directory changed.
+ * Listings of directories that are still being modified are not kept, since
+ * a change within the same second would not show in the directory times,
+ * nor are the listings of huge directories; the caller must free them with
+ * free_dir_cache if *cached is FALSE.
+ * dir_section must be held by caller.
+ */
+static NTSTATUS get_dir_cache( const char *unix_name, struct dir_cache **ret, BOOL *cached )
+{
+    struct dir_cache *cache;
+    struct stat st;
+    NTSTATUS status;
+
+    if (stat( unix_name, &st ) == -1)
+        return (errno == ENOENT) ? STATUS_OBJECT_PATH_NOT_FOUND : FILE_GetNtStatus();
+
+    LIST_FOR_EACH_ENTRY( cache, &dir_cache_list, struct dir_cache, entry )
+    {
+        if (cache->dev != st.st_dev || cache->ino != st.st_ino) continue;
+        list_remove( &cache->entry );
+        if (cache->mtime == st.st_mtime && cache->ctime == st.st_ctime)
+        {
+            list_add_head( &dir_cache_list, &cache->entry );
+            *ret = cache;
+            *cached = TRUE;
             return STATUS_SUCCESS;
         }
+        dir_cache_bytes -= cache->bytes;
+        dir_cache_count--;
+        free_dir_cache( cache );
+        break;
+    }
 
-        if (!is_name_8_dot_3) continue;
+    if ((status = read_dir_cache( unix_name, &st, &cache ))) return status;
 
-        str.Length = ret * sizeof(WCHAR);
-        if (!RtlIsNameLegalDOS8Dot3( &str, NULL, &spaces ) || spaces)
+    *ret = cache;
+    *cached = (cache->bytes <= DIR_CACHE_MAX_BYTES &&
+               max( st.st_mtime, st.st_ctime ) + DIR_CACHE_MIN_AGE <= time(NULL));
+    if (*cached)
+    {
+        while (dir_cache_count == DIR_CACHE_MAX || dir_cache_bytes + cache->bytes > DIR_CACHE_TOTAL_BYTES)
         {
-            WCHAR short_nameW[12];
-            ret = hash_short_file_name( &str, short_nameW );
-            if (ret == length && !memicmpW( short_nameW, name, length ))
-            {
-                strcpy( unix_name + pos, de->d_name );
-                closedir( dir );
-                return STATUS_SUCCESS;
-            }
+            struct dir_cache *lru = LIST_ENTRY( list_tail( &dir_cache_list ), struct dir_cache, entry );
+            list_remove( &lru->entry );
+            dir_cache_bytes -= lru->bytes;
+            dir_cache_count--;
+            free_dir_cache( lru );
         }
+        dir_cache_bytes += cache->bytes;
+        dir_cache_count++;
+        list_add_head( &dir_cache_list, &cache->entry );
     }
-    closedir( dir );
-    goto not_found;  /* avoid warning */
+    return STATUS_SUCCESS;
+}
+
+
+/***********************************************************************
+ *           find_file_in_dir
+ *
+ * Find a file in a directory the hard way, by doing a case-insensitive search.
+ * The file found is appended to unix_name at pos.
+ * There must be at least MAX_DIR_ENTRY_LEN+2 chars available at pos.
+ */
+static NTSTATUS find_file_in_dir( char *unix_name, int pos, const WCHAR *name, int length,
+                                  int check_case )
+{
+    struct dir_cache *cache = NULL;
+    struct stat st;
+    const char *found;
+    NTSTATUS status;
+    BOOL cached = FALSE;
+    int ret, used_default;
+
+    /* try a shortcut for this directory */
+
+    unix_name[pos++] = '/';
+    ret = ntdll_wcstoumbs( 0, name, length, unix_name + pos, MAX_DIR_ENTRY_LEN,
+                           NULL, &used_default );
+    /* if we used the default char, the Unix name won't round trip properly back to Unicode */
+    /* so it cannot match the file we are looking for */
+    if (ret >= 0 && !used_default)
+    {
+        unix_name[pos + ret] = 0;
+        if (!stat( unix_name, &st )) return STATUS_SUCCESS;
+    }
+    if (check_case) goto not_found;  /* we want an exact match */
+
+    if (pos > 1) unix_name[pos - 1] = 0;
+    else unix_name[1] = 0;  /* keep the initial slash */
+
+    /* now look for it through the directory listing */
+
+    RtlEnterCriticalSection( &dir_section );
+    if ((status = get_dir_cache( unix_name, &cache, &cached )))
+    {
+        RtlLeaveCriticalSection( &dir_section );
+        return status;
+    }
+    unix_name[pos - 1] = '/';
+    if ((found = lookup_dir_cache( cache, name, length ))) strcpy( unix_name + pos, found );
+    if (!cached) free_dir_cache( cache );
+    RtlLeaveCriticalSection( &dir_section );
+    if (found) return STATUS_SUCCESS;
 
 not_found:
     unix_name[pos - 1] = 0;
@@ -2256,47 +2766,61 @@ static void WINAPI read_changes_user_apc( void *arg, IO_STATUS_BLOCK *io, ULONG
 static NTSTATUS read_changes_apc( void *user, PIO_STATUS_BLOCK iosb, NTSTATUS status, ULONG_PTR *total )
 {
     struct read_changes_info *info = user;
-    char path[PATH_MAX];
-    NTSTATUS ret = STATUS_SUCCESS;
-    int len, action, i;
+    /* an event converted to a FILE_NOTIFY_INFORMATION at most doubles in size */
+    ULONG size = info->BufferSize / 2;
+    NTSTATUS ret = STATUS_NOTIFY_ENUM_DIR;
+    char *data = NULL;
+    ULONG len = 0;
+    int data_len = 0;
 
-    SERVER_START_REQ( read_change )
+    if (info->Buffer && size && (data = RtlAllocateHeap( GetProcessHeap(), 0, size )))
     {
-        req->handle = info->FileHandle;
-        wine_server_set_reply( req, path, PATH_MAX );
-        ret = wine_server_call( req );
-        action = reply->action;
-        len = wine_server_reply_size( reply );
+        SERVER_START_REQ( read_change )
+        {
+            req->handle = info->FileHandle;
+            wine_server_set_reply( req, data, size );
+            ret = wine_server_call( req );
+            data_len = wine_server_reply_size( reply );
+        }
+        SERVER_END_REQ;
     }
-    SERVER_END_REQ;
 
-    if (ret == STATUS_SUCCESS && info->Buffer && 
-        (info->BufferSize > (sizeof (FILE_NOTIFY_INFORMATION) + len*sizeof(WCHAR))))
+    if (ret == STATUS_SUCCESS)
     {
-        PFILE_NOTIFY_INFORMATION pfni;
+        PFILE_NOTIFY_INFORMATION pfni, prev = NULL;
+        char *ptr = data, *end = data + data_len;
+        int i, name_len;
 
-        pfni = (PFILE_NOTIFY_INFORMATION) info->Buffer;
+        while (end - ptr > (int)offsetof( struct filesystem_event, name ))
+        {
+            struct filesystem_event *event = (struct filesystem_event *)ptr;
+            ULONG entry = (len + 3) & ~3;
 
-        /* convert to an NT style path */
-        for (i=0; i<len; i++)
-            if (path[i] == '/')
-                path[i] = '\\';
+            if (offsetof( struct filesystem_event, name[event->len] ) > (ULONG)(end - ptr)) break;
+            if (entry + offsetof( FILE_NOTIFY_INFORMATION, FileName[event->len] ) > info->BufferSize) break;
+            pfni = (PFILE_NOTIFY_INFORMATION)((char *)info->Buffer + entry);
 
-        len = ntdll_umbstowcs( 0, path, len, pfni->FileName,
-                               info->BufferSize - sizeof (*pfni) );
+            /* convert to an NT style path */
+            for (i = 0; i < event->len; i++)
+                if (event->name[i] == '/')
+                    event->name[i] = '\\';
 
-        pfni->NextEntryOffset = 0;
-        pfni->Action = action;
-        pfni->FileNameLength = len * sizeof (WCHAR);
-        pfni->FileName[len] = 0;
-        len = sizeof (*pfni) - sizeof (DWORD) + pfni->FileNameLength;
-    }
-    else
-    {
-        ret = STATUS_NOTIFY_ENUM_DIR;
-        len = 0;
+            name_len = ntdll_umbstowcs( 0, event->name, event->len, pfni->FileName, event->len );
+
+            if (prev) prev->NextEntryOffset = (char *)pfni - (char *)prev;
+            pfni->NextEntryOffset = 0;
+            pfni->Action = event->action;
+            pfni->FileNameLength = name_len * sizeof(WCHAR);
+            len = entry + offsetof( FILE_NOTIFY_INFORMATION, FileName[name_len] );
+            prev = pfni;
+
+            ptr += (offsetof( struct filesystem_event, name[event->len] ) + 3) & ~3;
+        }
+        if (!len) ret = STATUS_NOTIFY_ENUM_DIR;
     }
+    else ret = STATUS_NOTIFY_ENUM_DIR;
 
+    RtlFreeHeap( GetProcessHeap(), 0, data );
     iosb->u.Status = ret;
     iosb->Information = *total = len;
     return ret;
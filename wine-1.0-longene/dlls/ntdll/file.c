@@ -1417,11 +1417,8 @@ NTSTATUS WINAPI NtFsControlFile(HANDLE handle, HANDLE event, PIO_APC_ROUTINE apc
     case FSCTL_PIPE_DISCONNECT:
         status = server_ioctl_file( handle, event, apc, apc_context, io, code,
                                     in_buffer, in_size, out_buffer, out_size );
-        if (!status)
-        {
-            int fd = server_remove_fd_from_cache( handle );
-            if (fd != -1) close( fd );
-        }
+        /* the cached fd belongs to the handle in the kernel, only forget it */
+        if (!status) server_remove_fd_from_cache( handle );
         break;
 
     case FSCTL_PIPE_IMPERSONATE:
@@ -20,6 +20,7 @@
  */
 
 #include "config.h"
+#include "wine/port.h"
 
 #include <assert.h>
 #include <stdlib.h>
@@ -38,10 +39,10 @@
 #include "winnt.h"
 #include "winternl.h"
 #include "wine/list.h"
+#include "wine/rbtree.h"
 #include "wine/debug.h"
 #include "wine/server.h"
-
-extern void sleep(int);
+#include "ntdll_misc.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(heap);
 
@@ -68,11 +69,24 @@ typedef struct tagARENA_FREE
     struct list           entry;    /* Entry in free list */
 } ARENA_FREE;
 
+typedef struct tagARENA_LARGE
+{
+    struct wine_rb_entry  tree_entry;  /* Entry in the large blocks tree */
+    struct list           entry;       /* Entry in the large blocks list */
+    SIZE_T                data_size;   /* Size of the user data */
+    SIZE_T                block_size;  /* Committed size of the block, this header included */
+    DWORD                 size;        /* Fields for compatibility with normal arenas, */
+    DWORD                 magic;       /* these must remain at the end of the structure */
+} ARENA_LARGE;
+
 #define ARENA_FLAG_FREE        0x00000001  /* flags OR'ed with arena size */
 #define ARENA_FLAG_PREV_FREE   0x00000002
 #define ARENA_SIZE_MASK        (~3)
 #define ARENA_INUSE_MAGIC      0x455355        /* Value for arena 'magic' field */
 #define ARENA_FREE_MAGIC       0x45455246      /* Value for arena 'magic' field */
+#define ARENA_CACHED_MAGIC     0x484643        /* Value for arena 'magic' field of front end blocks */
+#define ARENA_LARGE_SIZE       0xfedcba90      /* Value for arena 'size' field of large blocks */
+#define ARENA_LARGE_MAGIC      0x6752614c      /* Value for arena 'magic' field of large blocks */
 
 #define ARENA_INUSE_FILLER     0x55
 #define ARENA_FREE_FILLER      0xaa
@@ -88,6 +102,8 @@ typedef struct tagARENA_FREE
 #define HEAP_MIN_DATA_SIZE    (2 * sizeof(struct list))
 /* minimum size that must remain to shrink an allocated block */
 #define HEAP_MIN_SHRINK_SIZE  (HEAP_MIN_DATA_SIZE+sizeof(ARENA_FREE))
+/* minimum size of a block that gets a memory block of its own instead of an arena */
+#define HEAP_MIN_LARGE_BLOCK_SIZE  0x7f000
 
 /* Max size of the blocks on the free lists */
 static const SIZE_T HEAP_freeListSizes[] =
@@ -96,6 +112,45 @@ static const SIZE_T HEAP_freeListSizes[] =
 };
 #define HEAP_NB_FREE_LISTS  (sizeof(HEAP_freeListSizes)/sizeof(HEAP_freeListSizes[0]))
 
+/* The low-fragmentation front end: small blocks freed by a thread are kept
+ * in a cache of that thread, one list per block size, and handed out again
+ * without taking the heap lock.  Frees into the cache don't take it either,
+ * the block is checked against a copy of the sub-heap ranges that can be
+ * read without the lock, and the neighbour checks are done when the cache
+ * is flushed.  To the arena code cached blocks stay in use, only their magic
+ * tells that they are cached.  Larger blocks and heaps without the front end
+ * go straight to the arenas. */
+#define HEAP_LFH_MAX_SIZE     0x400   /* largest block size kept in the caches */
+#define HEAP_LFH_BUCKET_BYTES 0x1000  /* bytes kept per block size and thread */
+#define HEAP_LFH_MAX_HEAPS    4       /* heaps a thread keeps blocks for */
+#define HEAP_MAX_RANGES       32      /* sub-heaps found without the heap lock */
+
+struct heap_cache_bucket
+{
+    ARENA_INUSE        *head;       /* cached blocks, linked through their data */
+    DWORD               count;      /* number of cached blocks */
+};
+
+struct heap_thread_cache
+{
+    struct tagHEAP     *heap;       /* heap the blocks belong to */
+    LONG                serial;     /* front end serial of the heap */
+    struct heap_cache_bucket buckets[HEAP_LFH_MAX_SIZE / ALIGNMENT];
+};
+
+struct heap_thread_caches
+{
+    struct list         entry;      /* entry in heap_cache_list */
+    struct heap_thread_cache slots[HEAP_LFH_MAX_HEAPS];
+};
+
+/* arena range of a sub-heap, for the unlocked lookups of the front end */
+struct heap_range
+{
+    const char         *base;       /* first arena */
+    const char         *end;        /* end of the sub-heap */
+};
+
 typedef struct
 {
     ARENA_FREE  arena;
@@ -112,6 +167,7 @@ typedef struct tagSUBHEAP
     struct tagHEAP     *heap;       /* Main heap structure */
     DWORD               headerSize; /* Size of the heap header */
     DWORD               magic;      /* Magic number */
+    struct wine_rb_entry tree_entry; /* Entry in sub-heap tree */
 } SUBHEAP;
 
 #define SUBHEAP_MAGIC    ((DWORD)('S' | ('U'<<8) | ('B'<<16) | ('H'<<24)))
@@ -127,6 +183,13 @@ typedef struct tagHEAP
     DWORD            magic;         /* Magic number */
     RTL_CRITICAL_SECTION critSection; /* Critical section for serialization */
     FREE_LIST_ENTRY  freeList[HEAP_NB_FREE_LISTS];  /* Free lists */
+    LONG             lfh_serial;    /* Serial of the front end, 0 if disabled */
+    struct wine_rb_tree subheap_tree; /* Sub-heaps indexed by address */
+    struct list      large_list;    /* Large blocks list */
+    struct wine_rb_tree large_tree; /* Large blocks indexed by address */
+    LONG             range_seq;     /* Odd while the ranges are updated */
+    LONG             range_count;   /* Number of ranges, 0 if they don't fit */
+    struct heap_range ranges[HEAP_MAX_RANGES]; /* Sub-heap ranges */
 } HEAP;
 
 #define HEAP_MAGIC       ((DWORD)('H' | ('E'<<8) | ('A'<<16) | ('P'<<24)))
@@ -135,6 +198,9 @@ typedef struct tagHEAP
 #define COMMIT_MASK          0xffff  /* bitmask for commit/decommit granularity */
 
 static HEAP *processHeap;  /* main process heap */
+static LONG heap_lfh_serial;  /* last serial given to a front end */
+static BOOL heap_lfh_default;  /* enable the front end on every heap */
+static struct list heap_cache_list = LIST_INIT( heap_cache_list );  /* caches of all threads, guarded by the process heap lock */
 
 static BOOL HEAP_IsRealArena( HEAP *heapPtr, DWORD flags, LPCVOID block, BOOL quiet );
 
@@ -291,6 +357,16 @@ static void HEAP_Dump( HEAP *heap )
 	      subheap->size, subheap->commitSize, freeSize, usedSize,
 	      arenaSize, (arenaSize * 100) / subheap->size );
     }
+
+    if (!list_empty( &heap->large_list ))
+    {
+        ARENA_LARGE *large;
+
+        DPRINTF( "\nLarge blocks:\n Block    Arena   Stat   Size    Committed\n" );
+        LIST_FOR_EACH_ENTRY( large, &heap->large_list, ARENA_LARGE, entry )
+            DPRINTF( "%p %08x large %08lx %08lx\n",
+                     large, large->magic, large->data_size, large->block_size );
+    }
 }
 
 
@@ -396,12 +472,218 @@ static SUBHEAP *HEAP_FindSubHeap(
                 const HEAP *heap, /* [in] Heap pointer */
                 LPCVOID ptr ) /* [in] Address */
 {
-    SUBHEAP *sub;
-    LIST_FOR_EACH_ENTRY( sub, &heap->subheap_list, SUBHEAP, entry )
-        if (((const char *)ptr >= (const char *)sub->base) &&
-            ((const char *)ptr < (const char *)sub->base + sub->size - sizeof(ARENA_INUSE)))
-            return sub;
-    return NULL;
+    struct wine_rb_entry *entry = wine_rb_get( &heap->subheap_tree, ptr );
+    return entry ? WINE_RB_ENTRY_VALUE( entry, SUBHEAP, tree_entry ) : NULL;
+}
+
+
+/***********************************************************************
+ *           HEAP_UpdateRanges
+ *
+ * Rebuild the sub-heap ranges after a sub-heap was added or removed.
+ * Must be called with the heap lock held.
+ */
+static void HEAP_UpdateRanges( HEAP *heap )
+{
+    SUBHEAP *subheap;
+    LONG count = 0;
+
+    interlocked_xchg_add( (int *)&heap->range_seq, 1 );
+    LIST_FOR_EACH_ENTRY( subheap, &heap->subheap_list, SUBHEAP, entry )
+    {
+        if (count == HEAP_MAX_RANGES)
+        {
+            count = 0;  /* lookups fall back to the locked path */
+            break;
+        }
+        heap->ranges[count].base = (const char *)subheap->base + subheap->headerSize;
+        heap->ranges[count].end = (const char *)subheap->base + subheap->size;
+        count++;
+    }
+    heap->range_count = count;
+    interlocked_xchg_add( (int *)&heap->range_seq, 1 );
+}
+
+
+/***********************************************************************
+ *           HEAP_FindRangeEnd
+ *
+ * Find the end of the sub-heap whose arenas contain a given arena header,
+ * without the heap lock.  NULL means the caller has to take the lock.
+ */
+static const char *HEAP_FindRangeEnd( const HEAP *heap, const ARENA_INUSE *pArena )
+{
+    const volatile struct heap_range *range = heap->ranges;
+    const char *end = NULL;
+    LONG seq, count, i;
+
+    seq = *(const volatile LONG *)&heap->range_seq;
+    if (seq & 1) return NULL;
+    count = *(const volatile LONG *)&heap->range_count;
+    for (i = 0; i < count; i++)
+    {
+        if ((const char *)pArena >= range[i].base && (const char *)(pArena + 1) <= range[i].end)
+        {
+            end = range[i].end;
+            break;
+        }
+    }
+    if (*(const volatile LONG *)&heap->range_seq != seq) return NULL;
+    return end;
+}
+
+
+/***********************************************************************
+ *           compare_subheap
+ *
+ * Compare an address with the arena range of a sub-heap. Callback of the sub-heap tree.
+ */
+static int compare_subheap( const void *ptr, const struct wine_rb_entry *entry )
+{
+    const SUBHEAP *sub = WINE_RB_ENTRY_VALUE( entry, SUBHEAP, tree_entry );
+
+    if ((const char *)ptr < (const char *)sub->base) return -1;
+    return (const char *)ptr >= (const char *)sub->base + sub->size - sizeof(ARENA_INUSE);
+}
+
+
+/***********************************************************************
+ *           compare_large_block
+ *
+ * Compare an address with the range of a large block. Callback of the large blocks tree.
+ */
+static int compare_large_block( const void *ptr, const struct wine_rb_entry *entry )
+{
+    const ARENA_LARGE *arena = WINE_RB_ENTRY_VALUE( entry, ARENA_LARGE, tree_entry );
+
+    if ((const char *)ptr < (const char *)arena) return -1;
+    return (const char *)ptr >= (const char *)arena + arena->block_size;
+}
+
+
+/***********************************************************************
+ *           HEAP_FindLargeBlock
+ * Find the large block a pointer was returned for.
+ *
+ * RETURNS
+ *	Pointer: Success
+ *	NULL: Failure
+ */
+static ARENA_LARGE *HEAP_FindLargeBlock( const HEAP *heap, LPCVOID ptr )
+{
+    struct wine_rb_entry *entry = wine_rb_get( &heap->large_tree, ptr );
+    ARENA_LARGE *arena;
+
+    if (!entry) return NULL;
+    arena = WINE_RB_ENTRY_VALUE( entry, ARENA_LARGE, tree_entry );
+    return (ptr == arena + 1) ? arena : NULL;
+}
+
+
+/***********************************************************************
+ *           HEAP_UseLargeBlock
+ *
+ * Check whether a block of that size gets a memory block of its own.
+ */
+static inline BOOL HEAP_UseLargeBlock( DWORD flags, SIZE_T size )
+{
+    return size >= HEAP_MIN_LARGE_BLOCK_SIZE &&
+           (flags & HEAP_GROWABLE) && !(flags & HEAP_SHARED);
+}
+
+
+/***********************************************************************
+ *           HEAP_AllocLargeBlock
+ *
+ * Allocate a memory block of its own for a large block, with room for
+ * at least 'capacity' bytes. The memory comes zeroed.
+ */
+static void *HEAP_AllocLargeBlock( HEAP *heap, DWORD flags, SIZE_T size, SIZE_T capacity )
+{
+    ARENA_LARGE *arena;
+    SIZE_T block_size = sizeof(*arena) + ROUND_SIZE( max( size, capacity ));
+    void *address = NULL;
+
+    if (block_size < size) return NULL;  /* overflow */
+    if (NtAllocateVirtualMemory( NtCurrentProcess(), &address, 0, &block_size,
+                                 MEM_RESERVE | MEM_COMMIT, get_protection_type( flags ) ))
+    {
+        WARN("Could not allocate block for %08lx bytes\n", size );
+        return NULL;
+    }
+    arena = address;
+    arena->data_size  = size;
+    arena->block_size = block_size;
+    arena->size       = ARENA_LARGE_SIZE;
+    arena->magic      = ARENA_LARGE_MAGIC;
+    list_add_tail( &heap->large_list, &arena->entry );
+    wine_rb_put( &heap->large_tree, arena, &arena->tree_entry );
+    notify_alloc( arena + 1, size, flags & HEAP_ZERO_MEMORY );
+    return arena + 1;
+}
+
+
+/***********************************************************************
+ *           HEAP_FreeLargeBlock
+ *
+ * Give the memory of a large block back to the system.
+ */
+static void HEAP_FreeLargeBlock( HEAP *heap, ARENA_LARGE *arena )
+{
+    void *addr = arena;
+    SIZE_T size = 0;
+
+    list_remove( &arena->entry );
+    wine_rb_remove( &heap->large_tree, &arena->tree_entry );
+    NtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
+}
+
+
+/***********************************************************************
+ *           HEAP_ReAllocLargeBlock
+ *
+ * Resize a large block. It shrinks and grows in place as long as it fits
+ * its committed memory, giving whole chunks back when it shrinks; past
+ * that it moves to a new block with room to grow by half again, so that
+ * growing a buffer step by step only copies it now and then.
+ */
+static void *HEAP_ReAllocLargeBlock( HEAP *heap, DWORD flags, ARENA_LARGE *arena, SIZE_T size )
+{
+    SIZE_T old_size = arena->data_size;
+    SIZE_T needed = sizeof(*arena) + ROUND_SIZE( size );
+    void *ret;
+
+    if (needed < size) return NULL;  /* overflow */
+    if (needed <= arena->block_size)
+    {
+        char *end = (char *)arena + ((needed + COMMIT_MASK) & ~COMMIT_MASK);
+        if (end < (char *)arena + arena->block_size)
+        {
+            void *addr = end;
+            SIZE_T decommit_size = (char *)arena + arena->block_size - end;
+            if (!NtFreeVirtualMemory( NtCurrentProcess(), &addr, &decommit_size, MEM_DECOMMIT ))
+                arena->block_size = end - (char *)arena;
+        }
+        notify_free( arena + 1 );
+        notify_alloc( arena + 1, size, FALSE );
+        mark_block_initialized( arena + 1, min( old_size, size ));
+        if (size > old_size)
+        {
+            if (flags & HEAP_ZERO_MEMORY)
+                clear_block( (char *)(arena + 1) + old_size, size - old_size );
+            else
+                mark_block_uninitialized( (char *)(arena + 1) + old_size, size - old_size );
+        }
+        arena->data_size = size;
+        return arena + 1;
+    }
+
+    if (flags & HEAP_REALLOC_IN_PLACE_ONLY) return NULL;
+    if (!(ret = HEAP_AllocLargeBlock( heap, flags, size, old_size + old_size / 2 ))) return NULL;
+    memcpy( ret, arena + 1, old_size );
+    notify_free( arena + 1 );
+    HEAP_FreeLargeBlock( heap, arena );
+    return ret;
 }
 
 
@@ -551,8 +833,10 @@ static void HEAP_MakeInUseBlockFree( SUBHEAP *subheap, ARENA_INUSE *pArena )
         void *addr = subheap->base;
         /* Remove the free block from the list */
         list_remove( &pFree->entry );
-        /* Remove the subheap from the list */
+        /* Remove the subheap from the list and the tree */
         list_remove( &subheap->entry );
+        wine_rb_remove( &subheap->heap->subheap_tree, &subheap->tree_entry );
+        HEAP_UpdateRanges( subheap->heap );
         /* Free the memory */
         subheap->magic = 0;
         NtFreeVirtualMemory( NtCurrentProcess(), &addr, &size, MEM_RELEASE );
@@ -621,6 +905,8 @@ static SUBHEAP *HEAP_InitSubHeap( HEAP *heap, LPVOID address, DWORD flags,
         subheap->magic      = SUBHEAP_MAGIC;
         subheap->headerSize = ROUND_SIZE( sizeof(SUBHEAP) );
         list_add_head( &heap->subheap_list, &subheap->entry );
+        wine_rb_put( &heap->subheap_tree, subheap->base, &subheap->tree_entry );
+        HEAP_UpdateRanges( heap );
     }
     else
     {
@@ -630,6 +916,9 @@ static SUBHEAP *HEAP_InitSubHeap( HEAP *heap, LPVOID address, DWORD flags,
         heap->flags         = flags;
         heap->magic         = HEAP_MAGIC;
         list_init( &heap->subheap_list );
+        list_init( &heap->large_list );
+        wine_rb_init( &heap->subheap_tree, compare_subheap, NULL );
+        wine_rb_init( &heap->large_tree, compare_large_block, NULL );
 
         subheap = &heap->subheap;
         subheap->base       = address;
@@ -639,6 +928,8 @@ static SUBHEAP *HEAP_InitSubHeap( HEAP *heap, LPVOID address, DWORD flags,
         subheap->magic      = SUBHEAP_MAGIC;
         subheap->headerSize = ROUND_SIZE( sizeof(HEAP) );
         list_add_head( &heap->subheap_list, &subheap->entry );
+        wine_rb_put( &heap->subheap_tree, subheap->base, &subheap->tree_entry );
+        HEAP_UpdateRanges( heap );
 
         /* Build the free lists */
 
@@ -990,6 +1281,29 @@ static BOOL HEAP_ValidateInUseArena( const SUBHEAP *subheap, const ARENA_INUSE *
 }
 
 
+/***********************************************************************
+ *           HEAP_ValidateLargeArena
+ */
+static BOOL HEAP_ValidateLargeArena( const HEAP *heap, const ARENA_LARGE *arena, BOOL quiet )
+{
+    if (arena->size != ARENA_LARGE_SIZE || arena->magic != ARENA_LARGE_MAGIC)
+    {
+        if (quiet == NOISY)
+            ERR("Heap %p: invalid large arena %p values %x/%x\n", heap, arena, arena->size, arena->magic );
+        else if (WARN_ON(heap))
+            WARN("Heap %p: invalid large arena %p values %x/%x\n", heap, arena, arena->size, arena->magic );
+        return FALSE;
+    }
+    if (arena->data_size > arena->block_size - sizeof(*arena))
+    {
+        ERR("Heap %p: invalid large arena %p size %08lx/%08lx\n",
+            heap, arena, arena->data_size, arena->block_size );
+        return FALSE;
+    }
+    return TRUE;
+}
+
+
 /***********************************************************************
  *           HEAP_IsRealArena  [Internal]
  * Validates a block is a valid arena.
@@ -1016,9 +1330,12 @@ static BOOL HEAP_IsRealArena( HEAP *heapPtr,   /* [in] ptr to the heap */
     if (block)  /* only check this single memory block */
     {
         const ARENA_INUSE *arena = (const ARENA_INUSE *)block - 1;
+        const ARENA_LARGE *large;
 
-        if (!(subheap = HEAP_FindSubHeap( heapPtr, arena )) ||
-            ((const char *)arena < (char *)subheap->base + subheap->headerSize))
+        if ((large = HEAP_FindLargeBlock( heapPtr, block )))
+            ret = HEAP_ValidateLargeArena( heapPtr, large, quiet );
+        else if (!(subheap = HEAP_FindSubHeap( heapPtr, arena )) ||
+                 ((const char *)arena < (char *)subheap->base + subheap->headerSize))
         {
             if (quiet == NOISY)
                 ERR("Heap %p: block %p is not inside heap\n", heapPtr, block );
@@ -1046,6 +1363,11 @@ static BOOL HEAP_IsRealArena( HEAP *heapPtr,   /* [in] ptr to the heap */
                 }
                 ptr += sizeof(ARENA_FREE) + (*(DWORD *)ptr & ARENA_SIZE_MASK);
             }
+            else if (((ARENA_INUSE *)ptr)->magic == ARENA_CACHED_MAGIC)
+            {
+                /* kept by a thread cache, still in use for the arenas */
+                ptr += sizeof(ARENA_INUSE) + (*(DWORD *)ptr & ARENA_SIZE_MASK);
+            }
             else
             {
                 if (!HEAP_ValidateInUseArena( subheap, (ARENA_INUSE *)ptr, NOISY )) {
@@ -1058,11 +1380,239 @@ static BOOL HEAP_IsRealArena( HEAP *heapPtr,   /* [in] ptr to the heap */
         if (!ret) break;
     }
 
+    if (ret)
+    {
+        const ARENA_LARGE *large;
+
+        LIST_FOR_EACH_ENTRY( large, &heapPtr->large_list, ARENA_LARGE, entry )
+            if (!(ret = HEAP_ValidateLargeArena( heapPtr, large, NOISY ))) break;
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
     return ret;
 }
 
 
+/***********************************************************************
+ *           HEAP_EnableFrontEnd
+ *
+ * Turn on the low-fragmentation front end of a heap.
+ */
+static BOOL HEAP_EnableFrontEnd( HEAP *heapPtr )
+{
+    if (heapPtr->flags & HEAP_NO_SERIALIZE) return FALSE;
+    if (!heapPtr->lfh_serial)
+        heapPtr->lfh_serial = interlocked_xchg_add( (int *)&heap_lfh_serial, 1 ) + 1;
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *           HEAP_GetThreadCache
+ *
+ * Find the cache of the current thread for a heap, optionally setting it up.
+ * The serial tells a cache apart from one left over by a destroyed heap
+ * that lived at the same address.
+ */
+static struct heap_thread_cache *HEAP_GetThreadCache( HEAP *heapPtr, BOOL create )
+{
+    struct ntdll_thread_data *thread_data = ntdll_get_thread_data();
+    struct heap_thread_caches *thread_caches = thread_data->heap_cache;
+    struct heap_thread_cache *caches, *cache = NULL;
+    LONG serial = heapPtr->lfh_serial;
+    int i;
+
+    /* the debug fillers and checks need every block to go through the arenas */
+    if (!serial || TRACE_ON(heap) || WARN_ON(heap)) return NULL;
+
+    if (!thread_caches)
+    {
+        if (!create) return NULL;
+        if (!(thread_caches = RtlAllocateHeap( processHeap, HEAP_ZERO_MEMORY, sizeof(*thread_caches) )))
+            return NULL;
+        RtlEnterCriticalSection( &processHeap->critSection );
+        list_add_head( &heap_cache_list, &thread_caches->entry );
+        RtlLeaveCriticalSection( &processHeap->critSection );
+        thread_data->heap_cache = thread_caches;
+    }
+    caches = thread_caches->slots;
+
+    for (i = 0; i < HEAP_LFH_MAX_HEAPS; i++)
+    {
+        if (caches[i].heap == heapPtr)
+        {
+            if (caches[i].serial == serial) return &caches[i];
+            cache = &caches[i];  /* stale, the blocks went away with the old heap */
+            break;
+        }
+        if (!cache && !caches[i].heap) cache = &caches[i];
+    }
+    if (!cache || !create) return NULL;
+
+    memset( cache, 0, sizeof(*cache) );
+    cache->heap = heapPtr;
+    cache->serial = serial;
+    return cache;
+}
+
+
+/***********************************************************************
+ *           HEAP_GetCachedBlock
+ *
+ * Take a block of the given size from the cache of the current thread.
+ */
+static ARENA_INUSE *HEAP_GetCachedBlock( HEAP *heapPtr, SIZE_T size )
+{
+    struct heap_thread_cache *cache;
+    struct heap_cache_bucket *bucket;
+    ARENA_INUSE *pArena;
+
+    if (size > HEAP_LFH_MAX_SIZE) return NULL;
+    if (!(cache = HEAP_GetThreadCache( heapPtr, FALSE ))) return NULL;
+
+    bucket = &cache->buckets[size / ALIGNMENT - 1];
+    if (!(pArena = bucket->head)) return NULL;
+    bucket->head = *(ARENA_INUSE **)(pArena + 1);
+    bucket->count--;
+    pArena->magic = ARENA_INUSE_MAGIC;
+    return pArena;
+}
+
+
+/***********************************************************************
+ *           HEAP_PutCachedBlock
+ *
+ * Keep a freed block in the cache of the current thread if there is room.
+ * The block must have been validated by the caller, and the cache set up
+ * before taking the heap lock, since that needs the process heap lock.
+ */
+static BOOL HEAP_PutCachedBlock( HEAP *heapPtr, ARENA_INUSE *pArena )
+{
+    struct heap_thread_cache *cache;
+    struct heap_cache_bucket *bucket;
+    SIZE_T size;
+
+    if (!heapPtr->lfh_serial) return FALSE;
+    size = pArena->size & ARENA_SIZE_MASK;
+    if (size > HEAP_LFH_MAX_SIZE) return FALSE;
+    if (!(cache = HEAP_GetThreadCache( heapPtr, FALSE ))) return FALSE;
+
+    bucket = &cache->buckets[size / ALIGNMENT - 1];
+    if ((bucket->count + 1) * size > HEAP_LFH_BUCKET_BYTES) return FALSE;
+    pArena->magic = ARENA_CACHED_MAGIC;
+    *(ARENA_INUSE **)(pArena + 1) = bucket->head;
+    bucket->head = pArena;
+    bucket->count++;
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *           HEAP_FreeToCache
+ *
+ * Free a small block into the cache of the current thread without taking
+ * the heap lock.  The block is claimed by switching its magic atomically,
+ * so a double free still fails.  FALSE means the caller has to take the
+ * locked path, which reports the invalid blocks.
+ */
+static BOOL HEAP_FreeToCache( HEAP *heapPtr, ARENA_INUSE *pArena )
+{
+    struct heap_thread_cache *cache;
+    struct heap_cache_bucket *bucket;
+    ARENA_INUSE old, new;
+    const char *end;
+    SIZE_T size;
+
+    if ((ULONG_PTR)pArena % ALIGNMENT) return FALSE;
+    if (!(cache = HEAP_GetThreadCache( heapPtr, TRUE ))) return FALSE;
+    if (!(end = HEAP_FindRangeEnd( heapPtr, pArena ))) return FALSE;
+
+    old = *pArena;
+    if (old.magic != ARENA_INUSE_MAGIC || (old.size & ARENA_FLAG_FREE)) return FALSE;
+    size = old.size & ARENA_SIZE_MASK;
+    if (!size || size > HEAP_LFH_MAX_SIZE) return FALSE;
+    if ((const char *)(pArena + 1) + size > end) return FALSE;
+
+    bucket = &cache->buckets[size / ALIGNMENT - 1];
+    if ((bucket->count + 1) * size > HEAP_LFH_BUCKET_BYTES) return FALSE;
+
+    new = old;
+    new.magic = ARENA_CACHED_MAGIC;
+    if (interlocked_cmpxchg( (int *)pArena + 1, ((int *)&new)[1], ((int *)&old)[1] ) != ((int *)&old)[1])
+        return FALSE;
+    *(ARENA_INUSE **)(pArena + 1) = bucket->head;
+    bucket->head = pArena;
+    bucket->count++;
+    return TRUE;
+}
+
+
+/***********************************************************************
+ *           HEAP_FlushThreadCache
+ *
+ * Give the blocks of a thread cache back to the arenas, if the heap is
+ * still around.
+ */
+static void HEAP_FlushThreadCache( struct heap_thread_cache *cache )
+{
+    HEAP *heapPtr = cache->heap, *iter;
+    ARENA_INUSE *pArena;
+    SUBHEAP *subheap;
+    BOOL found = (heapPtr == processHeap);
+    int i;
+
+    /* the process heap lock keeps the heap from being destroyed meanwhile */
+    RtlEnterCriticalSection( &processHeap->critSection );
+    if (!found)
+    {
+        LIST_FOR_EACH_ENTRY( iter, &processHeap->entry, HEAP, entry )
+            if (iter == heapPtr) { found = TRUE; break; }
+    }
+    if (found && heapPtr->lfh_serial == cache->serial)
+    {
+        RtlEnterCriticalSection( &heapPtr->critSection );
+        for (i = 0; i < HEAP_LFH_MAX_SIZE / ALIGNMENT; i++)
+        {
+            while ((pArena = cache->buckets[i].head))
+            {
+                cache->buckets[i].head = *(ARENA_INUSE **)(pArena + 1);
+                pArena->magic = ARENA_INUSE_MAGIC;
+                /* the neighbours were not checked when the block was cached */
+                if ((subheap = HEAP_FindSubHeap( heapPtr, pArena )) &&
+                    HEAP_ValidateInUseArena( subheap, pArena, NOISY ))
+                    HEAP_MakeInUseBlockFree( subheap, pArena );
+                else
+                    WARN( "Heap %p: cached block %p is invalid, leaking it\n", heapPtr, pArena + 1 );
+            }
+        }
+        RtlLeaveCriticalSection( &heapPtr->critSection );
+    }
+    RtlLeaveCriticalSection( &processHeap->critSection );
+}
+
+
+/***********************************************************************
+ *           heap_thread_detach
+ *
+ * Release the heap caches of the current thread when it exits.
+ */
+void heap_thread_detach(void)
+{
+    struct ntdll_thread_data *thread_data = ntdll_get_thread_data();
+    struct heap_thread_caches *thread_caches = thread_data->heap_cache;
+    int i;
+
+    if (!thread_caches) return;
+    thread_data->heap_cache = NULL;
+    RtlEnterCriticalSection( &processHeap->critSection );
+    list_remove( &thread_caches->entry );
+    RtlLeaveCriticalSection( &processHeap->critSection );
+    for (i = 0; i < HEAP_LFH_MAX_HEAPS; i++)
+        if (thread_caches->slots[i].heap) HEAP_FlushThreadCache( &thread_caches->slots[i] );
+    RtlFreeHeap( processHeap, 0, thread_caches );
+}
+
+
 /***********************************************************************
  *           RtlCreateHeap   (NTDLL.@)
  *
@@ -1105,11 +1655,15 @@ HANDLE WINAPI RtlCreateHeap( ULONG flags, PVOID addr, SIZE_T totalSize, SIZE_T c
     }
     else
     {
+        const char *lfh = getenv( "WINEHEAPLFH" );
+
         processHeap = subheap->heap;  /* assume the first heap we create is the process main heap */
         list_init( &processHeap->entry );
         /* make sure structure alignment is correct */
         assert( (ULONG_PTR)&processHeap->freeList % ALIGNMENT == 0 );
+        heap_lfh_default = lfh && atoi( lfh );
     }
+    if (heap_lfh_default) HEAP_EnableFrontEnd( subheap->heap );
 
     return (HANDLE)subheap->heap;
 }
@@ -1131,6 +1685,7 @@ HANDLE WINAPI RtlDestroyHeap( HANDLE heap )
 {
     HEAP *heapPtr = HEAP_GetPtr( heap );
     SUBHEAP *subheap, *next;
+    ARENA_LARGE *arena, *arena_next;
     SIZE_T size;
     void *addr;
 
@@ -1139,14 +1694,29 @@ HANDLE WINAPI RtlDestroyHeap( HANDLE heap )
 
     if (heap == processHeap) return heap; /* cannot delete the main process heap */
 
-    /* remove it from the per-process list */
+    /* remove it from the per-process list, and drop the blocks the
+     * threads kept for it, they go away with the heap */
     RtlEnterCriticalSection( &processHeap->critSection );
     list_remove( &heapPtr->entry );
+    if (heapPtr->lfh_serial)
+    {
+        struct heap_thread_caches *thread_caches;
+        int i;
+
+        LIST_FOR_EACH_ENTRY( thread_caches, &heap_cache_list, struct heap_thread_caches, entry )
+            for (i = 0; i < HEAP_LFH_MAX_HEAPS; i++)
+                if (thread_caches->slots[i].heap == heapPtr)
+                    memset( &thread_caches->slots[i], 0, sizeof(thread_caches->slots[i]) );
+        heapPtr->lfh_serial = 0;
+    }
     RtlLeaveCriticalSection( &processHeap->critSection );
 
     heapPtr->critSection.DebugInfo->Spare[0] = 0;
     RtlDeleteCriticalSection( &heapPtr->critSection );
 
+    LIST_FOR_EACH_ENTRY_SAFE( arena, arena_next, &heapPtr->large_list, ARENA_LARGE, entry )
+        HEAP_FreeLargeBlock( heapPtr, arena );
+
     LIST_FOR_EACH_ENTRY_SAFE( subheap, next, &heapPtr->subheap_list, SUBHEAP, entry )
     {
         if (subheap == &heapPtr->subheap) continue;  /* do this one last */
@@ -1200,7 +1770,35 @@ PVOID WINAPI RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_T size )
     }
     if (rounded_size < HEAP_MIN_DATA_SIZE) rounded_size = HEAP_MIN_DATA_SIZE;
 
+    /* Try the front end first, it doesn't need the lock */
+
+    if ((pInUse = HEAP_GetCachedBlock( heapPtr, rounded_size )))
+    {
+        pInUse->unused_bytes = (pInUse->size & ARENA_SIZE_MASK) - size;
+        notify_alloc( pInUse + 1, size, flags & HEAP_ZERO_MEMORY );
+        if (flags & HEAP_ZERO_MEMORY)
+        {
+            clear_block( pInUse + 1, size );
+            mark_block_uninitialized( (char *)(pInUse + 1) + size, pInUse->unused_bytes );
+        }
+        else
+            mark_block_uninitialized( pInUse + 1, pInUse->size & ARENA_SIZE_MASK );
+
+        TRACE("(%p,%08x,%08lx): returning cached %p\n", heap, flags, size, pInUse + 1 );
+        return (LPVOID)(pInUse + 1);
+    }
+
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
+
+    if (HEAP_UseLargeBlock( flags, rounded_size ))
+    {
+        void *ret = HEAP_AllocLargeBlock( heapPtr, flags, size, 0 );
+        if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
+        if (!ret && (flags & HEAP_GENERATE_EXCEPTIONS)) RtlRaiseStatus( STATUS_NO_MEMORY );
+        TRACE("(%p,%08x,%08lx): returning large %p\n", heap, flags, size, ret );
+        return ret;
+    }
+
     /* Locate a suitable free block */
 
     if (!(pArena = HEAP_FindFreeBlock( heapPtr, rounded_size, &subheap )))
@@ -1264,6 +1862,7 @@ PVOID WINAPI RtlAllocateHeap( HANDLE heap, ULONG flags, SIZE_T size )
 BOOLEAN WINAPI RtlFreeHeap( HANDLE heap, ULONG flags, PVOID ptr )
 {
     ARENA_INUSE *pInUse;
+    ARENA_LARGE *pLarge;
     SUBHEAP *subheap;
     HEAP *heapPtr;
 
@@ -1280,17 +1879,44 @@ BOOLEAN WINAPI RtlFreeHeap( HANDLE heap, ULONG flags, PVOID ptr )
 
     flags &= HEAP_NO_SERIALIZE;
     flags |= heapPtr->flags;
-    if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
 
     /* Inform valgrind we are trying to free memory, so it can throw up an error message */
     notify_free( ptr );
 
+    /* Keep small blocks in the front end of this thread */
+
+    if (heapPtr->lfh_serial && HEAP_FreeToCache( heapPtr, (ARENA_INUSE *)ptr - 1 ))
+    {
+        TRACE("(%p,%08x,%p): returning TRUE, cached\n", heap, flags, ptr );
+        return TRUE;
+    }
+
+    if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
+
+    /* Large blocks go straight back to the system */
+    if ((pLarge = HEAP_FindLargeBlock( heapPtr, ptr )))
+    {
+        HEAP_FreeLargeBlock( heapPtr, pLarge );
+        if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
+        TRACE("(%p,%08x,%p): returning TRUE\n", heap, flags, ptr );
+        return TRUE;
+    }
+
     /* Some sanity checks */
     pInUse  = (ARENA_INUSE *)ptr - 1;
     if (!(subheap = HEAP_FindSubHeap( heapPtr, pInUse ))) goto error;
     if ((char *)pInUse < (char *)subheap->base + subheap->headerSize) goto error;
     if (!HEAP_ValidateInUseArena( subheap, pInUse, QUIET )) goto error;
 
+    /* The unlocked checks may have given up on a valid block */
+
+    if (HEAP_PutCachedBlock( heapPtr, pInUse ))
+    {
+        if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
+        TRACE("(%p,%08x,%p): returning TRUE, cached\n", heap, flags, ptr );
+        return TRUE;
+    }
+
     /* Turn the block into a free block */
 
     HEAP_MakeInUseBlockFree( subheap, pInUse );
@@ -1326,6 +1952,7 @@ error:
 PVOID WINAPI RtlReAllocateHeap( HANDLE heap, ULONG flags, PVOID ptr, SIZE_T size )
 {
     ARENA_INUSE *pArena;
+    ARENA_LARGE *pLarge;
     HEAP *heapPtr;
     SUBHEAP *subheap;
     SIZE_T oldBlockSize, oldActualSize, rounded_size;
@@ -1353,6 +1980,19 @@ PVOID WINAPI RtlReAllocateHeap( HANDLE heap, ULONG flags, PVOID ptr, SIZE_T size
 
     if (!(flags & HEAP_NO_SERIALIZE)) RtlEnterCriticalSection( &heapPtr->critSection );
 
+    if ((pLarge = HEAP_FindLargeBlock( heapPtr, ptr )))
+    {
+        void *ret = HEAP_ReAllocLargeBlock( heapPtr, flags, pLarge, size );
+        if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
+        if (!ret)
+        {
+            if (flags & HEAP_GENERATE_EXCEPTIONS) RtlRaiseStatus( STATUS_NO_MEMORY );
+            RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_NO_MEMORY );
+        }
+        TRACE("(%p,%08x,%p,%08lx): returning %p\n", heap, flags, ptr, size, ret );
+        return ret;
+    }
+
     pArena = (ARENA_INUSE *)ptr - 1;
     if (!(subheap = HEAP_FindSubHeap( heapPtr, pArena ))) goto error;
     if ((char *)pArena < (char *)subheap->base + subheap->headerSize) goto error;
@@ -1362,6 +2002,26 @@ PVOID WINAPI RtlReAllocateHeap( HANDLE heap, ULONG flags, PVOID ptr, SIZE_T size
 
     oldBlockSize = (pArena->size & ARENA_SIZE_MASK);
     oldActualSize = (pArena->size & ARENA_SIZE_MASK) - pArena->unused_bytes;
+    if (rounded_size > oldBlockSize && !(flags & HEAP_REALLOC_IN_PLACE_ONLY) &&
+        HEAP_UseLargeBlock( flags, rounded_size ))
+    {
+        /* Move it to a large block */
+        void *ret = HEAP_AllocLargeBlock( heapPtr, flags & ~HEAP_ZERO_MEMORY, size, 0 );
+        if (ret)
+        {
+            memcpy( ret, pArena + 1, oldActualSize );
+            notify_free( pArena + 1 );
+            HEAP_MakeInUseBlockFree( subheap, pArena );
+        }
+        if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
+        if (!ret)
+        {
+            if (flags & HEAP_GENERATE_EXCEPTIONS) RtlRaiseStatus( STATUS_NO_MEMORY );
+            RtlSetLastWin32ErrorAndNtStatusFromNtStatus( STATUS_NO_MEMORY );
+        }
+        TRACE("(%p,%08x,%p,%08lx): returning %p\n", heap, flags, ptr, size, ret );
+        return ret;
+    }
     if (rounded_size > oldBlockSize)
     {
         char *pNext = (char *)(pArena + 1) + oldBlockSize;
@@ -1566,7 +2226,10 @@ SIZE_T WINAPI RtlSizeHeap( HANDLE heap, ULONG flags, const void *ptr )
     else
     {
         const ARENA_INUSE *pArena = (const ARENA_INUSE *)ptr - 1;
-        ret = (pArena->size & ARENA_SIZE_MASK) - pArena->unused_bytes;
+        const ARENA_LARGE *pLarge = HEAP_FindLargeBlock( heapPtr, ptr );
+
+        if (pLarge) ret = pLarge->data_size;
+        else ret = (pArena->size & ARENA_SIZE_MASK) - pArena->unused_bytes;
     }
     if (!(flags & HEAP_NO_SERIALIZE)) RtlLeaveCriticalSection( &heapPtr->critSection );
 
@@ -1609,6 +2272,7 @@ NTSTATUS WINAPI RtlWalkHeap( HANDLE heap, PVOID entry_ptr )
     LPPROCESS_HEAP_ENTRY entry = entry_ptr; /* FIXME */
     HEAP *heapPtr = HEAP_GetPtr(heap);
     SUBHEAP *sub, *currentheap = NULL;
+    ARENA_LARGE *large = NULL;
     NTSTATUS ret;
     char *ptr;
     int region_index = 0;
@@ -1625,6 +2289,17 @@ NTSTATUS WINAPI RtlWalkHeap( HANDLE heap, PVOID entry_ptr )
         currentheap = &heapPtr->subheap;
         ptr = (char*)currentheap->base + currentheap->headerSize;
     }
+    else if ((large = HEAP_FindLargeBlock( heapPtr, entry->lpData )))
+    {
+        struct list *next = list_next( &heapPtr->large_list, &large->entry );
+        if (!next)
+        {  /* successfully finished */
+            TRACE("end reached.\n");
+            ret = STATUS_NO_MORE_ENTRIES;
+            goto HW_end;
+        }
+        large = LIST_ENTRY( next, ARENA_LARGE, entry );
+    }
     else
     {
         ptr = entry->lpData;
@@ -1661,19 +2336,31 @@ NTSTATUS WINAPI RtlWalkHeap( HANDLE heap, PVOID entry_ptr )
         if (ptr > (char *)currentheap->base + currentheap->size - 1)
         {   /* proceed with next subheap */
             struct list *next = list_next( &heapPtr->subheap_list, &currentheap->entry );
-            if (!next)
+            if (next)
+            {
+                currentheap = LIST_ENTRY( next, SUBHEAP, entry );
+                ptr = (char *)currentheap->base + currentheap->headerSize;
+            }
+            else if ((next = list_head( &heapPtr->large_list )))
+                large = LIST_ENTRY( next, ARENA_LARGE, entry );  /* large blocks come last */
+            else
             {  /* successfully finished */
                 TRACE("end reached.\n");
                 ret = STATUS_NO_MORE_ENTRIES;
                 goto HW_end;
             }
-            currentheap = LIST_ENTRY( next, SUBHEAP, entry );
-            ptr = (char *)currentheap->base + currentheap->headerSize;
         }
     }
 
     entry->wFlags = 0;
-    if (*(DWORD *)ptr & ARENA_FLAG_FREE)
+    if (large)
+    {
+        entry->lpData = large + 1;
+        entry->cbData = large->data_size;
+        entry->cbOverhead = sizeof(ARENA_LARGE);
+        entry->wFlags = PROCESS_HEAP_ENTRY_BUSY;
+    }
+    else if (*(DWORD *)ptr & ARENA_FLAG_FREE)
     {
         ARENA_FREE *pArena = (ARENA_FREE *)ptr;
 
@@ -1701,7 +2388,7 @@ NTSTATUS WINAPI RtlWalkHeap( HANDLE heap, PVOID entry_ptr )
     entry->iRegionIndex = region_index;
 
     /* first element of heap ? */
-    if (ptr == (char *)currentheap->base + currentheap->headerSize)
+    if (!large && ptr == (char *)currentheap->base + currentheap->headerSize)
     {
         entry->wFlags |= PROCESS_HEAP_REGION;
         entry->u.Region.dwCommittedSize = currentheap->commitSize;
@@ -1750,3 +2437,86 @@ ULONG WINAPI RtlGetProcessHeaps( ULONG count, HANDLE *heaps )
     RtlLeaveCriticalSection( &processHeap->critSection );
     return total;
 }
+
+
+/***********************************************************************
+ *           RtlSetHeapInformation    (NTDLL.@)
+ *
+ * Set information about a Heap.
+ *
+ * PARAMS
+ *  heap       [I] Heap to change
+ *  info_class [I] Type of information to set
+ *  info       [I] The information
+ *  size       [I] Size of info
+ *
+ * RETURNS
+ *  Success: STATUS_SUCCESS.
+ *  Failure: An NTSTATUS error code.
+ *
+ * NOTES
+ *  Setting HeapCompatibilityInformation to 2 turns on the low-fragmentation
+ *  front end, which can't be turned off again.
+ */
+NTSTATUS WINAPI RtlSetHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS info_class,
+                                       PVOID info, SIZE_T size )
+{
+    HEAP *heapPtr = HEAP_GetPtr( heap );
+
+    if (!heapPtr) return STATUS_INVALID_HANDLE;
+
+    switch (info_class)
+    {
+    case HeapCompatibilityInformation:
+        if (size < sizeof(ULONG)) return STATUS_BUFFER_TOO_SMALL;
+        switch (*(ULONG *)info)
+        {
+        case 0:  /* standard heap */
+            return heapPtr->lfh_serial ? STATUS_UNSUCCESSFUL : STATUS_SUCCESS;
+        case 2:  /* low-fragmentation heap */
+            return HEAP_EnableFrontEnd( heapPtr ) ? STATUS_SUCCESS : STATUS_UNSUCCESSFUL;
+        default:
+            return STATUS_UNSUCCESSFUL;
+        }
+    default:
+        FIXME( "%p: unknown information class %d\n", heap, info_class );
+        return STATUS_INVALID_PARAMETER;
+    }
+}
+
+
+/***********************************************************************
+ *           RtlQueryHeapInformation    (NTDLL.@)
+ *
+ * Get information about a Heap.
+ *
+ * PARAMS
+ *  heap       [I] Heap to query
+ *  info_class [I] Type of information to get
+ *  info       [O] Destination for the information
+ *  size       [I] Size of info
+ *  needed     [O] Optional destination for the size of the information
+ *
+ * RETURNS
+ *  Success: STATUS_SUCCESS.
+ *  Failure: An NTSTATUS error code.
+ */
+NTSTATUS WINAPI RtlQueryHeapInformation( HANDLE heap, HEAP_INFORMATION_CLASS info_class,
+                                         PVOID info, SIZE_T size, PSIZE_T needed )
+{
+    HEAP *heapPtr = HEAP_GetPtr( heap );
+
+    if (!heapPtr) return STATUS_INVALID_HANDLE;
+
+    switch (info_class)
+    {
+    case HeapCompatibilityInformation:
+        if (needed) *needed = sizeof(ULONG);
+        if (size < sizeof(ULONG)) return STATUS_BUFFER_TOO_SMALL;
+        *(ULONG *)info = heapPtr->lfh_serial ? 2 : 0;
+        return STATUS_SUCCESS;
+    default:
+        FIXME( "%p: unknown information class %d\n", heap, info_class );
+        return STATUS_INVALID_PARAMETER;
+    }
+}
@@ -446,6 +446,7 @@ void init_for_load()
 LOG(LOG_FILE, 0, 0, "init_for_load(),call NtAllocateVirtualMemory, addr=0x7ffe0000\n");
     NtAllocateVirtualMemory( NtCurrentProcess(), &addr, 0, &size, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE );
     user_shared_data = addr;
+    init_user_shared_time();
 
     /* signal */
     thread_data = (struct ntdll_thread_data *)NtCurrentTeb()->SystemReserved2;
@@ -23,10 +23,22 @@
 #include "wine/port.h"
 
 #include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <stdarg.h>
+#include <stdio.h>
+#include <sys/types.h>
 #ifdef HAVE_SYS_MMAN_H
 # include <sys/mman.h>
 #endif
+#ifdef HAVE_SYS_STAT_H
+# include <sys/stat.h>
+#endif
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
 
 #define NONAMELESSUNION
 #define NONAMELESSSTRUCT
@@ -39,6 +51,7 @@
 
 #include "wine/exception.h"
 #include "wine/library.h"
+#include "wine/list.h"
 #include "wine/pthread.h"
 #include "wine/unicode.h"
 #include "wine/debug.h"
@@ -90,6 +103,11 @@ typedef struct _wine_modref
     LDR_MODULE            ldr;
     int                   nDeps;
     struct _wine_modref **deps;
+    struct list           basename_entry;  /* entry in the base name hash */
+    struct list           fullname_entry;  /* entry in the full name hash */
+    ULONGLONG             export_hash;     /* hash of the export table, 0 if not computed */
+    DWORD                *export_names;    /* hash table of the export names, built on demand */
+    DWORD                 export_mask;     /* size of that table minus one */
 } WINE_MODREF;
 
 /* info about the current builtin dll load */
@@ -122,6 +140,14 @@ static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
 };
 static RTL_CRITICAL_SECTION loader_section = { &critsect_debug, -1, 0, 0, 0, 0 };
 
+/* module index, maintained under the loader_section as modules come and go */
+#define MODULE_HASH_SIZE 128
+static struct list basename_hash[MODULE_HASH_SIZE];
+static struct list fullname_hash[MODULE_HASH_SIZE];
+static WINE_MODREF **modules_by_base;  /* modules sorted by base address */
+static UINT modules_count;
+static UINT modules_size;
+
 static WINE_MODREF *cached_modref;
 static WINE_MODREF *current_modref;
 static WINE_MODREF *last_failed_modref;
@@ -258,6 +284,125 @@ static inline ULONG_PTR allocate_stub( const char *dll, const char *name ) { ret
 #endif  /* __i386__ */
 
 
+/*************************************************************************
+ *		hash_module_name
+ *
+ * Hash a module name case-insensitively.
+ */
+static unsigned int hash_module_name( LPCWSTR name )
+{
+    unsigned int hash = 0;
+
+    while (*name) hash = hash * 31 + tolowerW( *name++ );
+    return hash % MODULE_HASH_SIZE;
+}
+
+
+/*************************************************************************
+ *		find_module_index
+ *
+ * Find the position of the first module based above an address in the
+ * modules sorted by base address.
+ * The loader_section must be locked while calling this function.
+ */
+static UINT find_module_index( const void *addr )
+{
+    UINT min = 0, max = modules_count;
+
+    while (min < max)
+    {
+        UINT pos = (min + max) / 2;
+        if ((const void *)modules_by_base[pos]->ldr.BaseAddress <= addr) min = pos + 1;
+        else max = pos;
+    }
+    return min;
+}
+
+
+/*************************************************************************
+ *		add_module_index
+ *
+ * Add a module to the name hashes and the base address array.
+ * The loader_section must be locked while calling this function.
+ */
+static BOOL add_module_index( WINE_MODREF *wm )
+{
+    UINT i, pos;
+
+    if (!modules_by_base)
+    {
+        for (i = 0; i < MODULE_HASH_SIZE; i++)
+        {
+            list_init( &basename_hash[i] );
+            list_init( &fullname_hash[i] );
+        }
+    }
+    if (modules_count == modules_size)
+    {
+        UINT new_size = modules_size ? modules_size * 2 : 64;
+        WINE_MODREF **new_array;
+
+        if (modules_by_base)
+            new_array = RtlReAllocateHeap( GetProcessHeap(), 0, modules_by_base,
+                                           new_size * sizeof(*new_array) );
+        else
+            new_array = RtlAllocateHeap( GetProcessHeap(), 0, new_size * sizeof(*new_array) );
+        if (!new_array) return FALSE;
+        modules_by_base = new_array;
+        modules_size = new_size;
+    }
+
+    pos = find_module_index( wm->ldr.BaseAddress );
+    memmove( modules_by_base + pos + 1, modules_by_base + pos,
+             (modules_count - pos) * sizeof(*modules_by_base) );
+    modules_by_base[pos] = wm;
+    modules_count++;
+
+    list_add_tail( &basename_hash[hash_module_name( wm->ldr.BaseDllName.Buffer )], &wm->basename_entry );
+    list_add_tail( &fullname_hash[hash_module_name( wm->ldr.FullDllName.Buffer )], &wm->fullname_entry );
+    return TRUE;
+}
+
+
+/*************************************************************************
+ *		remove_module_index
+ *
+ * Remove a module from the name hashes and the base address array.
+ * The loader_section must be locked while calling this function.
+ */
+static void remove_module_index( WINE_MODREF *wm )
+{
+    UINT pos = find_module_index( wm->ldr.BaseAddress );
+
+    if (pos && modules_by_base[pos - 1] == wm)
+    {
+        modules_count--;
+        memmove( modules_by_base + pos - 1, modules_by_base + pos,
+                 (modules_count - pos + 1) * sizeof(*modules_by_base) );
+    }
+    list_remove( &wm->basename_entry );
+    list_remove( &wm->fullname_entry );
+    if (cached_modref == wm) cached_modref = NULL;
+}
+
+
+/*************************************************************************
+ *		rename_module_index
+ *
+ * Change the names of a module, moving it to the matching name hashes.
+ * The loader_section must be locked while calling this function.
+ */
+static void rename_module_index( WINE_MODREF *wm, LPWSTR fullname, LPWSTR basename )
+{
+    list_remove( &wm->basename_entry );
+    list_remove( &wm->fullname_entry );
+    RtlInitUnicodeString( &wm->ldr.FullDllName, fullname );
+    RtlInitUnicodeString( &wm->ldr.BaseDllName, basename );
+    list_add_tail( &basename_hash[hash_module_name( wm->ldr.BaseDllName.Buffer )], &wm->basename_entry );
+    list_add_tail( &fullname_hash[hash_module_name( wm->ldr.FullDllName.Buffer )], &wm->fullname_entry );
+}
+
+
 /*************************************************************************
  *		get_modref
  *
@@ -266,19 +411,13 @@ static inline ULONG_PTR allocate_stub( const char *dll, const char *name ) { ret
  */
 static WINE_MODREF *get_modref( HMODULE hmod )
 {
-    PLIST_ENTRY mark, entry;
-    PLDR_MODULE mod;
+    UINT pos;
 
     if (cached_modref && cached_modref->ldr.BaseAddress == hmod) return cached_modref;
 
-    mark = &NtCurrentTeb()->Peb->LdrData->InMemoryOrderModuleList;
-    for (entry = mark->Flink; entry != mark; entry = entry->Flink)
-    {
-        mod = CONTAINING_RECORD(entry, LDR_MODULE, InMemoryOrderModuleList);
-        if (mod->BaseAddress == hmod)
-            return cached_modref = CONTAINING_RECORD(mod, WINE_MODREF, ldr);
-        if (mod->BaseAddress > (void*)hmod) break;
-    }
+    pos = find_module_index( hmod );
+    if (pos && modules_by_base[pos - 1]->ldr.BaseAddress == hmod)
+        return cached_modref = modules_by_base[pos - 1];
     return NULL;
 }
 
@@ -291,21 +430,11 @@ static WINE_MODREF *get_modref( HMODULE hmod )
  */
 static WINE_MODREF *find_basename_module( LPCWSTR name )
 {
-    PLIST_ENTRY mark, entry;
-
-    if (cached_modref && !strcmpiW( name, cached_modref->ldr.BaseDllName.Buffer ))
-        return cached_modref;
+    WINE_MODREF *wm;
 
-    mark = &NtCurrentTeb()->Peb->LdrData->InLoadOrderModuleList;
-    for (entry = mark->Flink; entry != mark; entry = entry->Flink)
-    {
-        LDR_MODULE *mod = CONTAINING_RECORD(entry, LDR_MODULE, InLoadOrderModuleList);
-        if (!strcmpiW( name, mod->BaseDllName.Buffer ))
-        {
-            cached_modref = CONTAINING_RECORD(mod, WINE_MODREF, ldr);
-            return cached_modref;
-        }
-    }
+    if (!modules_by_base) return NULL;
+    LIST_FOR_EACH_ENTRY( wm, &basename_hash[hash_module_name( name )], WINE_MODREF, basename_entry )
+        if (!strcmpiW( name, wm->ldr.BaseDllName.Buffer )) return wm;
     return NULL;
 }
 
@@ -318,21 +447,11 @@ static WINE_MODREF *find_basename_module( LPCWSTR name )
  */
 static WINE_MODREF *find_fullname_module( LPCWSTR name )
 {
-    PLIST_ENTRY mark, entry;
-
-    if (cached_modref && !strcmpiW( name, cached_modref->ldr.FullDllName.Buffer ))
-        return cached_modref;
+    WINE_MODREF *wm;
 
-    mark = &NtCurrentTeb()->Peb->LdrData->InLoadOrderModuleList;
-    for (entry = mark->Flink; entry != mark; entry = entry->Flink)
-    {
-        LDR_MODULE *mod = CONTAINING_RECORD(entry, LDR_MODULE, InLoadOrderModuleList);
-        if (!strcmpiW( name, mod->FullDllName.Buffer ))
-        {
-            cached_modref = CONTAINING_RECORD(mod, WINE_MODREF, ldr);
-            return cached_modref;
-        }
-    }
+    if (!modules_by_base) return NULL;
+    LIST_FOR_EACH_ENTRY( wm, &fullname_hash[hash_module_name( name )], WINE_MODREF, fullname_entry )
+        if (!strcmpiW( name, wm->ldr.FullDllName.Buffer )) return wm;
     return NULL;
 }
 
@@ -438,6 +557,51 @@ static FARPROC find_ordinal_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY
 }
 
 
+/*************************************************************************
+ *		hash_export_name
+ */
+static inline DWORD hash_export_name( const char *name )
+{
+    DWORD hash = 0x811c9dc5;
+
+    while (*name) hash = (hash ^ (unsigned char)*name++) * 0x01000193;
+    return hash;
+}
+
+/*************************************************************************
+ *		get_export_names
+ *
+ * Return the modref of a module, with the hash table of its export names
+ * built on first use.  Each slot holds an index in the name table plus one, 0 for
+ * an empty slot; collisions go to the next slot.
+ * The loader_section must be locked while calling this function.
+ */
+static WINE_MODREF *get_export_names( HMODULE module, const IMAGE_EXPORT_DIRECTORY *exports )
+{
+    const DWORD *names = get_rva( module, exports->AddressOfNames );
+    WINE_MODREF *wm;
+    DWORD i, pos, mask;
+
+    if (!(wm = get_modref( module ))) return NULL;
+    if (wm->export_names) return wm;
+
+    /* keep it at most half full */
+    for (mask = 15; mask < exports->NumberOfNames * 2; mask = mask * 2 + 1)
+        if (mask >= 0x7fffffff) return NULL;
+    if (!(wm->export_names = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                              (mask + 1) * sizeof(DWORD) )))
+        return NULL;
+    wm->export_mask = mask;
+
+    for (i = 0; i < exports->NumberOfNames; i++)
+    {
+        pos = hash_export_name( get_rva( module, names[i] ) ) & mask;
+        while (wm->export_names[pos]) pos = (pos + 1) & mask;
+        wm->export_names[pos] = i + 1;
+    }
+    return wm;
+}
+
 /*************************************************************************
  *		find_named_export
  *
@@ -449,6 +613,7 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
 {
     const WORD *ordinals = get_rva( module, exports->AddressOfNameOrdinals );
     const DWORD *names = get_rva( module, exports->AddressOfNames );
+    WINE_MODREF *wm;
     int min = 0, max = exports->NumberOfNames - 1;
 
     /* first check the hint */
@@ -459,7 +624,22 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
             return find_ordinal_export( module, exports, exp_size, ordinals[hint], load_path );
     }
 
-    /* then do a binary search */
+    /* then the hash table */
+    if ((wm = get_export_names( module, exports )))
+    {
+        DWORD pos, index;
+
+        for (pos = hash_export_name( name ) & wm->export_mask; (index = wm->export_names[pos]);
+             pos = (pos + 1) & wm->export_mask)
+        {
+            char *ename = get_rva( module, names[index - 1] );
+            if (!strcmp( ename, name ))
+                return find_ordinal_export( module, exports, exp_size, ordinals[index - 1], load_path );
+        }
+        return NULL;
+    }
+
+    /* and a binary search if it couldn't be built */
     while (min <= max)
     {
         int res, pos = (min + max) / 2;
@@ -474,13 +654,428 @@ static FARPROC find_named_export( HMODULE module, const IMAGE_EXPORT_DIRECTORY *
 }
 
 
+/* Import binding cache
+ *
+ * The addresses an import descriptor resolves to are saved in a file per
+ * importing module under the config dir, as offsets from the base of the
+ * modules they ended up in.  The next time the module is loaded, a
+ * descriptor whose imported names hash the same is bound from the file
+ * without looking up each name, as long as the export tables of these
+ * modules hash the same as when the entry was written.  Since only
+ * offsets are stored, entries stay valid when a module is relocated.
+ */
+
+#define BIND_CACHE_MAGIC    0x444e4942  /* "BIND" */
+#define BIND_CACHE_VERSION  1
+#define BIND_CACHE_MAX_SIZE 0x100000
+#define BIND_MAX_TARGETS    8           /* modules an entry may bind to */
+
+struct bind_cache_header
+{
+    DWORD       magic;
+    DWORD       version;
+    DWORD       count;        /* number of entries */
+    DWORD       pad;
+};
+
+struct bind_target
+{
+    WCHAR       name[32];     /* base name of the module */
+    ULONGLONG   export_hash;  /* hash of its export table */
+};
+
+struct bind_thunk
+{
+    DWORD       target;       /* index of the target module */
+    DWORD       rva;          /* offset of the function from its base */
+};
+
+struct bind_entry
+{
+    DWORD       size;         /* size of the entry with its targets and thunks */
+    DWORD       nb_targets;
+    DWORD       nb_thunks;
+    DWORD       pad;
+    ULONGLONG   import_hash;  /* hash of the imported names */
+    /* followed by the targets, the first one being the imported dll, then the thunks */
+};
+
+struct bind_cache
+{
+    char                     *data;     /* contents of the cache file */
+    DWORD                     size;
+    const struct bind_entry **entries;  /* entry of each import descriptor */
+    BOOL                      changed;  /* new entries have to be saved */
+};
+
+static inline DWORD bind_entry_size( DWORD nb_targets, DWORD nb_thunks )
+{
+    return sizeof(struct bind_entry) + nb_targets * sizeof(struct bind_target) +
+           nb_thunks * sizeof(struct bind_thunk);
+}
+
+/* 64-bit FNV-1a */
+#define BIND_HASH_INIT  (((ULONGLONG)0xcbf29ce4 << 32) | 0x84222325)
+#define BIND_HASH_PRIME (((ULONGLONG)0x00000100 << 32) | 0x000001b3)
+
+static ULONGLONG hash_bind_data( ULONGLONG hash, const void *data, SIZE_T size )
+{
+    const unsigned char *p = data;
+
+    while (size--) hash = (hash ^ *p++) * BIND_HASH_PRIME;
+    return hash;
+}
+
+/*************************************************************************
+ *		get_export_hash
+ *
+ * Hash the export table of a module, computed once per module.
+ * Returns 0 if it has no exports.
+ */
+static ULONGLONG get_export_hash( WINE_MODREF *wm )
+{
+    HMODULE module = wm->ldr.BaseAddress;
+    const IMAGE_EXPORT_DIRECTORY *exports;
+    const DWORD *names;
+    ULONGLONG hash;
+    DWORD i, size;
+
+    if (wm->export_hash) return wm->export_hash;
+    if (!(exports = RtlImageDirectoryEntryToData( module, TRUE, IMAGE_DIRECTORY_ENTRY_EXPORT, &size )))
+        return 0;
+
+    /* the directory normally holds the tables and strings too, but don't count on it */
+    hash = hash_bind_data( BIND_HASH_INIT, &wm->ldr.SizeOfImage, sizeof(wm->ldr.SizeOfImage) );
+    hash = hash_bind_data( hash, exports, size );
+    hash = hash_bind_data( hash, get_rva( module, exports->AddressOfFunctions ),
+                           exports->NumberOfFunctions * sizeof(DWORD) );
+    hash = hash_bind_data( hash, get_rva( module, exports->AddressOfNameOrdinals ),
+                           exports->NumberOfNames * sizeof(WORD) );
+    names = get_rva( module, exports->AddressOfNames );
+    for (i = 0; i < exports->NumberOfNames; i++)
+    {
+        const char *name = get_rva( module, names[i] );
+        hash = hash_bind_data( hash, name, strlen(name) + 1 );
+    }
+    if (!hash) hash = 1;
+    return wm->export_hash = hash;
+}
+
+/*************************************************************************
+ *		get_import_hash
+ *
+ * Hash the dll name and the imported names or ordinals of an import descriptor.
+ */
+static ULONGLONG get_import_hash( HMODULE module, const char *name, const IMAGE_THUNK_DATA *import_list )
+{
+    ULONGLONG hash = hash_bind_data( BIND_HASH_INIT, name, strlen(name) + 1 );
+
+    for ( ; import_list->u1.Ordinal; import_list++)
+    {
+        if (IMAGE_SNAP_BY_ORDINAL(import_list->u1.Ordinal))
+            hash = hash_bind_data( hash, &import_list->u1.Ordinal, sizeof(import_list->u1.Ordinal) );
+        else
+        {
+            const IMAGE_IMPORT_BY_NAME *pe_name = get_rva( module, (DWORD)import_list->u1.AddressOfData );
+            hash = hash_bind_data( hash, pe_name->Name, strlen( (const char *)pe_name->Name ) + 1 );
+        }
+    }
+    return hash;
+}
+
+/*************************************************************************
+ *		get_bind_cache_name
+ *
+ * Build the unix name of the cache file of a module.
+ */
+static char *get_bind_cache_name( const WINE_MODREF *wm, BOOL create_dir )
+{
+    static const char subdir[] = "/bindcache";
+    const char *config_dir = wine_get_config_dir();
+    const UNICODE_STRING *base = &wm->ldr.BaseDllName;
+    ULONGLONG hash;
+    char *name, *p;
+    USHORT i;
+
+    if (!config_dir) return NULL;
+    if (!(name = RtlAllocateHeap( GetProcessHeap(), 0, strlen(config_dir) + sizeof(subdir) +
+                                  base->Length / sizeof(WCHAR) + 18 )))
+        return NULL;
+    strcpy( name, config_dir );
+    strcat( name, subdir );
+    if (create_dir) mkdir( name, 0777 );
+
+    /* the base name for readability, the hash of the full name to tell them apart */
+    p = name + strlen(name);
+    *p++ = '/';
+    for (i = 0; i < base->Length / sizeof(WCHAR); i++)
+    {
+        WCHAR ch = tolowerW( base->Buffer[i] );
+        *p++ = (ch > ' ' && ch < 0x7f && ch != '/') ? ch : '_';
+    }
+    hash = hash_bind_data( BIND_HASH_INIT, wm->ldr.FullDllName.Buffer, wm->ldr.FullDllName.Length );
+    sprintf( p, "-%08x%08x", (DWORD)(hash >> 32), (DWORD)hash );
+    return name;
+}
+
+/*************************************************************************
+ *		load_bind_cache
+ *
+ * Read the cache file of a module before fixing up its imports.
+ */
+static BOOL load_bind_cache( const WINE_MODREF *wm, struct bind_cache *cache, int nb_imports )
+{
+    const struct bind_cache_header *header;
+    struct stat st;
+    char *name;
+    int fd;
+
+    cache->data = NULL;
+    cache->size = 0;
+    cache->changed = FALSE;
+    if (!(cache->entries = RtlAllocateHeap( GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                            nb_imports * sizeof(*cache->entries) )))
+        return FALSE;
+
+    if (!(name = get_bind_cache_name( wm, FALSE ))) return TRUE;
+    fd = open( name, O_RDONLY );
+    RtlFreeHeap( GetProcessHeap(), 0, name );
+    if (fd == -1) return TRUE;
+
+    if (!fstat( fd, &st ) && st.st_size >= sizeof(*header) && st.st_size <= BIND_CACHE_MAX_SIZE &&
+        (cache->data = RtlAllocateHeap( GetProcessHeap(), 0, st.st_size )))
+    {
+        if (read( fd, cache->data, st.st_size ) == st.st_size) cache->size = st.st_size;
+    }
+    close( fd );
+
+    header = (const struct bind_cache_header *)cache->data;
+    if (cache->size && (header->magic != BIND_CACHE_MAGIC || header->version != BIND_CACHE_VERSION))
+        cache->size = 0;
+    return TRUE;
+}
+
+/*************************************************************************
+ *		find_bind_entry
+ *
+ * Find the cache entry of an import descriptor.
+ */
+static const struct bind_entry *find_bind_entry( const struct bind_cache *cache,
+                                                 ULONGLONG import_hash, DWORD nb_thunks )
+{
+    const char *pos = cache->data + sizeof(struct bind_cache_header);
+    const char *end = cache->data + cache->size;
+
+    if (!cache->size) return NULL;
+    while (end - pos >= sizeof(struct bind_entry))
+    {
+        const struct bind_entry *entry = (const struct bind_entry *)pos;
+
+        if (entry->size < sizeof(*entry) || entry->size > end - pos) break;
+        if (entry->import_hash == import_hash && entry->nb_thunks == nb_thunks &&
+            entry->nb_targets && entry->nb_targets <= BIND_MAX_TARGETS &&
+            entry->size == bind_entry_size( entry->nb_targets, nb_thunks ))
+            return entry;
+        pos += entry->size;
+    }
+    return NULL;
+}
+
+/*************************************************************************
+ *		apply_bind_entry
+ *
+ * Fill the import address table from a cache entry, if the modules it
+ * binds to are loaded and have not changed.
+ */
+static BOOL apply_bind_entry( const struct bind_entry *entry, WINE_MODREF *wmImp, IMAGE_THUNK_DATA *thunk_list )
+{
+    const struct bind_target *targets = (const struct bind_target *)(entry + 1);
+    const struct bind_thunk *thunks = (const struct bind_thunk *)(targets + entry->nb_targets);
+    WINE_MODREF *modules[BIND_MAX_TARGETS];
+    DWORD i;
+
+    for (i = 0; i < entry->nb_targets; i++)
+    {
+        if (!i) modules[i] = wmImp;
+        else if (targets[i].name[31] || !(modules[i] = find_basename_module( targets[i].name )))
+            return FALSE;  /* forwarded to a module that isn't loaded yet */
+        if (get_export_hash( modules[i] ) != targets[i].export_hash) return FALSE;
+    }
+    for (i = 0; i < entry->nb_thunks; i++)
+    {
+        if (thunks[i].target >= entry->nb_targets ||
+            thunks[i].rva >= modules[thunks[i].target]->ldr.SizeOfImage)
+            return FALSE;
+    }
+    for (i = 0; i < entry->nb_thunks; i++)
+        thunk_list[i].u1.Function = (ULONG_PTR)((char *)modules[thunks[i].target]->ldr.BaseAddress +
+                                                thunks[i].rva);
+    return TRUE;
+}
+
+/*************************************************************************
+ *		create_bind_entry
+ *
+ * Build the cache entry of an import descriptor that was just resolved.
+ * Returns NULL if some function doesn't live in a module, like stubs.
+ */
+static struct bind_entry *create_bind_entry( ULONGLONG import_hash, WINE_MODREF *wmImp,
+                                             const IMAGE_THUNK_DATA *thunk_list, DWORD nb_thunks )
+{
+    WINE_MODREF *modules[BIND_MAX_TARGETS];
+    struct bind_entry *entry;
+    struct bind_target *targets;
+    struct bind_thunk *thunks;
+    LDR_MODULE *mod;
+    DWORD i, j, nb_targets = 1;
+
+    if (!(entry = RtlAllocateHeap( GetProcessHeap(), 0, bind_entry_size( BIND_MAX_TARGETS, nb_thunks ) )))
+        return NULL;
+    targets = (struct bind_target *)(entry + 1);
+    thunks = (struct bind_thunk *)(targets + BIND_MAX_TARGETS);
+
+    modules[0] = wmImp;
+    for (i = 0; i < nb_thunks; i++)
+    {
+        if (LdrFindEntryForAddress( (const void *)thunk_list[i].u1.Function, &mod )) goto failed;
+        for (j = 0; j < nb_targets; j++) if (&modules[j]->ldr == mod) break;
+        if (j == nb_targets)
+        {
+            if (nb_targets == BIND_MAX_TARGETS) goto failed;
+            modules[nb_targets++] = CONTAINING_RECORD( mod, WINE_MODREF, ldr );
+        }
+        thunks[i].target = j;
+        thunks[i].rva = (const char *)thunk_list[i].u1.Function - (const char *)mod->BaseAddress;
+    }
+    for (j = 0; j < nb_targets; j++)
+    {
+        const UNICODE_STRING *name = &modules[j]->ldr.BaseDllName;
+
+        if (name->Length >= sizeof(targets[j].name)) goto failed;
+        if (!(targets[j].export_hash = get_export_hash( modules[j] ))) goto failed;
+        memset( targets[j].name, 0, sizeof(targets[j].name) );
+        memcpy( targets[j].name, name->Buffer, name->Length );
+    }
+    memmove( targets + nb_targets, thunks, nb_thunks * sizeof(*thunks) );
+
+    entry->size        = bind_entry_size( nb_targets, nb_thunks );
+    entry->nb_targets  = nb_targets;
+    entry->nb_thunks   = nb_thunks;
+    entry->pad         = 0;
+    entry->import_hash = import_hash;
+    return entry;
+
+failed:
+    RtlFreeHeap( GetProcessHeap(), 0, entry );
+    return NULL;
+}
+
+/*************************************************************************
+ *		remove_stale_bind_files
+ *
+ * Remove the temporary files left next to a cache file by processes that
+ * died while saving it.
+ */
+static void remove_stale_bind_files( const char *name )
+{
+    const char *base = strrchr( name, '/' ) + 1;
+    size_t len = strlen( base );
+    struct dirent *de;
+    char *path, *end;
+    DIR *dir;
+    long pid;
+
+    if (!(path = RtlAllocateHeap( GetProcessHeap(), 0, strlen(name) + 16 ))) return;
+    memcpy( path, name, base - name );
+    path[base - name] = 0;
+    if ((dir = opendir( path )))
+    {
+        while ((de = readdir( dir )))
+        {
+            if (strncmp( de->d_name, base, len ) || de->d_name[len] != '.') continue;
+            pid = strtol( de->d_name + len + 1, &end, 16 );
+            if (*end || pid <= 0 || pid == getpid() || strlen( de->d_name + len ) > 9) continue;
+            if (!kill( pid, 0 ) || errno != ESRCH) continue;  /* still saving */
+            strcpy( path + (base - name), de->d_name );
+            unlink( path );
+        }
+        closedir( dir );
+    }
+    RtlFreeHeap( GetProcessHeap(), 0, path );
+}
+
+/*************************************************************************
+ *		save_bind_cache
+ *
+ * Write the entries of all the import descriptors of a module and free the cache.
+ * The file is replaced by a rename so that other processes never see it half written.
+ */
+static void save_bind_cache( const WINE_MODREF *wm, struct bind_cache *cache, int nb_imports )
+{
+    struct bind_cache_header *header;
+    char *buffer = NULL, *pos, *name = NULL, *tmp = NULL;
+    DWORD size = sizeof(*header);
+    int i, fd;
+
+    if (!cache->changed) goto done;
+
+    for (i = 0; i < nb_imports; i++) if (cache->entries[i]) size += cache->entries[i]->size;
+    if (size > BIND_CACHE_MAX_SIZE) goto done;
+    if (!(buffer = RtlAllocateHeap( GetProcessHeap(), 0, size ))) goto done;
+
+    header = (struct bind_cache_header *)buffer;
+    header->magic   = BIND_CACHE_MAGIC;
+    header->version = BIND_CACHE_VERSION;
+    header->count   = 0;
+    header->pad     = 0;
+    pos = (char *)(header + 1);
+    for (i = 0; i < nb_imports; i++)
+    {
+        if (!cache->entries[i]) continue;
+        memcpy( pos, cache->entries[i], cache->entries[i]->size );
+        pos += cache->entries[i]->size;
+        header->count++;
+    }
+
+    if (!(name = get_bind_cache_name( wm, TRUE ))) goto done;
+    if (!(tmp = RtlAllocateHeap( GetProcessHeap(), 0, strlen(name) + 16 ))) goto done;
+    sprintf( tmp, "%s.%x", name, getpid() );
+    if ((fd = open( tmp, O_WRONLY | O_CREAT | O_TRUNC, 0666 )) == -1) goto done;
+    if (write( fd, buffer, size ) == size && !close( fd ))
+    {
+        if (rename( tmp, name ) == -1) unlink( tmp );
+        else remove_stale_bind_files( name );
+    }
+    else
+    {
+        close( fd );
+        unlink( tmp );
+    }
+
+done:
+    for (i = 0; i < nb_imports; i++)
+    {
+        const char *entry = (const char *)cache->entries[i];
+        if (entry && (entry < cache->data || entry >= cache->data + cache->size))
+            RtlFreeHeap( GetProcessHeap(), 0, (void *)entry );
+    }
+    RtlFreeHeap( GetProcessHeap(), 0, cache->entries );
+    RtlFreeHeap( GetProcessHeap(), 0, cache->data );
+    RtlFreeHeap( GetProcessHeap(), 0, buffer );
+    RtlFreeHeap( GetProcessHeap(), 0, name );
+    RtlFreeHeap( GetProcessHeap(), 0, tmp );
+}
+
+
 /*************************************************************************
  *		import_dll
  *
- * Import the dll specified by the given import descriptor.
+ * Import the dll specified by the given import descriptor, binding it from
+ * the cache when there is one.
  * The loader_section must be locked while calling this function.
  */
-static WINE_MODREF *import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *descr, LPCWSTR load_path )
+static WINE_MODREF *import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *descr, LPCWSTR load_path,
+                                struct bind_cache *cache, int index )
 {
     NTSTATUS status;
     WINE_MODREF *wmImp;
@@ -488,15 +1083,18 @@ static WINE_MODREF *import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *d
     const IMAGE_EXPORT_DIRECTORY *exports;
     DWORD exp_size;
     const IMAGE_THUNK_DATA *import_list;
-    IMAGE_THUNK_DATA *thunk_list;
+    IMAGE_THUNK_DATA *thunk_list, *thunk_base;
+    const struct bind_entry *entry = NULL;
+    struct bind_entry *new_entry;
+    ULONGLONG import_hash = 0;
     WCHAR buffer[32];
     const char *name = get_rva( module, descr->Name );
     DWORD len = strlen(name);
     PVOID protect_base;
     SIZE_T protect_size = 0;
-    DWORD protect_old;
+    DWORD protect_old, nb_thunks;
 
-    thunk_list = get_rva( module, (DWORD)descr->FirstThunk );
+    thunk_base = thunk_list = get_rva( module, (DWORD)descr->FirstThunk );
     if (descr->u.OriginalFirstThunk)
         import_list = get_rva( module, (DWORD)descr->u.OriginalFirstThunk );
     else
@@ -534,6 +1132,7 @@ static WINE_MODREF *import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *d
     /* unprotect the import address table since it can be located in
      * readonly section */
     while (import_list[protect_size].u1.Ordinal) protect_size++;
+    nb_thunks = protect_size;
     protect_base = thunk_list;
     protect_size *= sizeof(*thunk_list);
     NtProtectVirtualMemory( NtCurrentProcess(), &protect_base,
@@ -568,6 +1167,18 @@ static WINE_MODREF *import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *d
         goto done;
     }
 
+    if (cache)
+    {
+        import_hash = get_import_hash( module, name, import_list );
+        if ((entry = find_bind_entry( cache, import_hash, nb_thunks )) &&
+            apply_bind_entry( entry, wmImp, thunk_list ))
+        {
+            TRACE_(imports)("--- %u imports from %s bound from the cache\n", nb_thunks, name );
+            cache->entries[index] = entry;
+            goto done;
+        }
+    }
+
     while (import_list->u1.Ordinal)
     {
         if (IMAGE_SNAP_BY_ORDINAL(import_list->u1.Ordinal))
@@ -605,6 +1216,22 @@ static WINE_MODREF *import_dll( HMODULE module, const IMAGE_IMPORT_DESCRIPTOR *d
         thunk_list++;
     }
 
+    if (cache && (new_entry = create_bind_entry( import_hash, wmImp, thunk_base, nb_thunks )))
+    {
+        /* an entry forwarding into a module that is only loaded by the lookups
+         * can't be applied, but it comes out the same, don't rewrite the file */
+        if (entry && entry->size == new_entry->size && !memcmp( entry, new_entry, entry->size ))
+        {
+            RtlFreeHeap( GetProcessHeap(), 0, new_entry );
+            cache->entries[index] = entry;
+        }
+        else
+        {
+            cache->entries[index] = new_entry;
+            cache->changed = TRUE;
+        }
+    }
+
 done:
     /* restore old protection of the import address table */
     NtProtectVirtualMemory( NtCurrentProcess(), &protect_base, &protect_size, protect_old, NULL );
@@ -652,6 +1279,8 @@ static NTSTATUS fixup_imports( WINE_MODREF *wm, LPCWSTR load_path )
     DWORD size;
     NTSTATUS status;
     ULONG_PTR cookie;
+    struct bind_cache cache;
+    BOOL use_cache;
 
     if (!(wm->ldr.Flags & LDR_DONT_RESOLVE_REFS))
 	{
@@ -680,15 +1309,20 @@ static NTSTATUS fixup_imports( WINE_MODREF *wm, LPCWSTR load_path )
     /* load the imported modules. They are automatically
      * added to the modref list of the process.
      */
+    /* relay and snoop hook the exports as they are looked up, so look them all up */
+    use_cache = !TRACE_ON(relay) && !TRACE_ON(snoop) && load_bind_cache( wm, &cache, nb_imports );
+
     prev = current_modref;
     current_modref = wm;
     status = STATUS_SUCCESS;
     for (i = 0; i < nb_imports; i++)
     {
-        if (!(wm->deps[i] = import_dll( wm->ldr.BaseAddress, &imports[i], load_path )))
+        if (!(wm->deps[i] = import_dll( wm->ldr.BaseAddress, &imports[i], load_path,
+                                        use_cache ? &cache : NULL, i )))
             status = STATUS_DLL_NOT_FOUND;
     }
     current_modref = prev;
+    if (use_cache) save_bind_cache( wm, &cache, nb_imports );
     if (wm->ldr.ActivationContext) RtlDeactivateActivationContext( 0, cookie );
     return status;
 }
@@ -711,6 +1345,9 @@ WINE_MODREF *alloc_module( HMODULE hModule, LPCWSTR filename )
 
     wm->nDeps    = 0;
     wm->deps     = NULL;
+    wm->export_hash = 0;
+    wm->export_names = NULL;
+    wm->export_mask = 0;
 
     wm->ldr.BaseAddress   = hModule;
     wm->ldr.EntryPoint    = NULL;
@@ -735,6 +1372,13 @@ WINE_MODREF *alloc_module( HMODULE hModule, LPCWSTR filename )
             wm->ldr.EntryPoint = (char *)hModule + nt->OptionalHeader.AddressOfEntryPoint;
     }
 
+    if (!add_module_index( wm ))
+    {
+        RtlFreeUnicodeString( &wm->ldr.FullDllName );
+        RtlFreeHeap( GetProcessHeap(), 0, wm );
+        return NULL;
+    }
+
     InsertTailList(&NtCurrentTeb()->Peb->LdrData->InLoadOrderModuleList,
                    &wm->ldr.InLoadOrderModuleList);
 
@@ -1172,22 +1816,15 @@ NTSTATUS WINAPI LdrDisableThreadCalloutsForDll(HMODULE hModule)
  */
 NTSTATUS WINAPI LdrFindEntryForAddress(const void* addr, PLDR_MODULE* pmod)
 {
-    PLIST_ENTRY mark, entry;
+    UINT pos = find_module_index( addr );
     PLDR_MODULE mod;
 
-    mark = &NtCurrentTeb()->Peb->LdrData->InMemoryOrderModuleList;
-    for (entry = mark->Flink; entry != mark; entry = entry->Flink)
-    {
-        mod = CONTAINING_RECORD(entry, LDR_MODULE, InMemoryOrderModuleList);
-        if ((const void *)mod->BaseAddress <= addr &&
-            (const char *)addr < (char*)mod->BaseAddress + mod->SizeOfImage)
-        {
-            *pmod = mod;
-            return STATUS_SUCCESS;
-        }
-        if ((const void *)mod->BaseAddress > addr) break;
-    }
-    return STATUS_NO_MORE_ENTRIES;
+    if (!pos) return STATUS_NO_MORE_ENTRIES;
+    mod = &modules_by_base[pos - 1]->ldr;
+    if ((const char *)addr >= (char*)mod->BaseAddress + mod->SizeOfImage)
+        return STATUS_NO_MORE_ENTRIES;
+    *pmod = mod;
+    return STATUS_SUCCESS;
 }
 
 /******************************************************************
@@ -1390,6 +2027,7 @@ static void load_builtin_callback( void *module, const char *filename )
             /* the module has only be inserted in the load & memory order lists */
             RemoveEntryList(&wm->ldr.InLoadOrderModuleList);
             RemoveEntryList(&wm->ldr.InMemoryOrderModuleList);
+            remove_module_index( wm );
             /* FIXME: free the modref */
             builtin_load_info->status = STATUS_DLL_NOT_FOUND;
             return;
@@ -1466,6 +2104,7 @@ static NTSTATUS load_native_dll( LPCWSTR load_path, LPCWSTR name, HANDLE file,
             /* the module has only be inserted in the load & memory order lists */
             RemoveEntryList(&wm->ldr.InLoadOrderModuleList);
             RemoveEntryList(&wm->ldr.InMemoryOrderModuleList);
+            remove_module_index( wm );
 
             /* FIXME: there are several more dangling references
              * left. Including dlls loaded by this dll before the
@@ -2191,6 +2830,7 @@ void WINAPI LdrShutdownThread(void)
 
     RtlLeaveCriticalSection( &loader_section );
     RtlFreeHeap( GetProcessHeap(), 0, NtCurrentTeb()->ThreadLocalStoragePointer );
+    heap_thread_detach();
 }
 
 
@@ -2204,6 +2844,7 @@ static void free_modref( WINE_MODREF *wm )
     RemoveEntryList(&wm->ldr.InMemoryOrderModuleList);
     if (wm->ldr.InInitializationOrderModuleList.Flink)
         RemoveEntryList(&wm->ldr.InInitializationOrderModuleList);
+    remove_module_index( wm );
 
     TRACE(" unloading %s\n", debugstr_w(wm->ldr.FullDllName.Buffer));
     if (!TRACE_ON(module))
@@ -2221,8 +2862,8 @@ static void free_modref( WINE_MODREF *wm )
     RtlReleaseActivationContext( wm->ldr.ActivationContext );
     NtUnmapViewOfSection( NtCurrentProcess(), wm->ldr.BaseAddress );
     if (wm->ldr.Flags & LDR_WINE_INTERNAL) wine_dll_unload( wm->ldr.SectionHandle );
-    if (cached_modref == wm) cached_modref = NULL;
     RtlFreeUnicodeString( &wm->ldr.FullDllName );
+    RtlFreeHeap( GetProcessHeap(), 0, wm->export_names );
     RtlFreeHeap( GetProcessHeap(), 0, wm->deps );
     RtlFreeHeap( GetProcessHeap(), 0, wm );
 }
@@ -2370,47 +3011,19 @@ PIMAGE_NT_HEADERS WINAPI RtlImageNtHeader(HMODULE hModule)
  */
 void *get_dll_handle(char *dll_name)
 {
-    WCHAR module_name[32];
-    PLIST_ENTRY mark, entry;
-    PLDR_MODULE mod;
+    WCHAR module_name[32], *name = module_name;
+    WINE_MODREF *wm;
     int len = strlen(dll_name);
 
-    if (len * sizeof(WCHAR) < sizeof(module_name)) {
-        ascii_to_unicode(module_name, dll_name, len );
-        module_name[len] = 0;
-
-        if (cached_modref && !strcmpiW(module_name, cached_modref->ldr.FullDllName.Buffer))
-            return cached_modref->ldr.SectionHandle;
-
-        mark = &NtCurrentTeb()->Peb->LdrData->InMemoryOrderModuleList;
-        for (entry = mark->Flink; entry != mark; entry = entry->Flink) {
-            mod = CONTAINING_RECORD(entry, LDR_MODULE, InMemoryOrderModuleList);
-            if (!strcmpiW(module_name, mod->FullDllName.Buffer)) {
-                cached_modref = CONTAINING_RECORD(mod, WINE_MODREF, ldr);
-                return mod->SectionHandle;
-            }
-        }
-        return NULL;
-    } else {
-        WCHAR *ptr = RtlAllocateHeap(GetProcessHeap(), 0, (len + 1) * sizeof(WCHAR));
-        if (!ptr) return NULL;
-        ascii_to_unicode(ptr, dll_name, len);
-        ptr[len] = 0;
-
-        if (cached_modref && !strcmpiW(ptr, cached_modref->ldr.FullDllName.Buffer))
-            return cached_modref->ldr.SectionHandle;
-
-        mark = &NtCurrentTeb()->Peb->LdrData->InMemoryOrderModuleList;
-        for (entry = mark->Flink; entry != mark; entry = entry->Flink) {
-            mod = CONTAINING_RECORD(entry, LDR_MODULE, InMemoryOrderModuleList);
-            if (!strcmpiW(ptr, mod->FullDllName.Buffer)) {
-                cached_modref = CONTAINING_RECORD(mod, WINE_MODREF, ldr);
-                return mod->SectionHandle;
-            }
-        }
-        RtlFreeHeap( GetProcessHeap(), 0, ptr );
-        return NULL;
+    if (len * sizeof(WCHAR) >= sizeof(module_name)) {
+        if (!(name = RtlAllocateHeap(GetProcessHeap(), 0, (len + 1) * sizeof(WCHAR)))) return NULL;
     }
+    ascii_to_unicode(name, dll_name, len);
+    name[len] = 0;
+
+    wm = find_fullname_module(name);
+    if (name != module_name) RtlFreeHeap( GetProcessHeap(), 0, name );
+    return wm ? wm->ldr.SectionHandle : NULL;
 }
 
 /*
@@ -2678,9 +3291,10 @@ void __wine_init_windows_dir( const WCHAR *windir, const WCHAR *sysdir )
 
     RtlCreateUnicodeString( &windows_dir, windir );
     RtlCreateUnicodeString( &system_dir, sysdir );
-    strcpyW( user_shared_data->NtSystemRoot, windir );
+    if (user_shared_data_is_private()) strcpyW( user_shared_data->NtSystemRoot, windir );
 
     /* prepend the system dir to the name of the already created modules */
+    RtlEnterCriticalSection( &loader_section );
     mark = &NtCurrentTeb()->Peb->LdrData->InLoadOrderModuleList;
     for (entry = mark->Flink; entry != mark; entry = entry->Flink)
     {
@@ -2699,8 +3313,8 @@ void __wine_init_windows_dir( const WCHAR *windir, const WCHAR *sysdir )
         p = buffer + strlenW( buffer );
         if (p > buffer && p[-1] != '\\') *p++ = '\\';
         strcpyW( p, mod->FullDllName.Buffer );
-        RtlInitUnicodeString( &mod->FullDllName, buffer );
-        RtlInitUnicodeString( &mod->BaseDllName, p );
+        rename_module_index( CONTAINING_RECORD( mod, WINE_MODREF, ldr ), buffer, p );
     }
+    RtlLeaveCriticalSection( &loader_section );
 }
 
@@ -141,6 +141,9 @@ extern NTSTATUS VIRTUAL_HandleFault(LPCVOID addr);
 extern void VIRTUAL_SetForceExec( BOOL enable );
 extern void VIRTUAL_UseLargeAddressSpace(void);
 extern struct _KUSER_SHARED_DATA *user_shared_data;
+extern void init_user_shared_time(void);
+extern BOOL user_shared_data_is_private(void);
+extern void heap_thread_detach(void);
 
 /* code pages */
 extern int ntdll_umbstowcs(DWORD flags, const char* src, int srclen, WCHAR* dst, int dstlen);
@@ -180,8 +183,9 @@ struct ntdll_thread_data
     int                reply_fd;      /* 1e4 fd for receiving server replies */
     int                wait_fd[2];    /* 1e8 fd for sleeping server requests */
     void              *vm86_ptr;      /* 1f0 data for vm86 mode */
+    void              *heap_cache;    /* 1f4 heap front end caches of the thread */
 
-    void              *pad[2];        /* 1f4 change this if you add fields! */
+    void              *pad[1];        /* 1f8 change this if you add fields! */
 };
 
 static inline struct ntdll_thread_data *ntdll_get_thread_data(void)
@@ -222,6 +222,7 @@ NTSTATUS WINAPI NtClose( HANDLE Handle )
             "int $0x2E\n\t"
             :"=a" (ret)
             );
+    server_remove_fd_from_cache( Handle );  /* in case a lookup raced with the close */
 
     LOG(LOG_FILE, 0, ret, "return %x\n", ret);
     return ret;
@@ -23,7 +23,8 @@
  *  but are also available to applications that need this functionality.
  *
  *  Bits are set LSB to MSB in each consecutive byte, making this implementation
- *  binary compatible with Win32.
+ *  binary compatible with Win32. They are handled a ULONG at a time, which
+ *  keeps the same layout on the little-endian machines we run on.
  *
  *  Note that to avoid unexpected behaviour, the size of a bitmap should be set
  *  to a multiple of 32.
@@ -37,14 +38,6 @@
 
 WINE_DEFAULT_DEBUG_CHANNEL(ntdll);
 
-/* Bits set from LSB to MSB; used as mask for runs < 8 bits */
-static const BYTE NTDLL_maskBits[8] = { 0, 1, 3, 7, 15, 31, 63, 127 };
-
-/* Number of set bits for each value of a nibble; used for counting */
-static const BYTE NTDLL_nibbleBitCount[16] = {
-  0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4
-};
-
 /* First set bit in a nibble; used for determining least significant bit */
 static const BYTE NTDLL_leastSignificant[16] = {
   0, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0
@@ -55,6 +48,41 @@ static const signed char NTDLL_mostSignificant[16] = {
   -1, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3
 };
 
+/* Values to xor the bitmap words with so that the bits looked for are 1 */
+#define NTDLL_SET_BITS   0u
+#define NTDLL_CLEAR_BITS ~0u
+
+/* Number of ULONGs holding the bits of a bitmap */
+static inline ULONG NTDLL_BitmapWords(PCRTL_BITMAP lpBits)
+{
+  return (lpBits->SizeOfBitMap >> 5) + ((lpBits->SizeOfBitMap & 31) != 0);
+}
+
+/* Bits set from LSB to MSB; used as mask for runs < 32 bits */
+static inline ULONG NTDLL_LowMask(ULONG ulCount)
+{
+  return ulCount >= 32 ? ~0u : (1u << ulCount) - 1;
+}
+
+/* Position of the lowest set bit of a non-zero ULONG */
+static inline ULONG NTDLL_LowestBit(ULONG ulValue)
+{
+#ifdef __GNUC__
+  return __builtin_ctz(ulValue);  /* a single bsf */
+#else
+  return RtlFindLeastSignificantBit(ulValue);
+#endif
+}
+
+/* Number of set bits in a ULONG */
+static inline ULONG NTDLL_CountBits(ULONG ulValue)
+{
+  ulValue = ulValue - ((ulValue >> 1) & 0x55555555);
+  ulValue = (ulValue & 0x33333333) + ((ulValue >> 2) & 0x33333333);
+  ulValue = (ulValue + (ulValue >> 4)) & 0x0f0f0f0f;
+  return (ulValue * 0x01010101) >> 24;
+}
+
 /*************************************************************************
  * RtlInitializeBitMap	[NTDLL.@]
  *
@@ -128,7 +156,8 @@ VOID WINAPI RtlClearAllBits(PRTL_BITMAP lpBits)
  */
 VOID WINAPI RtlSetBits(PRTL_BITMAP lpBits, ULONG ulStart, ULONG ulCount)
 {
-  LPBYTE lpOut;
+  PULONG lpOut;
+  ULONG ulBit;
 
   TRACE("(%p,%d,%d)\n", lpBits, ulStart, ulCount);
 
@@ -137,40 +166,28 @@ VOID WINAPI RtlSetBits(PRTL_BITMAP lpBits, ULONG ulStart, ULONG ulCount)
       ulCount > lpBits->SizeOfBitMap - ulStart)
     return;
 
-  /* FIXME: It might be more efficient/cleaner to manipulate four bytes
-   * at a time. But beware of the pointer arithmetics...
-   */
-  lpOut = ((BYTE*)lpBits->Buffer) + (ulStart >> 3u);
+  lpOut = lpBits->Buffer + (ulStart >> 5);
+  ulBit = ulStart & 31;
 
-  /* Set bits in first byte, if ulStart isn't a byte boundary */
-  if (ulStart & 7)
+  /* Set bits in first word, if ulStart isn't a word boundary */
+  if (ulBit)
   {
-    if (ulCount > 7)
+    if (ulCount < 32 - ulBit)
     {
-      /* Set from start bit to the end of the byte */
-      *lpOut++ |= 0xff << (ulStart & 7);
-      ulCount -= (8 - (ulStart & 7));
-    }
-    else
-    {
-      /* Set from the start bit, possibly into the next byte also */
-      USHORT initialWord = NTDLL_maskBits[ulCount] << (ulStart & 7);
-
-      *lpOut++ |= (initialWord & 0xff);
-      *lpOut |= (initialWord >> 8);
+      *lpOut |= NTDLL_LowMask(ulCount) << ulBit;
       return;
     }
+    *lpOut++ |= ~0u << ulBit;
+    ulCount -= 32 - ulBit;
   }
 
-  /* Set bits up to complete byte count */
-  if (ulCount >> 3)
-  {
-    memset(lpOut, 0xff, ulCount >> 3);
-    lpOut = lpOut + (ulCount >> 3);
-  }
+  /* Set bits up to complete word count */
+  memset(lpOut, 0xff, (ulCount >> 5) * sizeof(ULONG));
+  lpOut += ulCount >> 5;
 
   /* Set remaining bits, if any */
-  *lpOut |= NTDLL_maskBits[ulCount & 0x7];
+  if (ulCount & 31)
+    *lpOut |= NTDLL_LowMask(ulCount & 31);
 }
 
 /*************************************************************************
@@ -188,7 +205,8 @@ VOID WINAPI RtlSetBits(PRTL_BITMAP lpBits, ULONG ulStart, ULONG ulCount)
  */
 VOID WINAPI RtlClearBits(PRTL_BITMAP lpBits, ULONG ulStart, ULONG ulCount)
 {
-  LPBYTE lpOut;
+  PULONG lpOut;
+  ULONG ulBit;
 
   TRACE("(%p,%d,%d)\n", lpBits, ulStart, ulCount);
 
@@ -197,41 +215,62 @@ VOID WINAPI RtlClearBits(PRTL_BITMAP lpBits, ULONG ulStart, ULONG ulCount)
       ulCount > lpBits->SizeOfBitMap - ulStart)
     return;
 
-  /* FIXME: It might be more efficient/cleaner to manipulate four bytes
-   * at a time. But beware of the pointer arithmetics...
-   */
-  lpOut = ((BYTE*)lpBits->Buffer) + (ulStart >> 3u);
+  lpOut = lpBits->Buffer + (ulStart >> 5);
+  ulBit = ulStart & 31;
 
-  /* Clear bits in first byte, if ulStart isn't a byte boundary */
-  if (ulStart & 7)
+  /* Clear bits in first word, if ulStart isn't a word boundary */
+  if (ulBit)
   {
-    if (ulCount > 7)
+    if (ulCount < 32 - ulBit)
     {
-      /* Clear from start bit to the end of the byte */
-      *lpOut++ &= ~(0xff << (ulStart & 7));
-      ulCount -= (8 - (ulStart & 7));
-    }
-    else
-    {
-      /* Clear from the start bit, possibly into the next byte also */
-      USHORT initialWord = ~(NTDLL_maskBits[ulCount] << (ulStart & 7));
-
-      *lpOut++ &= (initialWord & 0xff);
-      *lpOut &= (initialWord >> 8);
+      *lpOut &= ~(NTDLL_LowMask(ulCount) << ulBit);
       return;
     }
+    *lpOut++ &= ~(~0u << ulBit);
+    ulCount -= 32 - ulBit;
   }
 
-  /* Clear bits (in blocks of 8) on whole byte boundaries */
-  if (ulCount >> 3)
+  /* Clear bits (in blocks of 32) on whole word boundaries */
+  memset(lpOut, 0, (ulCount >> 5) * sizeof(ULONG));
+  lpOut += ulCount >> 5;
+
+  /* Clear remaining bits, if any */
+  if (ulCount & 31)
+    *lpOut &= ~NTDLL_LowMask(ulCount & 31);
+}
+
+/*************************************************************************
+ * NTDLL_AreBits
+ *
+ * Internal helper: Check that ulCount bits from ulStart are all set
+ * (NTDLL_SET_BITS) or all clear (NTDLL_CLEAR_BITS).
+ */
+static BOOLEAN NTDLL_AreBits(PCRTL_BITMAP lpBits, ULONG ulStart, ULONG ulCount, ULONG ulFlip)
+{
+  const ULONG *lpIn = lpBits->Buffer + (ulStart >> 5);
+  ULONG ulBit = ulStart & 31;
+
+  /* Check bits in first word, if ulStart isn't a word boundary */
+  if (ulBit)
   {
-    memset(lpOut, 0, ulCount >> 3);
-    lpOut = lpOut + (ulCount >> 3);
+    if (ulCount < 32 - ulBit)
+      return !(~(*lpIn ^ ulFlip) & (NTDLL_LowMask(ulCount) << ulBit));
+    if (~(*lpIn++ ^ ulFlip) & (~0u << ulBit))
+      return FALSE;
+    ulCount -= 32 - ulBit;
   }
 
-  /* Clear remaining bits, if any */
-  if (ulCount & 0x7)
-    *lpOut &= ~NTDLL_maskBits[ulCount & 0x7];
+  /* Check bits in blocks of 32 */
+  for (; ulCount >= 32; ulCount -= 32)
+  {
+    if (*lpIn++ != ~ulFlip)
+      return FALSE;
+  }
+
+  /* Check remaining bits, if any */
+  if (ulCount && (~(*lpIn ^ ulFlip) & NTDLL_LowMask(ulCount)))
+    return FALSE;
+  return TRUE;
 }
 
 /*************************************************************************
@@ -250,9 +289,6 @@ VOID WINAPI RtlClearBits(PRTL_BITMAP lpBits, ULONG ulStart, ULONG ulCount)
  */
 BOOLEAN WINAPI RtlAreBitsSet(PCRTL_BITMAP lpBits, ULONG ulStart, ULONG ulCount)
 {
-  LPBYTE lpOut;
-  ULONG ulRemainder;
-
   TRACE("(%p,%d,%d)\n", lpBits, ulStart, ulCount);
 
   if (!lpBits || !ulCount ||
@@ -260,51 +296,7 @@ BOOLEAN WINAPI RtlAreBitsSet(PCRTL_BITMAP lpBits, ULONG ulStart, ULONG ulCount)
       ulCount > lpBits->SizeOfBitMap - ulStart)
     return FALSE;
 
-  /* FIXME: It might be more efficient/cleaner to manipulate four bytes
-   * at a time. But beware of the pointer arithmetics...
-   */
-  lpOut = ((BYTE*)lpBits->Buffer) + (ulStart >> 3u);
-
-  /* Check bits in first byte, if ulStart isn't a byte boundary */
-  if (ulStart & 7)
-  {
-    if (ulCount > 7)
-    {
-      /* Check from start bit to the end of the byte */
-      if ((*lpOut &
-          ((0xff << (ulStart & 7))) & 0xff) != ((0xff << (ulStart & 7) & 0xff)))
-        return FALSE;
-      lpOut++;
-      ulCount -= (8 - (ulStart & 7));
-    }
-    else
-    {
-      /* Check from the start bit, possibly into the next byte also */
-      USHORT initialWord = NTDLL_maskBits[ulCount] << (ulStart & 7);
-
-      if ((*lpOut & (initialWord & 0xff)) != (initialWord & 0xff))
-        return FALSE;
-      if ((initialWord & 0xff00) &&
-          ((lpOut[1] & (initialWord >> 8)) != (initialWord >> 8)))
-        return FALSE;
-      return TRUE;
-    }
-  }
-
-  /* Check bits in blocks of 8 bytes */
-  ulRemainder = ulCount & 7;
-  ulCount >>= 3;
-  while (ulCount--)
-  {
-    if (*lpOut++ != 0xff)
-      return FALSE;
-  }
-
-  /* Check remaining bits, if any */
-  if (ulRemainder &&
-      (*lpOut & NTDLL_maskBits[ulRemainder]) != NTDLL_maskBits[ulRemainder])
-    return FALSE;
-  return TRUE;
+  return NTDLL_AreBits(lpBits, ulStart, ulCount, NTDLL_SET_BITS);
 }
 
 /*************************************************************************
@@ -323,9 +315,6 @@ BOOLEAN WINAPI RtlAreBitsSet(PCRTL_BITMAP lpBits, ULONG ulStart, ULONG ulCount)
  */
 BOOLEAN WINAPI RtlAreBitsClear(PCRTL_BITMAP lpBits, ULONG ulStart, ULONG ulCount)
 {
-  LPBYTE lpOut;
-  ULONG ulRemainder;
-
   TRACE("(%p,%d,%d)\n", lpBits, ulStart, ulCount);
 
   if (!lpBits || !ulCount ||
@@ -333,48 +322,67 @@ BOOLEAN WINAPI RtlAreBitsClear(PCRTL_BITMAP lpBits, ULONG ulStart, ULONG ulCount
       ulCount > lpBits->SizeOfBitMap - ulStart)
     return FALSE;
 
-  /* FIXME: It might be more efficient/cleaner to manipulate four bytes
-   * at a time. But beware of the pointer arithmetics...
-   */
-  lpOut = ((BYTE*)lpBits->Buffer) + (ulStart >> 3u);
+  return NTDLL_AreBits(lpBits, ulStart, ulCount, NTDLL_CLEAR_BITS);
+}
+
+/*************************************************************************
+ * NTDLL_FindRun
+ *
+ * Internal helper: Find the next run of set (NTDLL_SET_BITS) or clear
+ * (NTDLL_CLEAR_BITS) bits from ulStart, skipping whole words at a time.
+ */
+static ULONG NTDLL_FindRun(PCRTL_BITMAP lpBits, ULONG ulStart, PULONG lpSize, ULONG ulFlip)
+{
+  const ULONG *lpIn = lpBits->Buffer;
+  ULONG ulWords = NTDLL_BitmapWords(lpBits), ulIndex = ulStart >> 5;
+  ULONG ulWord, ulFoundAt, ulEnd;
 
-  /* Check bits in first byte, if ulStart isn't a byte boundary */
-  if (ulStart & 7)
+  /* Find the first bit of the run */
+  ulWord = (lpIn[ulIndex] ^ ulFlip) & (~0u << (ulStart & 31));
+  while (!ulWord)
   {
-    if (ulCount > 7)
-    {
-      /* Check from start bit to the end of the byte */
-      if (*lpOut & ((0xff << (ulStart & 7)) & 0xff))
-        return FALSE;
-      lpOut++;
-      ulCount -= (8 - (ulStart & 7));
-    }
-    else
-    {
-      /* Check from the start bit, possibly into the next byte also */
-      USHORT initialWord = NTDLL_maskBits[ulCount] << (ulStart & 7);
-
-      if (*lpOut & (initialWord & 0xff))
-        return FALSE;
-      if ((initialWord & 0xff00) && (lpOut[1] & (initialWord >> 8)))
-        return FALSE;
-      return TRUE;
-    }
+    if (++ulIndex >= ulWords)
+      return ~0U;
+    ulWord = lpIn[ulIndex] ^ ulFlip;
   }
+  ulFoundAt = (ulIndex << 5) + NTDLL_LowestBit(ulWord);
+  if (ulFoundAt >= lpBits->SizeOfBitMap)
+    return ~0U;
+
+  /* Find the first bit after it, the run may go on to the end */
+  ulWord = ~(lpIn[ulIndex] ^ ulFlip) & (~0u << (ulFoundAt & 31));
+  while (!ulWord && ++ulIndex < ulWords)
+    ulWord = ~(lpIn[ulIndex] ^ ulFlip);
+  ulEnd = lpBits->SizeOfBitMap;
+  if (ulWord && (ulIndex << 5) + NTDLL_LowestBit(ulWord) < ulEnd)
+    ulEnd = (ulIndex << 5) + NTDLL_LowestBit(ulWord);
+
+  *lpSize = ulEnd - ulFoundAt;
+  return ulFoundAt;
+}
+
+/*************************************************************************
+ * NTDLL_FindBits
+ *
+ * Internal helper: Find ulCount consecutive set or clear bits starting
+ * between ulStart and ulEnd. Only runs of the bits are looked at, as no
+ * position inside a shorter run can match.
+ */
+static ULONG NTDLL_FindBits(PCRTL_BITMAP lpBits, ULONG ulCount, ULONG ulStart, ULONG ulEnd,
+                            ULONG ulFlip)
+{
+  ULONG ulPos, ulSize;
 
-  /* Check bits in blocks of 8 bytes */
-  ulRemainder = ulCount & 7;
-  ulCount >>= 3;
-  while (ulCount--)
+  while (ulStart < ulEnd)
   {
-    if (*lpOut++)
-      return FALSE;
+    ulPos = NTDLL_FindRun(lpBits, ulStart, &ulSize, ulFlip);
+    if (ulPos == ~0U || ulPos >= ulEnd)
+      break;
+    if (ulSize >= ulCount)
+      return ulPos;
+    ulStart = ulPos + ulSize;
   }
-
-  /* Check remaining bits, if any */
-  if (ulRemainder && *lpOut & NTDLL_maskBits[ulRemainder])
-    return FALSE;
-  return TRUE;
+  return ~0U;
 }
 
 /*************************************************************************
@@ -392,36 +400,22 @@ BOOLEAN WINAPI RtlAreBitsClear(PCRTL_BITMAP lpBits, ULONG ulStart, ULONG ulCount
  */
 ULONG WINAPI RtlFindSetBits(PCRTL_BITMAP lpBits, ULONG ulCount, ULONG ulHint)
 {
-  ULONG ulPos, ulEnd;
+  ULONG ulPos;
 
   TRACE("(%p,%d,%d)\n", lpBits, ulCount, ulHint);
 
   if (!lpBits || !ulCount || ulCount > lpBits->SizeOfBitMap)
     return ~0U;
 
-  ulEnd = lpBits->SizeOfBitMap;
-
   if (ulHint + ulCount > lpBits->SizeOfBitMap)
     ulHint = 0;
 
-  ulPos = ulHint;
+  ulPos = NTDLL_FindBits(lpBits, ulCount, ulHint, lpBits->SizeOfBitMap, NTDLL_SET_BITS);
 
-  while (ulPos < ulEnd)
-  {
-    /* FIXME: This could be made a _lot_ more efficient */
-    if (RtlAreBitsSet(lpBits, ulPos, ulCount))
-      return ulPos;
-
-    /* Start from the beginning if we hit the end and had a hint */
-    if (ulPos == ulEnd - 1 && ulHint)
-    {
-      ulEnd = ulHint;
-      ulPos = ulHint = 0;
-    }
-    else
-      ulPos++;
-  }
-  return ~0U;
+  /* Start from the beginning if we hit the end and had a hint */
+  if (ulPos == ~0U && ulHint)
+    ulPos = NTDLL_FindBits(lpBits, ulCount, 0, ulHint, NTDLL_SET_BITS);
+  return ulPos;
 }
 
 /*************************************************************************
@@ -439,36 +433,22 @@ ULONG WINAPI RtlFindSetBits(PCRTL_BITMAP lpBits, ULONG ulCount, ULONG ulHint)
  */
 ULONG WINAPI RtlFindClearBits(PCRTL_BITMAP lpBits, ULONG ulCount, ULONG ulHint)
 {
-  ULONG ulPos, ulEnd;
+  ULONG ulPos;
 
   TRACE("(%p,%d,%d)\n", lpBits, ulCount, ulHint);
 
   if (!lpBits || !ulCount || ulCount > lpBits->SizeOfBitMap)
     return ~0U;
 
-  ulEnd = lpBits->SizeOfBitMap;
-
   if (ulHint + ulCount > lpBits->SizeOfBitMap)
     ulHint = 0;
 
-  ulPos = ulHint;
-
-  while (ulPos < ulEnd)
-  {
-    /* FIXME: This could be made a _lot_ more efficient */
-    if (RtlAreBitsClear(lpBits, ulPos, ulCount))
-      return ulPos;
+  ulPos = NTDLL_FindBits(lpBits, ulCount, ulHint, lpBits->SizeOfBitMap, NTDLL_CLEAR_BITS);
 
-    /* Start from the beginning if we hit the end and started from ulHint */
-    if (ulPos == ulEnd - 1 && ulHint)
-    {
-      ulEnd = ulHint;
-      ulPos = ulHint = 0;
-    }
-    else
-      ulPos++;
-  }
-  return ~0U;
+  /* Start from the beginning if we hit the end and started from ulHint */
+  if (ulPos == ~0U && ulHint)
+    ulPos = NTDLL_FindBits(lpBits, ulCount, 0, ulHint, NTDLL_CLEAR_BITS);
+  return ulPos;
 }
 
 /*************************************************************************
@@ -540,23 +520,17 @@ ULONG WINAPI RtlNumberOfSetBits(PCRTL_BITMAP lpBits)
 
   if (lpBits)
   {
-    LPBYTE lpOut = (BYTE *)lpBits->Buffer;
+    const ULONG *lpIn = lpBits->Buffer;
     ULONG ulCount, ulRemainder;
-    BYTE bMasked;
 
-    ulCount = lpBits->SizeOfBitMap >> 3;
-    ulRemainder = lpBits->SizeOfBitMap & 0x7;
+    ulCount = lpBits->SizeOfBitMap >> 5;
+    ulRemainder = lpBits->SizeOfBitMap & 31;
 
     while (ulCount--)
-    {
-      ulSet += NTDLL_nibbleBitCount[*lpOut >> 4];
-      ulSet += NTDLL_nibbleBitCount[*lpOut & 0xf];
-      lpOut++;
-    }
+      ulSet += NTDLL_CountBits(*lpIn++);
 
-    bMasked = *lpOut & NTDLL_maskBits[ulRemainder];
-    ulSet += NTDLL_nibbleBitCount[bMasked >> 4];
-    ulSet += NTDLL_nibbleBitCount[bMasked & 0xf];
+    if (ulRemainder)
+      ulSet += NTDLL_CountBits(*lpIn & NTDLL_LowMask(ulRemainder));
   }
   return ulSet;
 }
@@ -672,179 +646,17 @@ static int NTDLL_RunSortFn(const void *lhs, const void *rhs)
  */
 static ULONG NTDLL_FindSetRun(PCRTL_BITMAP lpBits, ULONG ulStart, PULONG lpSize)
 {
-  LPBYTE lpOut;
-  ULONG ulFoundAt = 0, ulCount = 0;
-
-  /* FIXME: It might be more efficient/cleaner to manipulate four bytes
-   * at a time. But beware of the pointer arithmetics...
-   */
-  lpOut = ((BYTE*)lpBits->Buffer) + (ulStart >> 3u);
-
-  while (1)
-  {
-    /* Check bits in first byte */
-    const BYTE bMask = (0xff << (ulStart & 7)) & 0xff;
-    const BYTE bFirst = *lpOut & bMask;
-
-    if (bFirst)
-    {
-      /* Have a set bit in first byte */
-      if (bFirst != bMask)
-      {
-        /* Not every bit is set */
-        ULONG ulOffset;
-
-        if (bFirst & 0x0f)
-          ulOffset = NTDLL_leastSignificant[bFirst & 0x0f];
-        else
-          ulOffset = 4 + NTDLL_leastSignificant[bFirst >> 4];
-        ulStart += ulOffset;
-        ulFoundAt = ulStart;
-        for (;ulOffset < 8; ulOffset++)
-        {
-          if (!(bFirst & (1 << ulOffset)))
-          {
-            *lpSize = ulCount;
-            return ulFoundAt; /* Set from start, but not until the end */
-          }
-          ulCount++;
-          ulStart++;
-        }
-        /* Set to the end - go on to count further bits */
-        lpOut++;
-        break;
-      }
-      /* every bit from start until the end of the byte is set */
-      ulFoundAt = ulStart;
-      ulCount = 8 - (ulStart & 7);
-      ulStart = (ulStart & ~7u) + 8;
-      lpOut++;
-      break;
-    }
-    ulStart = (ulStart & ~7u) + 8;
-    lpOut++;
-    if (ulStart >= lpBits->SizeOfBitMap)
-      return ~0U;
-  }
-
-  /* Count blocks of 8 set bits */
-  while (*lpOut == 0xff)
-  {
-    ulCount += 8;
-    ulStart += 8;
-    if (ulStart >= lpBits->SizeOfBitMap)
-    {
-      *lpSize = ulCount - (ulStart - lpBits->SizeOfBitMap);
-      return ulFoundAt;
-    }
-    lpOut++;
-  }
-
-  /* Count remaining contiguous bits, if any */
-  if (*lpOut & 1)
-  {
-    ULONG ulOffset = 0;
-
-    for (;ulOffset < 7u; ulOffset++)
-    {
-      if (!(*lpOut & (1 << ulOffset)))
-        break;
-      ulCount++;
-    }
-  }
-  *lpSize = ulCount;
-  return ulFoundAt;
+  return NTDLL_FindRun(lpBits, ulStart, lpSize, NTDLL_SET_BITS);
 }
 
 /*************************************************************************
  * NTDLL_FindClearRun
  *
- * Internal helper: Find the next run of set bits in a bitmap.
+ * Internal helper: Find the next run of clear bits in a bitmap.
  */
 static ULONG NTDLL_FindClearRun(PCRTL_BITMAP lpBits, ULONG ulStart, PULONG lpSize)
 {
-  LPBYTE lpOut;
-  ULONG ulFoundAt = 0, ulCount = 0;
-
-  /* FIXME: It might be more efficient/cleaner to manipulate four bytes
-   * at a time. But beware of the pointer arithmetics...
-   */
-  lpOut = ((BYTE*)lpBits->Buffer) + (ulStart >> 3u);
-
-  while (1)
-  {
-    /* Check bits in first byte */
-    const BYTE bMask = (0xff << (ulStart & 7)) & 0xff;
-    const BYTE bFirst = (~*lpOut) & bMask;
-
-    if (bFirst)
-    {
-      /* Have a clear bit in first byte */
-      if (bFirst != bMask)
-      {
-        /* Not every bit is clear */
-        ULONG ulOffset;
-
-        if (bFirst & 0x0f)
-          ulOffset = NTDLL_leastSignificant[bFirst & 0x0f];
-        else
-          ulOffset = 4 + NTDLL_leastSignificant[bFirst >> 4];
-        ulStart += ulOffset;
-        ulFoundAt = ulStart;
-        for (;ulOffset < 8; ulOffset++)
-        {
-          if (!(bFirst & (1 << ulOffset)))
-          {
-            *lpSize = ulCount;
-            return ulFoundAt; /* Clear from start, but not until the end */
-          }
-          ulCount++;
-          ulStart++;
-        }
-        /* Clear to the end - go on to count further bits */
-        lpOut++;
-        break;
-      }
-      /* Every bit from start until the end of the byte is clear */
-      ulFoundAt = ulStart;
-      ulCount = 8 - (ulStart & 7);
-      ulStart = (ulStart & ~7u) + 8;
-      lpOut++;
-      break;
-    }
-    ulStart = (ulStart & ~7u) + 8;
-    lpOut++;
-    if (ulStart >= lpBits->SizeOfBitMap)
-      return ~0U;
-  }
-
-  /* Count blocks of 8 clear bits */
-  while (!*lpOut)
-  {
-    ulCount += 8;
-    ulStart += 8;
-    if (ulStart >= lpBits->SizeOfBitMap)
-    {
-      *lpSize = ulCount - (ulStart - lpBits->SizeOfBitMap);
-      return ulFoundAt;
-    }
-    lpOut++;
-  }
-
-  /* Count remaining contiguous bits, if any */
-  if (!(*lpOut & 1))
-  {
-    ULONG ulOffset = 0;
-
-    for (;ulOffset < 7u; ulOffset++)
-    {
-      if (*lpOut & (1 << ulOffset))
-        break;
-      ulCount++;
-    }
-  }
-  *lpSize = ulCount;
-  return ulFoundAt;
+  return NTDLL_FindRun(lpBits, ulStart, lpSize, NTDLL_CLEAR_BITS);
 }
 
 /*************************************************************************
@@ -94,15 +94,6 @@ extern struct wine_pthread_functions pthread_functions;
 sigset_t server_block_set;  /* signals to block during server calls */
 static int fd_socket = -1;  /* socket to exchange file descriptors with the server */
 
-static RTL_CRITICAL_SECTION fd_cache_section;
-static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
-{
-    0, 0, &fd_cache_section,
-    { &critsect_debug.ProcessLocksList, &critsect_debug.ProcessLocksList },
-      0, 0, { (DWORD_PTR)(__FILE__ ": fd_cache_section") }
-};
-static RTL_CRITICAL_SECTION fd_cache_section = { &critsect_debug, -1, 0, 0, 0, 0 };
-
 
 #ifdef __GNUC__
 static void fatal_error( const char *err, ... ) __attribute__((noreturn, format(printf,1,2)));
@@ -366,19 +357,32 @@ void wine_server_send_fd( int fd )
 /***********************************************************************/
 /* fd cache support */
 
-struct fd_cache_entry
-{
-    int fd;
-    enum server_fd_type type : 6;
-    unsigned int        access : 2;
-    unsigned int        options : 24;
-};
+/* An entry is a single 64-bit word, so that it can be updated atomically and
+ * read without taking any lock.  The fd belongs to the handle in the kernel,
+ * we never close it ourselves.  The generation is bumped on every removal, so
+ * that a lookup racing with a close can't store the fd of a dead handle.
+ *
+ *  bits  0-23: unix fd + 1, 0 if unset
+ *  bits 24-31: generation
+ *  bits 32-37: fd type
+ *  bits 38-39: access
+ *  bits 40-63: options
+ */
+typedef __int64 fd_cache_entry_t;
+
+#define FD_CACHE_FD_MASK      0x00ffffff
+#define FD_CACHE_GEN_SHIFT    24
+#define FD_CACHE_GEN_MASK     0xff000000
+#define FD_CACHE_TYPE_SHIFT   32
+#define FD_CACHE_ACCESS_SHIFT 38
+#define FD_CACHE_OPTIONS_SHIFT 40
 
-#define FD_CACHE_BLOCK_SIZE  (65536 / sizeof(struct fd_cache_entry))
-#define FD_CACHE_ENTRIES     256
+#define FD_CACHE_BLOCK_SIZE  (65536 / sizeof(fd_cache_entry_t))
+#define FD_CACHE_MAX_HANDLES (1 << 27)  /* EX_MAX_HANDLES of the kernel */
+#define FD_CACHE_ENTRIES     (FD_CACHE_MAX_HANDLES / FD_CACHE_BLOCK_SIZE)
 
-static struct fd_cache_entry *fd_cache[FD_CACHE_ENTRIES];
-static struct fd_cache_entry fd_cache_initial_block[FD_CACHE_BLOCK_SIZE];
+static fd_cache_entry_t *fd_cache[FD_CACHE_ENTRIES];
+static fd_cache_entry_t fd_cache_initial_block[FD_CACHE_BLOCK_SIZE];
 
 static inline unsigned int handle_to_index( obj_handle_t handle, unsigned int *entry )
 {
@@ -386,67 +390,92 @@ static inline unsigned int handle_to_index( obj_handle_t handle, unsigned int *e
 
     idx = ((unsigned long)handle >> 2) - 1;
     *entry = idx / FD_CACHE_BLOCK_SIZE;
-    if (*entry > FD_CACHE_ENTRIES / 2)
-        *entry = FD_CACHE_ENTRIES;
     return idx % FD_CACHE_BLOCK_SIZE;
 }
 
+static inline unsigned int fd_cache_low( const fd_cache_entry_t *ptr )
+{
+    return ((volatile const unsigned int *)ptr)[0];
+}
 
-/***********************************************************************
- *           add_fd_to_cache
- *
- * Caller must hold fd_cache_section.
- */
-static int add_fd_to_cache( obj_handle_t handle, int fd, enum server_fd_type type,
-                            unsigned int access, unsigned int options )
+static inline unsigned int fd_cache_high( const fd_cache_entry_t *ptr )
 {
-    unsigned int entry, idx = handle_to_index( handle, &entry );
-    int prev_fd;
+    return ((volatile const unsigned int *)ptr)[1];
+}
+
+/* read an entry without locking; every update changes the low word, so
+ * finding it unchanged around the read of the high word means the two
+ * halves belong together */
+static inline fd_cache_entry_t read_fd_cache_entry( const fd_cache_entry_t *ptr )
+{
+    unsigned int low, high;
 
-    if (entry >= FD_CACHE_ENTRIES)
+    for (;;)
     {
-        FIXME( "too many allocated handles, not caching %p\n", handle );
-        return 0;
+        low = fd_cache_low( ptr );
+        __asm__ __volatile__( "" : : : "memory" );
+        high = fd_cache_high( ptr );
+        __asm__ __volatile__( "" : : : "memory" );
+        if (fd_cache_low( ptr ) == low) break;
     }
+    return ((fd_cache_entry_t)high << 32) | low;
+}
+
+/* get the block holding a handle, allocating it if needed */
+static fd_cache_entry_t *get_fd_cache_block( unsigned int entry )
+{
+    void *ptr;
+
+    if (entry >= FD_CACHE_ENTRIES) return NULL;
+    if (fd_cache[entry]) return fd_cache[entry];
 
-    if (!fd_cache[entry])  /* do we need to allocate a new block of entries? */
+    if (!entry) ptr = fd_cache_initial_block;
+    else
     {
-        if (!entry) fd_cache[0] = fd_cache_initial_block;
-        else
-        {
-            void *ptr = wine_anon_mmap( NULL, FD_CACHE_BLOCK_SIZE * sizeof(struct fd_cache_entry),
-                                        PROT_READ | PROT_WRITE, 0 );
-            if (ptr == MAP_FAILED) return 0;
-            fd_cache[entry] = ptr;
-        }
+        ptr = wine_anon_mmap( NULL, FD_CACHE_BLOCK_SIZE * sizeof(fd_cache_entry_t),
+                              PROT_READ | PROT_WRITE, 0 );
+        if (ptr == MAP_FAILED) return NULL;
     }
-    /* store fd+1 so that 0 can be used as the unset value */
-    prev_fd = interlocked_xchg( &fd_cache[entry][idx].fd, fd + 1 ) - 1;
-    fd_cache[entry][idx].type = type;
-    fd_cache[entry][idx].access = access;
-    fd_cache[entry][idx].options = options;
-    if (prev_fd != -1) close( prev_fd );
-    return 1;
+    if (interlocked_cmpxchg_ptr( (void **)&fd_cache[entry], ptr, NULL ) && entry)
+        munmap( ptr, FD_CACHE_BLOCK_SIZE * sizeof(fd_cache_entry_t) );  /* another thread won */
+    return fd_cache[entry];
 }
 
 
 /***********************************************************************
- *           get_cached_fd
+ *           add_fd_to_cache
  *
- * Caller must hold fd_cache_section.
+ * Store the fd of a handle in the slot read as prev before asking for it.
+ * Fails if the slot changed meanwhile, i.e. the handle was closed.
+ */
+static int add_fd_to_cache( fd_cache_entry_t *slot, fd_cache_entry_t prev, int fd,
+                            enum server_fd_type type, unsigned int access, unsigned int options )
+{
+    fd_cache_entry_t value;
+
+    if (!slot || fd + 1 > FD_CACHE_FD_MASK) return 0;
+
+    value = (fd + 1) | (prev & FD_CACHE_GEN_MASK) |
+            ((fd_cache_entry_t)type << FD_CACHE_TYPE_SHIFT) |
+            ((fd_cache_entry_t)(access & 3) << FD_CACHE_ACCESS_SHIFT) |
+            ((fd_cache_entry_t)(options & 0xffffff) << FD_CACHE_OPTIONS_SHIFT);
+    return interlocked_cmpxchg64( slot, value, prev ) == prev;
+}
+
+
+/***********************************************************************
+ *           get_cached_fd
  */
-static inline int get_cached_fd( obj_handle_t handle, enum server_fd_type *type,
+static inline int get_cached_fd( fd_cache_entry_t value, enum server_fd_type *type,
                                  unsigned int *access, unsigned int *options )
 {
-    unsigned int entry, idx = handle_to_index( handle, &entry );
-    int fd = -1;
+    int fd = (int)(value & FD_CACHE_FD_MASK) - 1;
 
-    if (entry < FD_CACHE_ENTRIES && fd_cache[entry])
+    if (fd != -1)
     {
-        fd = fd_cache[entry][idx].fd - 1;
-        if (type) *type = fd_cache[entry][idx].type;
-        if (access) *access = fd_cache[entry][idx].access;
-        if (options) *options = fd_cache[entry][idx].options;
+        if (type) *type = (value >> FD_CACHE_TYPE_SHIFT) & 0x3f;
+        if (access) *access = (value >> FD_CACHE_ACCESS_SHIFT) & 3;
+        if (options) *options = (value >> FD_CACHE_OPTIONS_SHIFT) & 0xffffff;
     }
     return fd;
 }
@@ -454,16 +483,25 @@ static inline int get_cached_fd( obj_handle_t handle, enum server_fd_type *type,
 
 /***********************************************************************
  *           server_remove_fd_from_cache
+ *
+ * Clear the entry of a handle and bump its generation.  Done both before and
+ * after the handle is closed, so that a lookup in progress can't cache it.
+ * The returned fd is still owned by the kernel and must not be closed.
  */
 int server_remove_fd_from_cache( obj_handle_t handle )
 {
     unsigned int entry, idx = handle_to_index( handle, &entry );
-    int fd = -1;
+    fd_cache_entry_t *slot, prev, value;
 
-    if (entry < FD_CACHE_ENTRIES && fd_cache[entry])
-        fd = interlocked_xchg( &fd_cache[entry][idx].fd, 0 ) - 1;
+    if (entry >= FD_CACHE_ENTRIES || !(slot = fd_cache[entry])) return -1;
 
-    return fd;
+    do
+    {
+        prev = read_fd_cache_entry( &slot[idx] );
+        value = (prev + (1 << FD_CACHE_GEN_SHIFT)) & FD_CACHE_GEN_MASK;
+    } while (interlocked_cmpxchg64( &slot[idx], value, prev ) != prev);
+
+    return (int)(prev & FD_CACHE_FD_MASK) - 1;
 }
 
 
@@ -475,7 +513,8 @@ int server_remove_fd_from_cache( obj_handle_t handle )
 int server_get_unix_fd( obj_handle_t handle, unsigned int wanted_access, int *unix_fd,
                         int *needs_close, enum server_fd_type *type, unsigned int *options )
 {
-    sigset_t sigset;
+    unsigned int entry, idx = handle_to_index( handle, &entry );
+    fd_cache_entry_t *slot, prev = 0;
     int ret = 0, fd;
     unsigned int access = 0;
 
@@ -483,10 +522,13 @@ int server_get_unix_fd( obj_handle_t handle, unsigned int wanted_access, int *un
     *needs_close = 0;
     wanted_access &= FILE_READ_DATA | FILE_WRITE_DATA;
 
-    server_enter_uninterrupted_section( &fd_cache_section, &sigset );
-
-    fd = get_cached_fd( handle, type, &access, options );
-    if (fd != -1) goto done;
+    if ((slot = get_fd_cache_block( entry ))) slot += idx;
+    if (slot)
+    {
+        prev = read_fd_cache_entry( slot );
+        fd = get_cached_fd( prev, type, &access, options );
+        if (fd != -1) goto done;
+    }
 
     SERVER_START_REQ( get_handle_fd )
     {
@@ -500,22 +542,15 @@ int server_get_unix_fd( obj_handle_t handle, unsigned int wanted_access, int *un
             access = reply->access;
             fd = reply->fd;
 
-            if (fd != -1)
-            {
-                *needs_close = FALSE;
-                add_fd_to_cache( handle, fd, reply->type, reply->access, reply->options);
-            }
+            /* the fd stays owned by the handle even if it can't be cached */
+            if (fd != -1) add_fd_to_cache( slot, prev, fd, reply->type, reply->access, reply->options );
             else ret = STATUS_TOO_MANY_OPENED_FILES;
         }
     }
     SERVER_END_REQ;
 done:
-    server_leave_uninterrupted_section( &fd_cache_section, &sigset );
     if (!ret && ((access & wanted_access) != wanted_access))
-    {
         ret = STATUS_ACCESS_DENIED;
-        if (*needs_close) close( fd );
-    }
     if (!ret) *unix_fd = fd;
     return ret;
 }
@@ -753,7 +788,7 @@ size_t server_init_thread( int unix_pid, int unix_tid, void *entry_point )
     return info_size;
 }
 
-const char* wine_service[REQ_NB_REQUESTS+2] =
+const char* wine_service[REQ_NB_REQUESTS] =
 {
     "new_process",
     "get_new_process_info",
@@ -990,7 +1025,15 @@ const char* wine_service[REQ_NB_REQUESTS+2] =
     "add_fd_completion",
 
     "req_load_init_registry",
-    "req_save_branch"
+    "req_save_branch",
+    "map_user_shared",
+    "read_directory",
+    "register_sock_io",
+    "map_screen_buffer",
+    "notify_screen_buffer",
+    "next_processes",
+    "next_threads",
+    "map_user_shared_data"
 };
 
 
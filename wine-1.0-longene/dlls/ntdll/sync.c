@@ -204,6 +204,90 @@ NTSTATUS WINAPI NtReleaseSemaphore( HANDLE handle, ULONG count, PULONG previous
     return ret;
 }
 
+/*
+ *	Keyed events
+ */
+
+/******************************************************************************
+ *  NtCreateKeyedEvent (NTDLL.@)
+ */
+NTSTATUS WINAPI NtCreateKeyedEvent( OUT PHANDLE handle, IN ACCESS_MASK access,
+                                    IN const OBJECT_ATTRIBUTES *attr OPTIONAL, IN ULONG flags )
+{
+    NTSTATUS ret;
+
+    __asm__ __volatile__ (
+            "movl $0xEB,%%eax\n\t"
+            "lea 8(%%ebp),%%edx\n\t"
+            "int $0x2E\n\t"
+            :"=a" (ret) : : "edx", "memory"
+            );
+    return ret;
+}
+
+/******************************************************************************
+ *  NtOpenKeyedEvent (NTDLL.@)
+ */
+NTSTATUS WINAPI NtOpenKeyedEvent( OUT PHANDLE handle, IN ACCESS_MASK access,
+                                  IN const OBJECT_ATTRIBUTES *attr )
+{
+    NTSTATUS ret;
+
+    __asm__ __volatile__ (
+            "movl $0xEC,%%eax\n\t"
+            "lea 8(%%ebp),%%edx\n\t"
+            "int $0x2E\n\t"
+            :"=a" (ret) : : "edx", "memory"
+            );
+    return ret;
+}
+
+/******************************************************************************
+ *  NtReleaseKeyedEvent (NTDLL.@)
+ *
+ * A NULL handle stands for the process-wide keyed event.
+ */
+NTSTATUS WINAPI NtReleaseKeyedEvent( IN HANDLE handle, IN const void *key,
+                                     IN BOOLEAN alertable, IN const LARGE_INTEGER *timeout )
+{
+    NTSTATUS ret;
+
+    /* the kernel returns STATUS_ALERTED when a signal interrupts the wait, so that
+     * it gets delivered; the timeout starts over, like in the futex case */
+    do
+    {
+        __asm__ __volatile__ (
+                "movl $0xED,%%eax\n\t"
+                "lea 8(%%ebp),%%edx\n\t"
+                "int $0x2E\n\t"
+                :"=a" (ret) : : "edx", "memory"
+                );
+    } while (ret == STATUS_ALERTED);
+    return ret;
+}
+
+/******************************************************************************
+ *  NtWaitForKeyedEvent (NTDLL.@)
+ *
+ * A NULL handle stands for the process-wide keyed event.
+ */
+NTSTATUS WINAPI NtWaitForKeyedEvent( IN HANDLE handle, IN const void *key,
+                                     IN BOOLEAN alertable, IN const LARGE_INTEGER *timeout )
+{
+    NTSTATUS ret;
+
+    do
+    {
+        __asm__ __volatile__ (
+                "movl $0xEE,%%eax\n\t"
+                "lea 8(%%ebp),%%edx\n\t"
+                "int $0x2E\n\t"
+                :"=a" (ret) : : "edx", "memory"
+                );
+    } while (ret == STATUS_ALERTED);
+    return ret;
+}
+
 /*
  *	Events
  */
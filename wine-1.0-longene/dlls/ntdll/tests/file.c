@@ -58,6 +58,9 @@ static NTSTATUS (WINAPI *pNtQueryIoCompletion)(HANDLE, IO_COMPLETION_INFORMATION
 static NTSTATUS (WINAPI *pNtRemoveIoCompletion)(HANDLE, PULONG_PTR, PULONG_PTR, PIO_STATUS_BLOCK, PLARGE_INTEGER);
 static NTSTATUS (WINAPI *pNtSetIoCompletion)(HANDLE, ULONG_PTR, ULONG_PTR, NTSTATUS, ULONG);
 static NTSTATUS (WINAPI *pNtSetInformationFile)(HANDLE, PIO_STATUS_BLOCK, PVOID, ULONG, FILE_INFORMATION_CLASS);
+static NTSTATUS (WINAPI *pNtQueryDirectoryFile)(HANDLE, HANDLE, PIO_APC_ROUTINE, PVOID, PIO_STATUS_BLOCK,
+                                                PVOID, ULONG, FILE_INFORMATION_CLASS, BOOLEAN,
+                                                PUNICODE_STRING, BOOLEAN);
 
 static inline BOOL is_signaled( HANDLE obj )
 {
@@ -614,6 +617,137 @@ static void test_iocompletion(void)
     }
 }
 
+/* enumerate a directory with the given class, returns the number of entries other than . and .. */
+static int count_dir_entries( HANDLE dir, FILE_INFORMATION_CLASS class, const WCHAR *maskW, int *dirs )
+{
+    static const WCHAR dotW[] = {'.'}, dotdotW[] = {'.','.'};
+    ULONG_PTR buffer[8192 / sizeof(ULONG_PTR)];
+    UNICODE_STRING mask;
+    IO_STATUS_BLOCK io;
+    NTSTATUS status;
+    BOOLEAN restart = TRUE;
+    int count = 0;
+
+    if (maskW) pRtlInitUnicodeString( &mask, maskW );
+    if (dirs) *dirs = 0;
+    for (;;)
+    {
+        char *ptr = (char *)buffer;
+        ULONG next;
+
+        status = pNtQueryDirectoryFile( dir, NULL, NULL, NULL, &io, buffer, sizeof(buffer), class,
+                                        FALSE, maskW ? &mask : NULL, restart );
+        if (status == STATUS_NO_MORE_FILES || status == STATUS_NO_SUCH_FILE) break;
+        ok( status == STATUS_SUCCESS, "class %d: wrong status %x\n", class, status );
+        if (status) break;
+        restart = FALSE;
+        do
+        {
+            const WCHAR *name;
+            ULONG name_len, attr = 0;
+
+            if (class == FileNamesInformation)
+            {
+                FILE_NAMES_INFORMATION *info = (FILE_NAMES_INFORMATION *)ptr;
+                next = info->NextEntryOffset;
+                name = info->FileName;
+                name_len = info->FileNameLength;
+            }
+            else
+            {
+                FILE_DIRECTORY_INFORMATION *info = (FILE_DIRECTORY_INFORMATION *)ptr;
+                next = info->NextEntryOffset;
+                name = class == FileBothDirectoryInformation ?
+                       ((FILE_BOTH_DIRECTORY_INFORMATION *)ptr)->FileName :
+                       class == FileFullDirectoryInformation ?
+                       ((FILE_FULL_DIRECTORY_INFORMATION *)ptr)->FileName : info->FileName;
+                name_len = info->FileNameLength;
+                attr = info->FileAttributes;
+                ok( attr != 0, "class %d: no attributes\n", class );
+            }
+            if (!(name_len == sizeof(dotW) && !memcmp( name, dotW, name_len )) &&
+                !(name_len == sizeof(dotdotW) && !memcmp( name, dotdotW, name_len )))
+            {
+                count++;
+                if (dirs && (attr & FILE_ATTRIBUTE_DIRECTORY)) (*dirs)++;
+            }
+            ptr += next;
+        } while (next);
+    }
+    return count;
+}
+
+static void test_query_directory(void)
+{
+    static const WCHAR starW[] = {'*',0};
+    static const WCHAR maskW[] = {'f','i','l','e','1','*','.','t','x','t',0};
+    const unsigned int count = 2000;
+    char temp_path[MAX_PATH], dir_name[MAX_PATH], path[MAX_PATH];
+    DWORD start, names_time, both_time;
+    unsigned int i;
+    int n, dirs;
+    HANDLE dir, file;
+
+    if (!pNtQueryDirectoryFile)
+    {
+        skip("NtQueryDirectoryFile not available\n");
+        return;
+    }
+
+    GetTempPathA( MAX_PATH, temp_path );
+    sprintf( dir_name, "%sQueryDir%x", temp_path, GetCurrentProcessId() );
+    ok( CreateDirectoryA( dir_name, NULL ), "CreateDirectoryA error %d\n", GetLastError() );
+    for (i = 0; i < count; i++)
+    {
+        sprintf( path, "%s\\file%u.txt", dir_name, i );
+        file = CreateFileA( path, GENERIC_WRITE, 0, NULL, CREATE_NEW, 0, NULL );
+        ok( file != INVALID_HANDLE_VALUE, "CreateFileA %s error %d\n", path, GetLastError() );
+        CloseHandle( file );
+    }
+    sprintf( path, "%s\\subdir", dir_name );
+    ok( CreateDirectoryA( path, NULL ), "CreateDirectoryA error %d\n", GetLastError() );
+
+    dir = CreateFileA( dir_name, FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                       NULL, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, NULL );
+    ok( dir != INVALID_HANDLE_VALUE, "CreateFileA error %d\n", GetLastError() );
+
+    n = count_dir_entries( dir, FileDirectoryInformation, NULL, &dirs );
+    ok( n == count + 1, "FileDirectoryInformation: got %d entries\n", n );
+    ok( dirs == 1, "FileDirectoryInformation: got %d directories\n", dirs );
+    n = count_dir_entries( dir, FileFullDirectoryInformation, starW, &dirs );
+    ok( n == count + 1, "FileFullDirectoryInformation: got %d entries\n", n );
+    ok( dirs == 1, "FileFullDirectoryInformation: got %d directories\n", dirs );
+
+    /* file1.txt, file10-19.txt, file100-199.txt, file1000-1999.txt */
+    n = count_dir_entries( dir, FileBothDirectoryInformation, maskW, NULL );
+    ok( n == 1111, "FileBothDirectoryInformation with mask: got %d entries\n", n );
+    n = count_dir_entries( dir, FileNamesInformation, maskW, NULL );
+    ok( n == 1111, "FileNamesInformation with mask: got %d entries\n", n );
+
+    start = GetTickCount();
+    for (i = 0; i < 10; i++) n = count_dir_entries( dir, FileNamesInformation, NULL, NULL );
+    names_time = GetTickCount() - start;
+    ok( n == count + 1, "FileNamesInformation: got %d entries\n", n );
+
+    start = GetTickCount();
+    for (i = 0; i < 10; i++) n = count_dir_entries( dir, FileBothDirectoryInformation, NULL, &dirs );
+    both_time = GetTickCount() - start;
+    ok( n == count + 1, "FileBothDirectoryInformation: got %d entries\n", n );
+    ok( dirs == 1, "FileBothDirectoryInformation: got %d directories\n", dirs );
+
+    trace( "%u entries listed 10 times: names %u ms, both %u ms\n", count + 1, names_time, both_time );
+
+    CloseHandle( dir );
+    for (i = 0; i < count; i++)
+    {
+        sprintf( path, "%s\\file%u.txt", dir_name, i );
+        DeleteFileA( path );
+    }
+    sprintf( path, "%s\\subdir", dir_name );
+    RemoveDirectoryA( path );
+    ok( RemoveDirectoryA( dir_name ), "RemoveDirectoryA error %d\n", GetLastError() );
+}
+
 START_TEST(file)
 {
     HMODULE hntdll = GetModuleHandleA("ntdll.dll");
@@ -634,8 +768,10 @@ START_TEST(file)
     pNtRemoveIoCompletion   = (void *)GetProcAddress(hntdll, "NtRemoveIoCompletion");
     pNtSetIoCompletion      = (void *)GetProcAddress(hntdll, "NtSetIoCompletion");
     pNtSetInformationFile   = (void *)GetProcAddress(hntdll, "NtSetInformationFile");
+    pNtQueryDirectoryFile   = (void *)GetProcAddress(hntdll, "NtQueryDirectoryFile");
 
     read_file_test();
     nt_mailslot_test();
     test_iocompletion();
+    test_query_directory();
 }
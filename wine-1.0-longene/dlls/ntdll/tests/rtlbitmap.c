@@ -34,6 +34,7 @@ static VOID (WINAPI *pRtlSetBits)(PRTL_BITMAP,ULONG,ULONG);
 static VOID (WINAPI *pRtlClearBits)(PRTL_BITMAP,ULONG,ULONG);
 static BOOLEAN (WINAPI *pRtlAreBitsSet)(PRTL_BITMAP,ULONG,ULONG);
 static BOOLEAN (WINAPI *pRtlAreBitsClear)(PRTL_BITMAP,ULONG,ULONG);
+static ULONG (WINAPI *pRtlFindClearBits)(PRTL_BITMAP,ULONG,ULONG);
 static ULONG (WINAPI *pRtlFindSetBitsAndClear)(PRTL_BITMAP,ULONG,ULONG);
 static ULONG (WINAPI *pRtlFindClearBitsAndSet)(PRTL_BITMAP,ULONG,ULONG);
 static CCHAR (WINAPI *pRtlFindMostSignificantBit)(ULONGLONG);
@@ -63,6 +64,7 @@ static void InitFunctionPtrs(void)
     pRtlAreBitsClear = (void *)GetProcAddress(hntdll, "RtlAreBitsClear");
     pRtlNumberOfSetBits = (void *)GetProcAddress(hntdll, "RtlNumberOfSetBits");
     pRtlNumberOfClearBits = (void *)GetProcAddress(hntdll, "RtlNumberOfClearBits");
+    pRtlFindClearBits = (void *)GetProcAddress(hntdll, "RtlFindClearBits");
     pRtlFindSetBitsAndClear = (void *)GetProcAddress(hntdll, "RtlFindSetBitsAndClear");
     pRtlFindClearBitsAndSet = (void *)GetProcAddress(hntdll, "RtlFindClearBitsAndSet");
     pRtlFindMostSignificantBit = (void *)GetProcAddress(hntdll, "RtlFindMostSignificantBit");
@@ -614,6 +616,148 @@ static void test_RtlFindClearRuns(void)
   }
 
 }
+
+/* Bit by bit search, to check and time RtlFindClearBits against */
+static ULONG find_clear_bits_slow(const BYTE *bits, ULONG size, ULONG count)
+{
+  ULONG pos, run = 0;
+
+  for (pos = 0; pos < size; pos++)
+  {
+    if (bits[pos >> 3] & (1 << (pos & 7)))
+      run = 0;
+    else if (++run == count)
+      return pos + 1 - count;
+  }
+  return ~0U;
+}
+
+/* RtlAreBitsClear and RtlFindClearBits as they were before working a ULONG
+ * at a time, to compare against: a byte-wise check at every position */
+static BOOLEAN old_are_bits_clear(const BYTE *bits, ULONG size, ULONG start, ULONG count)
+{
+  static const BYTE mask[8] = { 0, 1, 3, 7, 15, 31, 63, 127 };
+  const BYTE *out;
+  ULONG remainder;
+
+  if (!count || start >= size || count > size - start)
+    return FALSE;
+
+  out = bits + (start >> 3u);
+  if (start & 7)
+  {
+    if (count > 7)
+    {
+      if (*out & ((0xff << (start & 7)) & 0xff))
+        return FALSE;
+      out++;
+      count -= (8 - (start & 7));
+    }
+    else
+    {
+      USHORT initial = mask[count] << (start & 7);
+
+      if (*out & (initial & 0xff))
+        return FALSE;
+      if ((initial & 0xff00) && (out[1] & (initial >> 8)))
+        return FALSE;
+      return TRUE;
+    }
+  }
+
+  remainder = count & 7;
+  count >>= 3;
+  while (count--)
+  {
+    if (*out++)
+      return FALSE;
+  }
+  if (remainder && *out & mask[remainder])
+    return FALSE;
+  return TRUE;
+}
+
+static ULONG old_find_clear_bits(const BYTE *bits, ULONG size, ULONG count, ULONG hint)
+{
+  ULONG pos, end = size;
+
+  if (!count || count > size)
+    return ~0U;
+  if (hint + count > size)
+    hint = 0;
+
+  pos = hint;
+  while (pos < end)
+  {
+    if (old_are_bits_clear(bits, size, pos, count))
+      return pos;
+    if (pos == end - 1 && hint)
+    {
+      end = hint;
+      pos = hint = 0;
+    }
+    else
+      pos++;
+  }
+  return ~0U;
+}
+
+static void test_RtlLargeBitMap(void)
+{
+  static const ULONG size = 1 << 22;  /* 4 megabits */
+  RTL_BITMAP big;
+  BYTE *bits;
+  ULONG i, pos, slow, ulCount, ulStart, ticks;
+
+  if (!pRtlFindClearBits || !pRtlNumberOfSetBits || !pRtlFindLongestRunClear)
+    return;
+
+  bits = HeapAlloc(GetProcessHeap(), 0, size / 8);
+  pRtlInitializeBitMap(&big, bits, size);
+
+  /* An almost full allocation map: small holes everywhere, one large hole near the end */
+  memset(bits, 0xff, size / 8);
+  for (i = 0; i < size; i += 4099)
+    pRtlClearBits(&big, i, 3);
+  pRtlClearBits(&big, size - 1000, 100);
+
+  for (i = ulCount = 0; i < size; i++)
+    if (bits[i >> 3] & (1 << (i & 7))) ulCount++;
+  ok(pRtlNumberOfSetBits(&big) == ulCount, "count wrong\n");
+
+  slow = find_clear_bits_slow(bits, size, 50);
+  ok(slow == size - 1000, "reference search found %u\n", slow);
+  pos = pRtlFindClearBits(&big, 50, 0);
+  ok(pos == slow, "found %u instead of %u\n", pos, slow);
+  pos = pRtlFindClearBits(&big, 50, size - 900);
+  ok(pos == slow, "didn't wrap around, found %u\n", pos);
+  pos = pRtlFindClearBits(&big, 101, 0);
+  ok(pos == ~0U, "found %u bits that aren't clear\n", pos);
+
+  ulCount = pRtlFindLongestRunClear(&big, &ulStart);
+  ok(ulCount == 100 && ulStart == size - 1000, "didn't find longest, %u at %u\n", ulCount, ulStart);
+
+  ticks = GetTickCount();
+  for (i = 0; i < 20; i++)
+    pos = pRtlFindClearBits(&big, 50, 0);
+  ticks = GetTickCount() - ticks;
+  trace("RtlFindClearBits on %u bits: %u ms for 20 searches\n", size, ticks);
+
+  ticks = GetTickCount();
+  for (i = 0; i < 20; i++)
+    slow = old_find_clear_bits(bits, size, 50, 0);
+  ticks = GetTickCount() - ticks;
+  ok(slow == pos, "old search found %u instead of %u\n", slow, pos);
+  trace("previous byte-wise RtlFindClearBits on %u bits: %u ms for 20 searches\n", size, ticks);
+
+  ticks = GetTickCount();
+  for (i = 0; i < 20; i++)
+    ulCount = pRtlNumberOfSetBits(&big);
+  ticks = GetTickCount() - ticks;
+  trace("RtlNumberOfSetBits on %u bits: %u ms for 20 counts\n", size, ticks);
+
+  HeapFree(GetProcessHeap(), 0, bits);
+}
 #endif
 
 START_TEST(rtlbitmap)
@@ -639,6 +783,7 @@ START_TEST(rtlbitmap)
     test_RtlFindLeastSignificantBit();
     test_RtlFindSetRuns();
     test_RtlFindClearRuns();
+    test_RtlLargeBitMap();
   }
 #endif
 }
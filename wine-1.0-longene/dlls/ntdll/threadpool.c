@@ -37,22 +37,29 @@
 WINE_DEFAULT_DEBUG_CHANNEL(threadpool);
 
 #define WORKER_TIMEOUT 30000 /* 30 seconds */
+#define EXTRA_WORKER_TIMEOUT 2000 /* idle time before a worker above the target leaves */
+#define GATE_INTERVAL 100 /* how often the gate thread looks for a stalled queue */
+#define MAX_WORKERS 500
+
+/* The work items are posted to a completion port, with the function as key,
+ * the context as value and the flags as information.  Idle workers all block
+ * on it and the kernel wakes up one of them per item, so there is neither a
+ * shared list nor a lock on the queueing path.
+ *
+ * The pool aims at one running worker per processor.  A new worker is started
+ * right away only while fewer are running, workers busy with a long function
+ * not counting; beyond that the gate thread adds one whenever the queue made
+ * no progress for GATE_INTERVAL, i.e. when the workers are blocked.  Workers
+ * above the target leave after EXTRA_WORKER_TIMEOUT without work, the others
+ * after WORKER_TIMEOUT. */
+static HANDLE work_port;
+static ULONG target_workers = 1;
 
 static LONG num_workers;
-static LONG num_work_items;
 static LONG num_busy_workers;
-
-static struct list work_item_list = LIST_INIT(work_item_list);
-static HANDLE work_item_event;
-
-static RTL_CRITICAL_SECTION threadpool_cs;
-static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
-{
-    0, 0, &threadpool_cs,
-    { &critsect_debug.ProcessLocksList, &critsect_debug.ProcessLocksList },
-    0, 0, { (DWORD_PTR)(__FILE__ ": threadpool_cs") }
-};
-static RTL_CRITICAL_SECTION threadpool_cs = { &critsect_debug, -1, 0, 0, 0, 0 };
+static LONG num_long_workers;
+static LONG num_completed;
+static LONG gate_running;
 
 static HANDLE compl_port = NULL;
 static RTL_CRITICAL_SECTION threadpool_compl_cs;
@@ -64,13 +71,6 @@ static RTL_CRITICAL_SECTION_DEBUG critsect_compl_debug =
 };
 static RTL_CRITICAL_SECTION threadpool_compl_cs = { &critsect_compl_debug, -1, 0, 0, 0, 0 };
 
-struct work_item
-{
-    struct list entry;
-    PRTL_WORK_ITEM_ROUTINE function;
-    PVOID context;
-};
-
 static inline LONG interlocked_inc( PLONG dest )
 {
     return interlocked_xchg_add( dest, 1 ) + 1;
@@ -81,95 +81,162 @@ static inline LONG interlocked_dec( PLONG dest )
     return interlocked_xchg_add( dest, -1 ) - 1;
 }
 
+static inline PLARGE_INTEGER get_nt_timeout( PLARGE_INTEGER pTime, ULONG timeout )
+{
+    if (timeout == INFINITE) return NULL;
+    pTime->QuadPart = (ULONGLONG)timeout * -10000;
+    return pTime;
+}
+
+extern void (*ThreadStartup)(LPTHREAD_START_ROUTINE lpStartAddress, LPVOID lpParameter);
+extern NTSTATUS
+RtlRosCreateUserThread(IN HANDLE ProcessHandle,
+        IN POBJECT_ATTRIBUTES ObjectAttributes,
+        IN BOOLEAN CreateSuspended,
+        IN LONG StackZeroBits,
+        IN OUT PULONG StackReserve OPTIONAL,
+        IN OUT PULONG StackCommit OPTIONAL,
+        IN PVOID BaseStartAddress,
+        OUT PHANDLE ThreadHandle OPTIONAL,
+        OUT PCLIENT_ID ClientId OPTIONAL,
+        IN ULONG_PTR StartAddress,
+        IN ULONG_PTR Parameter);
+
+static NTSTATUS create_pool_thread( void (WINAPI *proc)(void *), void *param )
+{
+    HANDLE thread;
+    NTSTATUS status;
+
+    status = RtlRosCreateUserThread(GetCurrentProcess(),
+            NULL, FALSE, 0, NULL, NULL, (PVOID)ThreadStartup,
+            &thread, NULL, (ULONG_PTR)proc, (ULONG_PTR)param);
+    if (status == STATUS_SUCCESS)
+        NtClose( thread );
+    return status;
+}
+
+static HANDLE get_work_port(void)
+{
+    if (!work_port)
+    {
+        SYSTEM_BASIC_INFORMATION sbi;
+        HANDLE port;
+
+        if (NtCreateIoCompletion( &port, IO_COMPLETION_ALL_ACCESS, NULL, 0 )) return 0;
+        if (!NtQuerySystemInformation( SystemBasicInformation, &sbi, sizeof(sbi), NULL ) &&
+            sbi.bKeNumberProcessors > 0)
+            target_workers = sbi.bKeNumberProcessors;
+        if (interlocked_cmpxchg_ptr( &work_port, port, 0 ))
+            NtClose( port );  /* somebody beat us to it */
+    }
+    return work_port;
+}
+
+static ULONG get_queue_depth(void)
+{
+    ULONG depth = 0;
+
+    NtQueryIoCompletion( work_port, IoCompletionBasicInformation, &depth, sizeof(depth), NULL );
+    return depth;
+}
+
 static void WINAPI worker_thread_proc(void * param)
 {
-    interlocked_inc(&num_workers);
+    LARGE_INTEGER timeout;
+    IO_STATUS_BLOCK iosb;
+    ULONG_PTR key, value;
+    NTSTATUS status;
 
-    /* free the work item memory sooner to reduce memory usage */
     while (TRUE)
     {
-        if (num_work_items > 0)
-        {
-            struct list *item;
-            RtlEnterCriticalSection(&threadpool_cs);
-            item = list_head(&work_item_list);
-            if (item)
-            {
-                struct work_item *work_item_ptr = LIST_ENTRY(item, struct work_item, entry);
-                struct work_item work_item;
-                list_remove(&work_item_ptr->entry);
-                interlocked_dec(&num_work_items);
-
-                RtlLeaveCriticalSection(&threadpool_cs);
+        ULONG idle = num_workers > target_workers ? EXTRA_WORKER_TIMEOUT : WORKER_TIMEOUT;
 
-                work_item = *work_item_ptr;
-                RtlFreeHeap(GetProcessHeap(), 0, work_item_ptr);
+        status = NtRemoveIoCompletion( work_port, &key, &value, &iosb, get_nt_timeout( &timeout, idle ) );
+        if (status == STATUS_SUCCESS)
+        {
+            PRTL_WORK_ITEM_ROUTINE function = (PRTL_WORK_ITEM_ROUTINE)key;
+            BOOL long_function = (iosb.Information & WT_EXECUTELONGFUNCTION) != 0;
 
-                TRACE("executing %p(%p)\n", work_item.function, work_item.context);
+            TRACE("executing %p(%p)\n", function, (void *)value);
 
-                interlocked_inc(&num_busy_workers);
+            interlocked_inc(&num_busy_workers);
+            if (long_function) interlocked_inc(&num_long_workers);
 
-                /* do the work */
-                work_item.function(work_item.context);
+            /* do the work */
+            function((void *)value);
 
-                interlocked_dec(&num_busy_workers);
-            }
-            else
-                RtlLeaveCriticalSection(&threadpool_cs);
+            if (long_function) interlocked_dec(&num_long_workers);
+            interlocked_dec(&num_busy_workers);
+            interlocked_inc(&num_completed);
+        }
+        else if (status == STATUS_TIMEOUT)
+        {
+            /* leave, unless an item was queued while we were giving up */
+            interlocked_dec(&num_workers);
+            if (!get_queue_depth()) break;
+            interlocked_inc(&num_workers);
         }
         else
         {
-            NTSTATUS status;
-            LARGE_INTEGER timeout;
-            timeout.QuadPart = -(WORKER_TIMEOUT * (ULONGLONG)10000);
-            status = NtWaitForSingleObject(work_item_event, FALSE, &timeout);
-            if (status != STATUS_WAIT_0)
-                break;
+            ERR("NtRemoveIoCompletion failed: 0x%x\n", status);
+            interlocked_dec(&num_workers);
+            break;
         }
     }
 
-    interlocked_dec(&num_workers);
-
     RtlExitUserThread(0);
 
     /* never reached */
 }
 
-static NTSTATUS add_work_item_to_queue(struct work_item *work_item)
+static NTSTATUS create_worker(void)
 {
     NTSTATUS status;
 
-    RtlEnterCriticalSection(&threadpool_cs);
-    list_add_tail(&work_item_list, &work_item->entry);
-    num_work_items++;
-    RtlLeaveCriticalSection(&threadpool_cs);
+    if (interlocked_inc(&num_workers) > MAX_WORKERS)
+    {
+        interlocked_dec(&num_workers);
+        return STATUS_TOO_MANY_THREADS;
+    }
+    status = create_pool_thread( worker_thread_proc, NULL );
+    if (status != STATUS_SUCCESS)
+        interlocked_dec(&num_workers);
+    return status;
+}
 
-    if (!work_item_event)
+/* adds a worker when the queue didn't move since the last check */
+static void WINAPI gate_thread_proc(void * param)
+{
+    LONG completed = num_completed;
+    LARGE_INTEGER timeout;
+
+    while (TRUE)
     {
-        HANDLE sem;
-        status = NtCreateSemaphore(&sem, SEMAPHORE_ALL_ACCESS, NULL, 1, LONG_MAX);
-        if (interlocked_cmpxchg_ptr( &work_item_event, sem, 0 ))
-            NtClose(sem);  /* somebody beat us to it */
+        NtDelayExecution( FALSE, get_nt_timeout( &timeout, GATE_INTERVAL ) );
+
+        if (!get_queue_depth())
+        {
+            gate_running = 0;
+            if (!get_queue_depth() || interlocked_cmpxchg( &gate_running, 1, 0 ))
+                break;
+        }
+        else if (num_completed == completed && num_busy_workers >= num_workers)
+        {
+            TRACE("queue stalled with %d workers, adding one\n", num_workers);
+            create_worker();
+        }
+        completed = num_completed;
     }
-    else
-        status = NtReleaseSemaphore(work_item_event, 1, NULL);
 
-    return status;
+    RtlExitUserThread(0);
 }
 
-extern void (*ThreadStartup)(LPTHREAD_START_ROUTINE lpStartAddress, LPVOID lpParameter);
-extern NTSTATUS
-RtlRosCreateUserThread(IN HANDLE ProcessHandle,
-        IN POBJECT_ATTRIBUTES ObjectAttributes,
-        IN BOOLEAN CreateSuspended,
-        IN LONG StackZeroBits,
-        IN OUT PULONG StackReserve OPTIONAL,
-        IN OUT PULONG StackCommit OPTIONAL,
-        IN PVOID BaseStartAddress,
-        OUT PHANDLE ThreadHandle OPTIONAL,
-        OUT PCLIENT_ID ClientId OPTIONAL,
-        IN ULONG_PTR StartAddress,
-        IN ULONG_PTR Parameter);
+static void start_gate(void)
+{
+    if (interlocked_cmpxchg( &gate_running, 1, 0 )) return;
+    if (create_pool_thread( gate_thread_proc, NULL ) != STATUS_SUCCESS)
+        gate_running = 0;
+}
 
 /***********************************************************************
  *              RtlQueueWorkItem   (NTDLL.@)
@@ -195,51 +262,38 @@ RtlRosCreateUserThread(IN HANDLE ProcessHandle,
  */
 NTSTATUS WINAPI RtlQueueWorkItem(PRTL_WORK_ITEM_ROUTINE Function, PVOID Context, ULONG Flags)
 {
-    HANDLE thread;
     NTSTATUS status;
-    struct work_item *work_item = RtlAllocateHeap(GetProcessHeap(), 0, sizeof(struct work_item));
+    LONG busy;
 
-    if (!work_item)
+    if (!get_work_port())
         return STATUS_NO_MEMORY;
 
-    work_item->function = Function;
-    work_item->context = Context;
-
     if (Flags & ~WT_EXECUTELONGFUNCTION)
         FIXME("Flags 0x%x not supported\n", Flags);
 
-    status = add_work_item_to_queue(work_item);
-
-    /* FIXME: tune this algorithm to not be as aggressive with creating threads
-     * if WT_EXECUTELONGFUNCTION isn't specified */
-    if ((status == STATUS_SUCCESS) &&
-        ((num_workers == 0) || (num_workers == num_busy_workers)))
+    if (!num_workers)
     {
-        status = RtlRosCreateUserThread(GetCurrentProcess(),
-                NULL, FALSE, 0, NULL, NULL, (PVOID)ThreadStartup,
-                &thread, NULL, (ULONG_PTR)worker_thread_proc, 0);
-        if (status == STATUS_SUCCESS)
-            NtClose( thread );
-
-        /* NOTE: we don't care if we couldn't create the thread if there is at
-         * least one other available to process the request */
-        if ((num_workers > 0) && (status != STATUS_SUCCESS))
-            status = STATUS_SUCCESS;
+        status = create_worker();
+        if (status != STATUS_SUCCESS && !num_workers)
+            return status;
     }
 
+    status = NtSetIoCompletion( work_port, (ULONG_PTR)Function, (ULONG_PTR)Context,
+                                STATUS_SUCCESS, Flags );
     if (status != STATUS_SUCCESS)
-    {
-        RtlEnterCriticalSection(&threadpool_cs);
-
-        interlocked_dec(&num_work_items);
-        list_remove(&work_item->entry);
-        RtlFreeHeap(GetProcessHeap(), 0, work_item);
-
-        RtlLeaveCriticalSection(&threadpool_cs);
-
         return status;
-    }
 
+    /* look at the workers only now, so that one leaving sees the item or we see it gone */
+    busy = num_busy_workers;
+    if (num_workers <= busy)
+    {
+        /* NOTE: we don't care if we couldn't create the thread if there is at
+         * least one other available to process the request */
+        if ((Flags & WT_EXECUTELONGFUNCTION) || busy - num_long_workers < target_workers)
+            create_worker();
+        else
+            start_gate();
+    }
     return STATUS_SUCCESS;
 }
 
@@ -309,7 +363,7 @@ NTSTATUS WINAPI RtlSetIoCompletionCallback(HANDLE FileHandle, PRTL_OVERLAPPED_CO
             if (!res)
             {
                 /* FIXME native can start additional threads in case of e.g. hung callback function. */
-                res = RtlQueueWorkItem( iocp_poller, NULL, WT_EXECUTEDEFAULT );
+                res = RtlQueueWorkItem( iocp_poller, NULL, WT_EXECUTELONGFUNCTION );
                 if (!res)
                     compl_port = cport;
                 else
@@ -326,83 +380,288 @@ NTSTATUS WINAPI RtlSetIoCompletionCallback(HANDLE FileHandle, PRTL_OVERLAPPED_CO
     return NtSetInformationFile( FileHandle, &iosb, &info, sizeof(info), FileCompletionInformation );
 }
 
-static inline PLARGE_INTEGER get_nt_timeout( PLARGE_INTEGER pTime, ULONG timeout )
+/* Registered waits are served by wait threads, each waiting on the objects of
+ * up to WAITS_PER_THREAD of them at once plus an event telling it to look at
+ * its list again.  When an object is signaled or its wait times out, the
+ * callback is queued to the worker threads, or called right away for
+ * WT_EXECUTEINWAITTHREAD and WT_EXECUTEINIOTHREAD; the object is left out of
+ * the wait until the callback returns.  Everything below is protected by
+ * waitqueue_cs. */
+#define WAITS_PER_THREAD (MAXIMUM_WAIT_OBJECTS - 1)
+#define WAIT_ERROR_DELAY 100 /* back off after a wait failure with no culprit */
+
+struct wait_thread
 {
-    if (timeout == INFINITE) return NULL;
-    pTime->QuadPart = (ULONGLONG)timeout * -10000;
-    return pTime;
-}
+    struct list entry;        /* in wait_threads */
+    struct list waits;        /* the waits this thread is serving */
+    int         num_waits;
+    HANDLE      update_event; /* set when a wait is added, cancelled or re-armed */
+};
 
 struct wait_work_item
 {
+    struct list entry;
+    struct wait_thread *Thread;  /* NULL once the wait is over */
     HANDLE Object;
-    HANDLE CancelEvent;
     WAITORTIMERCALLBACK Callback;
     PVOID Context;
     ULONG Milliseconds;
     ULONG Flags;
+    ULONG Start;                 /* tick count when the wait was (re-)armed */
     HANDLE CompletionEvent;
-    LONG DeleteCount;
+    LONG Refs;                   /* registration, wait thread and pending callback */
+    BOOLEAN TimerOrWaitFired;
+    BOOLEAN CallbackQueued;
     BOOLEAN CallbackInProgress;
+    BOOLEAN Cancelled;
 };
 
-static void delete_wait_work_item(struct wait_work_item *wait_work_item)
+static struct list wait_threads = LIST_INIT(wait_threads);
+
+static RTL_CRITICAL_SECTION waitqueue_cs;
+static RTL_CRITICAL_SECTION_DEBUG waitqueue_debug =
 {
-    NtClose( wait_work_item->CancelEvent );
-    RtlFreeHeap( GetProcessHeap(), 0, wait_work_item );
+    0, 0, &waitqueue_cs,
+    { &waitqueue_debug.ProcessLocksList, &waitqueue_debug.ProcessLocksList },
+    0, 0, { (DWORD_PTR)(__FILE__ ": waitqueue_cs") }
+};
+static RTL_CRITICAL_SECTION waitqueue_cs = { &waitqueue_debug, -1, 0, 0, 0, 0 };
+
+static void release_wait_work_item(struct wait_work_item *wait_work_item)
+{
+    if (!--wait_work_item->Refs)
+        RtlFreeHeap( GetProcessHeap(), 0, wait_work_item );
 }
 
-static DWORD CALLBACK wait_thread_proc(LPVOID Arg)
+/* the wait is over, the thread stops waiting on its object */
+static void remove_wait_work_item(struct wait_work_item *wait_work_item)
+{
+    struct wait_thread *thread = wait_work_item->Thread;
+
+    list_remove( &wait_work_item->entry );
+    thread->num_waits--;
+    wait_work_item->Thread = NULL;
+    release_wait_work_item( wait_work_item );
+}
+
+/* take the wait out of its thread until the callback has run */
+static void fire_wait_work_item(struct wait_work_item *wait_work_item, BOOLEAN TimerOrWaitFired)
+{
+    wait_work_item->TimerOrWaitFired = TimerOrWaitFired;
+    wait_work_item->CallbackQueued = TRUE;
+    wait_work_item->Refs++;
+    if (wait_work_item->Flags & WT_EXECUTEONLYONCE)
+        remove_wait_work_item( wait_work_item );
+}
+
+static DWORD CALLBACK wait_callback_proc(LPVOID Arg)
 {
     struct wait_work_item *wait_work_item = Arg;
+    HANDLE completion_event = NULL;
+    BOOLEAN run;
+
+    RtlEnterCriticalSection( &waitqueue_cs );
+    if ((run = !wait_work_item->Cancelled))
+        wait_work_item->CallbackInProgress = TRUE;
+    RtlLeaveCriticalSection( &waitqueue_cs );
+
+    if (run)
+    {
+        TRACE( "wait for object %p %s, calling callback %p with context %p\n",
+               wait_work_item->Object, wait_work_item->TimerOrWaitFired ? "timed out" : "signaled",
+               wait_work_item->Callback, wait_work_item->Context );
+        wait_work_item->Callback( wait_work_item->Context, wait_work_item->TimerOrWaitFired );
+    }
+
+    RtlEnterCriticalSection( &waitqueue_cs );
+    wait_work_item->CallbackInProgress = FALSE;
+    wait_work_item->CallbackQueued = FALSE;
+    wait_work_item->Start = NtGetTickCount();
+    if (wait_work_item->Cancelled)
+        completion_event = wait_work_item->CompletionEvent;
+    else if (wait_work_item->Thread)
+        NtSetEvent( wait_work_item->Thread->update_event, NULL );
+    release_wait_work_item( wait_work_item );
+    RtlLeaveCriticalSection( &waitqueue_cs );
+
+    if (completion_event) NtSetEvent( completion_event, NULL );
+    return 0;
+}
+
+static void dispatch_wait_work_item(struct wait_work_item *wait_work_item)
+{
+    if ((wait_work_item->Flags & (WT_EXECUTEINWAITTHREAD | WT_EXECUTEINIOTHREAD)) ||
+        RtlQueueWorkItem( wait_callback_proc, wait_work_item,
+                          wait_work_item->Flags & WT_EXECUTELONGFUNCTION ) != STATUS_SUCCESS)
+        wait_callback_proc( wait_work_item );
+}
+
+/* end the waits whose object can't be waited on anymore, like a closed handle,
+ * and return the ones found signaled meanwhile */
+static ULONG check_wait_objects(struct wait_work_item **waits, ULONG count,
+                                struct wait_work_item **fired, ULONG *removed)
+{
+    LARGE_INTEGER zero;
+    NTSTATUS status;
+    ULONG i, num_fired = 0;
+
+    *removed = 0;
+    zero.QuadPart = 0;
+    RtlEnterCriticalSection( &waitqueue_cs );
+    for (i = 0; i < count; i++)
+    {
+        if (!waits[i]->Thread || waits[i]->CallbackQueued) continue;
+        status = NtWaitForSingleObject( waits[i]->Object, FALSE, &zero );
+        if (status != STATUS_WAIT_0 && status != STATUS_TIMEOUT)
+        {
+            WARN( "can't wait on %p anymore, status %x\n", waits[i]->Object, status );
+            remove_wait_work_item( waits[i] );
+            (*removed)++;
+        }
+        else if (status == STATUS_WAIT_0 && !waits[i]->Cancelled)
+        {
+            /* we may have consumed the signal, don't lose it */
+            fired[num_fired++] = waits[i];
+            fire_wait_work_item( waits[i], FALSE );
+        }
+    }
+    RtlLeaveCriticalSection( &waitqueue_cs );
+    return num_fired;
+}
+
+static void WINAPI wait_thread_proc(void * param)
+{
+    struct wait_thread *thread = param;
+    struct wait_work_item *waits[MAXIMUM_WAIT_OBJECTS], *fired[WAITS_PER_THREAD];
+    struct wait_work_item *wait_work_item, *next;
+    HANDLE handles[MAXIMUM_WAIT_OBJECTS];
+    LARGE_INTEGER time;
+    ULONG i, count, num_fired, num_removed, now, elapsed, timeout;
     NTSTATUS status;
-    BOOLEAN alertable = (wait_work_item->Flags & WT_EXECUTEINIOTHREAD) ? TRUE : FALSE;
-    HANDLE handles[2] = { wait_work_item->Object, wait_work_item->CancelEvent };
-    LARGE_INTEGER timeout;
-    HANDLE completion_event;
 
     TRACE("\n");
 
     while (TRUE)
     {
-        status = NtWaitForMultipleObjects( 2, handles, FALSE, alertable,
-                                           get_nt_timeout( &timeout, wait_work_item->Milliseconds ) );
-        if (status == STATUS_WAIT_0 || status == STATUS_TIMEOUT)
+        /* fire the waits that timed out and gather the objects of the others */
+        RtlEnterCriticalSection( &waitqueue_cs );
+        now = NtGetTickCount();
+        timeout = INFINITE;
+        count = num_fired = 0;
+        LIST_FOR_EACH_ENTRY_SAFE( wait_work_item, next, &thread->waits, struct wait_work_item, entry )
         {
-            BOOLEAN TimerOrWaitFired;
-
-            if (status == STATUS_WAIT_0)
+            if (wait_work_item->Cancelled)
             {
-                TRACE( "object %p signaled, calling callback %p with context %p\n",
-                    wait_work_item->Object, wait_work_item->Callback,
-                    wait_work_item->Context );
-                TimerOrWaitFired = FALSE;
+                remove_wait_work_item( wait_work_item );
+                continue;
             }
-            else
+            if (wait_work_item->CallbackQueued) continue;
+            if (wait_work_item->Milliseconds != INFINITE)
             {
-                TRACE( "wait for object %p timed out, calling callback %p with context %p\n",
-                    wait_work_item->Object, wait_work_item->Callback,
-                    wait_work_item->Context );
-                TimerOrWaitFired = TRUE;
+                elapsed = now - wait_work_item->Start;
+                if (elapsed >= wait_work_item->Milliseconds)
+                {
+                    fired[num_fired++] = wait_work_item;
+                    fire_wait_work_item( wait_work_item, TRUE );
+                    continue;
+                }
+                if (wait_work_item->Milliseconds - elapsed < timeout)
+                    timeout = wait_work_item->Milliseconds - elapsed;
             }
-            wait_work_item->CallbackInProgress = TRUE;
-            wait_work_item->Callback( wait_work_item->Context, TimerOrWaitFired );
-            wait_work_item->CallbackInProgress = FALSE;
+            waits[count] = wait_work_item;
+            handles[count++] = wait_work_item->Object;
+        }
+        if (!thread->num_waits) timeout = WORKER_TIMEOUT;
+        RtlLeaveCriticalSection( &waitqueue_cs );
 
-            if (wait_work_item->Flags & WT_EXECUTEONLYONCE)
+        for (i = 0; i < num_fired; i++) dispatch_wait_work_item( fired[i] );
+        if (num_fired) continue;
+
+        handles[count] = thread->update_event;
+        status = NtWaitForMultipleObjects( count + 1, handles, FALSE, TRUE,
+                                           get_nt_timeout( &time, timeout ) );
+        if ((ULONG)(status - STATUS_WAIT_0) < count)
+        {
+            wait_work_item = waits[status - STATUS_WAIT_0];
+            RtlEnterCriticalSection( &waitqueue_cs );
+            if (!wait_work_item->Cancelled)
+                fire_wait_work_item( wait_work_item, FALSE );
+            else
+                wait_work_item = NULL;
+            RtlLeaveCriticalSection( &waitqueue_cs );
+            if (wait_work_item) dispatch_wait_work_item( wait_work_item );
+        }
+        else if ((ULONG)(status - STATUS_ABANDONED_WAIT_0) < count)
+        {
+            RtlEnterCriticalSection( &waitqueue_cs );
+            wait_work_item = waits[status - STATUS_ABANDONED_WAIT_0];
+            if (wait_work_item->Thread) remove_wait_work_item( wait_work_item );
+            RtlLeaveCriticalSection( &waitqueue_cs );
+        }
+        else if (status == STATUS_TIMEOUT && !count)
+        {
+            /* nothing left to wait on for a while, leave unless a wait just came in */
+            RtlEnterCriticalSection( &waitqueue_cs );
+            if (!thread->num_waits)
+            {
+                list_remove( &thread->entry );
+                RtlLeaveCriticalSection( &waitqueue_cs );
                 break;
+            }
+            RtlLeaveCriticalSection( &waitqueue_cs );
+        }
+        else if (status != STATUS_WAIT_0 + count && status != STATUS_TIMEOUT &&
+                 status != STATUS_USER_APC)
+        {
+            num_fired = check_wait_objects( waits, count, fired, &num_removed );
+            for (i = 0; i < num_fired; i++) dispatch_wait_work_item( fired[i] );
+            if (!num_fired && !num_removed)
+            {
+                /* none of the waits is to blame, don't spin on the error */
+                ERR( "waiting for %u objects failed, status %x\n", count + 1, status );
+                NtDelayExecution( TRUE, get_nt_timeout( &time, WAIT_ERROR_DELAY ) );
+            }
         }
-        else
-            break;
     }
 
-    completion_event = wait_work_item->CompletionEvent;
-    if (completion_event) NtSetEvent( completion_event, NULL );
+    NtClose( thread->update_event );
+    RtlFreeHeap( GetProcessHeap(), 0, thread );
+    RtlExitUserThread(0);
+}
 
-    if (interlocked_inc( &wait_work_item->DeleteCount ) == 2 )
-        delete_wait_work_item( wait_work_item );
+/* find a wait thread with room left, caller must hold waitqueue_cs */
+static NTSTATUS get_wait_thread(struct wait_thread **ret)
+{
+    struct wait_thread *thread;
+    NTSTATUS status;
 
-    return 0;
+    LIST_FOR_EACH_ENTRY( thread, &wait_threads, struct wait_thread, entry )
+    {
+        if (thread->num_waits < WAITS_PER_THREAD)
+        {
+            *ret = thread;
+            return STATUS_SUCCESS;
+        }
+    }
+
+    if (!(thread = RtlAllocateHeap( GetProcessHeap(), 0, sizeof(*thread) )))
+        return STATUS_NO_MEMORY;
+    list_init( &thread->waits );
+    thread->num_waits = 0;
+    status = NtCreateEvent( &thread->update_event, EVENT_ALL_ACCESS, NULL, FALSE, FALSE );
+    if (status == STATUS_SUCCESS)
+    {
+        status = create_pool_thread( wait_thread_proc, thread );
+        if (status != STATUS_SUCCESS) NtClose( thread->update_event );
+    }
+    if (status != STATUS_SUCCESS)
+    {
+        RtlFreeHeap( GetProcessHeap(), 0, thread );
+        return status;
+    }
+    list_add_tail( &wait_threads, &thread->entry );
+    *ret = thread;
+    return STATUS_SUCCESS;
 }
 
 /***********************************************************************
@@ -435,6 +694,7 @@ NTSTATUS WINAPI RtlRegisterWait(PHANDLE NewWaitObject, HANDLE Object,
                                 PVOID Context, ULONG Milliseconds, ULONG Flags)
 {
     struct wait_work_item *wait_work_item;
+    struct wait_thread *thread;
     NTSTATUS status;
 
     TRACE( "(%p, %p, %p, %p, %d, 0x%x)\n", NewWaitObject, Object, Callback, Context, Milliseconds, Flags );
@@ -448,21 +708,28 @@ NTSTATUS WINAPI RtlRegisterWait(PHANDLE NewWaitObject, HANDLE Object,
     wait_work_item->Context = Context;
     wait_work_item->Milliseconds = Milliseconds;
     wait_work_item->Flags = Flags;
-    wait_work_item->CallbackInProgress = FALSE;
-    wait_work_item->DeleteCount = 0;
     wait_work_item->CompletionEvent = NULL;
+    wait_work_item->Refs = 2;
+    wait_work_item->TimerOrWaitFired = FALSE;
+    wait_work_item->CallbackQueued = FALSE;
+    wait_work_item->CallbackInProgress = FALSE;
+    wait_work_item->Cancelled = FALSE;
 
-    status = NtCreateEvent( &wait_work_item->CancelEvent, EVENT_ALL_ACCESS, NULL, TRUE, FALSE );
-    if (status != STATUS_SUCCESS)
+    RtlEnterCriticalSection( &waitqueue_cs );
+    status = get_wait_thread( &thread );
+    if (status == STATUS_SUCCESS)
     {
-        RtlFreeHeap( GetProcessHeap(), 0, wait_work_item );
-        return status;
+        wait_work_item->Thread = thread;
+        wait_work_item->Start = NtGetTickCount();
+        list_add_tail( &thread->waits, &wait_work_item->entry );
+        thread->num_waits++;
+        NtSetEvent( thread->update_event, NULL );
     }
+    RtlLeaveCriticalSection( &waitqueue_cs );
 
-    status = RtlQueueWorkItem( wait_thread_proc, wait_work_item, Flags & ~WT_EXECUTEONLYONCE );
     if (status != STATUS_SUCCESS)
     {
-        delete_wait_work_item( wait_work_item );
+        RtlFreeHeap( GetProcessHeap(), 0, wait_work_item );
         return status;
     }
 
@@ -487,41 +754,42 @@ NTSTATUS WINAPI RtlDeregisterWaitEx(HANDLE WaitHandle, HANDLE CompletionEvent)
 {
     struct wait_work_item *wait_work_item = WaitHandle;
     NTSTATUS status = STATUS_SUCCESS;
+    HANDLE event = NULL;
+    BOOLEAN in_progress;
 
     TRACE( "(%p)\n", WaitHandle );
 
-    NtSetEvent( wait_work_item->CancelEvent, NULL );
-    if (wait_work_item->CallbackInProgress)
+    if (CompletionEvent == INVALID_HANDLE_VALUE)
     {
-        if (CompletionEvent != NULL)
-        {
-            if (CompletionEvent == INVALID_HANDLE_VALUE)
-            {
-                status = NtCreateEvent( &CompletionEvent, EVENT_ALL_ACCESS, NULL, TRUE, FALSE );
-                if (status != STATUS_SUCCESS)
-                    return status;
-                interlocked_xchg_ptr( &wait_work_item->CompletionEvent, CompletionEvent );
-                if (wait_work_item->CallbackInProgress)
-                    NtWaitForSingleObject( CompletionEvent, FALSE, NULL );
-                NtClose( CompletionEvent );
-            }
-            else
-            {
-                interlocked_xchg_ptr( &wait_work_item->CompletionEvent, CompletionEvent );
-                if (wait_work_item->CallbackInProgress)
-                    status = STATUS_PENDING;
-            }
-        }
+        status = NtCreateEvent( &event, EVENT_ALL_ACCESS, NULL, TRUE, FALSE );
+        if (status != STATUS_SUCCESS)
+            return status;
+    }
+
+    RtlEnterCriticalSection( &waitqueue_cs );
+    wait_work_item->Cancelled = TRUE;
+    if (wait_work_item->Thread)
+        NtSetEvent( wait_work_item->Thread->update_event, NULL );
+    if ((in_progress = wait_work_item->CallbackInProgress))
+    {
+        if (event)
+            wait_work_item->CompletionEvent = event;
         else
+        {
+            wait_work_item->CompletionEvent = CompletionEvent;
             status = STATUS_PENDING;
+        }
     }
+    release_wait_work_item( wait_work_item );
+    RtlLeaveCriticalSection( &waitqueue_cs );
 
-    if (interlocked_inc( &wait_work_item->DeleteCount ) == 2 )
+    if (event)
     {
-        status = STATUS_SUCCESS;
-        delete_wait_work_item( wait_work_item );
+        if (in_progress) NtWaitForSingleObject( event, FALSE, NULL );
+        NtClose( event );
     }
-
+    else if (!in_progress && CompletionEvent)
+        NtSetEvent( CompletionEvent, NULL );  /* no callback to wait for */
     return status;
 }
 
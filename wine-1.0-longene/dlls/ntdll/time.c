@@ -46,8 +46,10 @@
 #include "windef.h"
 #include "winternl.h"
 #include "wine/unicode.h"
+#include "wine/server.h"
 #include "wine/debug.h"
 #include "ntdll_misc.h"
+#include "ddk/wdm.h"
 
 WINE_DEFAULT_DEBUG_CHANNEL(ntdll);
 
@@ -432,6 +434,52 @@ void WINAPI RtlTimeToElapsedTimeFields( const LARGE_INTEGER *Time, PTIME_FIELDS
     TimeFields->Hour = rem / 60;
 }
 
+/* whether the kernel keeps the time fields of user_shared_data current */
+static BOOL shared_time;
+
+/* a time written by the kernel High2Time first and High1Time last */
+static inline ULONGLONG read_ksystem_time( const volatile KSYSTEM_TIME *time )
+{
+    LONG high;
+    ULONG low;
+
+    do
+    {
+        high = time->High1Time;
+        low = time->LowPart;
+    } while (high != time->High2Time);
+    return ((ULONGLONG)high << 32) | low;
+}
+
+/***********************************************************************
+ *       init_user_shared_time
+ *
+ * Replace the private user shared data page by the kernel's read-only
+ * one, whose clock fields are kept current without any call.
+ */
+void init_user_shared_time(void)
+{
+    NTSTATUS status;
+
+    SERVER_START_REQ( map_user_shared_data )
+    {
+        status = wine_server_call( req );
+    }
+    SERVER_END_REQ;
+    shared_time = !status;
+}
+
+/***********************************************************************
+ *       user_shared_data_is_private
+ *
+ * Whether user_shared_data is still our own page.  The kernel's one is
+ * read-only, the kernel fills the system directory and version itself.
+ */
+BOOL user_shared_data_is_private(void)
+{
+    return !shared_time;
+}
+
 /***********************************************************************
  *       NtQuerySystemTime [NTDLL.@]
  *       ZwQuerySystemTime [NTDLL.@]
@@ -449,12 +497,50 @@ NTSTATUS WINAPI NtQuerySystemTime( PLARGE_INTEGER Time )
 {
     struct timeval now;
 
+    if (shared_time)
+    {
+        Time->QuadPart = read_ksystem_time( &user_shared_data->SystemTime );
+        return STATUS_SUCCESS;
+    }
+
     gettimeofday( &now, 0 );
     Time->QuadPart = now.tv_sec * (ULONGLONG)TICKSPERSEC + TICKS_1601_TO_1970;
     Time->QuadPart += now.tv_usec * 10;
     return STATUS_SUCCESS;
 }
 
+#ifdef __i386__
+/* the performance counter from the TSC and the kernel's calibration, if it has one */
+static BOOL read_tsc_counter( LONGLONG *counter )
+{
+    const volatile struct user_shared_qpc *qpc;
+    unsigned int seq, mult;
+    ULONGLONG tsc, tsc_base, qpc_base;
+
+    if (!shared_time) return FALSE;
+    qpc = (const volatile struct user_shared_qpc *)((const char *)user_shared_data + USER_SHARED_QPC_OFFSET);
+    do
+    {
+        seq = qpc->seq;
+        mult = qpc->tsc_mult;
+        tsc_base = qpc->tsc_base;
+        qpc_base = qpc->qpc_base;
+        __asm__ __volatile__( "rdtsc" : "=A" (tsc) );
+    } while ((seq & 1) || seq != qpc->seq);
+
+    if (!mult) return FALSE;
+    /* another cpu may be slightly behind the one that took the base */
+    if (tsc < tsc_base) tsc = tsc_base;
+    *counter = qpc_base + (((tsc - tsc_base) * mult) >> 32);
+    return TRUE;
+}
+#else
+static BOOL read_tsc_counter( LONGLONG *counter )
+{
+    return FALSE;
+}
+#endif
+
 /******************************************************************************
  *  NtQueryPerformanceCounter	[NTDLL.@]
  *
@@ -465,15 +551,20 @@ NTSTATUS WINAPI NtQuerySystemTime( PLARGE_INTEGER Time )
  */
 NTSTATUS WINAPI NtQueryPerformanceCounter( PLARGE_INTEGER Counter, PLARGE_INTEGER Frequency )
 {
-    LARGE_INTEGER now;
+    struct timeval now;
+    LONGLONG time;
 
     if (!Counter) return STATUS_ACCESS_VIOLATION;
 
-    /* convert a counter that increments at a rate of 10 MHz
-     * to one of 1.193182 MHz, with some care for arithmetic
-     * overflow and good accuracy (21/176 = 0.11931818) */
-    NtQuerySystemTime( &now );
-    Counter->QuadPart = ((now.QuadPart - server_start_time) * 21) / 176;
+    if (!read_tsc_counter( &Counter->QuadPart ))
+    {
+        /* convert a counter that increments at a rate of 10 MHz
+         * to one of 1.193182 MHz, with some care for arithmetic
+         * overflow and good accuracy (21/176 = 0.11931818) */
+        gettimeofday( &now, 0 );
+        time = now.tv_sec * (ULONGLONG)TICKSPERSEC + TICKS_1601_TO_1970 + now.tv_usec * 10;
+        Counter->QuadPart = ((time - server_start_time) * 21) / 176;
+    }
     if (Frequency) Frequency->QuadPart = 1193182;
     return STATUS_SUCCESS;
 }
@@ -487,6 +578,8 @@ ULONG WINAPI NtGetTickCount(void)
 {
     LARGE_INTEGER now;
 
+    if (shared_time) return read_ksystem_time( &user_shared_data->u.TickCount );
+
     NtQuerySystemTime( &now );
     return (now.QuadPart - server_start_time) / 10000;
 }
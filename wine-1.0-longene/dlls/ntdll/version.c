@@ -512,12 +512,15 @@ done:
     NtCurrentTeb()->Peb->OSBuildNumber  = current_version->dwBuildNumber;
     NtCurrentTeb()->Peb->OSPlatformId   = current_version->dwPlatformId;
 
-    user_shared_data->NtProductType      = current_version->wProductType;
-    user_shared_data->ProductTypeIsValid = TRUE;
-    user_shared_data->MajorNtVersion     = current_version->dwMajorVersion;
-    user_shared_data->MinorNtVersion     = current_version->dwMinorVersion;
-    user_shared_data->MinorNtVersion     = current_version->dwMinorVersion;
-    user_shared_data->SuiteMask          = current_version->wSuiteMask;
+    if (user_shared_data_is_private())
+    {
+        user_shared_data->NtProductType      = current_version->wProductType;
+        user_shared_data->ProductTypeIsValid = TRUE;
+        user_shared_data->MajorNtVersion     = current_version->dwMajorVersion;
+        user_shared_data->MinorNtVersion     = current_version->dwMinorVersion;
+        user_shared_data->MinorNtVersion     = current_version->dwMinorVersion;
+        user_shared_data->SuiteMask          = current_version->wSuiteMask;
+    }
 
     TRACE( "got %d.%d plaform %d build %x name %s service pack %d.%d product %d\n",
            current_version->dwMajorVersion, current_version->dwMinorVersion,
@@ -53,7 +53,7 @@
 #include "winternl.h"
 #include "wine/library.h"
 #include "wine/server.h"
-#include "wine/list.h"
+#include "wine/rbtree.h"
 #include "wine/debug.h"
 #include "ntdll_misc.h"
 #include "wine/log.h"
@@ -72,9 +72,11 @@ WINE_DECLARE_DEBUG_CHANNEL(module);
 /* File view */
 typedef struct file_view
 {
-    struct list   entry;       /* Entry in global view list */
+    struct wine_rb_entry entry; /* Entry in the views tree */
     void         *base;        /* Base address */
     size_t        size;        /* Size in bytes */
+    size_t        gap;         /* Free space between the previous view and this one */
+    size_t        max_gap;     /* Largest gap in the subtree of this view */
     HANDLE        mapping;     /* Handle to the file mapping */
     BYTE          flags;       /* Allocation flags (VFLAG_*) */
     BYTE          protect;     /* Protection for all pages at allocation time */
@@ -106,7 +108,11 @@ static const BYTE VIRTUAL_Win32Flags[16] =
     PAGE_EXECUTE_WRITECOPY      /* READ | WRITE | EXEC | WRITECOPY */
 };
 
-static struct list views_list = LIST_INIT(views_list);
+static int compare_view( const void *addr, const struct wine_rb_entry *entry );
+static void update_view_max_gap( struct wine_rb_entry *entry );
+
+/* views ordered by address, each caching the largest free gap of its subtree */
+static struct wine_rb_tree views_tree = { compare_view, update_view_max_gap };
 
 static RTL_CRITICAL_SECTION csVirtual;
 static RTL_CRITICAL_SECTION_DEBUG critsect_debug =
@@ -230,7 +236,7 @@ static void VIRTUAL_Dump(void)
 
     TRACE( "Dump of all virtual memory views:\n" );
     server_enter_uninterrupted_section( &csVirtual, &sigset );
-    LIST_FOR_EACH_ENTRY( view, &views_list, FILE_VIEW, entry )
+    WINE_RB_FOR_EACH_ENTRY( view, &views_tree, FILE_VIEW, entry )
     {
         VIRTUAL_DumpView( view );
     }
@@ -239,6 +245,65 @@ static void VIRTUAL_Dump(void)
 #endif
 
 
+/***********************************************************************
+ *           compare_view
+ *
+ * Compare an address with the base of a view.
+ */
+static int compare_view( const void *addr, const struct wine_rb_entry *entry )
+{
+    const struct file_view *view = WINE_RB_ENTRY_VALUE( entry, struct file_view, entry );
+
+    if ((const char *)addr < (const char *)view->base) return -1;
+    return (const char *)addr > (const char *)view->base;
+}
+
+
+/***********************************************************************
+ *           update_view_max_gap
+ *
+ * Recompute the largest gap of a view subtree. Augment callback of the views tree.
+ */
+static void update_view_max_gap( struct wine_rb_entry *entry )
+{
+    struct file_view *view = WINE_RB_ENTRY_VALUE( entry, struct file_view, entry );
+    size_t max_gap = view->gap;
+
+    if (entry->left)
+    {
+        struct file_view *left = WINE_RB_ENTRY_VALUE( entry->left, struct file_view, entry );
+        if (left->max_gap > max_gap) max_gap = left->max_gap;
+    }
+    if (entry->right)
+    {
+        struct file_view *right = WINE_RB_ENTRY_VALUE( entry->right, struct file_view, entry );
+        if (right->max_gap > max_gap) max_gap = right->max_gap;
+    }
+    view->max_gap = max_gap;
+}
+
+
+/***********************************************************************
+ *           update_view_gap
+ *
+ * Recompute the free space before a view after its previous neighbour changed.
+ * The csVirtual section must be held by caller.
+ */
+static void update_view_gap( struct file_view *view )
+{
+    struct wine_rb_entry *ptr = wine_rb_prev( &view->entry );
+    char *start = NULL;
+
+    if (ptr)
+    {
+        struct file_view *prev = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
+        start = (char *)prev->base + prev->size;
+    }
+    view->gap = (char *)view->base - start;
+    wine_rb_update_path( &views_tree, &view->entry );
+}
+
+
 /***********************************************************************
  *           VIRTUAL_FindView
  *
@@ -253,12 +318,15 @@ static void VIRTUAL_Dump(void)
  */
 static struct file_view *VIRTUAL_FindView( const void *addr )
 {
-    struct file_view *view;
+    struct wine_rb_entry *ptr = views_tree.root;
 
-    LIST_FOR_EACH_ENTRY( view, &views_list, struct file_view, entry )
+    while (ptr)
     {
-        if (view->base > addr) break;
-        if ((const char*)view->base + view->size > (const char*)addr) return view;
+        struct file_view *view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
+
+        if (view->base > addr) ptr = ptr->left;
+        else if ((const char*)view->base + view->size <= (const char*)addr) ptr = ptr->right;
+        else return view;
     }
     return NULL;
 }
@@ -283,61 +351,124 @@ static inline UINT_PTR get_mask( ULONG zero_bits )
  */
 static struct file_view *find_view_range( const void *addr, size_t size )
 {
-    struct file_view *view;
+    struct wine_rb_entry *ptr = views_tree.root;
+    struct file_view *found = NULL;
 
-    LIST_FOR_EACH_ENTRY( view, &views_list, struct file_view, entry )
+    /* views don't overlap, so their ends are ordered like their bases */
+    while (ptr)
     {
-        if ((const char *)view->base >= (const char *)addr + size) break;
-        if ((const char *)view->base + view->size > (const char *)addr) return view;
+        struct file_view *view = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
+
+        if ((const char *)view->base + view->size > (const char *)addr)
+        {
+            found = view;
+            ptr = ptr->left;
+        }
+        else ptr = ptr->right;
     }
+    if (found && (const char *)found->base < (const char *)addr + size) return found;
     return NULL;
 }
 
 
 /***********************************************************************
- *           find_free_area
+ *           find_free_in_range
  *
- * Find a free area between views inside the specified range.
- * The csVirtual section must be held by caller.
+ * Find an aligned block of the given size in the free range [start,end),
+ * clipped to [base,limit).
  */
-static void *find_free_area( void *base, void *end, size_t size, size_t mask, int top_down )
+static void *find_free_in_range( char *start, char *end, char *base, char *limit,
+                                 size_t size, size_t mask, int top_down )
 {
-    struct list *ptr;
-    void *start;
+    char *ptr;
+
+    if (start < base) start = base;
+    if (end > limit) end = limit;
+    if (start >= end || (size_t)(end - start) < size) return NULL;
 
     if (top_down)
     {
-        start = ROUND_ADDR( (char *)end - size, mask );
-        if (start >= end || start < base) return NULL;
+        ptr = ROUND_ADDR( end - size, mask );
+        if (!ptr || ptr < start) return NULL;
+    }
+    else
+    {
+        ptr = ROUND_ADDR( start + mask, mask );
+        /* stop if remaining space is not large enough */
+        if (!ptr || ptr < start || ptr >= end || (size_t)(end - ptr) < size) return NULL;
+    }
+    return ptr;
+}
 
-        for (ptr = views_list.prev; ptr != &views_list; ptr = ptr->prev)
-        {
-            struct file_view *view = LIST_ENTRY( ptr, struct file_view, entry );
 
-            if ((char *)view->base + view->size <= (char *)start) break;
-            if ((char *)view->base >= (char *)start + size) continue;
-            start = ROUND_ADDR( (char *)view->base - size, mask );
-            /* stop if remaining space is not large enough */
-            if (!start || start >= end || start < base) return NULL;
-        }
+/***********************************************************************
+ *           find_free_gap
+ *
+ * Find a free area in the gaps in front of the views of a subtree.
+ * Subtrees without a large enough gap, or entirely outside [base,end), are skipped.
+ */
+static void *find_free_gap( struct wine_rb_entry *entry, char *base, char *end,
+                            size_t size, size_t mask, int top_down )
+{
+    struct file_view *view;
+    char *gap_start, *view_end;
+    void *ptr;
+
+    if (!entry) return NULL;
+    view = WINE_RB_ENTRY_VALUE( entry, struct file_view, entry );
+    if (view->max_gap < size) return NULL;
+
+    gap_start = (char *)view->base - view->gap;
+    view_end = (char *)view->base + view->size;
+
+    if (top_down)
+    {
+        if (view_end < end && (ptr = find_free_gap( entry->right, base, end, size, mask, top_down )))
+            return ptr;
+        if ((ptr = find_free_in_range( gap_start, view->base, base, end, size, mask, top_down )))
+            return ptr;
+        if (gap_start > base) return find_free_gap( entry->left, base, end, size, mask, top_down );
     }
     else
     {
-        start = ROUND_ADDR( (char *)base + mask, mask );
-        if (start >= end || (char *)end - (char *)start < size) return NULL;
+        if (gap_start > base && (ptr = find_free_gap( entry->left, base, end, size, mask, top_down )))
+            return ptr;
+        if ((ptr = find_free_in_range( gap_start, view->base, base, end, size, mask, top_down )))
+            return ptr;
+        if (view_end < end) return find_free_gap( entry->right, base, end, size, mask, top_down );
+    }
+    return NULL;
+}
 
-        for (ptr = views_list.next; ptr != &views_list; ptr = ptr->next)
-        {
-            struct file_view *view = LIST_ENTRY( ptr, struct file_view, entry );
 
-            if ((char *)view->base >= (char *)start + size) break;
-            if ((char *)view->base + view->size <= (char *)start) continue;
-            start = ROUND_ADDR( (char *)view->base + view->size + mask, mask );
-            /* stop if remaining space is not large enough */
-            if (!start || start >= end || (char *)end - (char *)start < size) return NULL;
-        }
+/***********************************************************************
+ *           find_free_area
+ *
+ * Find a free area between views inside the specified range.
+ * The csVirtual section must be held by caller.
+ */
+static void *find_free_area( void *base, void *end, size_t size, size_t mask, int top_down )
+{
+    struct wine_rb_entry *ptr = wine_rb_tail( views_tree.root );
+    char *last_end = NULL;
+    void *start;
+
+    if (ptr)
+    {
+        struct file_view *last = WINE_RB_ENTRY_VALUE( ptr, struct file_view, entry );
+        last_end = (char *)last->base + last->size;
+    }
+
+    /* the space after the last view isn't part of any gap */
+    if (top_down)
+    {
+        if ((start = find_free_in_range( last_end, end, base, end, size, mask, top_down )))
+            return start;
+        return find_free_gap( views_tree.root, base, end, size, mask, top_down );
     }
-    return start;
+    if ((start = find_free_gap( views_tree.root, base, end, size, mask, top_down )))
+        return start;
+    return find_free_in_range( last_end, end, base, end, size, mask, top_down );
 }
 
 
@@ -400,11 +531,15 @@ static inline void unmap_area( void *addr, size_t size )
  */
 static void delete_view( struct file_view *view ) /* [in] View */
 {
+    struct wine_rb_entry *next;
+
     if (!(view->flags & VFLAG_SYSTEM)) {
         unmap_area( view->base, view->size );
         NtFreeVirtualMemory( NtCurrentProcess(), (PVOID *)(&view->base), (SIZE_T *)(&view->size), MEM_SYSTEM);
     }
-    list_remove( &view->entry );
+    next = wine_rb_next( &view->entry );
+    wine_rb_remove( &views_tree, &view->entry );
+    if (next) update_view_gap( WINE_RB_ENTRY_VALUE( next, struct file_view, entry ));
     if (view->mapping) NtClose( view->mapping );
     free( view );
 }
@@ -417,8 +552,8 @@ static void delete_view( struct file_view *view ) /* [in] View */
  */
 static NTSTATUS create_view( struct file_view **view_ret, void *base, size_t size, BYTE vprot )
 {
-    struct file_view *view;
-    struct list *ptr;
+    struct file_view *view, *other;
+    struct wine_rb_entry *next;
     int unix_prot = VIRTUAL_GetUnixProt( vprot );
 
     assert( !((UINT_PTR)base & page_mask) );
@@ -435,44 +570,27 @@ static NTSTATUS create_view( struct file_view **view_ret, void *base, size_t siz
     view->protect = vprot;
     memset( view->prot, vprot & ~VPROT_IMAGE, size >> page_shift );
 
-    /* Insert it in the linked list */
-
-    LIST_FOR_EACH( ptr, &views_list )
-    {
-        struct file_view *next = LIST_ENTRY( ptr, struct file_view, entry );
-        if (next->base > base) break;
-    }
-    list_add_before( ptr, &view->entry );
-
-    /* Check for overlapping views. This can happen if the previous view
+    /* Check for overlapping views. This can happen if a previous view
      * was a system view that got unmapped behind our back. In that case
      * we recover by simply deleting it. */
 
-    if ((ptr = list_prev( &views_list, &view->entry )) != NULL)
-    {
-        struct file_view *prev = LIST_ENTRY( ptr, struct file_view, entry );
-        if ((char *)prev->base + prev->size > (char *)base)
-        {
-            TRACE( "overlapping prev view %p-%p for %p-%p\n",
-                   prev->base, (char *)prev->base + prev->size,
-                   base, (char *)base + view->size );
-            assert( prev->flags & VFLAG_SYSTEM );
-            delete_view( prev );
-        }
-    }
-    if ((ptr = list_next( &views_list, &view->entry )) != NULL)
+    while ((other = find_view_range( base, size )))
     {
-        struct file_view *next = LIST_ENTRY( ptr, struct file_view, entry );
-        if ((char *)base + view->size > (char *)next->base)
-        {
-            TRACE( "overlapping next view %p-%p for %p-%p\n",
-                   next->base, (char *)next->base + next->size,
-                   base, (char *)base + view->size );
-            assert( next->flags & VFLAG_SYSTEM );
-            delete_view( next );
-        }
+        TRACE( "overlapping view %p-%p for %p-%p\n",
+               other->base, (char *)other->base + other->size,
+               base, (char *)base + view->size );
+        assert( other->flags & VFLAG_SYSTEM );
+        delete_view( other );
     }
 
+    /* Insert it in the tree */
+
+    view->gap = view->max_gap = 0;
+    wine_rb_put( &views_tree, view->base, &view->entry );
+    update_view_gap( view );
+    if ((next = wine_rb_next( &view->entry )))
+        update_view_gap( WINE_RB_ENTRY_VALUE( next, struct file_view, entry ));
+
     *view_ret = view;
     VIRTUAL_DEBUG_DUMP_VIEW( view );
 
@@ -1286,7 +1404,7 @@ void VIRTUAL_SetForceExec( BOOL enable )
     {
         force_exec_prot = enable;
 
-        LIST_FOR_EACH_ENTRY( view, &views_list, struct file_view, entry )
+        WINE_RB_FOR_EACH_ENTRY( view, &views_tree, struct file_view, entry )
         {
             UINT i, count;
             int unix_prot;
@@ -1976,6 +2094,48 @@ NTSTATUS WINAPI NtWriteVirtualMemory( HANDLE process, void *addr, const void *bu
 }
 
 
+/***********************************************************************
+ *             NtReadVirtualMemoryVector   (NTDLL.@)
+ *             ZwReadVirtualMemoryVector   (NTDLL.@)
+ *
+ * Read several ranges of another process in a single call.
+ */
+NTSTATUS WINAPI NtReadVirtualMemoryVector( HANDLE process, const VIRTUAL_MEMORY_VECTOR *vector,
+                                           ULONG count, SIZE_T *bytes_read )
+{
+    NTSTATUS status;
+
+    __asm__ __volatile__ (
+            "movl $0xE9,%%eax\n\t"
+            "lea 8(%%ebp),%%edx\n\t"
+            "int $0x2E\n\t"
+            :"=a" (status)
+            );
+    return status;
+}
+
+
+/***********************************************************************
+ *             NtWriteVirtualMemoryVector   (NTDLL.@)
+ *             ZwWriteVirtualMemoryVector   (NTDLL.@)
+ *
+ * Write several ranges of another process in a single call.
+ */
+NTSTATUS WINAPI NtWriteVirtualMemoryVector( HANDLE process, const VIRTUAL_MEMORY_VECTOR *vector,
+                                            ULONG count, SIZE_T *bytes_written )
+{
+    NTSTATUS status;
+
+    __asm__ __volatile__ (
+            "movl $0xEA,%%eax\n\t"
+            "lea 8(%%ebp),%%edx\n\t"
+            "int $0x2E\n\t"
+            :"=a" (status)
+            );
+    return status;
+}
+
+
 /***********************************************************************
  *             NtAreMappedFilesTheSame   (NTDLL.@)
  *             ZwAreMappedFilesTheSame   (NTDLL.@)
@@ -1999,8 +1999,10 @@ static inline void call_sendmsg_callback( SENDASYNCPROC callback, HWND hwnd, UIN
  *
  * Peek for a message matching the given parameters. Return FALSE if none available.
  * All pending sent messages are processed before returning.
+ * If block is set, the server waits on the queue until a message arrives, so that
+ * a queue-only GetMessage needs a single server call.
  */
-static BOOL peek_message( MSG *msg, HWND hwnd, UINT first, UINT last, UINT flags )
+static BOOL peek_message( MSG *msg, HWND hwnd, UINT first, UINT last, UINT flags, BOOL block )
 {
     LRESULT result;
     ULONG_PTR extra_info = 0;
@@ -2032,6 +2034,7 @@ static BOOL peek_message( MSG *msg, HWND hwnd, UINT first, UINT last, UINT flags
                 req->hw_id     = hw_id;
                 req->wake_mask = wake_mask;
                 req->changed_mask = changed_mask;
+                req->timeout   = block ? TIMEOUT_INFINITE : 0;
                 if (buffer_size) wine_server_set_reply( req, buffer, buffer_size );
                 if (!(res = wine_server_call( req )))
                 {
@@ -2164,7 +2167,11 @@ static BOOL peek_message( MSG *msg, HWND hwnd, UINT first, UINT last, UINT flags
         thread_info->receive_info = old_info;
 
         /* if some PM_QS* flags were specified, only handle sent messages from now on */
-        if (HIWORD(flags)) flags = PM_QS_SENDMESSAGE | LOWORD(flags);
+        if (HIWORD(flags))
+        {
+            flags = PM_QS_SENDMESSAGE | LOWORD(flags);
+            block = FALSE;  /* don't wait for sent messages only */
+        }
     next:
         HeapFree( GetProcessHeap(), 0, buffer );
     }
@@ -2179,7 +2186,7 @@ static BOOL peek_message( MSG *msg, HWND hwnd, UINT first, UINT last, UINT flags
 static inline void process_sent_messages(void)
 {
     MSG msg;
-    peek_message( &msg, 0, 0, 0, PM_REMOVE | PM_QS_SENDMESSAGE );
+    peek_message( &msg, 0, 0, 0, PM_REMOVE | PM_QS_SENDMESSAGE, FALSE );
 }
 
 
@@ -2834,9 +2841,11 @@ void WINAPI PostQuitMessage( INT exit_code )
 
 
 /***********************************************************************
- *		PeekMessageW  (USER32.@)
+ *		get_next_message
+ *
+ * Implementation of PeekMessageW, also waiting in the server if block is set.
  */
-BOOL WINAPI PeekMessageW( MSG *msg_out, HWND hwnd, UINT first, UINT last, UINT flags )
+static BOOL get_next_message( MSG *msg_out, HWND hwnd, UINT first, UINT last, UINT flags, BOOL block )
 {
     struct user_thread_info *thread_info = get_user_thread_info();
     MSG msg;
@@ -2850,7 +2859,7 @@ BOOL WINAPI PeekMessageW( MSG *msg_out, HWND hwnd, UINT first, UINT last, UINT f
 
     for (;;)
     {
-        if (!peek_message( &msg, hwnd, first, last, flags ))
+        if (!peek_message( &msg, hwnd, first, last, flags, block ))
         {
             if (!(flags & PM_NOYIELD))
             {
@@ -2868,7 +2877,7 @@ BOOL WINAPI PeekMessageW( MSG *msg_out, HWND hwnd, UINT first, UINT last, UINT f
                 /* Have to remove the message explicitly.
                    Do this before handling it, because the message handler may
                    call PeekMessage again */
-                peek_message( &msg, msg.hwnd, msg.message, msg.message, flags | PM_REMOVE );
+                peek_message( &msg, msg.hwnd, msg.message, msg.message, flags | PM_REMOVE, FALSE );
             }
             handle_internal_message( msg.hwnd, msg.message, msg.wParam, msg.lParam );
         }
@@ -2895,6 +2904,15 @@ BOOL WINAPI PeekMessageW( MSG *msg_out, HWND hwnd, UINT first, UINT last, UINT f
 }
 
 
+/***********************************************************************
+ *		PeekMessageW  (USER32.@)
+ */
+BOOL WINAPI PeekMessageW( MSG *msg_out, HWND hwnd, UINT first, UINT last, UINT flags )
+{
+    return get_next_message( msg_out, hwnd, first, last, flags, FALSE );
+}
+
+
 /***********************************************************************
  *		PeekMessageA  (USER32.@)
  */
@@ -2914,6 +2932,13 @@ BOOL WINAPI GetMessageW( MSG *msg, HWND hwnd, UINT first, UINT last )
 {
     HANDLE server_queue = get_server_queue_handle();
     int mask = QS_POSTMESSAGE | QS_SENDMESSAGE;  /* Always selected */
+    DWORD dwlc;
+    BOOL block;
+
+    /* we can only wait inside the server if we don't hold the Win16 lock */
+    ReleaseThunkLock( &dwlc );
+    if (dwlc) RestoreThunkLock( dwlc );
+    block = !dwlc;
 
     if (first || last)
     {
@@ -2926,10 +2951,8 @@ BOOL WINAPI GetMessageW( MSG *msg, HWND hwnd, UINT first, UINT last )
     }
     else mask = QS_ALLINPUT;
 
-    while (!PeekMessageW( msg, hwnd, first, last, PM_REMOVE | PM_NOYIELD | (mask << 16) ))
+    while (!get_next_message( msg, hwnd, first, last, PM_REMOVE | PM_NOYIELD | (mask << 16), block ))
     {
-        DWORD dwlc;
-
         ReleaseThunkLock( &dwlc );
         USER_Driver->pMsgWaitForMultipleObjectsEx( 1, &server_queue, INFINITE, mask, 0 );
         if (dwlc) RestoreThunkLock( dwlc );
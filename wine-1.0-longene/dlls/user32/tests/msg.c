@@ -9053,6 +9053,63 @@ static void test_PeekMessage2(void)
     flush_events();
 }
 
+#define FLOOD_MSG_COUNT 4000
+
+static DWORD CALLBACK post_flood_thread_proc(void *param)
+{
+    DWORD tid = *(DWORD *)param;
+    int i;
+
+    for (i = 0; i < FLOOD_MSG_COUNT; i++)
+        if (!PostThreadMessageA(tid, (i & 1) ? WM_APP + 1 : WM_USER + 1, i, 0)) return 1;
+    return 0;
+}
+
+static void test_PostMessage_flood(void)
+{
+    DWORD tid = GetCurrentThreadId(), start, ret;
+    HANDLE thread;
+    MSG msg;
+    int i, count;
+
+    /* make sure we have a queue and nothing is pending */
+    PeekMessageA(&msg, 0, 0, 0, PM_NOREMOVE);
+    while (PeekMessageA(&msg, 0, 0, 0, PM_REMOVE)) DispatchMessageA(&msg);
+
+    start = GetTickCount();
+    thread = CreateThread(NULL, 0, post_flood_thread_proc, &tid, 0, NULL);
+    ok(thread != 0, "CreateThread failed, error %d\n", GetLastError());
+    ok(WaitForSingleObject(thread, 10000) == WAIT_OBJECT_0, "posting thread timed out\n");
+    ok(GetExitCodeThread(thread, &ret) && !ret, "PostThreadMessage failed\n");
+    CloseHandle(thread);
+    trace("posted %d messages in %u ms\n", FLOOD_MSG_COUNT, GetTickCount() - start);
+
+    /* filtered retrieval must skip the other range and keep the posting order */
+    start = GetTickCount();
+    for (count = 0, i = 1; PeekMessageA(&msg, 0, WM_APP + 1, WM_APP + 1, PM_REMOVE); count++, i += 2)
+    {
+        ok(msg.message == WM_APP + 1, "unexpected message %04x\n", msg.message);
+        if (msg.wParam != i)
+        {
+            ok(0, "expected wparam %d, got %ld\n", i, msg.wParam);
+            break;
+        }
+    }
+    ok(count == FLOOD_MSG_COUNT / 2, "got %d WM_APP messages\n", count);
+
+    for (count = 0, i = 0; PeekMessageA(&msg, 0, 0, 0, PM_REMOVE); count++, i += 2)
+    {
+        ok(msg.message == WM_USER + 1, "unexpected message %04x\n", msg.message);
+        if (msg.wParam != i)
+        {
+            ok(0, "expected wparam %d, got %ld\n", i, msg.wParam);
+            break;
+        }
+    }
+    ok(count == FLOOD_MSG_COUNT / 2, "got %d WM_USER messages\n", count);
+    trace("retrieved %d messages in %u ms\n", FLOOD_MSG_COUNT, GetTickCount() - start);
+}
+
 static void test_quit_message(void)
 {
     MSG msg;
@@ -10511,6 +10568,7 @@ START_TEST(msg)
     test_SendMessageTimeout();
     test_edit_messages();
     test_quit_message();
+    test_PostMessage_flood();
 
     if (!pTrackMouseEvent)
         skip("TrackMouseEvent is not available\n");
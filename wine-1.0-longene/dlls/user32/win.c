@@ -92,6 +92,104 @@ static inline void set_win_data( void *ptr, LONG_PTR val, UINT size )
 
 static void *user_handles[NB_USER_HANDLES];
 
+/* read-only views of the window state and handle table published by the server,
+ * indexed like user_handles; the window state is only there for the windows of
+ * the desktop the process is allowed to read */
+static const struct window_shared * volatile shared_windows;
+static const struct user_handle_shared * volatile shared_handles;
+static BOOL user_shared_failed;
+
+#define SHARED_USER_WINDOW 1  /* USER_WINDOW object type in the server */
+#define SHARED_READ_TRIES  100  /* reads of an entry being updated before asking the server */
+
+/***********************************************************************
+ *           map_user_shared
+ *
+ * Map the shared user state on first use.
+ */
+static BOOL map_user_shared(void)
+{
+    if (shared_handles) return TRUE;
+    if (user_shared_failed) return FALSE;
+    USER_Lock();
+    if (!shared_handles && !user_shared_failed)
+    {
+        SERVER_START_REQ( map_user_shared )
+        {
+            if (!wine_server_call( req ))
+            {
+                shared_windows = reply->windows;
+                shared_handles = reply->handles;
+            }
+            else user_shared_failed = TRUE;
+        }
+        SERVER_END_REQ;
+    }
+    USER_Unlock();
+    return shared_handles != NULL;
+}
+
+
+/***********************************************************************
+ *           is_shared_window_handle
+ *
+ * Check a window handle against the shared handle table.
+ * Returns TRUE when the table isn't available, the server then decides.
+ */
+static BOOL is_shared_window_handle( HWND hwnd )
+{
+    const volatile struct user_handle_shared *entry;
+    WORD index = USER_HANDLE_TO_INDEX(hwnd);
+    unsigned short type, generation;
+
+    if (index >= NB_USER_HANDLES || !map_user_shared()) return TRUE;
+    entry = &shared_handles[index];
+    /* the server writes the generation before the type */
+    type = entry->type;
+    __asm__ __volatile__( "" : : : "memory" );
+    generation = entry->generation;
+    if (type != SHARED_USER_WINDOW) return FALSE;
+    return !HIWORD(hwnd) || HIWORD(hwnd) == 0xffff || HIWORD(hwnd) == generation;
+}
+
+
+/***********************************************************************
+ *           get_shared_window_info
+ *
+ * Read the state of another process window from the shared view.
+ * Returns FALSE if it isn't available there; the caller then asks the server.
+ */
+static BOOL get_shared_window_info( HWND hwnd, struct window_shared *info )
+{
+    const volatile struct window_shared *entry;
+    WORD index = USER_HANDLE_TO_INDEX(hwnd);
+    unsigned int seq, tries;
+
+    if (index >= NB_USER_HANDLES || !map_user_shared() || !shared_windows) return FALSE;
+
+    /* the server bumps seq around every update; x86 doesn't reorder loads,
+     * so a compiler barrier is enough to get a consistent copy */
+    entry = &shared_windows[index];
+    for (tries = 0; ; tries++)
+    {
+        /* don't wait for a writer that got preempted, the server has the answer too */
+        if (tries == SHARED_READ_TRIES) return FALSE;
+        if ((seq = entry->seq) & 1)  /* update in progress */
+        {
+            __asm__ __volatile__( "rep;nop" : : : "memory" );
+            continue;
+        }
+        __asm__ __volatile__( "" : : : "memory" );
+        memcpy( info, (const void *)entry, sizeof(*info) );
+        __asm__ __volatile__( "" : : : "memory" );
+        if (entry->seq == seq) break;
+    }
+
+    if (!info->handle) return FALSE;
+    if (hwnd != info->handle && HIWORD(hwnd) && HIWORD(hwnd) != 0xffff) return FALSE;
+    return TRUE;
+}
+
 /***********************************************************************
  *           create_window_handle
  *
@@ -379,6 +477,7 @@ WND *WIN_GetPtr( HWND hwnd )
         if (hwnd == GetDesktopWindow() || !HIWORD(hwnd) || HIWORD(hwnd) == 0xffff) ptr = WND_DESKTOP;
         else ptr = NULL;
     }
+    else if (!is_shared_window_handle( hwnd )) ptr = NULL;
     else ptr = WND_OTHER_PROCESS;
     USER_Unlock();
     return ptr;
@@ -557,6 +656,16 @@ BOOL WIN_GetRectangles( HWND hwnd, RECT *rectWindow, RECT *rectClient )
     }
     else if (win == WND_OTHER_PROCESS)
     {
+        struct window_shared info;
+
+        if (get_shared_window_info( hwnd, &info ))
+        {
+            if (rectWindow) SetRect( rectWindow, info.window.left, info.window.top,
+                                     info.window.right, info.window.bottom );
+            if (rectClient) SetRect( rectClient, info.client.left, info.client.top,
+                                     info.client.right, info.client.bottom );
+            return TRUE;
+        }
         SERVER_START_REQ( get_window_rectangles )
         {
             req->handle = hwnd;
@@ -1798,11 +1907,16 @@ static LONG_PTR WIN_GetWindowLong( HWND hwnd, INT offset, UINT size, BOOL unicod
 
     if (wndPtr == WND_OTHER_PROCESS || wndPtr == WND_DESKTOP)
     {
+        struct window_shared info;
+
         if (offset == GWLP_WNDPROC)
         {
             SetLastError( ERROR_ACCESS_DENIED );
             return 0;
         }
+        if ((offset == GWL_STYLE || offset == GWL_EXSTYLE) && wndPtr == WND_OTHER_PROCESS &&
+            get_shared_window_info( hwnd, &info ))
+            return (offset == GWL_STYLE) ? info.style : info.ex_style;
         SERVER_START_REQ( set_window_info )
         {
             req->handle = hwnd;
@@ -2440,6 +2554,7 @@ INT WINAPI GetWindowTextLengthW( HWND hwnd )
  */
 BOOL WINAPI IsWindow( HWND hwnd )
 {
+    struct window_shared info;
     WND *ptr;
     BOOL ret;
 
@@ -2453,6 +2568,7 @@ BOOL WINAPI IsWindow( HWND hwnd )
     }
 
     /* check other processes */
+    if (get_shared_window_info( hwnd, &info )) return TRUE;
     SERVER_START_REQ( get_window_info )
     {
         req->handle = hwnd;
@@ -2468,6 +2584,7 @@ BOOL WINAPI IsWindow( HWND hwnd )
  */
 DWORD WINAPI GetWindowThreadProcessId( HWND hwnd, LPDWORD process )
 {
+    struct window_shared info;
     WND *ptr;
     DWORD tid = 0;
 
@@ -2487,6 +2604,11 @@ DWORD WINAPI GetWindowThreadProcessId( HWND hwnd, LPDWORD process )
     }
 
     /* check other processes */
+    if (ptr == WND_OTHER_PROCESS && get_shared_window_info( hwnd, &info ))
+    {
+        if (process) *process = info.pid;
+        return info.tid;
+    }
     SERVER_START_REQ( get_window_info )
     {
         req->handle = hwnd;
@@ -2517,7 +2639,16 @@ HWND WINAPI GetParent( HWND hwnd )
     if (wndPtr == WND_DESKTOP) return 0;
     if (wndPtr == WND_OTHER_PROCESS)
     {
-        LONG style = GetWindowLongW( hwnd, GWL_STYLE );
+        struct window_shared info;
+        LONG style;
+
+        if (get_shared_window_info( hwnd, &info ))
+        {
+            if (info.style & WS_POPUP) retvalue = info.owner;
+            else if (info.style & WS_CHILD) retvalue = info.parent;
+            return retvalue;
+        }
+        style = GetWindowLongW( hwnd, GWL_STYLE );
         if (style & (WS_POPUP | WS_CHILD))
         {
             SERVER_START_REQ( get_window_tree )
@@ -2566,6 +2697,13 @@ HWND WINAPI GetAncestor( HWND hwnd, UINT type )
         }
         else /* need to query the server */
         {
+            struct window_shared info;
+
+            if (get_shared_window_info( hwnd, &info ))
+            {
+                ret = info.parent;
+                break;
+            }
             SERVER_START_REQ( get_window_tree )
             {
                 req->handle = hwnd;
@@ -2777,6 +2915,11 @@ HWND WINAPI GetWindow( HWND hwnd, UINT rel )
             WIN_ReleasePtr( wndPtr );
             return retval;
         }
+        else
+        {
+            struct window_shared info;
+            if (get_shared_window_info( hwnd, &info )) return info.owner;
+        }
         /* else fall through to server call */
     }
 
@@ -1268,6 +1268,62 @@ static NTSTATUS WS2_async_send(void* user, IO_STATUS_BLOCK* iosb, NTSTATUS statu
     return status;
 }
 
+/***********************************************************************
+ *              WS2_register_async_io   (INTERNAL)
+ *
+ * Queue an overlapped recv() or send(). When possible the kernel moves the
+ * data straight into or out of the buffers once the socket is ready and
+ * completes the request itself, else WS2_async_recv/send do it on the
+ * client side when the socket gets alerted.
+ */
+static NTSTATUS WS2_register_async_io( ws2_async *wsa, IO_STATUS_BLOCK *iosb, HANDLE event,
+                                       ULONG_PTR cvalue )
+{
+    struct sock_iovec iov[WS_MSG_MAXIOVLEN];
+    NTSTATUS status = STATUS_NOT_SUPPORTED;
+    int i;
+
+    /* the kernel doesn't know about winsock addresses */
+    if (!wsa->addr)
+    {
+        for (i = 0; i < wsa->n_iovecs; i++)
+        {
+            iov[i].base = wsa->iovec[i].iov_base;
+            iov[i].len  = wsa->iovec[i].iov_len;
+        }
+        SERVER_START_REQ( register_sock_io )
+        {
+            req->handle = wsa->hSocket;
+            req->type   = wsa->type;
+            req->flags  = wsa->flags;
+            req->async.iosb     = iosb;
+            req->async.arg      = wsa;
+            req->async.apc      = ws2_async_apc;
+            req->async.event    = event;
+            req->async.cvalue   = cvalue;
+            wine_server_add_data( req, iov, wsa->n_iovecs * sizeof(iov[0]) );
+            status = wine_server_call( req );
+        }
+        SERVER_END_REQ;
+        if (status != STATUS_NOT_SUPPORTED && status != STATUS_NOT_IMPLEMENTED) return status;
+    }
+
+    SERVER_START_REQ( register_async )
+    {
+        req->handle = wsa->hSocket;
+        req->type   = wsa->type;
+        req->async.callback = (wsa->type == ASYNC_TYPE_READ) ? WS2_async_recv : WS2_async_send;
+        req->async.iosb     = iosb;
+        req->async.arg      = wsa;
+        req->async.apc      = ws2_async_apc;
+        req->async.event    = event;
+        req->async.cvalue   = cvalue;
+        status = wine_server_call( req );
+    }
+    SERVER_END_REQ;
+    return status;
+}
+
 /***********************************************************************
  *              WS2_async_shutdown      (INTERNAL)
  *
@@ -2712,6 +2768,7 @@ INT WINAPI WSASendTo( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
         release_sock_fd( s, fd );
 
         wsa->hSocket         = SOCKET2HANDLE(s);
+        wsa->type            = ASYNC_TYPE_WRITE;
         wsa->addr            = (struct WS_sockaddr *)to;
         wsa->addrlen.val     = tolen;
         wsa->flags           = 0;
@@ -2726,19 +2783,8 @@ INT WINAPI WSASendTo( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
             iosb->u.Status = STATUS_PENDING;
             iosb->Information = 0;
 
-            SERVER_START_REQ( register_async )
-            {
-                req->handle = wsa->hSocket;
-                req->type   = ASYNC_TYPE_WRITE;
-                req->async.callback = WS2_async_send;
-                req->async.iosb     = iosb;
-                req->async.arg      = wsa;
-                req->async.apc      = ws2_async_apc;
-                req->async.event    = lpCompletionRoutine ? 0 : lpOverlapped->hEvent;
-                req->async.cvalue   = cvalue;
-                err = wine_server_call( req );
-            }
-            SERVER_END_REQ;
+            err = WS2_register_async_io( wsa, iosb, lpCompletionRoutine ? 0 : lpOverlapped->hEvent,
+                                         cvalue );
 
             if (err != STATUS_PENDING) HeapFree( GetProcessHeap(), 0, wsa );
             WSASetLastError( NtStatusToWSAError( err ));
@@ -4239,6 +4285,7 @@ INT WINAPI WSARecvFrom( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
             release_sock_fd( s, fd );
 
             wsa->hSocket         = SOCKET2HANDLE(s);
+            wsa->type            = ASYNC_TYPE_READ;
             wsa->flags           = *lpFlags;
             wsa->addr            = lpFrom;
             wsa->addrlen.ptr     = lpFromlen;
@@ -4254,19 +4301,8 @@ INT WINAPI WSARecvFrom( SOCKET s, LPWSABUF lpBuffers, DWORD dwBufferCount,
                 iosb->u.Status = STATUS_PENDING;
                 iosb->Information = 0;
 
-                SERVER_START_REQ( register_async )
-                {
-                    req->handle = wsa->hSocket;
-                    req->type   = ASYNC_TYPE_READ;
-                    req->async.callback = WS2_async_recv;
-                    req->async.iosb     = iosb;
-                    req->async.arg      = wsa;
-                    req->async.apc      = ws2_async_apc;
-                    req->async.event    = lpCompletionRoutine ? 0 : lpOverlapped->hEvent;
-                    req->async.cvalue   = cvalue;
-                    err = wine_server_call( req );
-                }
-                SERVER_END_REQ;
+                err = WS2_register_async_io( wsa, iosb, lpCompletionRoutine ? 0 : lpOverlapped->hEvent,
+                                             cvalue );
 
                 if (err != STATUS_PENDING) HeapFree( GetProcessHeap(), 0, wsa );
                 WSASetLastError( NtStatusToWSAError( err ));
@@ -2032,6 +2032,75 @@ end:
     CloseHandle(hEvent);
 }
 
+static void test_overlapped_recv(void)
+{
+    SOCKET src = INVALID_SOCKET;
+    SOCKET dst = INVALID_SOCKET;
+    HANDLE port = NULL;
+    WSAOVERLAPPED ov, *povl;
+    WSABUF bufs[2];
+    char buf1[4], buf2[16];
+    DWORD num_bytes, flags = 0;
+    ULONG_PTR key;
+    BOOL bret;
+    int ret;
+
+    if (tcp_socketpair(&src, &dst) != 0)
+    {
+        ok(0, "creating socket pair failed, skipping test\n");
+        return;
+    }
+
+    /* the receive is pending until the data arrives, then completes on its own */
+    memset(&ov, 0, sizeof(ov));
+    ov.hEvent = CreateEventA(NULL, TRUE, FALSE, NULL);
+    bufs[0].buf = buf1;
+    bufs[0].len = sizeof(buf1);
+    bufs[1].buf = buf2;
+    bufs[1].len = sizeof(buf2);
+    ret = WSARecv(dst, bufs, 2, &num_bytes, &flags, &ov, NULL);
+    ok(ret == SOCKET_ERROR && WSAGetLastError() == WSA_IO_PENDING,
+       "WSARecv returned %d, error %d\n", ret, WSAGetLastError());
+
+    ret = send(src, "0123456789", 10, 0);
+    ok(ret == 10, "send returned %d\n", ret);
+    ok(WaitForSingleObject(ov.hEvent, 5000) == WAIT_OBJECT_0, "the receive didn't complete\n");
+    bret = WSAGetOverlappedResult(dst, &ov, &num_bytes, FALSE, &flags);
+    ok(bret, "WSAGetOverlappedResult failed, error %d\n", WSAGetLastError());
+    ok(num_bytes == 10, "got %d bytes\n", num_bytes);
+    ok(!memcmp(buf1, "0123", 4) && !memcmp(buf2, "456789", 6), "wrong data\n");
+    CloseHandle(ov.hEvent);
+
+    /* the same through a completion port */
+    port = CreateIoCompletionPort((HANDLE)dst, NULL, 0x1234, 0);
+    ok(port != NULL, "CreateIoCompletionPort failed, error %d\n", GetLastError());
+    if (!port) goto end;
+
+    memset(&ov, 0, sizeof(ov));
+    flags = 0;
+    ret = WSARecv(dst, bufs, 1, &num_bytes, &flags, &ov, NULL);
+    ok(ret == SOCKET_ERROR && WSAGetLastError() == WSA_IO_PENDING,
+       "WSARecv returned %d, error %d\n", ret, WSAGetLastError());
+
+    ret = send(src, "abc", 3, 0);
+    ok(ret == 3, "send returned %d\n", ret);
+    povl = NULL;
+    bret = GetQueuedCompletionStatus(port, &num_bytes, &key, &povl, 5000);
+    ok(bret, "GetQueuedCompletionStatus failed, error %d\n", GetLastError());
+    ok(povl == &ov, "got overlapped %p, expected %p\n", povl, &ov);
+    ok(key == 0x1234, "got key %lx\n", key);
+    ok(num_bytes == 3, "got %d bytes\n", num_bytes);
+    ok(!memcmp(buf1, "abc", 3), "wrong data\n");
+
+end:
+    if (src != INVALID_SOCKET)
+        closesocket(src);
+    if (dst != INVALID_SOCKET)
+        closesocket(dst);
+    if (port)
+        CloseHandle(port);
+}
+
 static void test_ipv6only(void)
 {
     SOCKET v4 = INVALID_SOCKET,
@@ -2116,6 +2185,7 @@ START_TEST( sock )
 
     test_send();
     test_write_events();
+    test_overlapped_recv();
 
     test_ipv6only();
 
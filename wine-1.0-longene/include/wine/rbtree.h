@@ -0,0 +1,360 @@
+/*
+ * Red-black trees
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301, USA
+ */
+
+#ifndef __WINE_WINE_RBTREE_H
+#define __WINE_WINE_RBTREE_H
+
+#define WINE_RB_FLAG_RED 0x1
+
+struct wine_rb_entry
+{
+    struct wine_rb_entry *parent;
+    struct wine_rb_entry *left;
+    struct wine_rb_entry *right;
+    unsigned int flags;
+};
+
+/* compare a key with an entry: <0, 0 or >0 like strcmp */
+typedef int (*wine_rb_compare_func_t)( const void *key, const struct wine_rb_entry *entry );
+/* recompute the data an entry caches about its subtree from its children */
+typedef void (*wine_rb_augment_func_t)( struct wine_rb_entry *entry );
+
+struct wine_rb_tree
+{
+    wine_rb_compare_func_t compare;
+    wine_rb_augment_func_t augment;  /* optional */
+    struct wine_rb_entry *root;
+};
+
+/* Define a tree like so:
+ *
+ *   struct gadget
+ *   {
+ *       struct wine_rb_entry  entry;   <-- doesn't have to be the first item in the struct
+ *       int                   key;
+ *   };
+ *
+ *   static int compare_gadget( const void *key, const struct wine_rb_entry *entry )
+ *   {
+ *       return *(const int *)key - WINE_RB_ENTRY_VALUE( entry, struct gadget, entry )->key;
+ *   }
+ *
+ *   static struct wine_rb_tree gadgets = { compare_gadget };
+ *
+ * Manipulate it like this:
+ *
+ *   wine_rb_put( &gadgets, &new_gadget->key, &new_gadget->entry );
+ *   entry = wine_rb_get( &gadgets, &key );
+ *   wine_rb_remove( &gadgets, &new_gadget->entry );
+ *
+ * When an augment function is given, it is called on every entry whose
+ * subtree changed, children first, so it can maintain per-subtree data.
+ * Data that depends on an entry's neighbours rather than on its subtree
+ * has to be refreshed by the caller with wine_rb_update_path().
+ */
+
+static inline void wine_rb_init( struct wine_rb_tree *tree, wine_rb_compare_func_t compare,
+                                 wine_rb_augment_func_t augment )
+{
+    tree->compare = compare;
+    tree->augment = augment;
+    tree->root = NULL;
+}
+
+static inline int wine_rb_is_red( const struct wine_rb_entry *entry )
+{
+    return entry && (entry->flags & WINE_RB_FLAG_RED);
+}
+
+/* leftmost entry of a subtree */
+static inline struct wine_rb_entry *wine_rb_head( struct wine_rb_entry *iter )
+{
+    if (!iter) return NULL;
+    while (iter->left) iter = iter->left;
+    return iter;
+}
+
+/* rightmost entry of a subtree */
+static inline struct wine_rb_entry *wine_rb_tail( struct wine_rb_entry *iter )
+{
+    if (!iter) return NULL;
+    while (iter->right) iter = iter->right;
+    return iter;
+}
+
+static inline struct wine_rb_entry *wine_rb_next( struct wine_rb_entry *iter )
+{
+    if (iter->right) return wine_rb_head( iter->right );
+    while (iter->parent && iter->parent->right == iter) iter = iter->parent;
+    return iter->parent;
+}
+
+static inline struct wine_rb_entry *wine_rb_prev( struct wine_rb_entry *iter )
+{
+    if (iter->left) return wine_rb_tail( iter->left );
+    while (iter->parent && iter->parent->left == iter) iter = iter->parent;
+    return iter->parent;
+}
+
+/* call the augment function on an entry and all its ancestors */
+static inline void wine_rb_update_path( struct wine_rb_tree *tree, struct wine_rb_entry *entry )
+{
+    if (!tree->augment) return;
+    for ( ; entry; entry = entry->parent) tree->augment( entry );
+}
+
+static inline void wine_rb_replace_child( struct wine_rb_tree *tree, struct wine_rb_entry *parent,
+                                          struct wine_rb_entry *old, struct wine_rb_entry *new )
+{
+    if (!parent) tree->root = new;
+    else if (parent->left == old) parent->left = new;
+    else parent->right = new;
+}
+
+static inline void wine_rb_rotate_left( struct wine_rb_tree *tree, struct wine_rb_entry *entry )
+{
+    struct wine_rb_entry *right = entry->right;
+
+    wine_rb_replace_child( tree, entry->parent, entry, right );
+    right->parent = entry->parent;
+    entry->right = right->left;
+    if (entry->right) entry->right->parent = entry;
+    right->left = entry;
+    entry->parent = right;
+
+    if (tree->augment)
+    {
+        tree->augment( entry );
+        tree->augment( right );
+    }
+}
+
+static inline void wine_rb_rotate_right( struct wine_rb_tree *tree, struct wine_rb_entry *entry )
+{
+    struct wine_rb_entry *left = entry->left;
+
+    wine_rb_replace_child( tree, entry->parent, entry, left );
+    left->parent = entry->parent;
+    entry->left = left->right;
+    if (entry->left) entry->left->parent = entry;
+    left->right = entry;
+    entry->parent = left;
+
+    if (tree->augment)
+    {
+        tree->augment( entry );
+        tree->augment( left );
+    }
+}
+
+static inline struct wine_rb_entry *wine_rb_get( const struct wine_rb_tree *tree, const void *key )
+{
+    struct wine_rb_entry *entry = tree->root;
+
+    while (entry)
+    {
+        int c = tree->compare( key, entry );
+        if (!c) return entry;
+        entry = c < 0 ? entry->left : entry->right;
+    }
+    return NULL;
+}
+
+/* insert an entry, returns -1 if the key is already present */
+static inline int wine_rb_put( struct wine_rb_tree *tree, const void *key, struct wine_rb_entry *entry )
+{
+    struct wine_rb_entry **iter = &tree->root, *parent = NULL, *grand, *uncle;
+
+    while (*iter)
+    {
+        int c;
+
+        parent = *iter;
+        c = tree->compare( key, parent );
+        if (!c) return -1;
+        iter = c < 0 ? &parent->left : &parent->right;
+    }
+
+    entry->flags = WINE_RB_FLAG_RED;
+    entry->parent = parent;
+    entry->left = NULL;
+    entry->right = NULL;
+    *iter = entry;
+    wine_rb_update_path( tree, entry );
+
+    while (wine_rb_is_red( entry->parent ))
+    {
+        parent = entry->parent;
+        grand = parent->parent;
+        if (parent == grand->left)
+        {
+            uncle = grand->right;
+            if (wine_rb_is_red( uncle ))
+            {
+                parent->flags &= ~WINE_RB_FLAG_RED;
+                uncle->flags &= ~WINE_RB_FLAG_RED;
+                grand->flags |= WINE_RB_FLAG_RED;
+                entry = grand;
+                continue;
+            }
+            if (entry == parent->right)
+            {
+                wine_rb_rotate_left( tree, parent );
+                entry = parent;
+                parent = entry->parent;
+            }
+            parent->flags &= ~WINE_RB_FLAG_RED;
+            grand->flags |= WINE_RB_FLAG_RED;
+            wine_rb_rotate_right( tree, grand );
+        }
+        else
+        {
+            uncle = grand->left;
+            if (wine_rb_is_red( uncle ))
+            {
+                parent->flags &= ~WINE_RB_FLAG_RED;
+                uncle->flags &= ~WINE_RB_FLAG_RED;
+                grand->flags |= WINE_RB_FLAG_RED;
+                entry = grand;
+                continue;
+            }
+            if (entry == parent->left)
+            {
+                wine_rb_rotate_right( tree, parent );
+                entry = parent;
+                parent = entry->parent;
+            }
+            parent->flags &= ~WINE_RB_FLAG_RED;
+            grand->flags |= WINE_RB_FLAG_RED;
+            wine_rb_rotate_left( tree, grand );
+        }
+    }
+
+    tree->root->flags &= ~WINE_RB_FLAG_RED;
+    return 0;
+}
+
+static inline void wine_rb_remove( struct wine_rb_tree *tree, struct wine_rb_entry *entry )
+{
+    struct wine_rb_entry *iter, *child, *parent, *w;
+    int need_fixup;
+
+    /* iter is the entry that actually leaves its position */
+    if (entry->left && entry->right) iter = wine_rb_head( entry->right );
+    else iter = entry;
+
+    child = iter->left ? iter->left : iter->right;
+    parent = iter->parent;
+    wine_rb_replace_child( tree, parent, iter, child );
+    if (child) child->parent = parent;
+    need_fixup = !wine_rb_is_red( iter );
+
+    if (iter != entry)
+    {
+        /* move the successor into the place of the removed entry */
+        *iter = *entry;
+        wine_rb_replace_child( tree, iter->parent, entry, iter );
+        if (iter->left) iter->left->parent = iter;
+        if (iter->right) iter->right->parent = iter;
+        if (parent == entry) parent = iter;
+    }
+    wine_rb_update_path( tree, parent );
+
+    if (!need_fixup) return;
+
+    while (child != tree->root && !wine_rb_is_red( child ))
+    {
+        if (child == parent->left)
+        {
+            w = parent->right;
+            if (wine_rb_is_red( w ))
+            {
+                w->flags &= ~WINE_RB_FLAG_RED;
+                parent->flags |= WINE_RB_FLAG_RED;
+                wine_rb_rotate_left( tree, parent );
+                w = parent->right;
+            }
+            if (!wine_rb_is_red( w->left ) && !wine_rb_is_red( w->right ))
+            {
+                w->flags |= WINE_RB_FLAG_RED;
+                child = parent;
+                parent = child->parent;
+                continue;
+            }
+            if (!wine_rb_is_red( w->right ))
+            {
+                w->left->flags &= ~WINE_RB_FLAG_RED;
+                w->flags |= WINE_RB_FLAG_RED;
+                wine_rb_rotate_right( tree, w );
+                w = parent->right;
+            }
+            w->flags = (w->flags & ~WINE_RB_FLAG_RED) | (parent->flags & WINE_RB_FLAG_RED);
+            parent->flags &= ~WINE_RB_FLAG_RED;
+            if (w->right) w->right->flags &= ~WINE_RB_FLAG_RED;
+            wine_rb_rotate_left( tree, parent );
+        }
+        else
+        {
+            w = parent->left;
+            if (wine_rb_is_red( w ))
+            {
+                w->flags &= ~WINE_RB_FLAG_RED;
+                parent->flags |= WINE_RB_FLAG_RED;
+                wine_rb_rotate_right( tree, parent );
+                w = parent->left;
+            }
+            if (!wine_rb_is_red( w->left ) && !wine_rb_is_red( w->right ))
+            {
+                w->flags |= WINE_RB_FLAG_RED;
+                child = parent;
+                parent = child->parent;
+                continue;
+            }
+            if (!wine_rb_is_red( w->left ))
+            {
+                w->right->flags &= ~WINE_RB_FLAG_RED;
+                w->flags |= WINE_RB_FLAG_RED;
+                wine_rb_rotate_left( tree, w );
+                w = parent->left;
+            }
+            w->flags = (w->flags & ~WINE_RB_FLAG_RED) | (parent->flags & WINE_RB_FLAG_RED);
+            parent->flags &= ~WINE_RB_FLAG_RED;
+            if (w->left) w->left->flags &= ~WINE_RB_FLAG_RED;
+            wine_rb_rotate_right( tree, parent );
+        }
+        child = tree->root;
+        break;
+    }
+    if (child) child->flags &= ~WINE_RB_FLAG_RED;
+}
+
+/* iterate through the tree in key order */
+#define WINE_RB_FOR_EACH( cursor, tree ) \
+    for ((cursor) = wine_rb_head( (tree)->root ); (cursor); (cursor) = wine_rb_next( cursor ))
+
+/* iterate through the tree in key order using a tree entry */
+#define WINE_RB_FOR_EACH_ENTRY( elem, tree, type, field ) \
+    for ((elem) = WINE_RB_ENTRY_VALUE( wine_rb_head( (tree)->root ), type, field ); \
+         &(elem)->field; \
+         (elem) = WINE_RB_ENTRY_VALUE( wine_rb_next( &(elem)->field ), type, field ))
+
+/* get pointer to object containing tree entry */
+#define WINE_RB_ENTRY_VALUE(element, type, field) \
+    ((type *)((char *)(element) - (unsigned long)(&((type *)0)->field)))
+
+#endif  /* __WINE_WINE_RBTREE_H */
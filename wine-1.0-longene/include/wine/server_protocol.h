@@ -156,6 +156,91 @@ typedef struct
 } rectangle_t;
 
 
+struct window_shared
+{
+    unsigned int   seq;
+    user_handle_t  handle;
+    thread_id_t    tid;
+    process_id_t   pid;
+    user_handle_t  parent;
+    user_handle_t  owner;
+    unsigned int   style;
+    unsigned int   ex_style;
+    rectangle_t    window;
+    rectangle_t    client;
+};
+
+
+struct user_handle_shared
+{
+    unsigned short type;
+    unsigned short generation;
+};
+
+
+struct filesystem_event
+{
+    int            action;
+    data_size_t    len;
+    char           name[1];
+};
+
+struct dir_entry_info
+{
+    file_pos_t     next_pos;
+    file_pos_t     size;
+    file_pos_t     blocks;
+    int            atime;
+    int            mtime;
+    int            ctime;
+    unsigned int   mode;
+    unsigned int   flags;
+    data_size_t    len;
+    char           name[1];
+};
+#define DIR_ENTRY_SYMLINK  0x01
+
+
+struct sock_iovec
+{
+    void           *base;
+    data_size_t     len;
+};
+
+
+struct snapshot_process
+{
+    int            count;
+    process_id_t   pid;
+    process_id_t   ppid;
+    int            threads;
+    int            priority;
+    int            handles;
+    data_size_t    namelen;
+    WCHAR          name[1];
+};
+
+
+struct snapshot_thread
+{
+    int            count;
+    process_id_t   pid;
+    thread_id_t    tid;
+    int            base_pri;
+    int            delta_pri;
+};
+
+
+#define USER_SHARED_QPC_OFFSET  0x800
+struct user_shared_qpc
+{
+    unsigned int       seq;
+    unsigned int       tsc_mult;
+    unsigned long long tsc_base;
+    unsigned long long qpc_base;
+};
+
+
 typedef struct
 {
     void           *callback;
@@ -197,6 +282,21 @@ typedef struct
     unsigned short attr;
 } char_info_t;
 
+
+struct screen_buffer_shared
+{
+    unsigned int   seq;
+    int            stale;
+    int            width;
+    int            height;
+    unsigned int   dirty;
+    int            pending;
+    unsigned short attr;
+    unsigned short __pad;
+    char_info_t    cells[1];
+};
+#define SCREEN_BUFFER_CLEAN  0xffff0000
+
 typedef struct
 {
     unsigned int low_part;
@@ -1663,8 +1763,7 @@ struct read_change_request
 struct read_change_reply
 {
     struct reply_header __header;
-    int          action;
-    /* VARARG(name,string); */
+    /* VARARG(events,filesystem_events); */
 };
 
 
@@ -2507,6 +2606,7 @@ struct get_message_request
     unsigned int    hw_id;
     unsigned int    wake_mask;
     unsigned int    changed_mask;
+    timeout_t       timeout;
 };
 struct get_message_reply
 {
@@ -4285,6 +4385,117 @@ struct add_fd_completion_reply
 };
 
 
+
+struct map_user_shared_request
+{
+    struct request_header __header;
+};
+struct map_user_shared_reply
+{
+    struct reply_header __header;
+    void*          windows;
+    void*          handles;
+};
+
+
+struct read_directory_request
+{
+    struct request_header __header;
+    obj_handle_t   handle;
+    unsigned int   flags;
+};
+struct read_directory_reply
+{
+    struct reply_header __header;
+};
+#define READ_DIRECTORY_NAMES_ONLY  0x01
+
+
+
+struct register_sock_io_request
+{
+    struct request_header __header;
+    obj_handle_t   handle;
+    int            type;
+    unsigned int   flags;
+    async_data_t   async;
+    /* VARARG(iov,sock_iovecs); */
+};
+struct register_sock_io_reply
+{
+    struct reply_header __header;
+};
+
+
+
+struct map_screen_buffer_request
+{
+    struct request_header __header;
+    obj_handle_t   handle;
+    void*          unmap;
+};
+struct map_screen_buffer_reply
+{
+    struct reply_header __header;
+    void*          view;
+    int            writable;
+};
+
+
+
+struct notify_screen_buffer_request
+{
+    struct request_header __header;
+    obj_handle_t   handle;
+};
+struct notify_screen_buffer_reply
+{
+    struct reply_header __header;
+};
+
+
+
+struct next_processes_request
+{
+    struct request_header __header;
+    obj_handle_t   handle;
+    int            reset;
+};
+struct next_processes_reply
+{
+    struct reply_header __header;
+    int            count;
+    /* VARARG(processes,snapshot_processes); */
+};
+
+
+
+struct next_threads_request
+{
+    struct request_header __header;
+    obj_handle_t   handle;
+    int            reset;
+    process_id_t   pid;
+};
+struct next_threads_reply
+{
+    struct reply_header __header;
+    int            count;
+    /* VARARG(threads,snapshot_threads); */
+};
+
+
+
+struct map_user_shared_data_request
+{
+    struct request_header __header;
+};
+struct map_user_shared_data_reply
+{
+    struct reply_header __header;
+};
+
+
 enum request
 {
     REQ_new_process,
@@ -4520,6 +4731,16 @@ enum request
     REQ_query_completion,
     REQ_set_completion_info,
     REQ_add_fd_completion,
+    REQ_load_init_registry,
+    REQ_save_branch,
+    REQ_map_user_shared,
+    REQ_read_directory,
+    REQ_register_sock_io,
+    REQ_map_screen_buffer,
+    REQ_notify_screen_buffer,
+    REQ_next_processes,
+    REQ_next_threads,
+    REQ_map_user_shared_data,
     REQ_NB_REQUESTS
 };
 
@@ -4760,6 +4981,14 @@ union generic_request
     struct query_completion_request query_completion_request;
     struct set_completion_info_request set_completion_info_request;
     struct add_fd_completion_request add_fd_completion_request;
+    struct map_user_shared_request map_user_shared_request;
+    struct read_directory_request read_directory_request;
+    struct register_sock_io_request register_sock_io_request;
+    struct map_screen_buffer_request map_screen_buffer_request;
+    struct notify_screen_buffer_request notify_screen_buffer_request;
+    struct next_processes_request next_processes_request;
+    struct next_threads_request next_threads_request;
+    struct map_user_shared_data_request map_user_shared_data_request;
 };
 union generic_reply
 {
@@ -4998,8 +5227,16 @@ union generic_reply
     struct query_completion_reply query_completion_reply;
     struct set_completion_info_reply set_completion_info_reply;
     struct add_fd_completion_reply add_fd_completion_reply;
+    struct map_user_shared_reply map_user_shared_reply;
+    struct read_directory_reply read_directory_reply;
+    struct register_sock_io_reply register_sock_io_reply;
+    struct map_screen_buffer_reply map_screen_buffer_reply;
+    struct notify_screen_buffer_reply notify_screen_buffer_reply;
+    struct next_processes_reply next_processes_reply;
+    struct next_threads_reply next_threads_reply;
+    struct map_user_shared_data_reply map_user_shared_data_reply;
 };
 
-#define SERVER_PROTOCOL_VERSION 339
+#define SERVER_PROTOCOL_VERSION 348
 
 #endif /* __WINE_WINE_SERVER_PROTOCOL_H */
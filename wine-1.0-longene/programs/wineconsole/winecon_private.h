@@ -57,6 +57,7 @@ struct inner_data {
 
     HANDLE		hConIn;		/* console input handle */
     HANDLE		hConOut;	/* screen buffer handle: has to be changed when active sb changes */
+    struct screen_buffer_shared* shared;	/* shared view of hConOut's cells, or NULL */
     HANDLE		hSynchro;	/* waitable handle signalled by server when something in server has been modified */
     HWND		hWnd;           /* handle of 'user' window or NULL for 'curses' */
     INT                 nCmdShow;       /* argument of WinMain */
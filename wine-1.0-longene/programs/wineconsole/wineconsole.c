@@ -59,6 +59,25 @@ static void WINECON_Usage(void)
     printf_res(IDS_USAGE_FOOTER);
 }
 
+/******************************************************************
+ *		WINECON_MapScreenBuffer
+ *
+ * maps the shared view of the cells of the active screen buffer
+ */
+static void WINECON_MapScreenBuffer(struct inner_data* data)
+{
+    void*       unmap = data->shared;
+
+    data->shared = NULL;
+    SERVER_START_REQ( map_screen_buffer )
+    {
+        req->handle = data->hConOut;
+        req->unmap  = unmap;
+        if (!wine_server_call( req )) data->shared = reply->view;
+    }
+    SERVER_END_REQ;
+}
+
 /******************************************************************
  *		WINECON_FetchCells
  *
@@ -66,18 +85,31 @@ static void WINECON_Usage(void)
  */
 void WINECON_FetchCells(struct inner_data* data, int upd_tp, int upd_bm)
 {
-    SERVER_START_REQ( read_console_output )
+    int         width = data->curcfg.sb_width;
+
+    if (!data->shared || data->shared->stale) WINECON_MapScreenBuffer(data);
+
+    if (data->shared && data->shared->width == width && upd_bm < data->shared->height)
     {
-        req->handle = data->hConOut;
-        req->x      = 0;
-        req->y      = upd_tp;
-        req->mode   = CHAR_INFO_MODE_TEXTATTR;
-        req->wrap   = TRUE;
-        wine_server_set_reply( req, &data->cells[upd_tp * data->curcfg.sb_width],
-                               (upd_bm-upd_tp+1) * data->curcfg.sb_width * sizeof(CHAR_INFO) );
-        wine_server_call( req );
+        /* the cells are right there, no need to ask the server */
+        memcpy(&data->cells[upd_tp * width], &data->shared->cells[upd_tp * width],
+               (upd_bm - upd_tp + 1) * width * sizeof(CHAR_INFO));
+    }
+    else
+    {
+        SERVER_START_REQ( read_console_output )
+        {
+            req->handle = data->hConOut;
+            req->x      = 0;
+            req->y      = upd_tp;
+            req->mode   = CHAR_INFO_MODE_TEXTATTR;
+            req->wrap   = TRUE;
+            wine_server_set_reply( req, &data->cells[upd_tp * width],
+                                   (upd_bm-upd_tp+1) * width * sizeof(CHAR_INFO) );
+            wine_server_call( req );
+        }
+        SERVER_END_REQ;
     }
-    SERVER_END_REQ;
     data->fnRefresh(data, upd_tp, upd_bm);
 }
 
@@ -309,6 +341,7 @@ int	WINECON_GrabChanges(struct inner_data* data)
 	    {
 		CloseHandle(data->hConOut);
 		data->hConOut = h;
+		WINECON_MapScreenBuffer(data);
 	    }
 	    break;
 	case CONSOLE_RENDERER_SB_RESIZE_EVENT: